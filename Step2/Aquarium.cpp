@@ -8,6 +8,12 @@
 
 #include "pch.h"
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <typeinfo>
+#include <unordered_set>
 #include "Aquarium.h"
 #include "Item.h"
 #include "FishBeta.h"
@@ -15,25 +21,49 @@
 #include "XmlNode.h"
 #include "Buddha.h"
 #include "DecorCastle.h"
+#include "Stinky.h"
+#include "TraceLog.h"
+#include "MemoryAccounting.h"
+#include "SpriteCache.h"
 
 
 using namespace Gdiplus;
 using namespace std;
 using namespace xmlnode;
 
+/// Seed used until SetSeed is called, so runs are reproducible by default
+const uint64_t DefaultSeed = 0x5eed5eed5eed5eedULL;
+
+/// Updates longer than this, such as after the window was minimized,
+/// jump the items forward instead of taking one long step
+const double MaxUpdateStep = 0.25;
+
+/// Shortest time between cell crossing events, so an item sitting on
+/// a cell edge is carried over it instead of being rescheduled forever
+const double MinCellEventGap = 0.0001;
+
+/// Fewest items a worker is given in a parallel update
+const size_t MinUpdateGrain = 1024;
+
+/// Background image filename
+const wstring BackgroundImageName = L"images/background1.png";
+
 /**
  * Constructor for the Aquarium object
  */
-CAquarium::CAquarium()
+CAquarium::CAquarium() : mSeed(DefaultSeed)
 {
-	mBackground = unique_ptr<Gdiplus::Bitmap>(
-		Bitmap::FromFile(L"images/background1.png"));
+	// Every aquarium shares one decoded background
+	mBackground = CSpriteCache::Get().Load(BackgroundImageName);
 
 	if (mBackground->GetLastStatus() != Ok)
 	{
 		AfxMessageBox(L"Failed to open images/background1.png");
 	}
-	
+
+	// The world starts out the size of the background
+	mWidth = mBackground->GetWidth();
+	mHeight = mBackground->GetHeight();
 }
 
 /**
@@ -43,34 +73,221 @@ CAquarium::~CAquarium()
 {
 }
 
-/** Draw the aquarium
+/** Draw the whole aquarium world
 * \param graphics The GDI+ graphics context to draw on
 */
 void CAquarium::OnDraw(Gdiplus::Graphics *graphics)
 {
-	graphics->DrawImage(mBackground.get(), 0, 0,
-		mBackground->GetWidth(), mBackground->GetHeight());
+	CCamera camera;
+	OnDraw(graphics, camera, mWidth, mHeight);
+}
 
-	FontFamily fontFamily(L"Arial");
-	Gdiplus::Font font(&fontFamily, 16);
+/** Draw the part of the aquarium a camera sees
+*
+* Only the items the spatial index finds in the visible rectangle
+* are touched, so the cost follows the number of visible items
+* rather than the size of the world.
+* \param graphics The GDI+ graphics context to draw on
+* \param camera Camera we are looking through
+* \param width Width of the window in pixels
+* \param height Height of the window in pixels
+*/
+void CAquarium::OnDraw(Gdiplus::Graphics* graphics, const CCamera& camera, int width, int height)
+{
+	double left, top, right, bottom;
+	camera.GetVisibleRect(width, height, left, top, right, bottom);
 
-	SolidBrush green(Color(0, 64, 0));
-	graphics->DrawString(L"Under the Sea!", -1, &font, PointF(2, 2), &green);
+	{
+		CProfileTimer timer(mProfiler, CFrameProfiler::Background);
+		auto state = graphics->Save();
+		camera.Apply(graphics);
 
-	// Draws each item to the screen
-	for (auto item : mItems)
+		// The background is tiled over the visible part of the world
+		double tileWidth = mBackground->GetWidth();
+		double tileHeight = mBackground->GetHeight();
+		if (tileWidth > 0 && tileHeight > 0)
+		{
+			double firstX = max(0.0, floor(left / tileWidth) * tileWidth);
+			double firstY = max(0.0, floor(top / tileHeight) * tileHeight);
+			for (double y = firstY; y < min(bottom, (double)mHeight); y += tileHeight)
+			{
+				for (double x = firstX; x < min(right, (double)mWidth); x += tileWidth)
+				{
+					graphics->DrawImage(mBackground.get(), (REAL)x, (REAL)y, (REAL)tileWidth, (REAL)tileHeight);
+				}
+			}
+		}
+
+		graphics->Restore(state);
+	}
+
+	{
+		CProfileTimer timer(mProfiler, CFrameProfiler::Text);
+		FontFamily fontFamily(L"Arial");
+		Gdiplus::Font font(&fontFamily, 16);
+
+		SolidBrush green(Color(0, 64, 0));
+		graphics->DrawString(L"Under the Sea!", -1, &font, PointF(2, 2), &green);
+	}
+
+	// Draws each visible item to the screen, back to front through the batch
+	CProfileTimer timer(mProfiler, CFrameProfiler::Items);
+	auto state = graphics->Save();
+	camera.Apply(graphics);
+
+	mLod.SetView(left, top, right, bottom);
+	mGrid.Query(left, top, right, bottom, mVisible);
+	for (auto item : mVisible)
+	{
+		if (IsLazy())
+		{
+			item->SyncTo(mTime);
+		}
+
+		item->AddToBatch(&mBatch);
+	}
+
+	mBatch.Flush(graphics, camera.GetZoom());
+	graphics->Restore(state);
+}
+
+/**
+ * Change the size of the aquarium world.
+ *
+ * Fish swim between the edges of the world, which can be much
+ * larger than the window. The background is tiled to fill it.
+ * \param width World width in pixels
+ * \param height World height in pixels
+ */
+void CAquarium::SetWorldSize(int width, int height)
+{
+	Synchronize();
+	mWidth = width;
+	mHeight = height;
+
+	if (mEventDriven)
+	{
+		Reschedule();
+	}
+}
+
+/**
+ * Find the items that overlap a region of the world, at their
+ * current locations, in drawing order
+ * \param left Left edge of the region
+ * \param top Top edge of the region
+ * \param right Right edge of the region
+ * \param bottom Bottom edge of the region
+ * \param items Receives the items
+ */
+void CAquarium::Query(double left, double top, double right, double bottom, std::vector<CItem*>& items)
+{
+	mGrid.Query(left, top, right, bottom, items);
+	if (IsLazy())
+	{
+		for (auto item : items)
+		{
+			item->SyncTo(mTime);
+		}
+	}
+}
+
+/**
+ * Keep the spatial index current when an item moves
+ * \param item Item that moved
+ */
+void CAquarium::OnItemMoved(CItem* item)
+{
+	// Parallel updates move the items in the index afterwards
+	if (!mDeferMoves)
 	{
-		item->Draw(graphics);
+		mGrid.Move(item);
 	}
 }
 
 /**
- * Add an item to the aquarium
+ * Restart the random streams of this aquarium from a new seed.
+ * \param seed New seed
+ */
+void CAquarium::SetSeed(uint64_t seed)
+{
+	mSeed = seed;
+	mNextStream = 0;
+}
+
+/**
+ * Get how the items move and where the random streams are
+ * \returns Settings a load would replace
+ */
+CAquarium::Settings CAquarium::GetSettings() const
+{
+	Settings settings;
+	settings.mSeed = mSeed;
+	settings.mNextStream = mNextStream.load();
+	settings.mEventDriven = mEventDriven;
+	settings.mSchooling = mSchoolingEnabled;
+	settings.mColliding = mCollisionsEnabled;
+	settings.mUpdateLod = mLodEnabled;
+	settings.mLodFrame = mLod.GetFrame();
+	return settings;
+}
+
+/**
+ * Restore settings from GetSettings, as undoing a load does
+ * \param settings Settings to restore
+ */
+void CAquarium::SetSettings(const Settings& settings)
+{
+	mSeed = settings.mSeed;
+	mNextStream = settings.mNextStream;
+	SetEventDriven(settings.mEventDriven);
+	SetSchooling(settings.mSchooling);
+	SetColliding(settings.mColliding);
+	SetUpdateLod(settings.mUpdateLod);
+	mLod.SetFrame(settings.mLodFrame);
+}
+
+/**
+ * Create a random generator on the next stream of our seed.
+ *
+ * Each call returns an independent generator, so items and worker
+ * threads never share generator state. Safe to call from any thread.
+ * \returns New generator
+ */
+CRandom CAquarium::CreateStream()
+{
+	return CRandom(mSeed, mNextStream++);
+}
+
+/**
+ * Add an item to the aquarium, giving it an id if it has none
  * \param item New item to add
  */
 void CAquarium::Add(std::shared_ptr<CItem> item)
 {
+	if (item->GetId() == 0)
+	{
+		item->SetId(++mLastId);
+	}
+
 	mItems.push_back(item);
+	mGrid.Insert(item.get());
+
+	auto stinky = dynamic_cast<CStinky*>(item.get());
+	if (stinky != nullptr)
+	{
+		mRepellers.push_back(stinky);
+	}
+
+	if (IsLazy())
+	{
+		item->SetSyncTime(mTime);
+	}
+
+	if (mEventDriven)
+	{
+		Schedule(item);
+	}
 }
 
 
@@ -82,11 +299,22 @@ void CAquarium::Add(std::shared_ptr<CItem> item)
 */
 std::shared_ptr<CItem> CAquarium::HitTest(int x, int y)
 {
-	for (auto i = mItems.rbegin(); i != mItems.rend(); i++)
+	// Only the items near the location can be hit
+	vector<CItem*> candidates;
+	mGrid.Query(x, y, x, y, candidates);
+
+	for (auto i = candidates.rbegin(); i != candidates.rend(); i++)
 	{
+		if (IsLazy())
+		{
+			(*i)->SyncTo(mTime);
+		}
+
 		if ((*i)->HitTest(x, y))
 		{
-			return *i;
+			auto item = find_if(mItems.rbegin(), mItems.rend(),
+				[i](const shared_ptr<CItem>& item) { return item.get() == *i; });
+			return *item;
 		}
 	}
 
@@ -132,15 +360,183 @@ std::shared_ptr<CItem> CAquarium::TopImageHitTest(std::shared_ptr<CItem> imageOn
  */
 void CAquarium::MoveToFront(std::shared_ptr<CItem> item)
 {
+	if (IsLazy())
+	{
+		item->SyncTo(mTime);
+	}
+
 	auto location = find(begin(mItems), end(mItems), item);		// Find the location of the item.
 	if (location != end(mItems))								// If the item exists
 	{
+		RemoveRepeller(item.get());
 		mItems.erase(location);
 		//CAquarium::Add(item);
 	}
 	CAquarium::Add(item);
 }
 
+/**
+ * Take an item out of the aquarium. Items not in the aquarium are ignored.
+ *
+ * The item keeps its id and location, so it can be added back.
+ * \param item Item to remove
+ */
+void CAquarium::Remove(const std::shared_ptr<CItem>& item)
+{
+	auto location = find(begin(mItems), end(mItems), item);
+	if (location == end(mItems))
+	{
+		return;
+	}
+
+	if (IsLazy())
+	{
+		// Its queued events no longer match, so they are skipped
+		item->SyncTo(mTime);
+		item->SetEventTime(numeric_limits<double>::infinity());
+	}
+
+	RemoveRepeller(item.get());
+	mItems.erase(location);
+	mGrid.Remove(item.get());
+}
+
+/**
+ * Take many items out of the aquarium at once, in time linear in
+ * the number of items. Items not in the aquarium are ignored.
+ * \param items Items to remove
+ */
+void CAquarium::Remove(const std::vector<CItem*>& items)
+{
+	unordered_set<CItem*> removing(items.begin(), items.end());
+	auto last = remove_if(begin(mItems), end(mItems), [this, &removing](const shared_ptr<CItem>& item) {
+		if (removing.count(item.get()) == 0)
+		{
+			return false;
+		}
+
+		if (IsLazy())
+		{
+			item->SyncTo(mTime);
+			item->SetEventTime(numeric_limits<double>::infinity());
+		}
+
+		mGrid.Remove(item.get());
+		return true;
+	});
+
+	mItems.erase(last, end(mItems));
+
+	auto lastRepeller = remove_if(begin(mRepellers), end(mRepellers), [&removing](CStinky* stinky) {
+		return removing.count(stinky) != 0;
+	});
+	mRepellers.erase(lastRepeller, end(mRepellers));
+}
+
+/**
+ * Take an item out of the list of repellers, if it is a Stinky
+ * \param item Item leaving the aquarium
+ */
+void CAquarium::RemoveRepeller(CItem* item)
+{
+	auto location = find(begin(mRepellers), end(mRepellers), item);
+	if (location != end(mRepellers))
+	{
+		mRepellers.erase(location);
+	}
+}
+
+/**
+ * Put an item moved to the front back where it was in the drawing
+ * order. Used to undo MoveToFront.
+ * \param item Item in the aquarium
+ * \param index Index it had in the items, back to front
+ */
+void CAquarium::MoveBack(const std::shared_ptr<CItem>& item, size_t index)
+{
+	auto location = find(begin(mItems), end(mItems), item);
+	if (location == end(mItems))
+	{
+		return;
+	}
+
+	if (IsLazy())
+	{
+		item->SyncTo(mTime);
+	}
+
+	mItems.erase(location);
+	index = min(index, mItems.size());
+	mItems.insert(begin(mItems) + index, item);
+
+	// Repellers are applied in drawing order, so a Stinky moved back
+	// takes its place among them again
+	if (dynamic_cast<CStinky*>(item.get()) != nullptr)
+	{
+		mRepellers.clear();
+		for (auto& other : mItems)
+		{
+			auto stinky = dynamic_cast<CStinky*>(other.get());
+			if (stinky != nullptr)
+			{
+				mRepellers.push_back(stinky);
+			}
+		}
+	}
+
+	// The grid only adds in front, so the item and everything in
+	// front of it are added again in order
+	for (auto i = begin(mItems) + index; i != end(mItems); i++)
+	{
+		mGrid.Insert(i->get());
+	}
+
+	if (IsLazy())
+	{
+		item->SetSyncTime(mTime);
+	}
+
+	if (mEventDriven)
+	{
+		Schedule(item);
+	}
+}
+
+/**
+ * Replace every item of the aquarium. Used to undo a load or clear.
+ *
+ * The items keep their ids and locations.
+ * \param items New items in drawing order, back to front
+ */
+void CAquarium::SetItems(const std::vector<std::shared_ptr<CItem>>& items)
+{
+	Clear();
+	mItems.reserve(items.size());
+	for (auto& item : items)
+	{
+		Add(item);
+	}
+}
+
+/**
+ * Push items away from every Stinky in the aquarium.
+ */
+void CAquarium::Nudge()
+{
+	if (mRepellers.empty())
+	{
+		return;
+	}
+
+	vector<CNudge::Repeller> repellers;
+	for (auto stinky : mRepellers)
+	{
+		repellers.push_back(CNudge::Repeller{ stinky->GetX(), stinky->GetY(), stinky->GetRepelDistance() });
+	}
+
+	Repel(repellers);
+}
+
 /**
  * Nudges other fish away.
  * \param stinkyX Stinky's X position
@@ -148,9 +544,51 @@ void CAquarium::MoveToFront(std::shared_ptr<CItem> item)
  */
 void CAquarium::Nudge(double stinkyX, double stinkyY)
 {
-	for (auto fish : mItems)
+	Repel({ CNudge::Repeller{ stinkyX, stinkyY, CNudge::DefaultDistance } });
+}
+
+/**
+ * Push items away from repellers and keep the event queue valid
+ * \param repellers Repellers to apply, in order
+ */
+void CAquarium::Repel(const std::vector<CNudge::Repeller>& repellers)
+{
+	CProfileTimer timer(mProfiler, CFrameProfiler::Nudge);
+	if (mEventDriven)
+	{
+		Synchronize();
+	}
+
+	// Items waiting for their level of detail update may have swum
+	// as far as the guard band since they were indexed
+	double reach = mLodEnabled && !mEventDriven ? mLod.GetGuard() : 0;
+
+	// Items away from every repeller can never be pushed, even
+	// after another repeller moves the items near it
+	vector<CItem*> nearby, found;
+	for (auto& repeller : repellers)
+	{
+		double distance = repeller.mDistance + reach;
+		mGrid.Query(repeller.mX - distance, repeller.mY - distance,
+			repeller.mX + distance, repeller.mY + distance, found);
+		nearby.insert(nearby.end(), found.begin(), found.end());
+	}
+
+	// Each item is pushed on its own, so their order does not matter
+	sort(nearby.begin(), nearby.end());
+	nearby.erase(unique(nearby.begin(), nearby.end()), nearby.end());
+	if (reach > 0)
 	{
-		fish->UpdatePosition(stinkyX, stinkyY);
+		for (auto item : nearby)
+		{
+			item->SyncTo(mTime);
+		}
+	}
+
+	int moved = mNudge.Apply(nearby, repellers, mPool.get());
+	if (moved > 0 && mEventDriven)
+	{
+		Reschedule();
 	}
 }
 
@@ -163,28 +601,46 @@ void CAquarium::Nudge(double stinkyX, double stinkyY)
  */
 void CAquarium::Save(const std::wstring& filename)
 {
+	AQUA_TRACE_SCOPE("Save");
+
+	// The document is held in memory until we return. It is
+	// accounted at the size of the text it has been given.
+	CMemoryScope xml(CMemoryAccounting::Xml, L"Save", 0);
+
 	//
 	// Create an XML document
 	//
 	auto root = CXmlNode::CreateDocument(L"aqua");
 
-	// Iterate over all items and save them
-	for (auto item : mItems)
-	{
-		item->XmlSave(root);
-	}
+	// Save where our random streams are, so a reloaded tank continues them
+	wstringstream seed;
+	seed << hex << mSeed;
+	root->SetAttribute(L"seed", seed.str());
+	root->SetAttribute(L"stream", to_wstring(mNextStream.load()));
+	root->SetAttribute(L"width", mWidth);
+	root->SetAttribute(L"height", mHeight);
 
-	try
-	{
-		root->Save(filename);
-	}
-	catch (CXmlNode::Exception ex)
+	// Save how the items move, so a reloaded tank moves the same way
+	root->SetAttribute(L"eventdriven", mEventDriven ? 1 : 0);
+	root->SetAttribute(L"schooling", mSchoolingEnabled ? 1 : 0);
+	root->SetAttribute(L"collisions", mCollisionsEnabled ? 1 : 0);
+	root->SetAttribute(L"lod", mLodEnabled ? 1 : 0);
+	root->SetAttribute(L"lodframe", to_wstring(mLod.GetFrame()));
+
+	// Iterate over all items and save them
+	Synchronize();
 	{
-		AfxMessageBox(ex.Message().c_str());
+		AQUA_TRACE_SCOPE("Save/Serialize");
+		for (auto item : mItems)
+		{
+			item->XmlSave(root);
+		}
 	}
+	xml.Resize(root->GetDocumentSize());
 
 	try
 	{
+		AQUA_TRACE_SCOPE("Save/Write");
 		root->Save(filename);
 	}
 	catch (CXmlNode::Exception ex)
@@ -202,14 +658,29 @@ void CAquarium::Save(const std::wstring& filename)
  */
 void CAquarium::Load(const std::wstring& filename)
 {
+	AQUA_TRACE_SCOPE("Load");
+
 	// We surround with a try/catch to handle errors
 	try
 	{
 		// Open the document to read
-		shared_ptr<CXmlNode> root = CXmlNode::OpenDocument(filename);
+		shared_ptr<CXmlNode> root;
+		{
+			AQUA_TRACE_SCOPE("Load/Parse");
+			root = CXmlNode::OpenDocument(filename);
+		}
+
+		// The document is held in memory until we return
+		CMemoryScope xml(CMemoryAccounting::Xml, L"Load", root->GetDocumentSize());
 
 		// Once we know it is open, clear the existing data
 		Clear();
+
+		// Files from before large worlds are the size of the background
+		SetWorldSize(root->GetAttributeIntValue(L"width", mBackground->GetWidth()),
+			root->GetAttributeIntValue(L"height", mBackground->GetHeight()));
+
+		AQUA_TRACE_SCOPE("Load/Items");
 		//
 		// Traverse the children of the root
 		// node of the XML document in memory!!!!
@@ -221,6 +692,26 @@ void CAquarium::Load(const std::wstring& filename)
 				XmlItem(node);
 			}
 		}
+
+		// Continue the random streams where the saved tank left off
+		wstring seed = root->GetAttributeValue(L"seed", L"");
+		wstring stream = root->GetAttributeValue(L"stream", L"");
+		if (!seed.empty() && !stream.empty())
+		{
+			mSeed = wcstoull(seed.c_str(), nullptr, 16);
+			mNextStream = wcstoull(stream.c_str(), nullptr, 10);
+		}
+
+		// Files from before the motion modes were saved keep the current ones
+		SetEventDriven(root->GetAttributeIntValue(L"eventdriven", mEventDriven) != 0);
+		SetSchooling(root->GetAttributeIntValue(L"schooling", mSchoolingEnabled) != 0);
+		SetColliding(root->GetAttributeIntValue(L"collisions", mCollisionsEnabled) != 0);
+		SetUpdateLod(root->GetAttributeIntValue(L"lod", mLodEnabled) != 0);
+		wstring frame = root->GetAttributeValue(L"lodframe", L"");
+		if (!frame.empty())
+		{
+			mLod.SetFrame((unsigned)wcstoul(frame.c_str(), nullptr, 10));
+		}
 	}
 	catch (CXmlNode::Exception ex)
 	{
@@ -232,11 +723,17 @@ void CAquarium::Load(const std::wstring& filename)
 /**
  * Clear the aquarium data.
  *
- * Deletes all known items in the aquarium.
+ * Deletes all known items in the aquarium. They are brought up to
+ * date first, so any kept elsewhere, such as by the undo history,
+ * are where they were when the aquarium was cleared.
  */
 void CAquarium::Clear()
 {
+	Synchronize();
 	mItems.clear();
+	mGrid.Clear();
+	mRepellers.clear();
+	mEvents = decltype(mEvents)();
 }
 
 /**
@@ -245,34 +742,80 @@ void CAquarium::Clear()
 */
 void CAquarium::XmlItem(const std::shared_ptr<xmlnode::CXmlNode>& node)
 {
-	// A pointer for the item we are loading
-	shared_ptr<CItem> item;
-
 	// We have an item. What type?
 	wstring type = node->GetAttributeValue(L"type", L"");
+	auto item = CreateItem(type);
+
+	if (item != nullptr)
+	{
+		item->XmlLoad(node);
+		Add(item);
+	}
+}
+
+/**
+ * Create an item for this aquarium from its type name.
+ *
+ * The names are the ones saved in the type attribute of .aqua files.
+ * The item is not added to the aquarium.
+ * \param type Item type name
+ * \returns New item or nullptr if the type is unknown
+ */
+std::shared_ptr<CItem> CAquarium::CreateItem(const std::wstring& type)
+{
 	if (type == L"beta")
 	{
-		item = make_shared<CFishBeta>(this);
+		return make_shared<CFishBeta>(this);
 	}
 	if (type == L"buddha")
 	{
-		item = make_shared<CBuddha>(this);
+		return make_shared<CBuddha>(this);
 	}
 	if (type == L"magikarp")
 	{
-		item = make_shared<CMagikarp>(this);
+		return make_shared<CMagikarp>(this);
 	}
 	if (type == L"castle")
 	{
-		item = make_shared<CDecorCastle>(this);
+		return make_shared<CDecorCastle>(this);
 	}
+	if (type == L"stinky")
+	{
+		return make_shared<CStinky>(this);
+	}
+
+	return nullptr;
+}
+
+/**
+ * Compute a hash of the state of the aquarium.
+ *
+ * Covers the order, type and exact location of every item, so two
+ * runs that end with equal hashes ended in the same state.
+ * \returns 64 bit FNV-1a hash
+ */
+uint64_t CAquarium::GetStateHash()
+{
+	Synchronize();
 
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	auto mix = [&hash](const void* data, size_t size) {
+		auto bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+		}
+	};
 
-	if (item != nullptr)
+	for (auto& item : mItems)
 	{
-		item->XmlLoad(node);
-		Add(item);
+		const char* type = typeid(*item).name();
+		double location[] = { item->GetX(), item->GetY() };
+		mix(type, strlen(type));
+		mix(location, sizeof(location));
 	}
+
+	return hash;
 }
 
 /** Handle updates for animation
@@ -280,8 +823,311 @@ void CAquarium::XmlItem(const std::shared_ptr<xmlnode::CXmlNode>& node)
 */
 void CAquarium::Update(double elapsed)
 {
+	AQUA_TRACE_SCOPE("Update");
+	CProfileTimer timer(mProfiler, CFrameProfiler::Update);
+
+	if (elapsed > MaxUpdateStep)
+	{
+		// Steering is not stable over a long frame, but the fish
+		// still have to be pushed apart and away from stinkies
+		FastForward(elapsed);
+	}
+	else
+	{
+		Step(elapsed);
+	}
+
+	if (mCollisionsEnabled)
+	{
+		// Any fish may be bumped, so every fish has to be current
+		Synchronize();
+		mCollision.Resolve(mItems);
+		if (mEventDriven && !mCollision.GetContacts().empty())
+		{
+			Reschedule();
+		}
+	}
+
+	Nudge();
+}
+
+/**
+ * Advance the items by a short frame.
+ * \param elapsed The time since the last update, at most MaxUpdateStep
+ */
+void CAquarium::Step(double elapsed)
+{
+	if (mSchoolingEnabled)
+	{
+		// Steering changes every fish every frame, so event driven
+		// tanks have to bring everything up to date and replan
+		Synchronize();
+		mSchooling.Steer(mItems, elapsed);
+		if (mEventDriven)
+		{
+			Reschedule();
+		}
+	}
+
+	double previous = mTime;
+	mTime += elapsed;
+	if (!mEventDriven)
+	{
+		if (mLodEnabled)
+		{
+			mLod.Update(mItems, previous, elapsed);
+		}
+		else if (mPool != nullptr)
+		{
+			UpdateParallel(elapsed);
+		}
+		else
+		{
+			for (auto item : mItems)
+			{
+				item->Update(elapsed);
+			}
+		}
+		return;
+	}
+
+	// Only the items whose next event is due are touched
+	while (!mEvents.empty() && mEvents.top().mTime <= mTime)
+	{
+		auto event = mEvents.top();
+		mEvents.pop();
+
+		// The item was rescheduled since this event was queued
+		if (event.mTime != event.mItem->GetEventTime())
+		{
+			continue;
+		}
+
+		event.mItem->SyncTo(event.mTime);
+		Schedule(event.mItem);
+	}
+}
+
+/**
+ * Update every item on the workers.
+ *
+ * Each item only changes itself, so the items can be updated in any
+ * order on any thread. The spatial index is shared, so the workers
+ * only note which items left their cell, and the index is updated
+ * afterwards on this thread in item order. The result is the same
+ * as a serial update whatever the number of threads.
+ * \param elapsed Time since the last update in seconds
+ */
+void CAquarium::UpdateParallel(double elapsed)
+{
+	mMoved.assign(mItems.size(), 0);
+	mDeferMoves = true;
+	mPool->ParallelFor(mItems.size(), [this, elapsed](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			mItems[i]->Update(elapsed);
+			mMoved[i] = mGrid.IsMoved(mItems[i].get());
+		}
+	}, MinUpdateGrain);
+	mDeferMoves = false;
+
+	for (size_t i = 0; i < mItems.size(); i++)
+	{
+		if (mMoved[i])
+		{
+			mGrid.Move(mItems[i].get());
+		}
+	}
+}
+
+/**
+ * Set the number of threads stepped updates and nudges run on.
+ *
+ * Results are identical to running on one thread.
+ * \param threads Number of threads, 1 to run on the calling thread,
+ * 0 for one per core
+ */
+void CAquarium::SetThreads(int threads)
+{
+	if (threads <= 0)
+	{
+		threads = max(1, (int)thread::hardware_concurrency());
+	}
+
+	if (threads == 1)
+	{
+		mPool.reset();
+		return;
+	}
+
+	if (threads != GetNumThreads())
+	{
+		mPool = make_unique<CThreadPool>(threads);
+	}
+}
+
+/**
+ * Jump every item forward by a duration.
+ *
+ * Items with closed form motion take constant time however long
+ * the duration is, so this is linear in the number of items.
+ * \param duration Time to advance in seconds
+ */
+void CAquarium::FastForward(double duration)
+{
+	Synchronize();
+	for (auto item : mItems)
+	{
+		item->FastForward(duration);
+	}
+
+	mTime += duration;
+	if (IsLazy())
+	{
+		// The items are already at the new time, so they must not
+		// be synchronized forward again
+		for (auto item : mItems)
+		{
+			item->SetSyncTime(mTime);
+		}
+	}
+
+	if (mEventDriven)
+	{
+		Reschedule();
+	}
+}
+
+/**
+ * Select event driven or stepped updates.
+ *
+ * Event driven updates only touch a fish when it bounces off a wall.
+ * Other fish are brought up to date when they are drawn, hit tested
+ * or saved, so a tank of slow fish costs almost nothing to update.
+ * \param eventDriven true for event driven updates
+ */
+void CAquarium::SetEventDriven(bool eventDriven)
+{
+	if (eventDriven == mEventDriven)
+	{
+		return;
+	}
+
+	if (eventDriven)
+	{
+		// Stepped items are already up to date
+		Reschedule();
+		mEventDriven = true;
+	}
+	else
+	{
+		Synchronize();
+		mEventDriven = false;
+		mEvents = decltype(mEvents)();
+	}
+}
+
+/**
+ * Select full rate or level of detail updates for stepped items.
+ *
+ * With level of detail, items far from the last view drawn are
+ * updated less often. Event driven updates are already lazy, so they
+ * are not changed.
+ * \param lod true for level of detail updates
+ */
+void CAquarium::SetUpdateLod(bool lod)
+{
+	if (lod == mLodEnabled)
+	{
+		return;
+	}
+
+	if (lod)
+	{
+		// Stepped items are up to date but their sync times are not
+		if (!mEventDriven)
+		{
+			for (auto item : mItems)
+			{
+				item->SetSyncTime(mTime);
+			}
+		}
+
+		mLodEnabled = true;
+	}
+	else
+	{
+		Synchronize();
+		mLodEnabled = false;
+	}
+}
+
+/**
+ * Bring every item up to the current aquarium time.
+ *
+ * Only needed with event driven or level of detail updates, where
+ * items are otherwise advanced lazily. Stepped items are always up
+ * to date.
+ */
+void CAquarium::Synchronize()
+{
+	if (IsLazy())
+	{
+		for (auto item : mItems)
+		{
+			item->SyncTo(mTime);
+		}
+	}
+}
+
+/**
+ * Queue the next event of an item that is synchronized to its own
+ * sync time.
+ * \param item Item to schedule
+ */
+void CAquarium::Schedule(const std::shared_ptr<CItem>& item)
+{
+	double next = item->GetTimeToEvent();
+	if (next <= 0)
+	{
+		// At a wall and swimming into it, so turn around now
+		item->FastForward(0);
+		next = item->GetTimeToEvent();
+	}
+
+	// Crossing into another cell is an event too, which keeps the
+	// spatial index exact without touching the other items
+	double speedX, speedY;
+	item->GetVelocity(speedX, speedY);
+	double leave = mGrid.GetTimeToLeaveCell(item->GetX(), item->GetY(), speedX, speedY);
+	next = min(next, max(leave, MinCellEventGap));
+
+	double time = item->GetSyncTime() + next;
+	item->SetEventTime(time);
+	if (next < numeric_limits<double>::infinity())
+	{
+		mEvents.push(ScheduledEvent{ time, item });
+	}
+
+	// Drags and reloads leave stale events behind, drop them
+	// once they outnumber the live ones
+	if (mEvents.size() > 2 * mItems.size() + 64)
+	{
+		Reschedule();
+	}
+}
+
+/**
+ * Rebuild the event queue for every item at the current time.
+ */
+void CAquarium::Reschedule()
+{
+	Synchronize();
+
+	mEvents = decltype(mEvents)();
 	for (auto item : mItems)
 	{
-		item->Update(elapsed);
+		item->SetSyncTime(mTime);
+		Schedule(item);
 	}
 }
\ No newline at end of file
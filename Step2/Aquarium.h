@@ -8,10 +8,25 @@
 
 #pragma once
 
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <queue>
 #include <vector>
 #include "Item.h"
 #include "FishBeta.h"
+#include "FrameProfiler.h"
+#include "Random.h"
+#include "SpatialGrid.h"
+#include "Schooling.h"
+#include "Collision.h"
+#include "Nudge.h"
+#include "UpdateLod.h"
+#include "ThreadPool.h"
+#include "Camera.h"
+#include "SpriteBatch.h"
+
+class CStinky;
 
 
 /**
@@ -20,6 +35,19 @@
 class CAquarium
 {
 public:
+	/** How the items move and where the random streams are, all of
+	 * which a load sets besides the items and the world size */
+	struct Settings
+	{
+		uint64_t mSeed = 0;             ///< Seed of the random streams
+		uint64_t mNextStream = 0;       ///< Number of the next random stream
+		bool mEventDriven = false;      ///< True if updates are event driven
+		bool mSchooling = false;        ///< True if fish school
+		bool mColliding = false;        ///< True if fish collide
+		bool mUpdateLod = false;        ///< True if updates use level of detail
+		unsigned mLodFrame = 0;         ///< Frame of the level of detail schedule
+	};
+
 	/// Constructor
 	CAquarium();
 
@@ -28,6 +56,8 @@ public:
 
 	void OnDraw(Gdiplus::Graphics * graphics);
 
+	void OnDraw(Gdiplus::Graphics* graphics, const CCamera& camera, int width, int height);
+
 	void Add(std::shared_ptr<CItem> item);
 
 	std::shared_ptr<CItem> HitTest(int x, int y);
@@ -36,6 +66,20 @@ public:
 
 	void MoveToFront(std::shared_ptr<CItem> item);
 
+	void Remove(const std::shared_ptr<CItem>& item);
+
+	void Remove(const std::vector<CItem*>& items);
+
+	void MoveBack(const std::shared_ptr<CItem>& item, size_t index);
+
+	void SetItems(const std::vector<std::shared_ptr<CItem>>& items);
+
+	/// Get the items in drawing order, back to front
+	/// \returns Items of the aquarium
+	const std::vector<std::shared_ptr<CItem>>& GetItems() const { return mItems; }
+
+	void Nudge();
+
 	void Nudge(double stinkyX, double stinkyY);
 
 	void Save(const std::wstring& filename);
@@ -46,20 +90,212 @@ public:
 
 	void Update(double elapsed);
 
-	/// Get the width of the aquarium
+	void FastForward(double duration);
+
+	void SetEventDriven(bool eventDriven);
+
+	/// Are fish only advanced when their next bounce is due?
+	/// \returns true if updates are event driven
+	bool IsEventDriven() const { return mEventDriven; }
+
+	/// Get the simulation time of the aquarium
+	/// \returns Seconds of updates since the aquarium was created
+	double GetTime() const { return mTime; }
+
+	void Synchronize();
+
+	/// Do fish of the same species school together?
+	/// \returns true if schooling is enabled
+	bool IsSchooling() const { return mSchoolingEnabled; }
+
+	/// Enable or disable schooling
+	/// \param schooling true to make fish school
+	void SetSchooling(bool schooling) { mSchoolingEnabled = schooling; }
+
+	/// Get the schooling behavior, for its weights and costs
+	/// \returns Schooling reference
+	CSchooling& GetSchooling() { return mSchooling; }
+
+	/// Do fish bump into each other?
+	/// \returns true if fish collisions are enabled
+	bool IsColliding() const { return mCollisionsEnabled; }
+
+	/// Enable or disable fish collisions
+	/// \param colliding true to keep fish from swimming through each other
+	void SetColliding(bool colliding) { mCollisionsEnabled = colliding; }
+
+	/// Get the fish collision detection, for its options and costs
+	/// \returns Collision reference
+	CCollision& GetCollision() { return mCollision; }
+
+	/// Are items far from the view updated less often?
+	/// \returns true if update level of detail is enabled
+	bool IsUpdateLod() const { return mLodEnabled; }
+
+	void SetUpdateLod(bool lod);
+
+	/// Get the update level of detail, for its margins and counts
+	/// \returns Update level of detail reference
+	CUpdateLod& GetUpdateLod() { return mLod; }
+
+	void SetThreads(int threads);
+
+	/// Get the number of threads stepped updates and nudges run on
+	/// \returns Number of threads, 1 if they run on the calling thread
+	int GetNumThreads() const { return mPool != nullptr ? mPool->GetNumThreads() : 1; }
+
+	std::shared_ptr<CItem> CreateItem(const std::wstring& type);
+
+	uint64_t GetStateHash();
+
+	/// Get the width of the aquarium world
 	/// \returns Aquarium width
-	int GetWidth() const { return mBackground->GetWidth(); }
+	int GetWidth() const { return mWidth; }
 
-	/// Get the height of the aquarium
+	/// Get the height of the aquarium world
 	/// \returns Aquarium height
-	int GetHeight() const { return mBackground->GetHeight(); }
+	int GetHeight() const { return mHeight; }
+
+	void SetWorldSize(int width, int height);
+
+	void OnItemMoved(CItem* item);
+
+	void Query(double left, double top, double right, double bottom, std::vector<CItem*>& items);
+
+	/// Get the number of items drawn by the last OnDraw
+	/// \returns Number of items
+	int GetNumDrawn() const { return (int)mVisible.size(); }
+
+	/// Get the batch the items are drawn through
+	/// \returns Sprite batch, with the counts of the last OnDraw
+	const CSpriteBatch& GetSpriteBatch() const { return mBatch; }
+
+	/// Get the number of items in the aquarium
+	/// \returns Number of items
+	int GetNumItems() const { return (int)mItems.size(); }
+
+	/// Make sure new items are not given an id up to one already in use
+	/// elsewhere, such as by items of a tiled tank still on disk
+	/// \param id Largest id in use
+	void ReserveId(unsigned id) { if (id > mLastId) { mLastId = id; } }
+
+	void SetSeed(uint64_t seed);
+
+	CRandom CreateStream();
+
+	Settings GetSettings() const;
+	void SetSettings(const Settings& settings);
+
+	/// Get the frame profiler for this aquarium
+	/// \returns Profiler reference
+	CFrameProfiler& GetProfiler() { return mProfiler; }
 
 private:
-	std::unique_ptr<Gdiplus::Bitmap> mBackground; ///< Background image to use
+	std::shared_ptr<Gdiplus::Bitmap> mBackground; ///< Background image to use
 
 	/// All of the items to populate our aquarium
 	std::vector<std::shared_ptr<CItem> > mItems;
 
+	/// Width of the world in pixels
+	int mWidth = 0;
+
+	/// Height of the world in pixels
+	int mHeight = 0;
+
+	/// Index of the items by location
+	CSpatialGrid mGrid;
+
+	/// Items found by the last draw or hit test
+	std::vector<CItem*> mVisible;
+
+	/// Sprite draws of the visible items, issued page by page
+	CSpriteBatch mBatch;
+
+	/// Steers fish of the same species into schools
+	CSchooling mSchooling;
+
+	/// True if fish school
+	bool mSchoolingEnabled = false;
+
+	/// Keeps fish from swimming through each other
+	CCollision mCollision;
+
+	/// True if fish collide
+	bool mCollisionsEnabled = false;
+
+	/// Pushes items away from each Stinky
+	CNudge mNudge;
+
+	/// Updates items far from the view less often
+	CUpdateLod mLod;
+
+	/// True if stepped items are updated by level of detail
+	bool mLodEnabled = false;
+
+	/// Workers stepped updates and nudges run on, null to run them on the calling thread
+	std::unique_ptr<CThreadPool> mPool;
+
+	/// True while items are updated in parallel and their moves are
+	/// applied to the spatial index afterwards
+	bool mDeferMoves = false;
+
+	/// Which items left their grid cell in a parallel update
+	std::vector<unsigned char> mMoved;
+
+	/// Stinky items in the aquarium, in drawing order, so a Stinky
+	/// moving does not have to search every item for them
+	std::vector<CStinky*> mRepellers;
+
+	/// Id given to the last item added
+	unsigned mLastId = 0;
+
+	/// Times the phases of each frame
+	CFrameProfiler mProfiler;
+
+	/// Seed all of our random streams come from
+	uint64_t mSeed;
+
+	/// Number of the next random stream to hand out
+	std::atomic<uint64_t> mNextStream{ 0 };
+
+	/** An item event waiting in the queue */
+	struct ScheduledEvent
+	{
+		double mTime;                   ///< Aquarium time the event is due
+		std::shared_ptr<CItem> mItem;   ///< Item the event is for
+
+		/** Order events by time for the queue
+		 * \param other Event to compare to
+		 * \returns true if this event is later */
+		bool operator>(const ScheduledEvent& other) const { return mTime > other.mTime; }
+	};
+
+	/// Seconds of updates since the aquarium was created
+	double mTime = 0;
+
+	/// True if fish are only advanced when their next event is due
+	bool mEventDriven = false;
+
+	/// Upcoming item events, earliest first
+	std::priority_queue<ScheduledEvent, std::vector<ScheduledEvent>,
+		std::greater<ScheduledEvent>> mEvents;
+
+	/// Are items advanced lazily, so they have to be synchronized before use?
+	/// \returns true if item locations may be behind the aquarium time
+	bool IsLazy() const { return mEventDriven || mLodEnabled; }
+
+	void Schedule(const std::shared_ptr<CItem>& item);
+
+	void Reschedule();
+
+	void Step(double elapsed);
+
+	void UpdateParallel(double elapsed);
+
+	void Repel(const std::vector<CNudge::Repeller>& repellers);
+
+	void RemoveRepeller(CItem* item);
+
 	void XmlItem(const std::shared_ptr<xmlnode::CXmlNode>& node);
 };
 
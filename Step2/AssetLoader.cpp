@@ -0,0 +1,300 @@
+/**
+ * \file AssetLoader.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the parallel asset loader.
+ */
+
+#include "pch.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include "AssetLoader.h"
+#include "SpriteCache.h"
+#include "TraceLog.h"
+
+using namespace Gdiplus;
+using namespace std;
+
+/// Signature at the start of every PNG file
+const unsigned char PngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+/**
+ * Constructor
+ * \param atlas Atlas the sprites are loaded into
+ * \param threads Number of worker threads, 0 for one per core
+ */
+CAssetLoader::CAssetLoader(CSpriteAtlas& atlas, int threads) : mAtlas(atlas), mPool(threads)
+{
+}
+
+/**
+ * Destructor. Waits for any load still running.
+ */
+CAssetLoader::~CAssetLoader()
+{
+	Wait();
+}
+
+/**
+ * Read the size of an image from its PNG header without decoding it
+ * \param filename PNG file
+ * \param width Receives the width in pixels
+ * \param height Receives the height in pixels
+ * \returns True if the file starts with a PNG header
+ */
+bool CAssetLoader::ReadSize(const std::wstring& filename, int& width, int& height)
+{
+	// Signature, then the IHDR chunk length, type, width and height
+	unsigned char header[24];
+	ifstream in(filename, ios::binary);
+	if (!in.read((char*)header, sizeof(header)) ||
+		memcmp(header, PngSignature, sizeof(PngSignature)) != 0 || memcmp(header + 12, "IHDR", 4) != 0)
+	{
+		return false;
+	}
+
+	auto bigEndian = [](const unsigned char* bytes) {
+		return (int)(((unsigned)bytes[0] << 24) | ((unsigned)bytes[1] << 16) | ((unsigned)bytes[2] << 8) | bytes[3]);
+	};
+
+	width = bigEndian(header + 16);
+	height = bigEndian(header + 20);
+	return width > 0 && height > 0;
+}
+
+/**
+ * Start loading every PNG in a directory and return.
+ *
+ * Every sprite is reserved in the atlas before this returns, and
+ * every larger image is expected by the sprite cache, so nothing
+ * created afterwards decodes an image itself.
+ * \param directory Directory holding the images, such as images/
+ * \param cachePath Pixel cache file to map and later rewrite
+ */
+void CAssetLoader::Start(const std::wstring& directory, const std::wstring& cachePath)
+{
+	AQUA_TRACE_SCOPE("StartAssetLoad");
+	mStart = chrono::steady_clock::now();
+	mCachePath = cachePath;
+
+	wstring folder = directory;
+	if (!folder.empty() && folder.back() != L'/' && folder.back() != L'\\')
+	{
+		folder += L'/';
+	}
+
+	/** An image to load and its size */
+	struct Asset
+	{
+		wstring mFilename;  ///< Image file
+		int mWidth;         ///< Width from the header
+		int mHeight;        ///< Height from the header
+	};
+
+	vector<Asset> sprites;
+	vector<Asset> large;
+
+	WIN32_FIND_DATA data;
+	HANDLE find = FindFirstFile((folder + L"*.png").c_str(), &data);
+	if (find != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			Asset asset{ folder + data.cFileName, 0, 0 };
+			if (!ReadSize(asset.mFilename, asset.mWidth, asset.mHeight))
+			{
+				mFailed++;
+			}
+			else if (asset.mWidth <= CSpriteAtlas::MaxSpriteSize && asset.mHeight <= CSpriteAtlas::MaxSpriteSize)
+			{
+				sprites.push_back(asset);
+			}
+			else
+			{
+				large.push_back(asset);
+			}
+		} while (FindNextFile(find, &data));
+		FindClose(find);
+	}
+
+	// Tallest first keeps the shelves full, and the order does not
+	// depend on which worker finishes first
+	sort(sprites.begin(), sprites.end(), [](const Asset& a, const Asset& b) {
+		return a.mHeight != b.mHeight ? a.mHeight > b.mHeight : a.mFilename < b.mFilename;
+	});
+
+	for (auto& sprite : sprites)
+	{
+		mAtlas.Reserve(sprite.mFilename, sprite.mWidth, sprite.mHeight);
+	}
+
+	for (auto& image : large)
+	{
+		CSpriteCache::Get().Expect(image.mFilename);
+	}
+
+	mNumImages = (int)(sprites.size() + large.size());
+	mRemaining = mNumImages;
+	if (mNumImages == 0)
+	{
+		Finish();
+		return;
+	}
+
+	mCache.Open(cachePath);
+
+	// The large images take longest, so they start first
+	for (auto& image : large)
+	{
+		auto filename = image.mFilename;
+		mPool.Submit([this, filename]() { Load(filename, false); });
+	}
+
+	for (auto& sprite : sprites)
+	{
+		auto filename = sprite.mFilename;
+		mPool.Submit([this, filename]() { Load(filename, true); });
+	}
+}
+
+/**
+ * Wait until every image is loaded
+ */
+void CAssetLoader::Wait()
+{
+	mPool.Wait();
+}
+
+/**
+ * Load one image on a worker thread
+ * \param filename Image file
+ * \param sprite True to fill its atlas sprite, false to give it to the sprite cache
+ */
+void CAssetLoader::Load(const std::wstring& filename, bool sprite)
+{
+	AQUA_TRACE_SCOPE("LoadAsset");
+
+	ifstream in(filename, ios::binary);
+	vector<char> bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+	uint64_t hash = CPixelCache::Hash(bytes.data(), bytes.size());
+
+	CPixelCache::Image image;
+	bool loaded = true;
+	if (!bytes.empty() && mCache.Find(hash, image))
+	{
+		mFromCache++;
+	}
+	else
+	{
+		vector<uint32_t> pixels;
+		int width, height;
+		bool opaque;
+		loaded = !bytes.empty() && Decode(filename, pixels, width, height, opaque);
+		if (loaded)
+		{
+			image = mCache.Add(hash, width, height, opaque, move(pixels));
+			mDecoded++;
+		}
+	}
+
+	if (!loaded)
+	{
+		// Sprites stay placeholders, Load reports large images itself
+		mFailed++;
+		if (!sprite)
+		{
+			CSpriteCache::Get().Cancel(filename);
+		}
+	}
+	else
+	{
+		// A view of the pixels where they are, for copying into the atlas
+		Bitmap view(image.mWidth, image.mHeight, image.mWidth * 4, PixelFormat32bppPARGB, (BYTE*)image.mPixels);
+
+		if (sprite)
+		{
+			mAtlas.Fill(filename, &view, image.mOpaque);
+		}
+		else
+		{
+			// The cache outlives the mapping, so the pixels are copied
+			auto copy = new Bitmap(image.mWidth, image.mHeight, PixelFormat32bppPARGB);
+			Rect rect(0, 0, image.mWidth, image.mHeight);
+			BitmapData data;
+			copy->LockBits(&rect, ImageLockModeWrite, PixelFormat32bppPARGB, &data);
+			for (int row = 0; row < image.mHeight; row++)
+			{
+				memcpy((BYTE*)data.Scan0 + row * data.Stride, image.mPixels + row * image.mWidth, image.mWidth * 4);
+			}
+			copy->UnlockBits(&data);
+
+			auto shared = CSpriteCache::Get().Insert(filename, copy);
+			lock_guard<mutex> lock(mMutex);
+			mHeld.push_back(shared);
+		}
+	}
+
+	if (--mRemaining == 0)
+	{
+		Finish();
+	}
+}
+
+/**
+ * Decode a PNG into premultiplied ARGB rows
+ * \param filename PNG file
+ * \param pixels Receives the rows, with no padding
+ * \param width Receives the width in pixels
+ * \param height Receives the height in pixels
+ * \param opaque Receives true if the image has no alpha
+ * \returns True if the image decoded
+ */
+bool CAssetLoader::Decode(const std::wstring& filename, std::vector<uint32_t>& pixels, int& width, int& height, bool& opaque)
+{
+	AQUA_TRACE_SCOPE("DecodeAsset");
+
+	unique_ptr<Bitmap> bitmap(Bitmap::FromFile(filename.c_str()));
+	if (bitmap == nullptr || bitmap->GetLastStatus() != Ok)
+	{
+		return false;
+	}
+
+	width = bitmap->GetWidth();
+	height = bitmap->GetHeight();
+	opaque = !IsAlphaPixelFormat(bitmap->GetPixelFormat());
+
+	pixels.resize((size_t)width * height);
+	Rect rect(0, 0, width, height);
+	BitmapData data;
+	if (bitmap->LockBits(&rect, ImageLockModeRead, PixelFormat32bppPARGB, &data) != Ok)
+	{
+		return false;
+	}
+
+	for (int row = 0; row < height; row++)
+	{
+		memcpy(pixels.data() + (size_t)row * width, (const BYTE*)data.Scan0 + row * data.Stride, width * 4);
+	}
+
+	bitmap->UnlockBits(&data);
+	return true;
+}
+
+/**
+ * Called once the last image is in. Saves the pixel cache if it
+ * changed and lets go of the mapped file.
+ */
+void CAssetLoader::Finish()
+{
+	if (mCache.IsDirty() && !mCachePath.empty())
+	{
+		mCache.Save(mCachePath);
+	}
+	mCache.Close();
+
+	mSeconds = chrono::duration<double>(chrono::steady_clock::now() - mStart).count();
+	mDone = true;
+}
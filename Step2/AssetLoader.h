@@ -0,0 +1,124 @@
+/**
+ * \file AssetLoader.h
+ *
+ * \author Grant Youngs
+ *
+ * Class that decodes every image on worker threads at startup.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "PixelCache.h"
+#include "SpriteAtlas.h"
+#include "ThreadPool.h"
+
+
+/**
+ * Loads every image in a directory in parallel.
+ *
+ * Start reads only the size from each PNG header, which is enough
+ * to reserve every sprite in the atlas at once, and returns. Items
+ * created from then on are laid out at their real size and draw a
+ * placeholder until their pixels arrive. Workers then hash each
+ * file and take its pixels from the memory mapped pixel cache, or
+ * decode it on a miss. Sprites are copied into the atlas and larger
+ * images, such as the background, are handed to the sprite cache.
+ *
+ * When the last image is in, the pixel cache is rewritten if
+ * anything was decoded, so the next run does not decode any PNG.
+ */
+class CAssetLoader
+{
+public:
+	CAssetLoader(CSpriteAtlas& atlas = CSpriteAtlas::Get(), int threads = 0);
+	virtual ~CAssetLoader();
+
+	/// Copy constructor (disabled)
+	CAssetLoader(const CAssetLoader&) = delete;
+
+	void Start(const std::wstring& directory, const std::wstring& cachePath);
+
+	void Wait();
+
+	/// Determine if every image has been loaded
+	/// \returns True when loading is finished
+	bool IsDone() const { return mDone; }
+
+	/// Get the number of images being loaded
+	/// \returns Number of images found by Start
+	int GetNumImages() const { return mNumImages; }
+
+	/// Get the number of images taken from the pixel cache
+	/// \returns Number of cache hits
+	int GetNumFromCache() const { return mFromCache; }
+
+	/// Get the number of images decoded from PNG
+	/// \returns Number of cache misses
+	int GetNumDecoded() const { return mDecoded; }
+
+	/// Get the number of images that could not be read or decoded
+	/// \returns Number of failures
+	int GetNumFailed() const { return mFailed; }
+
+	/// Get how long loading took, once it is done
+	/// \returns Seconds from Start until the last image was in
+	double GetSeconds() const { return mSeconds; }
+
+	static bool ReadSize(const std::wstring& filename, int& width, int& height);
+
+private:
+	void Load(const std::wstring& filename, bool sprite);
+	void Finish();
+
+	static bool Decode(const std::wstring& filename, std::vector<uint32_t>& pixels, int& width, int& height, bool& opaque);
+
+	/// Atlas the sprites are loaded into
+	CSpriteAtlas& mAtlas;
+
+	/// Decoded pixels from earlier runs
+	CPixelCache mCache;
+
+	/// Where the pixel cache is saved
+	std::wstring mCachePath;
+
+	/// Large images handed to the sprite cache, held so they stay cached
+	std::vector<std::shared_ptr<Gdiplus::Bitmap>> mHeld;
+
+	/// Protects the held images
+	std::mutex mMutex;
+
+	/// When Start was called
+	std::chrono::steady_clock::time_point mStart;
+
+	/// Number of images found by Start
+	int mNumImages = 0;
+
+	/// Images not loaded yet
+	std::atomic<int> mRemaining{ 0 };
+
+	/// Images taken from the pixel cache
+	std::atomic<int> mFromCache{ 0 };
+
+	/// Images decoded from PNG
+	std::atomic<int> mDecoded{ 0 };
+
+	/// Images that could not be loaded
+	std::atomic<int> mFailed{ 0 };
+
+	/// Seconds from Start until the last image was in
+	std::atomic<double> mSeconds{ 0 };
+
+	/// True when every image is loaded
+	std::atomic<bool> mDone{ false };
+
+	/// Workers that load the images. Declared last so it is destroyed
+	/// first, which waits for any load still running.
+	CThreadPool mPool;
+};
+
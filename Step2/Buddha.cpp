@@ -25,11 +25,9 @@ const double ImageWidth = 250;
 /// Height of the image
 const double ImageHeight = 304;
 
-/// Minimum speed of Buddha in X direction
-const double MinSpeedX = 25;
+const double CBuddha::MinSpeedX = 25;
 
-/// Minimum speed of Buddha in Y direction
-const double MinSpeedY = 10;
+const double CBuddha::MinSpeedY = 10;
 
 /** Constructor
  * \param aquarium The aquarium this is a member of
@@ -46,6 +44,11 @@ CBuddha::CBuddha(CAquarium* aquarium) :
 	// Sets the minimum speed member variables
 	SetMinSpeedX(MinSpeedX);
 	SetMinSpeedY(MinSpeedY);
+
+	// Schools with the other buddha fish
+	SetSpecies(CSchooling::Buddha);
+
+	Count(this);
 }
 
 /**
@@ -57,7 +60,7 @@ CBuddha::XmlSave(const std::shared_ptr<xmlnode::CXmlNode>& node)
 {
 	auto itemNode = CFish::XmlSave(node);
 
-	itemNode->SetAttribute(L"type", L"buddha");
+	itemNode->SetAttribute(L"type", GetType());
 
 	return itemNode;
 }
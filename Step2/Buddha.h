@@ -18,10 +18,20 @@
 class CBuddha : public CFish
 {
 public:
+	/// Minimum speed of Buddha in the X direction in pixels per second
+	static const double MinSpeedX;
+
+	/// Minimum speed of Buddha in the Y direction in pixels per second
+	static const double MinSpeedY;
+
 	/// Constructor
 	CBuddha(CAquarium* aquarium);
 
 	/// Saves the attributes of the Buddha
+	/// Get the name of the item type, as saved in files
+	/// \returns Type name
+	virtual const wchar_t* GetType() const override { return L"buddha"; }
+
 	virtual std::shared_ptr<xmlnode::CXmlNode> XmlSave(const std::shared_ptr<xmlnode::CXmlNode>& node) override;
 
 	/// Default constructor (disabled)
@@ -0,0 +1,111 @@
+/**
+ * \file Camera.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the pan and zoom camera.
+ */
+
+#include "pch.h"
+#include <algorithm>
+#include "Camera.h"
+
+using namespace Gdiplus;
+using namespace std;
+
+/// Smallest zoom factor
+const double MinZoom = 0.05;
+
+/// Largest zoom factor
+const double MaxZoom = 8;
+
+/**
+ * Set the zoom factor, limited to the supported range
+ * \param zoom Screen pixels per world pixel
+ */
+void CCamera::SetZoom(double zoom)
+{
+	mZoom = min(max(zoom, MinZoom), MaxZoom);
+}
+
+/**
+ * Move the camera as if the world was dragged by the mouse
+ * \param dx Screen pixels the world moves right
+ * \param dy Screen pixels the world moves down
+ */
+void CCamera::Pan(double dx, double dy)
+{
+	mX -= dx / mZoom;
+	mY -= dy / mZoom;
+}
+
+/**
+ * Zoom while keeping the world point under a screen location fixed
+ * \param factor Amount to multiply the zoom by
+ * \param screenX X location of the fixed point in the window
+ * \param screenY Y location of the fixed point in the window
+ */
+void CCamera::ZoomAt(double factor, double screenX, double screenY)
+{
+	double worldX, worldY;
+	ScreenToWorld(screenX, screenY, worldX, worldY);
+
+	SetZoom(mZoom * factor);
+
+	mX = worldX - screenX / mZoom;
+	mY = worldY - screenY / mZoom;
+}
+
+/**
+ * Convert a window location to a world location
+ * \param screenX X location in the window
+ * \param screenY Y location in the window
+ * \param worldX Receives the world X location
+ * \param worldY Receives the world Y location
+ */
+void CCamera::ScreenToWorld(double screenX, double screenY, double& worldX, double& worldY) const
+{
+	worldX = mX + screenX / mZoom;
+	worldY = mY + screenY / mZoom;
+}
+
+/**
+ * Convert a world location to a window location
+ * \param worldX X location in the world
+ * \param worldY Y location in the world
+ * \param screenX Receives the window X location
+ * \param screenY Receives the window Y location
+ */
+void CCamera::WorldToScreen(double worldX, double worldY, double& screenX, double& screenY) const
+{
+	screenX = (worldX - mX) * mZoom;
+	screenY = (worldY - mY) * mZoom;
+}
+
+/**
+ * Get the part of the world a window shows
+ * \param width Window width in pixels
+ * \param height Window height in pixels
+ * \param left Receives the smallest visible world X
+ * \param top Receives the smallest visible world Y
+ * \param right Receives the largest visible world X
+ * \param bottom Receives the largest visible world Y
+ */
+void CCamera::GetVisibleRect(int width, int height, double& left, double& top, double& right, double& bottom) const
+{
+	ScreenToWorld(0, 0, left, top);
+	ScreenToWorld(width, height, right, bottom);
+}
+
+/**
+ * Set a graphics transform so drawing in world coordinates
+ * appears where the camera shows it
+ * \param graphics Graphics context to transform
+ */
+void CCamera::Apply(Gdiplus::Graphics* graphics) const
+{
+	// Prepended transforms apply in reverse order, so points
+	// are translated first and then scaled
+	graphics->ScaleTransform((REAL)mZoom, (REAL)mZoom);
+	graphics->TranslateTransform((REAL)-mX, (REAL)-mY);
+}
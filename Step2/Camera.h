@@ -0,0 +1,60 @@
+/**
+ * \file Camera.h
+ *
+ * \author Grant Youngs
+ *
+ * Class that maps between the aquarium world and the window.
+ */
+
+#pragma once
+
+
+/**
+ * A camera that pans and zooms over the aquarium world.
+ *
+ * The camera location is the world point shown at the top left
+ * corner of the window. Screen coordinates are world coordinates
+ * relative to that point, multiplied by the zoom.
+ */
+class CCamera
+{
+public:
+	CCamera() {}
+
+	/// Get the world X location at the left edge of the window
+	/// \returns X location in world pixels
+	double GetX() const { return mX; }
+
+	/// Get the world Y location at the top edge of the window
+	/// \returns Y location in world pixels
+	double GetY() const { return mY; }
+
+	/// Get the zoom factor
+	/// \returns Screen pixels per world pixel
+	double GetZoom() const { return mZoom; }
+
+	/// Set the world location at the top left of the window
+	/// \param x X location in world pixels
+	/// \param y Y location in world pixels
+	void SetLocation(double x, double y) { mX = x; mY = y; }
+
+	void SetZoom(double zoom);
+
+	void Pan(double dx, double dy);
+
+	void ZoomAt(double factor, double screenX, double screenY);
+
+	void ScreenToWorld(double screenX, double screenY, double& worldX, double& worldY) const;
+
+	void WorldToScreen(double worldX, double worldY, double& screenX, double& screenY) const;
+
+	void GetVisibleRect(int width, int height, double& left, double& top, double& right, double& bottom) const;
+
+	void Apply(Gdiplus::Graphics* graphics) const;
+
+private:
+	double mX = 0;      ///< World X location at the left of the window
+	double mY = 0;      ///< World Y location at the top of the window
+	double mZoom = 1;   ///< Screen pixels per world pixel
+};
+
@@ -9,6 +9,7 @@
  */
 
 #include "pch.h"
+#include <cmath>
 #include <memory>
 #include "framework.h"
 #include "Step2.h"
@@ -22,30 +23,44 @@
 #endif
 #include "DoubleBufferDC.h"
 #include "DecorCastle.h"
+#include "TraceLog.h"
+#include "MemoryAccounting.h"
 
 
 using namespace Gdiplus;
 using namespace std;
 
 
-/// Initial fish X location
-const int InitialX = 200;
-
-/// Initial fish Y location
-const int InitialY = 200;
-
 /// Frame duration in milliseconds
 const int FrameDuration = 30;
 
+/**
+ * Get the socket file monitoring tools watch the aquarium through
+ * \returns Path of the observer stream socket
+ */
+static wstring GetObserverPath()
+{
+	wchar_t path[MAX_PATH];
+	GetTempPath(MAX_PATH, path);
+	return wstring(path) + L"aquarium-observer.sock";
+}
+
 
 // CChildView
 
 /**
  * Constructor
  */
-CChildView::CChildView()
+CChildView::CChildView() : mPlayer(&mAquarium)
 {
-	srand((unsigned int)time(nullptr));
+	// Interactive sessions get a different tank every run
+	mAquarium.SetSeed((uint64_t)time(nullptr));
+
+	// Large tanks update on every core, small ones stay on this thread
+	mAquarium.SetThreads(0);
+
+	// Loads, clears and their undos write any tiled tank back first
+	mPlayer.SetTiledTank(&mTiles);
 }
 
 /**
@@ -62,13 +77,44 @@ BEGIN_MESSAGE_MAP(CChildView, CWnd)
 	ON_WM_LBUTTONDOWN()
 	ON_WM_LBUTTONUP()
 	ON_WM_MOUSEMOVE()
+	ON_WM_RBUTTONDOWN()
+	ON_WM_RBUTTONUP()
+	ON_WM_MOUSEWHEEL()
 	ON_WM_ERASEBKGND()
 	ON_COMMAND(ID_ADDFISH_MAGIKARP, &CChildView::OnAddfishMagikarp)
 	ON_COMMAND(ID_ADDFISH_BUDDHA, &CChildView::OnAddfishBuddha)
+	ON_COMMAND(ID_ADDFISH_STINKY, &CChildView::OnAddfishStinky)
 	ON_COMMAND(ID_Menu, &CChildView::OnAddDecorCastle)
 	ON_COMMAND(ID_FILE_SAVEAS, &CChildView::OnFileSaveas)
 	ON_COMMAND(ID_FILE_OPEN32779, &CChildView::OnFileOpen)
 	ON_WM_TIMER()
+	ON_COMMAND(ID_VIEW_FRAMEPROFILER, &CChildView::OnViewFrameprofiler)
+	ON_UPDATE_COMMAND_UI(ID_VIEW_FRAMEPROFILER, &CChildView::OnUpdateViewFrameprofiler)
+	ON_COMMAND(ID_FILE_EXPORTPROFILE, &CChildView::OnFileExportprofile)
+	ON_COMMAND(ID_FILE_SAVETRACE, &CChildView::OnFileSavetrace)
+	ON_COMMAND(ID_VIEW_MEMORYUSAGE, &CChildView::OnViewMemoryusage)
+	ON_COMMAND(ID_FILE_RECORDSESSION, &CChildView::OnFileRecordsession)
+	ON_UPDATE_COMMAND_UI(ID_FILE_RECORDSESSION, &CChildView::OnUpdateFileRecordsession)
+	ON_COMMAND(ID_FILE_REPLAYSESSION, &CChildView::OnFileReplaysession)
+	ON_COMMAND(ID_VIEW_EVENTDRIVENMOTION, &CChildView::OnViewEventdrivenmotion)
+	ON_UPDATE_COMMAND_UI(ID_VIEW_EVENTDRIVENMOTION, &CChildView::OnUpdateViewEventdrivenmotion)
+	ON_COMMAND(ID_VIEW_RESETCAMERA, &CChildView::OnViewResetcamera)
+	ON_COMMAND(ID_VIEW_SCHOOLING, &CChildView::OnViewSchooling)
+	ON_UPDATE_COMMAND_UI(ID_VIEW_SCHOOLING, &CChildView::OnUpdateViewSchooling)
+	ON_COMMAND(ID_VIEW_FISHCOLLISIONS, &CChildView::OnViewFishcollisions)
+	ON_UPDATE_COMMAND_UI(ID_VIEW_FISHCOLLISIONS, &CChildView::OnUpdateViewFishcollisions)
+	ON_COMMAND(ID_FILE_RECORDTRAJECTORIES, &CChildView::OnFileRecordtrajectories)
+	ON_UPDATE_COMMAND_UI(ID_FILE_RECORDTRAJECTORIES, &CChildView::OnUpdateFileRecordtrajectories)
+	ON_COMMAND(ID_EDIT_UNDO, &CChildView::OnEditUndo)
+	ON_UPDATE_COMMAND_UI(ID_EDIT_UNDO, &CChildView::OnUpdateEditUndo)
+	ON_COMMAND(ID_EDIT_REDO, &CChildView::OnEditRedo)
+	ON_UPDATE_COMMAND_UI(ID_EDIT_REDO, &CChildView::OnUpdateEditRedo)
+	ON_COMMAND(ID_EDIT_CLEAR, &CChildView::OnEditClear)
+	ON_COMMAND(ID_FILE_OPENTILEDTANK, &CChildView::OnFileOpentiledtank)
+	ON_COMMAND(ID_FILE_SAVETILEDTANK, &CChildView::OnFileSavetiledtank)
+	ON_UPDATE_COMMAND_UI(ID_FILE_SAVETILEDTANK, &CChildView::OnUpdateFileSavetiledtank)
+	ON_COMMAND(ID_VIEW_UPDATELOD, &CChildView::OnViewUpdatelod)
+	ON_UPDATE_COMMAND_UI(ID_VIEW_UPDATELOD, &CChildView::OnUpdateViewUpdatelod)
 END_MESSAGE_MAP()
 
 
@@ -100,17 +146,51 @@ BOOL CChildView::PreCreateWindow(CREATESTRUCT& cs)
 */
 void CChildView::OnPaint()
 {
+	AQUA_TRACE_SCOPE("Frame");
+
 	CPaintDC paintDC(this);     // device context for painting
 	CDoubleBufferDC dc(&paintDC); // device context for painting
 	Graphics graphics(dc.m_hDC); // Create GDI+ graphics context
 	
-	mAquarium.OnDraw(&graphics);
+	CRect rect;
+	GetClientRect(&rect);
+
+	double left, top, right, bottom;
+	mCamera.GetVisibleRect(rect.Width(), rect.Height(), left, top, right, bottom);
+	if (mView.mType != CSessionEvent::Type::View || left != mView.mX || top != mView.mY ||
+		right != mView.mRight || bottom != mView.mBottom)
+	{
+		// The view decides which items level of detail updates
+		mView.mType = CSessionEvent::Type::View;
+		mView.mX = left;
+		mView.mY = top;
+		mView.mRight = right;
+		mView.mBottom = bottom;
+		Dispatch(mView);
+	}
+
+	if (mTiles.IsOpen())
+	{
+		// Bring in the items around what we are about to draw
+		mTiles.SetView(left, top, right, bottom);
+	}
+
+	mAquarium.OnDraw(&graphics, mCamera, rect.Width(), rect.Height());
+
+	auto& profiler = mAquarium.GetProfiler();
+	if (profiler.IsEnabled())
+	{
+		profiler.DrawOverlay(&graphics);
+	}
 
 	if (mFirstDraw)
 	{
 		mFirstDraw = false;
 		SetTimer(1, FrameDuration, nullptr);
 
+		// Monitoring is optional, so the window works without it
+		mObserver.Open(GetObserverPath());
+
 		/*
 		 * Initialize the elapsed time system
 		 */
@@ -131,7 +211,11 @@ void CChildView::OnPaint()
 	double elapsed = double(diff) / mTimeFreq;
 	mLastTime = time.QuadPart;
 
-	mAquarium.Update(elapsed);
+	CSessionEvent update;
+	update.mType = CSessionEvent::Type::Update;
+	update.mValue = elapsed;
+	Dispatch(update);
+	mObserver.Publish(&mAquarium);
 	// Do not call CWnd::OnPaint() for painting messages
 }
 
@@ -142,10 +226,10 @@ void CChildView::OnPaint()
  */
 void CChildView::OnAddfishBetafish()
 {
-	auto fish = make_shared<CFishBeta>(&mAquarium);
-	fish->SetLocation(InitialX, InitialY);
-	mAquarium.Add(fish);
-	Invalidate();
+	CSessionEvent event;
+	event.mType = CSessionEvent::Type::Add;
+	event.mText = L"beta";
+	Dispatch(event);
 }
 
 
@@ -155,7 +239,13 @@ void CChildView::OnAddfishBetafish()
 */
 void CChildView::OnLButtonDown(UINT nFlags, CPoint point)
 {
-    mGrabbedItem = mAquarium.HitTest(point.x, point.y);
+	CProfileTimer timer(mAquarium.GetProfiler(), CFrameProfiler::Input);
+
+	// Events are in world coordinates, so replays do not depend on the camera
+	CSessionEvent event;
+	event.mType = CSessionEvent::Type::MouseDown;
+	mCamera.ScreenToWorld(point.x, point.y, event.mX, event.mY);
+	Dispatch(event);
 }
 
 
@@ -175,28 +265,21 @@ void CChildView::OnLButtonUp(UINT nFlags, CPoint point)
 */
 void CChildView::OnMouseMove(UINT nFlags, CPoint point)
 {
-	// See if an item is currently being moved by the mouse
-	if (mGrabbedItem != nullptr)
-	{
-		// Moves the grabbed item to the front
-		mAquarium.MoveToFront(mGrabbedItem);
+	CProfileTimer timer(mAquarium.GetProfiler(), CFrameProfiler::Input);
 
-		// If an item is being moved, we only continue to 
-		// move it while the left button is down.
-		if (nFlags & MK_LBUTTON)
-		{
-			mGrabbedItem->SetLocation(point.x, point.y);
-		}
-		else
-		{
-			// When the left button is released, we release the
-			// item.
-			mGrabbedItem = nullptr;
-		}
-
-		// Force the screen to redraw
+	if (mPanning)
+	{
+		mCamera.Pan(point.x - mPanPoint.x, point.y - mPanPoint.y);
+		mPanPoint = point;
 		Invalidate();
 	}
+
+	// The player moves any item being dragged
+	CSessionEvent event;
+	event.mType = CSessionEvent::Type::MouseMove;
+	mCamera.ScreenToWorld(point.x, point.y, event.mX, event.mY);
+	event.mButton = (nFlags & MK_LBUTTON) != 0;
+	Dispatch(event);
 }
 
 /**
@@ -217,10 +300,10 @@ BOOL CChildView::OnEraseBkgnd(CDC* pDC)
  */
 void CChildView::OnAddfishMagikarp()
 {
-	auto fish = make_shared<CMagikarp>(&mAquarium);
-	fish->SetLocation(InitialX, InitialY);
-	mAquarium.Add(fish);
-	Invalidate();
+	CSessionEvent event;
+	event.mType = CSessionEvent::Type::Add;
+	event.mText = L"magikarp";
+	Dispatch(event);
 }
 
 
@@ -229,19 +312,31 @@ void CChildView::OnAddfishMagikarp()
  */
 void CChildView::OnAddfishBuddha()
 {
-	auto fish = make_shared<CBuddha>(&mAquarium);
-	fish->SetLocation(InitialX, InitialY);
-	mAquarium.Add(fish);
-	Invalidate();
+	CSessionEvent event;
+	event.mType = CSessionEvent::Type::Add;
+	event.mText = L"buddha";
+	Dispatch(event);
+}
+
+
+/**
+ * Adds a Stinky to the screen when selected in the GUI's menu
+ */
+void CChildView::OnAddfishStinky()
+{
+	CSessionEvent event;
+	event.mType = CSessionEvent::Type::Add;
+	event.mText = L"stinky";
+	Dispatch(event);
 }
 
 
 void CChildView::OnAddDecorCastle()
 {
-	auto fish = make_shared<CDecorCastle>(&mAquarium);
-	fish->SetLocation(InitialX, InitialY);
-	mAquarium.Add(fish);
-	Invalidate();
+	CSessionEvent event;
+	event.mType = CSessionEvent::Type::Add;
+	event.mText = L"castle";
+	Dispatch(event);
 }
 
 
@@ -277,10 +372,11 @@ void CChildView::OnFileOpen()
 	if (dlg.DoModal() != IDOK)
 		return;
 
-	wstring filename = dlg.GetPathName();
-
-	mAquarium.Load(filename);
-	Invalidate();
+	// The player closes any tiled tank before loading
+	CSessionEvent event;
+	event.mType = CSessionEvent::Type::Load;
+	event.mText = dlg.GetPathName();
+	Dispatch(event);
 }
 
 
@@ -293,3 +389,516 @@ void CChildView::OnTimer(UINT_PTR nIDEvent)
 	Invalidate();
 	CWnd::OnTimer(nIDEvent);
 }
+
+
+/**
+ * Toggle the frame profiler and its overlay
+ */
+void CChildView::OnViewFrameprofiler()
+{
+	auto& profiler = mAquarium.GetProfiler();
+	profiler.SetEnabled(!profiler.IsEnabled());
+	Invalidate();
+}
+
+
+/**
+ * Show a check on the frame profiler menu item when it is enabled
+ * \param pCmdUI The menu item to update
+ */
+void CChildView::OnUpdateViewFrameprofiler(CCmdUI* pCmdUI)
+{
+	pCmdUI->SetCheck(mAquarium.GetProfiler().IsEnabled());
+}
+
+
+/**
+ * Export the frame profiler samples as a CSV file
+ */
+void CChildView::OnFileExportprofile()
+{
+	CFileDialog dlg(false,  // false = Save dialog box
+		L".csv",            // Default file extension
+		nullptr,            // Default file name (none)
+		OFN_OVERWRITEPROMPT,      // Flags (warn it overwriting file)
+		L"CSV Files (*.csv)|*.csv|All Files (*.*)|*.*||"); // Filter
+
+	if (dlg.DoModal() != IDOK)
+		return;
+
+	wstring filename = dlg.GetPathName();
+
+	if (!mAquarium.GetProfiler().SaveCsv(filename))
+	{
+		wstring msg(L"Failed to write ");
+		msg += filename;
+		AfxMessageBox(msg.c_str());
+	}
+}
+
+
+/**
+ * Save the trace events recorded so far as Chrome trace JSON
+ */
+void CChildView::OnFileSavetrace()
+{
+#ifdef AQUARIUM_TRACE
+	CFileDialog dlg(false,  // false = Save dialog box
+		L".json",           // Default file extension
+		nullptr,            // Default file name (none)
+		OFN_OVERWRITEPROMPT,      // Flags (warn it overwriting file)
+		L"Trace Files (*.json)|*.json|All Files (*.*)|*.*||"); // Filter
+
+	if (dlg.DoModal() != IDOK)
+		return;
+
+	wstring filename = dlg.GetPathName();
+
+	if (!CTraceLog::Get().Save(filename))
+	{
+		wstring msg(L"Failed to write ");
+		msg += filename;
+		AfxMessageBox(msg.c_str());
+	}
+#else
+	AfxMessageBox(L"Tracing is not compiled into this build");
+#endif
+}
+
+
+/**
+ * Show the current and peak memory held by each subsystem
+ */
+void CChildView::OnViewMemoryusage()
+{
+	wstring report = CMemoryAccounting::Get().Dump() + L"\n" + mPlayer.GetHistory().Report();
+	if (mTiles.IsOpen())
+	{
+		report += L"\n" + mTiles.Report();
+	}
+
+	AfxMessageBox(report.c_str());
+}
+
+
+/**
+ * Record an event if we are recording and apply it to the aquarium.
+ * \param event Event to dispatch
+ * \returns true if the aquarium changed
+ */
+bool CChildView::Dispatch(const CSessionEvent& event)
+{
+	mSessionLog.Record(event);
+	if (!mPlayer.Apply(event))
+	{
+		return false;
+	}
+
+	// Anything but a mouse move without a drag may move items
+	if (event.mType != CSessionEvent::Type::MouseMove)
+	{
+		mTrajectories.Sample(&mAquarium);
+	}
+	else if (event.mButton)
+	{
+		mTrajectories.Sample(&mAquarium, CTrajectoryRecorder::Drag);
+	}
+
+	// Updates happen while painting, everything else needs a redraw
+	if (event.mType != CSessionEvent::Type::Update)
+	{
+		Invalidate();
+	}
+
+	return true;
+}
+
+
+/**
+ * Dispatch turning one of the ways the items move on or off
+ * \param mode Mode name from CSessionPlayer
+ * \param enabled true to turn the mode on
+ */
+void CChildView::DispatchMode(const wchar_t* mode, bool enabled)
+{
+	CSessionEvent event;
+	event.mType = CSessionEvent::Type::Mode;
+	event.mText = mode;
+	event.mValue = enabled ? 1 : 0;
+	Dispatch(event);
+}
+
+
+/**
+ * Start recording a session, or stop and save the recorded session
+ */
+void CChildView::OnFileRecordsession()
+{
+	if (!mSessionLog.IsRecording())
+	{
+		mSessionLog.Start(&mAquarium);
+
+		// The session starts from the view we are drawing
+		mView = CSessionEvent();
+		Invalidate();
+		return;
+	}
+
+	mSessionLog.Stop(&mAquarium);
+
+	CFileDialog dlg(false,  // false = Save dialog box
+		L".session",        // Default file extension
+		nullptr,            // Default file name (none)
+		OFN_OVERWRITEPROMPT,      // Flags (warn it overwriting file)
+		L"Session Files (*.session)|*.session|All Files (*.*)|*.*||"); // Filter
+
+	if (dlg.DoModal() != IDOK)
+		return;
+
+	wstring filename = dlg.GetPathName();
+
+	if (!mSessionLog.Save(filename))
+	{
+		wstring msg(L"Failed to write ");
+		msg += filename;
+		AfxMessageBox(msg.c_str());
+	}
+}
+
+
+/**
+ * Show a check on the record session menu item while recording
+ * \param pCmdUI The menu item to update
+ */
+void CChildView::OnUpdateFileRecordsession(CCmdUI* pCmdUI)
+{
+	pCmdUI->SetCheck(mSessionLog.IsRecording());
+}
+
+
+/**
+ * Replay a recorded session into an offscreen aquarium as fast as
+ * possible and show the event timings and final state hash
+ */
+void CChildView::OnFileReplaysession()
+{
+	CFileDialog dlg(true,  // true = Open dialog box
+		L".session",        // Default file extension
+		nullptr,            // Default file name (none)
+		0,    // Flags
+		L"Session Files (*.session)|*.session|All Files (*.*)|*.*||");  // Filter
+	if (dlg.DoModal() != IDOK)
+		return;
+
+	wstring filename = dlg.GetPathName();
+
+	CSessionLog log;
+	if (!log.Load(filename))
+	{
+		wstring msg(L"Failed to read ");
+		msg += filename;
+		AfxMessageBox(msg.c_str());
+		return;
+	}
+
+	CAquarium aquarium;
+	CSessionPlayer player(&aquarium);
+	auto result = player.Replay(log, false);
+	AfxMessageBox(CSessionPlayer::Report(log, result).c_str());
+}
+
+
+/**
+ * Toggle event driven motion, where fish are only updated when
+ * they bounce off a wall
+ */
+void CChildView::OnViewEventdrivenmotion()
+{
+	DispatchMode(CSessionPlayer::ModeEventDriven, !mAquarium.IsEventDriven());
+}
+
+
+/**
+ * Show a check on the event driven motion menu item when it is enabled
+ * \param pCmdUI The menu item to update
+ */
+void CChildView::OnUpdateViewEventdrivenmotion(CCmdUI* pCmdUI)
+{
+	pCmdUI->SetCheck(mAquarium.IsEventDriven());
+}
+
+
+/** Called when there is a right mouse button press, which
+ * starts dragging the camera
+ * \param nFlags Flags associated with the mouse button press
+ * \param point Where the button was pressed
+ */
+void CChildView::OnRButtonDown(UINT nFlags, CPoint point)
+{
+	mPanning = true;
+	mPanPoint = point;
+	SetCapture();
+}
+
+
+/** Called when the right mouse button is released
+ * \param nFlags Flags associated with the mouse button release
+ * \param point Where the button was released
+ */
+void CChildView::OnRButtonUp(UINT nFlags, CPoint point)
+{
+	mPanning = false;
+	ReleaseCapture();
+}
+
+
+/** Called when the mouse wheel turns, which zooms the camera
+ * about the mouse location
+ * \param nFlags Flags associated with the wheel
+ * \param zDelta Amount the wheel turned
+ * \param pt Mouse location in screen coordinates
+ * \returns TRUE if the wheel was handled
+ */
+BOOL CChildView::OnMouseWheel(UINT nFlags, short zDelta, CPoint pt)
+{
+	/// Zoom factor for one notch of the wheel
+	const double ZoomStep = 1.2;
+
+	ScreenToClient(&pt);
+	mCamera.ZoomAt(pow(ZoomStep, (double)zDelta / WHEEL_DELTA), pt.x, pt.y);
+	Invalidate();
+	return TRUE;
+}
+
+
+/**
+ * Return the camera to the top left of the world at full size
+ */
+void CChildView::OnViewResetcamera()
+{
+	mCamera = CCamera();
+	Invalidate();
+}
+
+
+/**
+ * Toggle schooling, where fish of the same species swim together
+ */
+void CChildView::OnViewSchooling()
+{
+	DispatchMode(CSessionPlayer::ModeSchooling, !mAquarium.IsSchooling());
+}
+
+
+/**
+ * Show a check on the schooling menu item when it is enabled
+ * \param pCmdUI The menu item to update
+ */
+void CChildView::OnUpdateViewSchooling(CCmdUI* pCmdUI)
+{
+	pCmdUI->SetCheck(mAquarium.IsSchooling());
+}
+
+
+/**
+ * Toggle fish collisions, where fish bump off each other
+ */
+void CChildView::OnViewFishcollisions()
+{
+	DispatchMode(CSessionPlayer::ModeCollisions, !mAquarium.IsColliding());
+}
+
+
+/**
+ * Show a check on the fish collisions menu item when it is enabled
+ * \param pCmdUI The menu item to update
+ */
+void CChildView::OnUpdateViewFishcollisions(CCmdUI* pCmdUI)
+{
+	pCmdUI->SetCheck(mAquarium.IsColliding());
+}
+
+
+/**
+ * Start recording the paths of the items to a file, or stop and
+ * finish the file
+ */
+void CChildView::OnFileRecordtrajectories()
+{
+	if (mTrajectories.IsOpen())
+	{
+		if (!mTrajectories.Close())
+		{
+			AfxMessageBox(L"Failed to finish the trajectory file");
+		}
+		return;
+	}
+
+	CFileDialog dlg(false,  // false = Save dialog box
+		L".traj",           // Default file extension
+		nullptr,            // Default file name (none)
+		OFN_OVERWRITEPROMPT,      // Flags (warn it overwriting file)
+		L"Trajectory Files (*.traj)|*.traj|All Files (*.*)|*.*||"); // Filter
+
+	if (dlg.DoModal() != IDOK)
+		return;
+
+	wstring filename = dlg.GetPathName();
+
+	if (!mTrajectories.Open(filename))
+	{
+		wstring msg(L"Failed to write ");
+		msg += filename;
+		AfxMessageBox(msg.c_str());
+		return;
+	}
+
+	mTrajectories.Sample(&mAquarium);
+}
+
+
+/**
+ * Show a check on the record trajectories menu item while recording
+ * \param pCmdUI The menu item to update
+ */
+void CChildView::OnUpdateFileRecordtrajectories(CCmdUI* pCmdUI)
+{
+	pCmdUI->SetCheck(mTrajectories.IsOpen());
+}
+
+
+/**
+ * Undo the last edit to the aquarium
+ */
+void CChildView::OnEditUndo()
+{
+	CSessionEvent event;
+	event.mType = CSessionEvent::Type::Undo;
+	Dispatch(event);
+}
+
+
+/**
+ * Enable the undo menu item when there is an edit to undo
+ * \param pCmdUI The menu item to update
+ */
+void CChildView::OnUpdateEditUndo(CCmdUI* pCmdUI)
+{
+	pCmdUI->Enable(mPlayer.GetHistory().CanUndo());
+}
+
+
+/**
+ * Redo the last edit undone
+ */
+void CChildView::OnEditRedo()
+{
+	CSessionEvent event;
+	event.mType = CSessionEvent::Type::Redo;
+	Dispatch(event);
+}
+
+
+/**
+ * Enable the redo menu item when there is an edit to redo
+ * \param pCmdUI The menu item to update
+ */
+void CChildView::OnUpdateEditRedo(CCmdUI* pCmdUI)
+{
+	pCmdUI->Enable(mPlayer.GetHistory().CanRedo());
+}
+
+
+/**
+ * Take every item out of the aquarium, which can be undone
+ */
+void CChildView::OnEditClear()
+{
+	CSessionEvent event;
+	event.mType = CSessionEvent::Type::Clear;
+	Dispatch(event);
+}
+
+
+/**
+ * Open a tiled tank and stream its items around the camera
+ */
+void CChildView::OnFileOpentiledtank()
+{
+	CFileDialog dlg(true,  // true = Open dialog box
+		L".aqtl",           // Default file extension
+		nullptr,            // Default file name (none)
+		0,    // Flags
+		L"Tiled Tank Files (*.aqtl)|*.aqtl|All Files (*.*)|*.*||");  // Filter
+	if (dlg.DoModal() != IDOK)
+		return;
+
+	wstring filename = dlg.GetPathName();
+
+	if (!mTiles.Open(filename, &mAquarium))
+	{
+		wstring msg(L"Failed to open ");
+		msg += filename;
+		AfxMessageBox(msg.c_str());
+		return;
+	}
+
+	// Tiles come and go as the camera moves, so edits before now cannot be undone
+	mPlayer.GetHistory().Reset();
+	Invalidate();
+}
+
+
+/**
+ * Save the aquarium as a tiled tank
+ */
+void CChildView::OnFileSavetiledtank()
+{
+	CFileDialog dlg(false,  // false = Save dialog box
+		L".aqtl",           // Default file extension
+		nullptr,            // Default file name (none)
+		OFN_OVERWRITEPROMPT,      // Flags (warn it overwriting file)
+		L"Tiled Tank Files (*.aqtl)|*.aqtl|All Files (*.*)|*.*||"); // Filter
+
+	if (dlg.DoModal() != IDOK)
+		return;
+
+	wstring filename = dlg.GetPathName();
+
+	if (!CTiledTank::Write(&mAquarium, filename))
+	{
+		wstring msg(L"Failed to write ");
+		msg += filename;
+		AfxMessageBox(msg.c_str());
+	}
+}
+
+
+/**
+ * Only a tank that is all in memory can be saved as a tiled tank
+ * \param pCmdUI The menu item to update
+ */
+void CChildView::OnUpdateFileSavetiledtank(CCmdUI* pCmdUI)
+{
+	pCmdUI->Enable(!mTiles.IsOpen());
+}
+
+
+/**
+ * Toggle update level of detail, where fish far from the view are
+ * updated less often
+ */
+void CChildView::OnViewUpdatelod()
+{
+	DispatchMode(CSessionPlayer::ModeUpdateLod, !mAquarium.IsUpdateLod());
+}
+
+
+/**
+ * Show a check on the update level of detail menu item when it is enabled
+ * \param pCmdUI The menu item to update
+ */
+void CChildView::OnUpdateViewUpdatelod(CCmdUI* pCmdUI)
+{
+	pCmdUI->SetCheck(mAquarium.IsUpdateLod());
+}
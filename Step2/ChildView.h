@@ -14,6 +14,11 @@
 #pragma once
 
 #include "Aquarium.h"
+#include "SessionLog.h"
+#include "SessionPlayer.h"
+#include "ObserverStream.h"
+#include "TrajectoryRecorder.h"
+#include "TiledTank.h"
 
 
  /**
@@ -48,8 +53,32 @@ private:
 	/// An object that describes our aquarium
 	CAquarium mAquarium;
 
-	/// Any item we are currently dragging
-	std::shared_ptr<CItem> mGrabbedItem;
+	/// Records our events while a session is being recorded
+	CSessionLog mSessionLog;
+
+	/// Applies our input and menu events to the aquarium
+	CSessionPlayer mPlayer;
+
+	/// Camera that pans and zooms over the aquarium world
+	CCamera mCamera;
+
+	/// Publishes the aquarium to local monitoring tools every tick
+	CObserverStream mObserver;
+
+	/// Records the path of every item while trajectories are being recorded
+	CTrajectoryRecorder mTrajectories;
+
+	/// Streams the items of a tiled tank around the camera while one is open
+	CTiledTank mTiles;
+
+	/// Last view sent to the aquarium, so only changes are recorded
+	CSessionEvent mView;
+
+	/// True while the right button drags the camera
+	bool mPanning = false;
+
+	/// Last mouse location while panning
+	CPoint mPanPoint;
 
 	/// True until the first time we draw
 	bool mFirstDraw = true;
@@ -57,6 +86,10 @@ private:
 	long long mLastTime;    ///< Last time we read the timer
 	double mTimeFreq;       ///< Rate the timer updates
 
+	bool Dispatch(const CSessionEvent& event);
+
+	void DispatchMode(const wchar_t* mode, bool enabled);
+
 public:
 	afx_msg void OnAddfishBetafish();
 	afx_msg void OnLButtonDown(UINT nFlags, CPoint point);
@@ -65,9 +98,40 @@ public:
 	afx_msg BOOL OnEraseBkgnd(CDC* pDC);
 	afx_msg void OnAddfishMagikarp();
 	afx_msg void OnAddfishBuddha();
+	afx_msg void OnAddfishStinky();
 	afx_msg void OnAddDecorCastle();
 	afx_msg void OnFileSaveas();
 	afx_msg void OnFileOpen();
 	afx_msg void OnTimer(UINT_PTR nIDEvent);
+	afx_msg void OnViewFrameprofiler();
+	afx_msg void OnUpdateViewFrameprofiler(CCmdUI* pCmdUI);
+	afx_msg void OnFileExportprofile();
+	afx_msg void OnFileSavetrace();
+	afx_msg void OnViewMemoryusage();
+	afx_msg void OnFileRecordsession();
+	afx_msg void OnUpdateFileRecordsession(CCmdUI* pCmdUI);
+	afx_msg void OnFileReplaysession();
+	afx_msg void OnViewEventdrivenmotion();
+	afx_msg void OnUpdateViewEventdrivenmotion(CCmdUI* pCmdUI);
+	afx_msg void OnRButtonDown(UINT nFlags, CPoint point);
+	afx_msg void OnRButtonUp(UINT nFlags, CPoint point);
+	afx_msg BOOL OnMouseWheel(UINT nFlags, short zDelta, CPoint pt);
+	afx_msg void OnViewResetcamera();
+	afx_msg void OnViewSchooling();
+	afx_msg void OnUpdateViewSchooling(CCmdUI* pCmdUI);
+	afx_msg void OnViewFishcollisions();
+	afx_msg void OnUpdateViewFishcollisions(CCmdUI* pCmdUI);
+	afx_msg void OnFileRecordtrajectories();
+	afx_msg void OnUpdateFileRecordtrajectories(CCmdUI* pCmdUI);
+	afx_msg void OnEditUndo();
+	afx_msg void OnUpdateEditUndo(CCmdUI* pCmdUI);
+	afx_msg void OnEditRedo();
+	afx_msg void OnUpdateEditRedo(CCmdUI* pCmdUI);
+	afx_msg void OnEditClear();
+	afx_msg void OnFileOpentiledtank();
+	afx_msg void OnFileSavetiledtank();
+	afx_msg void OnUpdateFileSavetiledtank(CCmdUI* pCmdUI);
+	afx_msg void OnViewUpdatelod();
+	afx_msg void OnUpdateViewUpdatelod(CCmdUI* pCmdUI);
 };
 
@@ -0,0 +1,339 @@
+/**
+ * \file Collision.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the fish collision detection and response.
+ */
+
+#include "pch.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "Collision.h"
+#include "Fish.h"
+#include "TraceLog.h"
+
+using namespace std;
+
+/// Most samples taken across the overlap in each direction
+/// by the alpha narrowphase
+const int AlphaSamples = 8;
+
+/**
+ * Order two edges along an axis. End edges come before start edges
+ * at the same location, so boxes that only touch do not overlap.
+ * \param aValue Location of the first edge
+ * \param aData Proxy and kind of the first edge
+ * \param bValue Location of the second edge
+ * \param bData Proxy and kind of the second edge
+ * \returns true if the first edge is before the second
+ */
+static bool Before(float aValue, uint32_t aData, float bValue, uint32_t bData)
+{
+	return aValue < bValue || (aValue == bValue && (aData & 1) > (bData & 1));
+}
+
+/**
+ * Find the colliding fish and push them apart.
+ *
+ * Fish that collide are moved out of each other along the axis they
+ * overlap least on and turned to swim away from each other.
+ * \param items Items of the aquarium
+ */
+void CCollision::Resolve(const std::vector<std::shared_ptr<CItem>>& items)
+{
+	Detect(items);
+
+	AQUA_TRACE_SCOPE("Update/Collisions/Response");
+	for (auto& contact : mContacts)
+	{
+		CFish* a = contact.first;
+		CFish* b = contact.second;
+
+		double overlapX = (a->GetImageWidth() + b->GetImageWidth()) / 2 - fabs(a->GetX() - b->GetX());
+		double overlapY = (a->GetImageHeight() + b->GetImageHeight()) / 2 - fabs(a->GetY() - b->GetY());
+		if (overlapX <= 0 || overlapY <= 0)
+		{
+			// An earlier contact already pushed these apart
+			continue;
+		}
+
+		if (overlapX < overlapY)
+		{
+			double direction = a->GetX() < b->GetX() ? -1 : 1;
+			a->SetLocation(a->GetX() + direction * overlapX / 2, a->GetY());
+			b->SetLocation(b->GetX() - direction * overlapX / 2, b->GetY());
+			a->SetVelocity(direction * fabs(a->GetSpeedX()), a->GetSpeedY());
+			b->SetVelocity(-direction * fabs(b->GetSpeedX()), b->GetSpeedY());
+		}
+		else
+		{
+			double direction = a->GetY() < b->GetY() ? -1 : 1;
+			a->SetLocation(a->GetX(), a->GetY() + direction * overlapY / 2);
+			b->SetLocation(b->GetX(), b->GetY() - direction * overlapY / 2);
+			a->SetVelocity(a->GetSpeedX(), direction * fabs(a->GetSpeedY()));
+			b->SetVelocity(b->GetSpeedX(), -direction * fabs(b->GetSpeedY()));
+		}
+	}
+}
+
+/**
+ * Find the pairs of fish that collide.
+ *
+ * Items that are not fish are ignored.
+ * \param items Items of the aquarium
+ */
+void CCollision::Detect(const std::vector<std::shared_ptr<CItem>>& items)
+{
+	AQUA_TRACE_SCOPE("Update/Collisions");
+	auto start = chrono::steady_clock::now();
+
+	mSwaps = 0;
+	if (Gather(items))
+	{
+		// Only the edge locations changed since last frame
+		for (int axis = 0; axis < 2; axis++)
+		{
+			for (auto& endpoint : mAxes[axis])
+			{
+				auto& proxy = mProxies[endpoint.mData >> 1];
+				endpoint.mValue = (endpoint.mData & 1) ? proxy.mMax[axis] : proxy.mMin[axis];
+			}
+
+			Sort(axis);
+		}
+	}
+	else
+	{
+		Rebuild();
+	}
+
+	mSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	// Sorted so the response does not depend on the hash order
+	vector<uint64_t> pairs(mPairs.begin(), mPairs.end());
+	sort(pairs.begin(), pairs.end());
+
+	mContacts.clear();
+	for (auto key : pairs)
+	{
+		auto& a = mProxies[(uint32_t)(key >> 32)];
+		auto& b = mProxies[(uint32_t)key];
+		if (!mAlphaTest || AlphaOverlaps(a, b))
+		{
+			mContacts.push_back(make_pair(a.mFish, b.mFish));
+		}
+	}
+}
+
+/**
+ * Update the box of every fish.
+ * \param items Items of the aquarium
+ * \returns true if the fish are the same as last time, false
+ * if fish were added, removed or reordered
+ */
+bool CCollision::Gather(const std::vector<std::shared_ptr<CItem>>& items)
+{
+	bool same = true;
+	size_t count = 0;
+
+	for (auto& item : items)
+	{
+		auto fish = dynamic_cast<CFish*>(item.get());
+		if (fish == nullptr)
+		{
+			continue;
+		}
+
+		if (count == mProxies.size())
+		{
+			mProxies.push_back(Proxy());
+			same = false;
+		}
+
+		auto& proxy = mProxies[count++];
+		if (proxy.mFish != fish)
+		{
+			proxy.mFish = fish;
+			same = false;
+		}
+
+		float halfWidth = (float)fish->GetImageWidth() / 2;
+		float halfHeight = (float)fish->GetImageHeight() / 2;
+		proxy.mMin[0] = (float)fish->GetX() - halfWidth;
+		proxy.mMax[0] = (float)fish->GetX() + halfWidth;
+		proxy.mMin[1] = (float)fish->GetY() - halfHeight;
+		proxy.mMax[1] = (float)fish->GetY() + halfHeight;
+	}
+
+	if (count != mProxies.size())
+	{
+		mProxies.resize(count);
+		same = false;
+	}
+
+	return same;
+}
+
+/**
+ * Sort the box edges from scratch and find every overlap with
+ * a single sweep along X.
+ */
+void CCollision::Rebuild()
+{
+	mRebuilds++;
+	mPairs.clear();
+
+	for (int axis = 0; axis < 2; axis++)
+	{
+		auto& endpoints = mAxes[axis];
+		endpoints.clear();
+		for (uint32_t p = 0; p < (uint32_t)mProxies.size(); p++)
+		{
+			endpoints.push_back(Endpoint{ mProxies[p].mMin[axis], p << 1 });
+			endpoints.push_back(Endpoint{ mProxies[p].mMax[axis], (p << 1) | 1 });
+		}
+
+		sort(endpoints.begin(), endpoints.end(), [](const Endpoint& a, const Endpoint& b) {
+			return Before(a.mValue, a.mData, b.mValue, b.mData);
+		});
+	}
+
+	// The boxes open along X, each tested against the others
+	// that start here
+	vector<uint32_t> open;
+	vector<size_t> where(mProxies.size());
+	for (auto& endpoint : mAxes[0])
+	{
+		uint32_t proxy = endpoint.mData >> 1;
+		if (endpoint.mData & 1)
+		{
+			size_t slot = where[proxy];
+			open[slot] = open.back();
+			where[open[slot]] = slot;
+			open.pop_back();
+		}
+		else
+		{
+			for (auto other : open)
+			{
+				if (Overlaps(proxy, other))
+				{
+					mPairs.insert(PairKey(proxy, other));
+				}
+			}
+
+			where[proxy] = open.size();
+			open.push_back(proxy);
+		}
+	}
+}
+
+/**
+ * Insertion sort the edges along one axis, updating the overlaps
+ * as edges pass each other.
+ * \param axis 0 for X, 1 for Y
+ */
+void CCollision::Sort(int axis)
+{
+	auto& endpoints = mAxes[axis];
+	for (size_t i = 1; i < endpoints.size(); i++)
+	{
+		Endpoint moving = endpoints[i];
+		size_t j = i;
+
+		while (j > 0 && Before(moving.mValue, moving.mData, endpoints[j - 1].mValue, endpoints[j - 1].mData))
+		{
+			const Endpoint& passed = endpoints[j - 1];
+			uint32_t a = moving.mData >> 1;
+			uint32_t b = passed.mData >> 1;
+
+			if (!(moving.mData & 1) && (passed.mData & 1))
+			{
+				// A start passed an end, so the boxes now overlap on
+				// this axis and may overlap on both
+				if (Overlaps(a, b))
+				{
+					mPairs.insert(PairKey(a, b));
+				}
+			}
+			else if ((moving.mData & 1) && !(passed.mData & 1))
+			{
+				// An end passed a start, so the boxes no longer overlap.
+				// Along X, boxes apart on Y were either never a pair or
+				// stopped overlapping on Y too, which the Y sort sees.
+				if (axis == 1 || OverlapsOn(1, a, b))
+				{
+					mPairs.erase(PairKey(a, b));
+				}
+			}
+
+			endpoints[j] = passed;
+			j--;
+			mSwaps++;
+		}
+
+		endpoints[j] = moving;
+	}
+}
+
+/**
+ * Test if the boxes of two proxies overlap on both axes
+ * \param a First proxy index
+ * \param b Second proxy index
+ * \returns true if they overlap
+ */
+bool CCollision::Overlaps(uint32_t a, uint32_t b) const
+{
+	return OverlapsOn(0, a, b) && OverlapsOn(1, a, b);
+}
+
+/**
+ * Test if the boxes of two proxies overlap on one axis
+ * \param axis 0 for X, 1 for Y
+ * \param a First proxy index
+ * \param b Second proxy index
+ * \returns true if they overlap
+ */
+bool CCollision::OverlapsOn(int axis, uint32_t a, uint32_t b) const
+{
+	auto& first = mProxies[a];
+	auto& second = mProxies[b];
+	return first.mMin[axis] < second.mMax[axis] && second.mMin[axis] < first.mMax[axis];
+}
+
+/**
+ * Test if two fish are both drawn anywhere over their box overlap.
+ *
+ * The overlap is sampled on a grid, using the same alpha test as
+ * clicking on a fish. The masks are fetched once for the pair.
+ * \param a First proxy
+ * \param b Second proxy
+ * \returns true if some sample is inside both images
+ */
+bool CCollision::AlphaOverlaps(const Proxy& a, const Proxy& b) const
+{
+	double left = max(a.mMin[0], b.mMin[0]);
+	double right = min(a.mMax[0], b.mMax[0]);
+	double top = max(a.mMin[1], b.mMin[1]);
+	double bottom = min(a.mMax[1], b.mMax[1]);
+
+	double stepX = max(1.0, (right - left) / AlphaSamples);
+	double stepY = max(1.0, (bottom - top) / AlphaSamples);
+
+	auto maskA = a.mFish->GetAlphaMask();
+	auto maskB = b.mFish->GetAlphaMask();
+	for (double y = top + stepY / 2; y < bottom; y += stepY)
+	{
+		for (double x = left + stepX / 2; x < right; x += stepX)
+		{
+			if (a.mFish->HitTest(maskA.get(), (int)x, (int)y) && b.mFish->HitTest(maskB.get(), (int)x, (int)y))
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,136 @@
+/**
+ * \file Collision.h
+ *
+ * \author Grant Youngs
+ *
+ * Class that keeps fish from swimming through each other.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+class CItem;
+class CFish;
+
+
+/**
+ * Finds fish whose images overlap and pushes them apart.
+ *
+ * The broadphase is an incremental sweep and prune. The box edges of
+ * every fish are kept sorted along X and along Y, and each frame the
+ * lists are re-sorted with an insertion sort. Fish only move a little
+ * between frames, so the sort does few swaps, and every swap of a box
+ * start past another box end is exactly where an overlap begins or
+ * ends. The set of overlapping pairs is updated from the swaps alone,
+ * so a frame costs about the number of fish plus the number of
+ * overlaps.
+ *
+ * An optional narrowphase tests the alpha of both images over the
+ * overlap, so fish only collide where they are actually drawn.
+ */
+class CCollision
+{
+public:
+	CCollision() {}
+
+	/// Copy constructor (disabled)
+	CCollision(const CCollision&) = delete;
+
+	void Resolve(const std::vector<std::shared_ptr<CItem>>& items);
+
+	void Detect(const std::vector<std::shared_ptr<CItem>>& items);
+
+	/// Is the alpha narrowphase used?
+	/// \returns true if pairs are tested against the image alpha
+	bool IsAlphaTest() const { return mAlphaTest; }
+
+	/// Enable or disable the alpha narrowphase
+	/// \param alphaTest true to test pairs against the image alpha
+	void SetAlphaTest(bool alphaTest) { mAlphaTest = alphaTest; }
+
+	/// Get the number of pairs of fish whose boxes overlap
+	/// \returns Number of overlapping pairs after the last detection
+	int GetNumPairs() const { return (int)mPairs.size(); }
+
+	/// Get the pairs of fish that collided in the last detection
+	/// \returns Colliding pairs, each in item order
+	const std::vector<std::pair<CFish*, CFish*>>& GetContacts() const { return mContacts; }
+
+	/// Get the number of swaps the last detection's sort made
+	/// \returns Number of swaps
+	long long GetNumSwaps() const { return mSwaps; }
+
+	/// Get the number of times the sorted lists were rebuilt
+	/// \returns Number of rebuilds
+	int GetNumRebuilds() const { return mRebuilds; }
+
+	/// Get the time the last broadphase took
+	/// \returns Time in seconds
+	double GetSeconds() const { return mSeconds; }
+
+private:
+	/** The box of one fish */
+	struct Proxy
+	{
+		CFish* mFish;       ///< The fish
+		float mMin[2];      ///< Smallest X and Y of the box
+		float mMax[2];      ///< Largest X and Y of the box
+	};
+
+	/** One edge of a box along an axis */
+	struct Endpoint
+	{
+		float mValue;       ///< Location of the edge
+		uint32_t mData;     ///< Proxy index times two, plus one for the end edge
+	};
+
+	bool Gather(const std::vector<std::shared_ptr<CItem>>& items);
+
+	void Rebuild();
+
+	void Sort(int axis);
+
+	bool Overlaps(uint32_t a, uint32_t b) const;
+
+	bool OverlapsOn(int axis, uint32_t a, uint32_t b) const;
+
+	bool AlphaOverlaps(const Proxy& a, const Proxy& b) const;
+
+	/// Make the key of a pair of proxies
+	/// \param a First proxy index
+	/// \param b Second proxy index
+	/// \returns Key, the same for either order
+	static uint64_t PairKey(uint32_t a, uint32_t b)
+	{
+		return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+	}
+
+	/// Box of every fish, in item order
+	std::vector<Proxy> mProxies;
+
+	/// Box edges sorted along X and along Y
+	std::vector<Endpoint> mAxes[2];
+
+	/// Pairs of proxies whose boxes overlap
+	std::unordered_set<uint64_t> mPairs;
+
+	/// Pairs that collided in the last detection
+	std::vector<std::pair<CFish*, CFish*>> mContacts;
+
+	/// True to test pairs against the image alpha
+	bool mAlphaTest = false;
+
+	/// Swaps made by the last detection
+	long long mSwaps = 0;
+
+	/// Times the sorted lists were rebuilt
+	int mRebuilds = 0;
+
+	/// Time the last broadphase took in seconds
+	double mSeconds = 0;
+};
+
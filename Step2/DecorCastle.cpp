@@ -26,6 +26,7 @@ const wstring DecorCastleImageName = L"images/castle.png";
 CDecorCastle::CDecorCastle(CAquarium* aquarium) :
 	CItem(aquarium, DecorCastleImageName)
 {
+	Count(this);
 }
 
 /**
@@ -37,7 +38,7 @@ CDecorCastle::XmlSave(const std::shared_ptr<xmlnode::CXmlNode>& node)
 {
 	auto itemNode = CItem::XmlSave(node);
 
-	itemNode->SetAttribute(L"type", L"castle");
+	itemNode->SetAttribute(L"type", GetType());
 
 	return itemNode;
 }
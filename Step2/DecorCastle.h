@@ -21,6 +21,10 @@ public:
 	CDecorCastle(CAquarium* aquarium);
 
 	/// Saves the attributes of the Castle
+	/// Get the name of the item type, as saved in files
+	/// \returns Type name
+	virtual const wchar_t* GetType() const override { return L"castle"; }
+
 	virtual std::shared_ptr<xmlnode::CXmlNode> XmlSave(const std::shared_ptr<xmlnode::CXmlNode>& node) override;
 
 	/// Default constructor (disabled)
@@ -5,16 +5,17 @@
  */
 
 #include "pch.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include "Fish.h"
 #include "Aquarium.h"
 
- /// Maximum speed in the X direction in
- /// in pixels per second
-const double MaxSpeedX = 200;
+using namespace std;
 
-/// Maximum speed in the Y direction in
-/// pixels per second
-const double MaxSpeedY = 50;
+const double CFish::MaxSpeedX = 200;
+
+const double CFish::MaxSpeedY = 50;
 
 /**
  * Save this item to an XML node
@@ -54,8 +55,31 @@ void CFish::XmlLoad(const std::shared_ptr<xmlnode::CXmlNode>& node)
 CFish::CFish(CAquarium* aquarium, const std::wstring& filename) :
 	CItem(aquarium, filename)
 {
-	mSpeedX = mMinSpeedX + (((double)rand() / RAND_MAX) * (MaxSpeedX - mMinSpeedX));
-	mSpeedY = mMinSpeedY + (((double)rand() / RAND_MAX) * (MaxSpeedY - mMinSpeedY));
+	CRandom random = aquarium->CreateStream();
+	mSpeedX = random.Uniform(mMinSpeedX, MaxSpeedX);
+	mSpeedY = random.Uniform(mMinSpeedY, MaxSpeedY);
+}
+
+/**
+ * Change the velocity of the fish.
+ *
+ * The speed on each axis is kept between the minimum speed of the
+ * fish and the maximum speed of all fish, so steering can turn a
+ * fish but never stop it.
+ * \param speedX New speed in the X direction
+ * \param speedY New speed in the Y direction
+ */
+void CFish::SetVelocity(double speedX, double speedY)
+{
+	auto limit = [](double speed, double previous, double low, double high) {
+		double size = min(max(fabs(speed), low), high);
+		bool positive = speed > 0 || (speed == 0 && previous >= 0);
+		return positive ? size : -size;
+	};
+
+	mSpeedX = limit(speedX, mSpeedX, mMinSpeedX, MaxSpeedX);
+	mSpeedY = limit(speedY, mSpeedY, mMinSpeedY, MaxSpeedY);
+	SetMirror(mSpeedX < 0);
 }
 
 /**
@@ -89,4 +113,112 @@ void CFish::Update(double elapsed)
 	{
 		mSpeedY = -mSpeedY;
 	}
-}
\ No newline at end of file
+}
+
+/**
+ * Advance motion along one axis between two walls.
+ *
+ * Inside the walls the location is a triangle wave of time, so it
+ * is computed directly by unfolding the bounces into one long line
+ * of length twice the distance between the walls. A location outside
+ * the walls, for example after a drag, first swims back in.
+ * \param location Location, updated
+ * \param speed Speed, negated if the last bounce reversed it
+ * \param low Smallest location
+ * \param high Largest location
+ * \param duration Time to advance in seconds
+ */
+void CFish::AdvanceAxis(double& location, double& speed, double low, double high, double duration)
+{
+	if (speed == 0 || high <= low)
+	{
+		return;
+	}
+
+	// Outside the walls, Update turns the fish around at once
+	if ((location >= high && speed > 0) || (location <= low && speed < 0))
+	{
+		speed = -speed;
+	}
+
+	double outside = location > high ? location - high : (location < low ? low - location : 0);
+	if (outside > 0)
+	{
+		double toWall = outside / fabs(speed);
+		if (duration <= toWall)
+		{
+			location += speed * duration;
+			return;
+		}
+
+		location = location > high ? high : low;
+		duration -= toWall;
+	}
+
+	double range = high - low;
+	double unfolded = speed > 0 ? location - low : 2 * range - (location - low);
+	unfolded = fmod(unfolded + fabs(speed) * duration, 2 * range);
+
+	if (unfolded < range)
+	{
+		location = low + unfolded;
+		speed = fabs(speed);
+	}
+	else
+	{
+		location = low + 2 * range - unfolded;
+		speed = -fabs(speed);
+	}
+}
+
+/**
+ * Advance the fish by any duration in constant time.
+ *
+ * Gives the location continuous bounces would reach, which is the
+ * limit of Update as the frame time goes to zero.
+ * \param duration Time to advance in seconds
+ */
+void CFish::FastForward(double duration)
+{
+	double minX, maxX, minY, maxY;
+	GetBounds(minX, maxX, minY, maxY);
+
+	double x = GetX();
+	double y = GetY();
+	AdvanceAxis(x, mSpeedX, minX, maxX, duration);
+	AdvanceAxis(y, mSpeedY, minY, maxY, duration);
+
+	SetLocation(x, y);
+	SetMirror(mSpeedX < 0);
+}
+
+/**
+ * Get the time until the fish next bounces off a wall.
+ * \returns Seconds, or infinity if the fish is not moving
+ */
+double CFish::GetTimeToEvent()
+{
+	double minX, maxX, minY, maxY;
+	GetBounds(minX, maxX, minY, maxY);
+
+	auto axis = [](double location, double speed, double low, double high) {
+		if (high <= low)
+		{
+			// No room to swim, AdvanceAxis leaves the fish alone
+			return numeric_limits<double>::infinity();
+		}
+		if (speed > 0)
+		{
+			return max(0.0, (high - location) / speed);
+		}
+		if (speed < 0)
+		{
+			return max(0.0, (location - low) / -speed);
+		}
+		return numeric_limits<double>::infinity();
+	};
+
+	double timeX = axis(GetX(), mSpeedX, minX, maxX);
+	double timeY = axis(GetY(), mSpeedY, minY, maxY);
+	return min(timeX, timeY);
+}
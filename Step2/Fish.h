@@ -8,6 +8,7 @@
 
 #pragma once
 #include "Item.h"
+#include "Schooling.h"
 
  /**
   * Base class for a fish
@@ -17,6 +18,12 @@
 class CFish : public CItem
 {
 public: 
+	/// Maximum speed in the X direction in pixels per second
+	static const double MaxSpeedX;
+
+	/// Maximum speed in the Y direction in pixels per second
+	static const double MaxSpeedY;
+
 	/// Default constructor (disabled)
 	CFish() = delete;
 
@@ -29,12 +36,29 @@ public:
 	/// Returns the speed in the Y direction
 	double GetSpeedY() { return mSpeedY; }
 
+	void SetVelocity(double speedX, double speedY);
+
+	/// Get the species the fish schools with
+	/// \returns Species
+	CSchooling::Species GetSpecies() const { return mSpecies; }
+
 	/// Saves the attributes of the Fish object
 	virtual std::shared_ptr<xmlnode::CXmlNode> XmlSave(const std::shared_ptr<xmlnode::CXmlNode>& node) override;
 
 	/// Loads the attributes of the fish object
 	virtual void XmlLoad(const std::shared_ptr<xmlnode::CXmlNode>& node) override;
 
+	virtual void FastForward(double duration) override;
+
+	virtual double GetTimeToEvent() override;
+
+	static void AdvanceAxis(double& location, double& speed, double low, double high, double duration);
+
+	/// Get the velocity of the fish
+	/// \param speedX Receives the speed in the X direction
+	/// \param speedY Receives the speed in the Y direction
+	virtual void GetVelocity(double& speedX, double& speedY) override { speedX = mSpeedX; speedY = mSpeedY; }
+
 protected:
 	/// Constructor
 	CFish(CAquarium* aquarium, const std::wstring& filename);
@@ -48,6 +72,10 @@ protected:
 	/// Sets the minimum speed of the fish in the Y direction
 	void SetMinSpeedY(double speedY) { mMinSpeedY = speedY; }
 
+	/// Sets the species the fish schools with
+	/// \param species Species of the fish
+	void SetSpecies(CSchooling::Species species) { mSpecies = species; }
+
 private:
 	/// Fish speed in the X direction
 	double mSpeedX;
@@ -60,5 +88,8 @@ private:
 
 	/// Minimum speed for each fish in Y direction
 	double mMinSpeedY = 0;
+
+	/// Species the fish schools with
+	CSchooling::Species mSpecies = CSchooling::Other;
 };
 
@@ -27,11 +27,9 @@ const double ImageWidth = 125;
 /// Height of the image
 const double ImageHeight = 117;
 
-/// Minimum speed of Beta fish in X direction
-const double MinSpeedX = 100;
+const double CFishBeta::MinSpeedX = 100;
 
-/// Minimum speed of Beta fish in Y direction
-const double MinSpeedY = 10;
+const double CFishBeta::MinSpeedY = 10;
 
 /** Constructor
  * \param aquarium The aquarium this is a member of
@@ -48,6 +46,11 @@ CFishBeta::CFishBeta(CAquarium* aquarium) :
 	// Sets the minimum speed member variables
 	SetMinSpeedX(MinSpeedX);
 	SetMinSpeedY(MinSpeedY);
+
+	// Schools with the other beta fish
+	SetSpecies(CSchooling::Beta);
+
+	Count(this);
 }
 
 /**
@@ -59,7 +62,7 @@ CFishBeta::XmlSave(const std::shared_ptr<xmlnode::CXmlNode>& node)
 {
 	auto itemNode = CFish::XmlSave(node);
 
-	itemNode->SetAttribute(L"type", L"beta");
+	itemNode->SetAttribute(L"type", GetType());
 
 	return itemNode;
 }
\ No newline at end of file
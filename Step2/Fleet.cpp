@@ -0,0 +1,188 @@
+/**
+ * \file Fleet.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the fleet of aquariums.
+ */
+
+#include "pch.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <functional>
+#include <iomanip>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include "Fleet.h"
+#include "Aquarium.h"
+
+using namespace std;
+using namespace std::chrono;
+
+/**
+ * Constructor
+ * \param threads Number of worker threads, 0 for one per core
+ */
+CFleet::CFleet(int threads) : mPool(threads)
+{
+}
+
+/**
+ * Add a tank to the fleet
+ * \param tank Aquarium to run
+ * \param tickRate Ticks per second of simulated time
+ * \returns Index of the tank
+ */
+int CFleet::AddTank(std::shared_ptr<CAquarium> tank, double tickRate)
+{
+	mTanks.push_back(Tank{ tank, tickRate, TankStats() });
+	return (int)mTanks.size() - 1;
+}
+
+/**
+ * Run every tank for a span of simulated time.
+ *
+ * Tick k of a tank is due k / rate seconds after the start. The tick
+ * due soonest is always handed to the pool first, and no more ticks
+ * are in flight than there are workers, so every tank advances at
+ * its own rate even when the fleet is overloaded.
+ * \param seconds Simulated seconds to run each tank
+ * \param realTime If true ticks wait until they are due, otherwise
+ * they run as fast as the pool allows
+ */
+void CFleet::Run(double seconds, bool realTime)
+{
+	typedef pair<double, int> Due;
+	priority_queue<Due, vector<Due>, greater<Due>> ready;
+
+	vector<long long> ticks(mTanks.size(), 0);
+	vector<long long> limit(mTanks.size(), 0);
+	for (size_t i = 0; i < mTanks.size(); i++)
+	{
+		limit[i] = (long long)floor(seconds * mTanks[i].mTickRate + 1e-9);
+		if (limit[i] > 0)
+		{
+			ready.push(Due(0, (int)i));
+		}
+	}
+
+	mutex access;
+	condition_variable done;
+	int inFlight = 0;
+	int maxInFlight = mPool.GetNumThreads();
+
+	auto start = steady_clock::now();
+
+	unique_lock<mutex> guard(access);
+	while (!ready.empty() || inFlight > 0)
+	{
+		if (ready.empty() || inFlight >= maxInFlight)
+		{
+			done.wait(guard);
+			continue;
+		}
+
+		double due = ready.top().first;
+		if (realTime)
+		{
+			auto dueTime = start + duration_cast<steady_clock::duration>(duration<double>(due));
+			if (steady_clock::now() < dueTime)
+			{
+				// Woken early by a finished tick, which may have
+				// queued an earlier one
+				done.wait_until(guard, dueTime);
+				continue;
+			}
+		}
+
+		int index = ready.top().second;
+		ready.pop();
+		inFlight++;
+
+		mPool.Submit([this, index, due, realTime, start, &ticks, &limit, &ready, &access, &done, &inFlight]() {
+			Tank& tank = mTanks[index];
+			double period = 1.0 / tank.mTickRate;
+
+			auto tickStart = steady_clock::now();
+			tank.mAquarium->Update(period);
+			auto tickEnd = steady_clock::now();
+
+			double busy = duration<double>(tickEnd - tickStart).count();
+			double started = duration<double>(tickStart - start).count();
+
+			lock_guard<mutex> guard(access);
+			tank.mStats.mTicks++;
+			tank.mStats.mBusySeconds += busy;
+			tank.mStats.mMaxTickSeconds = max(tank.mStats.mMaxTickSeconds, busy);
+			if (realTime && started > due + period)
+			{
+				tank.mStats.mLateTicks++;
+			}
+
+			if (++ticks[index] < limit[index])
+			{
+				ready.push(Due(ticks[index] * period, index));
+			}
+
+			inFlight--;
+			done.notify_one();
+		});
+	}
+
+	// The last task may still be leaving its lock
+	guard.unlock();
+	mPool.Wait();
+}
+
+/**
+ * Get how many tanks one core can keep up with.
+ *
+ * Based on the average time a tick has taken across the whole fleet.
+ * \param tickRate Ticks per second each tank needs
+ * \returns Tanks per core, 0 if nothing has run yet
+ */
+double CFleet::GetTanksPerCore(double tickRate) const
+{
+	long long ticks = 0;
+	double busy = 0;
+	for (auto& tank : mTanks)
+	{
+		ticks += tank.mStats.mTicks;
+		busy += tank.mStats.mBusySeconds;
+	}
+
+	if (ticks == 0 || busy <= 0)
+	{
+		return 0;
+	}
+
+	return 1.0 / (tickRate * busy / ticks);
+}
+
+/**
+ * Make a text report of what every tank has cost
+ * \param tickRate Ticks per second the capacity estimate is for
+ * \returns Report text
+ */
+std::wstring CFleet::Report(double tickRate) const
+{
+	wstringstream out;
+	out << mTanks.size() << L" tanks on " << mPool.GetNumThreads() << L" threads, "
+		<< mPool.GetSteals() << L" steals" << endl;
+
+	out << fixed << setprecision(3);
+	for (size_t i = 0; i < mTanks.size(); i++)
+	{
+		auto& stats = mTanks[i].mStats;
+		double average = stats.mTicks > 0 ? stats.mBusySeconds / stats.mTicks : 0;
+		out << L"Tank " << i << L": " << mTanks[i].mTickRate << L" Hz, " << stats.mTicks << L" ticks, cpu "
+			<< stats.mBusySeconds * 1000 << L" ms, avg " << average * 1e6 << L" us, max "
+			<< stats.mMaxTickSeconds * 1e6 << L" us, " << stats.mLateTicks << L" late" << endl;
+	}
+
+	out << L"Tanks per core at " << tickRate << L" Hz: " << GetTanksPerCore(tickRate) << endl;
+	return out.str();
+}
@@ -0,0 +1,85 @@
+/**
+ * \file Fleet.h
+ *
+ * \author Grant Youngs
+ *
+ * Class that runs many aquariums in one process.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "ThreadPool.h"
+
+class CAquarium;
+
+
+/**
+ * A fleet of independent aquariums ticked on a shared thread pool.
+ *
+ * Every tank has its own tick rate. Ticks are handed to the pool
+ * earliest deadline first, at most one at a time per tank, so a slow
+ * or fast tank cannot starve the others. Sprites are shared by every
+ * tank through the sprite cache.
+ */
+class CFleet
+{
+public:
+	/** What a tank has cost so far */
+	struct TankStats
+	{
+		long long mTicks = 0;           ///< Ticks run
+		double mBusySeconds = 0;        ///< Time spent running ticks
+		double mMaxTickSeconds = 0;     ///< Longest single tick
+		long long mLateTicks = 0;       ///< Ticks started more than a tick period late
+	};
+
+	CFleet(int threads = 0);
+
+	/// Copy constructor (disabled)
+	CFleet(const CFleet&) = delete;
+
+	int AddTank(std::shared_ptr<CAquarium> tank, double tickRate);
+
+	void Run(double seconds, bool realTime);
+
+	/// Get a tank
+	/// \param index Index returned by AddTank
+	/// \returns The aquarium
+	std::shared_ptr<CAquarium> GetTank(int index) const { return mTanks[index].mAquarium; }
+
+	/// Get the statistics of a tank
+	/// \param index Index returned by AddTank
+	/// \returns Statistics so far
+	const TankStats& GetStats(int index) const { return mTanks[index].mStats; }
+
+	/// Get the number of tanks
+	/// \returns Number of tanks
+	int GetNumTanks() const { return (int)mTanks.size(); }
+
+	/// Get the pool the tanks are ticked on
+	/// \returns Thread pool
+	CThreadPool& GetPool() { return mPool; }
+
+	double GetTanksPerCore(double tickRate) const;
+
+	std::wstring Report(double tickRate) const;
+
+private:
+	/** A tank in the fleet */
+	struct Tank
+	{
+		std::shared_ptr<CAquarium> mAquarium;   ///< The aquarium
+		double mTickRate;                       ///< Ticks per second
+		TankStats mStats;                       ///< What the tank has cost
+	};
+
+	/// The tanks
+	std::vector<Tank> mTanks;
+
+	/// Pool the ticks run on
+	CThreadPool mPool;
+};
+
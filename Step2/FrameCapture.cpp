@@ -0,0 +1,303 @@
+/**
+ * \file FrameCapture.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements headless frame capture.
+ */
+
+#include "pch.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include "FrameCapture.h"
+#include "Aquarium.h"
+#include "SpriteCache.h"
+#include "TraceLog.h"
+
+using namespace Gdiplus;
+using namespace std;
+
+/// Frame buffers beyond one per encoding thread, so drawing
+/// does not wait for the encoder to pick up the last frame
+const int ExtraFrames = 2;
+
+/// Color outside the aquarium world
+const Color CaptureBackground(0, 0, 0);
+
+/**
+ * Constructor
+ *
+ * Y4M video subsamples color by 2 in each direction, so odd sizes
+ * are rounded down to even.
+ * \param width Frame width in pixels
+ * \param height Frame height in pixels
+ * \param fps Frames per second of aquarium time
+ * \param threads Number of encoding threads, 0 for one per core
+ */
+CFrameCapture::CFrameCapture(int width, int height, double fps, int threads) :
+	mWidth(max(2, width & ~1)), mHeight(max(2, height & ~1)), mFps(fps), mPool(threads)
+{
+	int count = mPool.GetNumThreads() + ExtraFrames;
+	for (int i = 0; i < count; i++)
+	{
+		auto frame = make_unique<Frame>();
+		frame->mPixels.resize((size_t)mWidth * mHeight);
+		frame->mImage = make_unique<Bitmap>(mWidth, mHeight, mWidth * 4, PixelFormat32bppPARGB,
+			(BYTE*)frame->mPixels.data());
+		mFree.push_back(frame.get());
+		mFrames.push_back(move(frame));
+	}
+}
+
+/**
+ * Destructor. Waits for any frame still being encoded.
+ */
+CFrameCapture::~CFrameCapture()
+{
+	mPool.Wait();
+}
+
+/**
+ * Get a camera that shows the whole aquarium world in a frame,
+ * centered, without stretching it
+ * \param aquarium Aquarium to show
+ * \returns Camera
+ */
+CCamera CFrameCapture::FitCamera(CAquarium* aquarium) const
+{
+	double worldWidth = max(1, aquarium->GetWidth());
+	double worldHeight = max(1, aquarium->GetHeight());
+	double zoom = min(mWidth / worldWidth, mHeight / worldHeight);
+
+	CCamera camera;
+	camera.SetZoom(zoom);
+	zoom = camera.GetZoom();
+	camera.SetLocation((worldWidth - mWidth / zoom) / 2, (worldHeight - mHeight / zoom) / 2);
+	return camera;
+}
+
+/**
+ * Get the file a frame of a PNG sequence is written to
+ * \param path Path of the sequence, such as clip.png
+ * \param frame Frame number
+ * \returns Frame file, such as clip00012.png
+ */
+std::wstring CFrameCapture::GetFrameName(const std::wstring& path, int frame)
+{
+	wstring prefix = path;
+	if (prefix.size() >= 4 && prefix.compare(prefix.size() - 4, 4, L".png") == 0)
+	{
+		prefix.resize(prefix.size() - 4);
+	}
+
+	wstringstream name;
+	name << prefix << setw(5) << setfill(L'0') << frame << L".png";
+	return name.str();
+}
+
+/**
+ * Render frames of an aquarium and write them to a file.
+ *
+ * Each frame shows the aquarium at the current time, after which
+ * it is advanced by one frame time.
+ * \param aquarium Aquarium to capture
+ * \param camera Camera to look through
+ * \param frames Number of frames
+ * \param format Png for a numbered PNG sequence, Y4m for one raw video file
+ * \param path Video file, or the name the PNG frame numbers are added to
+ * \returns True if every frame was written
+ */
+bool CFrameCapture::Capture(CAquarium* aquarium, const CCamera& camera, int frames, Format format, const std::wstring& path)
+{
+	AQUA_TRACE_SCOPE("Capture");
+
+	mFormat = format;
+	mPath = path;
+	mFramesWritten = 0;
+	mFailed = false;
+	mNextWrite = 0;
+	mWaiting.clear();
+	mDrawSeconds = 0;
+
+	if (format == Png && !CSpriteCache::GetEncoderClsid(L"image/png", &mPng))
+	{
+		return false;
+	}
+
+	if (format == Y4m)
+	{
+		mOut.open(path, ios::binary | ios::trunc);
+		if (!mOut)
+		{
+			return false;
+		}
+
+		// Frame rate as a fraction with millisecond precision
+		mOut << "YUV4MPEG2 W" << mWidth << " H" << mHeight << " F" << (long long)llround(mFps * 1000)
+			<< ":1000 Ip A1:1 C420jpeg\n";
+	}
+
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i < frames; i++)
+	{
+		Frame* frame;
+		{
+			unique_lock<mutex> lock(mMutex);
+			mReleased.wait(lock, [this]() { return !mFree.empty(); });
+			frame = mFree.back();
+			mFree.pop_back();
+		}
+
+		auto drawStart = chrono::steady_clock::now();
+		{
+			Graphics graphics(frame->mImage.get());
+			graphics.Clear(CaptureBackground);
+			aquarium->OnDraw(&graphics, camera, mWidth, mHeight);
+		}
+		mDrawSeconds += chrono::duration<double>(chrono::steady_clock::now() - drawStart).count();
+
+		// The frame encodes while the next one is drawn
+		frame->mIndex = i;
+		mPool.Submit([this, frame]() { Encode(frame); });
+
+		aquarium->Update(1 / mFps);
+	}
+
+	mPool.Wait();
+	if (format == Y4m)
+	{
+		mOut.close();
+	}
+
+	mSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	return !mFailed && mFramesWritten == frames;
+}
+
+/**
+ * Encode a drawn frame on a worker thread and write it out
+ * \param frame Frame to encode
+ */
+void CFrameCapture::Encode(Frame* frame)
+{
+	AQUA_TRACE_SCOPE("EncodeFrame");
+
+	if (mFormat == Png)
+	{
+		auto name = GetFrameName(mPath, frame->mIndex);
+		if (frame->mImage->Save(name.c_str(), &mPng, nullptr) != Ok)
+		{
+			mFailed = true;
+		}
+
+		Release(frame);
+		mFramesWritten++;
+		return;
+	}
+
+	vector<uint8_t> yuv((size_t)mWidth * mHeight * 3 / 2);
+	ToYuv420(frame->mPixels.data(), mWidth, mHeight, mWidth, yuv.data());
+	int index = frame->mIndex;
+	Release(frame);
+	Write(index, move(yuv));
+}
+
+/**
+ * Give a frame buffer back for drawing
+ * \param frame Frame buffer
+ */
+void CFrameCapture::Release(Frame* frame)
+{
+	{
+		lock_guard<mutex> lock(mMutex);
+		mFree.push_back(frame);
+	}
+
+	mReleased.notify_one();
+}
+
+/**
+ * Write an encoded Y4M frame, and any frames after it that were
+ * encoded first and are waiting for it
+ * \param index Frame number
+ * \param yuv Encoded frame
+ */
+void CFrameCapture::Write(int index, std::vector<uint8_t>&& yuv)
+{
+	lock_guard<mutex> lock(mWriteMutex);
+	mWaiting[index] = move(yuv);
+
+	for (auto next = mWaiting.find(mNextWrite); next != mWaiting.end(); next = mWaiting.find(mNextWrite))
+	{
+		mOut << "FRAME\n";
+		mOut.write((const char*)next->second.data(), next->second.size());
+		if (!mOut)
+		{
+			mFailed = true;
+		}
+
+		mWaiting.erase(next);
+		mNextWrite++;
+		mFramesWritten++;
+	}
+}
+
+/**
+ * Get how many times faster than real time the last capture ran
+ * \returns Seconds of aquarium time per second of capture
+ */
+double CFrameCapture::GetSpeedup() const
+{
+	return mSeconds > 0 ? mFramesWritten / mFps / mSeconds : 0;
+}
+
+/**
+ * Convert opaque pixels to planar YUV 4:2:0 with full range
+ * BT.601 coefficients, as Y4M C420jpeg expects.
+ *
+ * The Y plane is followed by the Cb and Cr planes at half the width
+ * and height, each sample taken from the average of a 2x2 block.
+ * \param pixels First row of ARGB pixels
+ * \param width Width in pixels, even
+ * \param height Height in pixels, even
+ * \param stride Pixels from one row to the next
+ * \param yuv Receives width * height * 3 / 2 bytes
+ */
+void CFrameCapture::ToYuv420(const uint32_t* pixels, int width, int height, int stride, uint8_t* yuv)
+{
+	uint8_t* yPlane = yuv;
+	uint8_t* cbPlane = yuv + (size_t)width * height;
+	uint8_t* crPlane = cbPlane + (size_t)(width / 2) * (height / 2);
+
+	for (int y = 0; y < height; y += 2)
+	{
+		const uint32_t* rows[2] = { pixels + (size_t)y * stride, pixels + (size_t)(y + 1) * stride };
+		for (int x = 0; x < width; x += 2)
+		{
+			int sumR = 0, sumG = 0, sumB = 0;
+			for (int dy = 0; dy < 2; dy++)
+			{
+				for (int dx = 0; dx < 2; dx++)
+				{
+					uint32_t pixel = rows[dy][x + dx];
+					int r = (pixel >> 16) & 0xff;
+					int g = (pixel >> 8) & 0xff;
+					int b = pixel & 0xff;
+					yPlane[(size_t)(y + dy) * width + x + dx] = (uint8_t)((77 * r + 150 * g + 29 * b + 128) >> 8);
+					sumR += r;
+					sumG += g;
+					sumB += b;
+				}
+			}
+
+			int r = (sumR + 2) >> 2;
+			int g = (sumG + 2) >> 2;
+			int b = (sumB + 2) >> 2;
+			size_t chroma = (size_t)(y / 2) * (width / 2) + x / 2;
+			cbPlane[chroma] = (uint8_t)min(255, (-43 * r - 85 * g + 128 * b + 32896) >> 8);
+			crPlane[chroma] = (uint8_t)min(255, (128 * r - 107 * g - 21 * b + 32896) >> 8);
+		}
+	}
+}
@@ -0,0 +1,142 @@
+/**
+ * \file FrameCapture.h
+ *
+ * \author Grant Youngs
+ *
+ * Class that renders an aquarium to image files without a window.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Camera.h"
+#include "ThreadPool.h"
+
+class CAquarium;
+
+
+/**
+ * Renders an aquarium frame by frame at a fixed time step and size,
+ * and writes the frames as a PNG sequence or a raw Y4M video.
+ *
+ * Frames are drawn into offscreen bitmaps, so no window is needed
+ * and the capture runs as fast as the machine allows. Drawing and
+ * encoding are pipelined: while frame N is encoded on the worker
+ * pool, frame N+1 is already being drawn. A few frame buffers are
+ * recycled between the two, and drawing waits when every buffer is
+ * still being encoded. Y4M frames may finish encoding out of order
+ * and are written in order as they become ready.
+ */
+class CFrameCapture
+{
+public:
+	/** Output formats */
+	enum Format { Png, Y4m };
+
+	CFrameCapture(int width, int height, double fps, int threads = 0);
+	virtual ~CFrameCapture();
+
+	/// Copy constructor (disabled)
+	CFrameCapture(const CFrameCapture&) = delete;
+
+	bool Capture(CAquarium* aquarium, const CCamera& camera, int frames, Format format, const std::wstring& path);
+
+	CCamera FitCamera(CAquarium* aquarium) const;
+
+	static std::wstring GetFrameName(const std::wstring& path, int frame);
+
+	static void ToYuv420(const uint32_t* pixels, int width, int height, int stride, uint8_t* yuv);
+
+	/// Get the width of a frame
+	/// \returns Width in pixels
+	int GetWidth() const { return mWidth; }
+
+	/// Get the height of a frame
+	/// \returns Height in pixels
+	int GetHeight() const { return mHeight; }
+
+	/// Get the number of frames written by the last capture
+	/// \returns Number of frames
+	int GetNumFrames() const { return mFramesWritten; }
+
+	/// Get how long the last capture took
+	/// \returns Wall clock seconds
+	double GetSeconds() const { return mSeconds; }
+
+	/// Get how long the last capture spent drawing
+	/// \returns Seconds on the drawing thread
+	double GetDrawSeconds() const { return mDrawSeconds; }
+
+	double GetSpeedup() const;
+
+private:
+	/** A frame buffer and a bitmap drawing into it */
+	struct Frame
+	{
+		int mIndex = 0;                             ///< Frame number
+		std::vector<uint32_t> mPixels;              ///< Premultiplied ARGB rows
+		std::unique_ptr<Gdiplus::Bitmap> mImage;    ///< Bitmap over the pixels
+	};
+
+	void Encode(Frame* frame);
+	void Release(Frame* frame);
+	void Write(int index, std::vector<uint8_t>&& yuv);
+
+	int mWidth;     ///< Frame width in pixels
+	int mHeight;    ///< Frame height in pixels
+	double mFps;    ///< Frames per second of aquarium time
+
+	/// Format of the capture in progress
+	Format mFormat = Png;
+
+	/// Path of the capture in progress
+	std::wstring mPath;
+
+	/// PNG encoder
+	CLSID mPng;
+
+	/// Every frame buffer
+	std::vector<std::unique_ptr<Frame>> mFrames;
+
+	/// Frame buffers not being drawn or encoded
+	std::vector<Frame*> mFree;
+
+	/// Protects the free buffers
+	std::mutex mMutex;
+
+	/// Signaled when a buffer is released
+	std::condition_variable mReleased;
+
+	/// Y4M output stream
+	std::ofstream mOut;
+
+	/// Protects the output stream and the frames waiting for it
+	std::mutex mWriteMutex;
+
+	/// Encoded Y4M frames waiting for the frames before them
+	std::map<int, std::vector<uint8_t>> mWaiting;
+
+	/// Next Y4M frame to write
+	int mNextWrite = 0;
+
+	/// Frames written so far
+	std::atomic<int> mFramesWritten{ 0 };
+
+	/// True if any frame failed to encode or write
+	std::atomic<bool> mFailed{ false };
+
+	double mSeconds = 0;        ///< Wall clock time of the last capture
+	double mDrawSeconds = 0;    ///< Drawing time of the last capture
+
+	/// Encoding workers. Declared last so it is destroyed first.
+	CThreadPool mPool;
+};
+
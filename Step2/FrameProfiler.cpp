@@ -0,0 +1,165 @@
+/**
+ * \file FrameProfiler.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the per-phase frame profiler.
+ */
+
+#include "pch.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include "FrameProfiler.h"
+
+using namespace Gdiplus;
+using namespace std;
+
+/// Names of the phases for the overlay and CSV export
+const wchar_t* PhaseNames[] = { L"Background", L"Text", L"Items", L"Update", L"Nudge", L"Input" };
+
+/// Left edge of the overlay in pixels
+const float OverlayX = 10;
+
+/// Top edge of the overlay in pixels
+const float OverlayY = 30;
+
+/// Height of one overlay line in pixels
+const float OverlayLineHeight = 16;
+
+/// Width of the overlay in pixels
+const float OverlayWidth = 330;
+
+/// Ring size definition for uses that need its address
+const int CFrameProfiler::RingSize;
+
+/**
+ * Constructor
+ */
+CFrameProfiler::CFrameProfiler()
+{
+}
+
+/**
+ * Get the display name of a phase
+ * \param phase Phase to name
+ * \returns Phase name
+ */
+const wchar_t* CFrameProfiler::GetPhaseName(Phase phase)
+{
+	return PhaseNames[phase];
+}
+
+/**
+ * Record one sample for a phase.
+ *
+ * Must only be called from the thread that runs the phase.
+ * \param phase Phase the sample belongs to
+ * \param milliseconds Duration of the phase
+ */
+void CFrameProfiler::AddSample(Phase phase, double milliseconds)
+{
+	auto& ring = mRings[phase];
+	unsigned written = ring.mWritten.load(memory_order_relaxed);
+	ring.mSamples[written % RingSize] = milliseconds;
+	ring.mWritten.store(written + 1, memory_order_release);
+}
+
+/**
+ * Compute rolling statistics over the samples in a phase ring.
+ * \param phase Phase to compute statistics for
+ * \returns Statistics in milliseconds
+ */
+CFrameProfiler::Stats CFrameProfiler::GetStats(Phase phase) const
+{
+	auto& ring = mRings[phase];
+	unsigned written = ring.mWritten.load(memory_order_acquire);
+	int count = (int)min<unsigned>(written, RingSize);
+
+	Stats stats;
+	stats.mCount = count;
+	if (count == 0)
+	{
+		return stats;
+	}
+
+	vector<double> samples(ring.mSamples, ring.mSamples + count);
+
+	double sum = 0;
+	for (auto s : samples)
+	{
+		sum += s;
+	}
+
+	stats.mAvg = sum / count;
+	stats.mMin = *min_element(samples.begin(), samples.end());
+
+	auto p99 = samples.begin() + (count - 1) * 99 / 100;
+	nth_element(samples.begin(), p99, samples.end());
+	stats.mP99 = *p99;
+
+	return stats;
+}
+
+/**
+ * Draw the phase statistics over the aquarium.
+ * \param graphics The GDI+ graphics context to draw on
+ */
+void CFrameProfiler::DrawOverlay(Gdiplus::Graphics* graphics)
+{
+	SolidBrush background(Color(160, 0, 0, 0));
+	graphics->FillRectangle(&background, OverlayX, OverlayY, OverlayWidth,
+		OverlayLineHeight * (NumPhases + 1) + 4);
+
+	FontFamily fontFamily(L"Consolas");
+	Gdiplus::Font font(&fontFamily, 11);
+	SolidBrush white(Color(255, 255, 255));
+
+	graphics->DrawString(L"Phase        min ms   avg ms   p99 ms", -1, &font,
+		PointF(OverlayX + 4, OverlayY + 2), &white);
+
+	for (int p = 0; p < NumPhases; p++)
+	{
+		auto stats = GetStats(Phase(p));
+
+		wstringstream line;
+		line << left << setw(10) << PhaseNames[p] << right << fixed << setprecision(3)
+			<< setw(9) << stats.mMin << setw(9) << stats.mAvg << setw(9) << stats.mP99;
+
+		graphics->DrawString(line.str().c_str(), -1, &font,
+			PointF(OverlayX + 4, OverlayY + 2 + OverlayLineHeight * (p + 1)), &white);
+	}
+}
+
+/**
+ * Save the contents of every ring as CSV.
+ *
+ * Rows are written oldest sample first for each phase.
+ * \param filename File to write
+ * \returns true if the file was written
+ */
+bool CFrameProfiler::SaveCsv(const std::wstring& filename) const
+{
+	wofstream out(filename);
+	if (!out)
+	{
+		return false;
+	}
+
+	out << L"phase,sample,milliseconds" << endl;
+	for (int p = 0; p < NumPhases; p++)
+	{
+		auto& ring = mRings[p];
+		unsigned written = ring.mWritten.load(memory_order_acquire);
+		unsigned first = written > RingSize ? written - RingSize : 0;
+
+		for (unsigned i = first; i < written; i++)
+		{
+			out << PhaseNames[p] << L"," << i << L"," << ring.mSamples[i % RingSize] << endl;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,121 @@
+/**
+ * \file FrameProfiler.h
+ *
+ * \author Grant Youngs
+ *
+ * Class that times the phases of each frame and draws the results.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+
+/**
+ * Per-phase frame profiler.
+ *
+ * Each phase keeps its most recent samples in a ring buffer. The
+ * only writer of a ring is the thread that runs that phase, which
+ * publishes samples with an atomic index, so recording never takes
+ * a lock. When profiling is disabled a timer costs one branch.
+ */
+class CFrameProfiler
+{
+public:
+	/** The phases we time */
+	enum Phase { Background, Text, Items, Update, Nudge, Input, NumPhases };
+
+	/// Number of samples kept for each phase
+	static const int RingSize = 256;
+
+	/** Rolling statistics for one phase, in milliseconds */
+	struct Stats
+	{
+		double mMin = 0;    ///< Fastest sample
+		double mAvg = 0;    ///< Mean of the samples
+		double mP99 = 0;    ///< 99th percentile sample
+		int mCount = 0;     ///< Number of samples in the ring
+	};
+
+	CFrameProfiler();
+
+	/// Destructor
+	virtual ~CFrameProfiler() {}
+
+	/// Is profiling enabled?
+	/// \returns true if samples are being recorded
+	bool IsEnabled() const { return mEnabled; }
+
+	/// Enable or disable profiling
+	/// \param enabled New enabled state
+	void SetEnabled(bool enabled) { mEnabled = enabled; }
+
+	void AddSample(Phase phase, double milliseconds);
+
+	Stats GetStats(Phase phase) const;
+
+	static const wchar_t* GetPhaseName(Phase phase);
+
+	void DrawOverlay(Gdiplus::Graphics* graphics);
+
+	bool SaveCsv(const std::wstring& filename) const;
+
+private:
+	/** Ring of samples for one phase */
+	struct Ring
+	{
+		double mSamples[RingSize] = {};           ///< Sample storage
+		std::atomic<unsigned> mWritten{ 0 };     ///< Total samples ever written
+	};
+
+	/// True when samples are recorded. Set from the UI thread and
+	/// read by timers on worker threads.
+	std::atomic<bool> mEnabled{ false };
+
+	/// One ring per phase
+	Ring mRings[NumPhases];
+};
+
+
+/**
+ * Times a scope and adds the time to a frame profiler phase.
+ */
+class CProfileTimer
+{
+public:
+	/** Constructor
+	 * \param profiler Profiler to add the sample to
+	 * \param phase Phase being timed */
+	CProfileTimer(CFrameProfiler& profiler, CFrameProfiler::Phase phase) :
+		mProfiler(profiler), mPhase(phase), mEnabled(profiler.IsEnabled())
+	{
+		if (mEnabled)
+		{
+			mStart = std::chrono::steady_clock::now();
+		}
+	}
+
+	/// Destructor, records the sample
+	~CProfileTimer()
+	{
+		if (mEnabled)
+		{
+			auto end = std::chrono::steady_clock::now();
+			mProfiler.AddSample(mPhase, std::chrono::duration<double, std::milli>(end - mStart).count());
+		}
+	}
+
+	/// Copy constructor (disabled)
+	CProfileTimer(const CProfileTimer&) = delete;
+
+private:
+	CFrameProfiler& mProfiler;      ///< Profiler we report to
+	CFrameProfiler::Phase mPhase;   ///< Phase we time
+	bool mEnabled;                  ///< Profiling state when the scope began
+
+	/// Time the scope began
+	std::chrono::steady_clock::time_point mStart;
+};
+
@@ -10,6 +10,10 @@
 #include "Item.h"
 #include "Aquarium.h"
 #include "XmlNode.h"
+#include "MemoryAccounting.h"
+#include "SpriteAtlas.h"
+#include "SpriteBatch.h"
+#include "Nudge.h"
 
 using namespace Gdiplus;
 using namespace std;
@@ -20,13 +24,18 @@ using namespace std;
 CItem::CItem(CAquarium* aquarium, const std::wstring &filename) :
 	mAquarium(aquarium)
 {
-	mItemImage = unique_ptr<Bitmap>(Bitmap::FromFile(filename.c_str()));
-	if (mItemImage->GetLastStatus() != Ok)
+	// Items of the same type share one sprite in the atlas
+	mSprite = CSpriteAtlas::Get().Find(filename);
+	if (mSprite->mImage == nullptr)
 	{
 		wstring msg(L"Failed to open ");
 		msg += filename;
 		AfxMessageBox(msg.c_str());
 	}
+
+	// Derived classes that know their size set it themselves
+	mImageWidth = mSprite->mWidth;
+	mImageHeight = mSprite->mHeight;
 }
 
 /**
@@ -34,7 +43,28 @@ CItem::CItem(CAquarium* aquarium, const std::wstring &filename) :
  */
 CItem::~CItem()
 {
+	if (mCounter != nullptr)
+	{
+		mCounter->Remove();
+	}
+}
+
+/**
+ * Account this item to the live items of a type.
+ *
+ * A class derived from a concrete item class counts its items as
+ * its own type, so any earlier count is moved.
+ * \param counter Counter of the item type
+ */
+void CItem::Count(CItemCounter* counter)
+{
+	if (mCounter != nullptr)
+	{
+		mCounter->Remove();
+	}
 
+	mCounter = counter;
+	mCounter->Add();
 }
 
 /**
@@ -44,60 +74,68 @@ CItem::~CItem()
  */
 void CItem::UpdatePosition(double stinkyX, double stinkyY) 
 {
-	/// Maximum allowed X value
-	const double MaxX = 950;
-
-	/// Minimum allowed X value
-	const double MinX = 100;
-
-	/// Maximum allowed Y value
-	const double MaxY = 750;
-
-	/// Minimum allowed Y value
-	const double MinY = 50;
-
-	/// Minimum distance from a nudging fish
-	const double MinDistance = 200;
-
-	// fishX, fishY is the position of a fish
-    // stinkyX, stinkyY is the position of the stinky 
-	double fishX = mX;
-	double fishY = mY;
-
-    // Create a vector in the direction we are from the nudger
-    double dx = fishX - stinkyX;
-    double dy = fishY - stinkyY;
-
-    // Determine how far away we are
-    double distance = sqrt(dx * dx + dy * dy);
-    if (distance > 0 && distance < MinDistance)
-    {
-        // Distance is less than our minimum
-        dx *= MinDistance / distance;
-        dy *= MinDistance / distance;
-
-        fishX = stinkyX + dx;
-        fishY = stinkyY + dy;
-
-		if (fishX > MaxX)
-		{
-			fishX = MaxX;
-		}
-		if (fishX < MinX)
-		{
-			fishX = MinX;
-		}
-		if (fishY > MaxY)
-		{
-			fishY = MaxY;
-		}
-		if (fishY < MinY)
-		{
-			fishY = MinY;
-		}
-
-		CItem::SetLocation(fishX, fishY);
-    }
+	double minX, maxX, minY, maxY;
+	GetBounds(minX, maxX, minY, maxY);
+
+	double x = mX;
+	double y = mY;
+	unsigned char moved = 0;
+
+	CNudge::Batch batch = { &x, &y, &minX, &maxX, &minY, &maxY, &moved, 1 };
+	CNudge::Repeller stinky = { stinkyX, stinkyY, CNudge::DefaultDistance };
+	if (CNudge::KernelScalar(batch, 0, 1, stinky))
+	{
+		CItem::SetLocation(x, y);
+	}
+}
+
+/**
+ * Get the range of locations the item is kept in.
+ *
+ * The image stays inside the tank, 10 pixels from the edges. Fish
+ * turn around at these locations.
+ * \param minX Receives the smallest X location
+ * \param maxX Receives the largest X location
+ * \param minY Receives the smallest Y location
+ * \param maxY Receives the largest Y location
+ */
+void CItem::GetBounds(double& minX, double& maxX, double& minY, double& maxY)
+{
+	minX = 10 + mImageWidth / 2;
+	maxX = mAquarium->GetWidth() - 10 - mImageWidth / 2;
+	minY = 10 + mImageHeight / 2;
+	maxY = mAquarium->GetHeight() - 10 - mImageHeight / 2;
+}
+
+/**
+ * Set the item location
+ *
+ * The aquarium is told, so it can keep its spatial index current.
+ * \param x X location
+ * \param y Y location
+ */
+void CItem::SetLocation(double x, double y)
+{
+	mX = x;
+	mY = y;
+	mAquarium->OnItemMoved(this);
+}
+
+/**
+ * Bring the item up to an aquarium time.
+ *
+ * Used by event driven updates, where items are only advanced
+ * when they are drawn or their next event is due.
+ * \param time Aquarium time in seconds
+ */
+void CItem::SyncTo(double time)
+{
+	if (time > mSyncTime)
+	{
+		FastForward(time - mSyncTime);
+	}
+
+	mSyncTime = time;
 }
 
 /**
@@ -108,8 +146,22 @@ void CItem::UpdatePosition(double stinkyX, double stinkyY)
  */
 bool CItem::HitTest(int x, int y)
 {
-	double wid = mItemImage->GetWidth();
-	double hit = mItemImage->GetHeight();
+	return HitTest(GetAlphaMask().get(), x, y);
+}
+
+/**
+ * Test to see if a location is on this object, with an alpha mask
+ * already fetched. Nothing is locked, so callers testing many
+ * locations fetch the mask once.
+ * \param mask Alpha mask of our image from GetAlphaMask
+ * \param x X position to test
+ * \param y Y position to test
+ * \return true if hit.
+ */
+bool CItem::HitTest(const CSpriteAtlas::AlphaMask* mask, int x, int y) const
+{
+	double wid = mSprite->mWidth;
+	double hit = mSprite->mHeight;
 
 	// Make x and y relative to the top-left corner of the bitmap image.
 	// Subtracting the center makes x, y relative to the center of 
@@ -125,21 +177,16 @@ bool CItem::HitTest(int x, int y)
 		return false;
 	}
 
-	// Test to see if x, y are in the drawn part of the image
-	auto format = mItemImage->GetPixelFormat();
-	if (format == PixelFormat32bppARGB || format == PixelFormat32bppPARGB)
+	// Test to see if x, y are in the drawn part of the image. Opaque
+	// images, and images still loading, hit over their whole box.
+	if (mask == nullptr)
 	{
-		// This image has an alpha map, which implements the 
-		// transparency. If so, we should check to see if we
-		// clicked on a pixel where alpha is not zero, meaning
-		// the pixel shows on the screen.
-		Color color;
-		mItemImage->GetPixel((int)testX, (int)testY, &color);
-		return color.GetAlpha() != 0;
-	}
-	else {
 		return true;
 	}
+
+	// The mask has a bit for each pixel where alpha is not zero,
+	// meaning the pixel shows on the screen.
+	return mask->Test((int)testX, (int)testY);
 }
 
 /**
@@ -148,21 +195,18 @@ bool CItem::HitTest(int x, int y)
  */
 void CItem::Draw(Gdiplus::Graphics* graphics)
 {
-	double wid = mItemImage->GetWidth();
-	double hit = mItemImage->GetHeight();
+	CSpriteBatch batch;
+	AddToBatch(&batch);
+	batch.Flush(graphics);
+}
 
-	if (mMirror)
-	{
-		graphics->DrawImage(mItemImage.get(),
-			float(GetX() + wid / 2), float(GetY() - hit / 2),
-			-(float)mItemImage->GetWidth(), (float)mItemImage->GetHeight());
-	}
-	else
-	{
-		graphics->DrawImage(mItemImage.get(),
-			float(GetX() - wid / 2), float(GetY() - hit / 2),
-			(float)mItemImage->GetWidth(), (float)mItemImage->GetHeight());
-	}
+/**
+ * Add our item to a batch of sprites drawn together
+ * \param batch Batch to add to
+ */
+void CItem::AddToBatch(CSpriteBatch* batch)
+{
+	batch->Add(mSprite, mMirror, GetX(), GetY());
 }
 
 /**
@@ -8,11 +8,15 @@
 
 #pragma once
 
+#include <limits>
 #include <memory>
 #include <string>
 #include "XmlNode.h"
+#include "SpriteAtlas.h"
+#include "MemoryAccounting.h"
 
 class CAquarium;
+class CSpriteBatch;
 
 
 /**
@@ -38,15 +42,14 @@ public:
 	* \returns Y location in pixels */
 	double GetY() const { return mY; }
 
-	/// Set the item location
-	/// \param x X location
-	/// \param y Y location
-	virtual void SetLocation(double x, double y) { mX = x; mY = y; }
+	virtual void SetLocation(double x, double y);
 
 	/// Draw this item
 	/// \param graphics Graphics device to draw on
 	virtual void Draw(Gdiplus::Graphics* graphics);
 
+	virtual void AddToBatch(CSpriteBatch* batch);
+
 	virtual std::shared_ptr<xmlnode::CXmlNode> XmlSave(const std::shared_ptr<xmlnode::CXmlNode>& node);
 
 	virtual void XmlLoad(const std::shared_ptr<xmlnode::CXmlNode>& node);
@@ -57,12 +60,53 @@ public:
 	 * \return true if clicked on */
 	virtual bool HitTest(int x, int y);
 
+	bool HitTest(const CSpriteAtlas::AlphaMask* mask, int x, int y) const;
+
+	/// Get which pixels of our image are drawn
+	/// \returns Alpha mask, null if the whole box hits
+	std::shared_ptr<const CSpriteAtlas::AlphaMask> GetAlphaMask() const { return mSprite->GetMask(); }
+
 	void UpdatePosition(double stinkyX, double stinkyY);
 
+	void GetBounds(double& minX, double& maxX, double& minY, double& maxY);
+
 	/// Handle updates for animation
 	/// \param elapsed The time since the last update
 	virtual void Update(double elapsed) {}
 
+	/// Advance the item by any duration in a single step.
+	/// Items with closed form motion override this so the
+	/// cost does not depend on the duration.
+	/// \param duration Time to advance in seconds
+	virtual void FastForward(double duration) { Update(duration); }
+
+	/// Get the velocity of the item
+	/// \param speedX Receives the speed in the X direction
+	/// \param speedY Receives the speed in the Y direction
+	virtual void GetVelocity(double& speedX, double& speedY) { speedX = 0; speedY = 0; }
+
+	/// Get the time until the item next changes its motion
+	/// \returns Seconds, or infinity if it never does on its own
+	virtual double GetTimeToEvent() { return std::numeric_limits<double>::infinity(); }
+
+	void SyncTo(double time);
+
+	/// Get the aquarium time the item location is valid at
+	/// \returns Time in seconds
+	double GetSyncTime() const { return mSyncTime; }
+
+	/// Set the aquarium time the item location is valid at
+	/// \param time Time in seconds
+	void SetSyncTime(double time) { mSyncTime = time; }
+
+	/// Get the aquarium time of the item's scheduled event
+	/// \returns Time in seconds
+	double GetEventTime() const { return mEventTime; }
+
+	/// Set the aquarium time of the item's scheduled event
+	/// \param time Time in seconds
+	void SetEventTime(double time) { mEventTime = time; }
+
 	/// Get the aquarium this item is in
 	/// \returns Aquarium pointer
 	CAquarium* GetAquarium() { return mAquarium; }
@@ -71,6 +115,22 @@ public:
 	/// \param m New mirror flag
 	void SetMirror(bool m) { mMirror = m; }
 
+	/// Is the item image mirrored?
+	/// \returns true if mirrored
+	bool IsMirror() const { return mMirror; }
+
+	/// Get the number that identifies the item in its aquarium
+	/// \returns Item id, 0 until the item is added
+	unsigned GetId() const { return mId; }
+
+	/// Set the number that identifies the item in its aquarium
+	/// \param id Item id
+	void SetId(unsigned id) { mId = id; }
+
+	/// Get the name of the item type, as saved in files
+	/// \returns Type name
+	virtual const wchar_t* GetType() const { return L"item"; }
+
 	/// Gets the width of the image
 	/// \return Width of the image
 	double GetImageWidth() { return mImageWidth; }
@@ -89,6 +149,19 @@ protected:
 	/// Sets the height of the image
 	void SetImageHeight(double height) { mImageHeight = height; }
 
+	/// Account this item to the live items of its type. Called by
+	/// the constructor of each concrete item class, where the type
+	/// and size are those of the concrete class.
+	/// \param item This item
+	template <typename T>
+	void Count(const T* item)
+	{
+		static CItemCounter counter(item->GetType(), sizeof(T));
+		Count(&counter);
+	}
+
+	void Count(CItemCounter* counter);
+
 private:
 	// Item location in the aquarium
 	double mX = 0;		///< X location for the center of the item
@@ -97,8 +170,11 @@ private:
 	/// The aquarium this item is contained in
 	CAquarium* mAquarium;
 
-	/// The image of the Fish to be displayed
-	std::unique_ptr<Gdiplus::Bitmap> mItemImage;
+	/// Where the image of the item is in the sprite atlas, shared by every item of the type
+	const CSpriteAtlas::Sprite* mSprite = nullptr;
+
+	/// Live count of our type, if we are accounted
+	CItemCounter* mCounter = nullptr;
 
 	/// The width of the image
 	double mImageWidth = 0;
@@ -107,5 +183,14 @@ private:
 	double mImageHeight = 0;
 
 	bool mMirror = false;   ///< True mirrors the item image
+
+	/// Number that identifies the item in its aquarium
+	unsigned mId = 0;
+
+	/// Aquarium time the location is valid at, used by event driven updates
+	double mSyncTime = 0;
+
+	/// Aquarium time of the scheduled event, used to skip stale queue entries
+	double mEventTime = 0;
 };
 
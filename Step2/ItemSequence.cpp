@@ -0,0 +1,270 @@
+/**
+ * \file ItemSequence.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the item sequence.
+ */
+
+#include "pch.h"
+#include "ItemSequence.h"
+
+using namespace std;
+
+/// Priority of the root of a tree built from a list. Each level below
+/// has one less, and single items added later have less than any
+/// built level, so they hang below the built tree.
+const uint32_t BuiltPriority = 0xffffffff;
+
+std::atomic<long long> CItemSequence::sCreated(0);
+std::atomic<long long> CItemSequence::sLive(0);
+
+/**
+ * Constructor
+ * \param item Item at the node
+ * \param left Items before it
+ * \param right Items after it
+ * \param priority Heap priority
+ */
+CItemSequence::Node::Node(const std::shared_ptr<CItem>& item, const NodePtr& left, const NodePtr& right, uint32_t priority) :
+	mItem(item), mLeft(left), mRight(right), mSize(Size(left) + 1 + Size(right)), mPriority(priority)
+{
+	sCreated++;
+	sLive++;
+}
+
+/**
+ * Destructor
+ */
+CItemSequence::Node::~Node()
+{
+	sLive--;
+}
+
+/**
+ * Constructor, an empty sequence
+ */
+CItemSequence::CItemSequence()
+{
+}
+
+/**
+ * Constructor, a sequence of the items in a list.
+ *
+ * The tree is built balanced in linear time.
+ * \param items Items in order
+ */
+CItemSequence::CItemSequence(const std::vector<std::shared_ptr<CItem>>& items) :
+	mRoot(Build(items, 0, items.size(), BuiltPriority))
+{
+}
+
+/**
+ * Get the item at an index
+ * \param index Index of the item, less than GetSize()
+ * \returns Item
+ */
+std::shared_ptr<CItem> CItemSequence::Get(size_t index) const
+{
+	auto node = mRoot.get();
+	while (node != nullptr)
+	{
+		size_t left = Size(node->mLeft);
+		if (index < left)
+		{
+			node = node->mLeft.get();
+		}
+		else if (index == left)
+		{
+			return node->mItem;
+		}
+		else
+		{
+			index -= left + 1;
+			node = node->mRight.get();
+		}
+	}
+
+	return nullptr;
+}
+
+/**
+ * Add an item at the end
+ * \param item Item to add
+ * \returns The new sequence
+ */
+CItemSequence CItemSequence::PushBack(const std::shared_ptr<CItem>& item) const
+{
+	return CItemSequence(Merge(mRoot, Single(item)));
+}
+
+/**
+ * Insert an item
+ * \param index Index the item will have, at most GetSize()
+ * \param item Item to insert
+ * \returns The new sequence
+ */
+CItemSequence CItemSequence::Insert(size_t index, const std::shared_ptr<CItem>& item) const
+{
+	NodePtr left, right;
+	Split(mRoot, index, left, right);
+	return CItemSequence(Merge(Merge(left, Single(item)), right));
+}
+
+/**
+ * Remove an item
+ * \param index Index of the item, less than GetSize()
+ * \returns The new sequence
+ */
+CItemSequence CItemSequence::Erase(size_t index) const
+{
+	NodePtr left, middle, right;
+	Split(mRoot, index, left, right);
+	Split(right, 1, middle, right);
+	return CItemSequence(Merge(left, right));
+}
+
+/**
+ * Get every item in order
+ * \param items Receives the items
+ */
+void CItemSequence::ToVector(std::vector<std::shared_ptr<CItem>>& items) const
+{
+	items.clear();
+	items.reserve(GetSize());
+	Collect(mRoot, items);
+}
+
+/**
+ * Get the memory a node takes, with the count block make_shared
+ * puts beside it
+ * \returns Bytes per node
+ */
+long long CItemSequence::GetNodeBytes()
+{
+	return sizeof(Node) + 2 * sizeof(void*);
+}
+
+/**
+ * Make a node
+ * \param item Item at the node
+ * \param left Items before it
+ * \param right Items after it
+ * \param priority Heap priority
+ * \returns The node
+ */
+CItemSequence::NodePtr CItemSequence::Make(const std::shared_ptr<CItem>& item, const NodePtr& left, const NodePtr& right, uint32_t priority)
+{
+	return make_shared<const Node>(item, left, right, priority);
+}
+
+/**
+ * Make a node for a single item.
+ *
+ * The priority is a hash of the item address, so a sequence of the
+ * same items is always the same shape no matter how it was changed.
+ * \param item Item
+ * \returns The node
+ */
+CItemSequence::NodePtr CItemSequence::Single(const std::shared_ptr<CItem>& item)
+{
+	uint64_t hash = (uint64_t)(uintptr_t)item.get();
+	hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+	hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+	hash ^= hash >> 31;
+	return Make(item, nullptr, nullptr, (uint32_t)(hash >> 33));
+}
+
+/**
+ * Join two trees, every item of the first before every item of the
+ * second. Only the nodes along the seam are copied.
+ * \param left First tree
+ * \param right Second tree
+ * \returns Joined tree
+ */
+CItemSequence::NodePtr CItemSequence::Merge(const NodePtr& left, const NodePtr& right)
+{
+	if (!left)
+	{
+		return right;
+	}
+
+	if (!right)
+	{
+		return left;
+	}
+
+	if (left->mPriority >= right->mPriority)
+	{
+		return Make(left->mItem, left->mLeft, Merge(left->mRight, right), left->mPriority);
+	}
+
+	return Make(right->mItem, Merge(left, right->mLeft), right->mRight, right->mPriority);
+}
+
+/**
+ * Split a tree in two. Only the nodes along the cut are copied.
+ * \param node Tree to split
+ * \param count Number of items that go in the first tree
+ * \param left Receives the first count items
+ * \param right Receives the rest
+ */
+void CItemSequence::Split(const NodePtr& node, size_t count, NodePtr& left, NodePtr& right)
+{
+	if (!node)
+	{
+		left = nullptr;
+		right = nullptr;
+		return;
+	}
+
+	// The node is held, since left or right may be the pointer it came from
+	NodePtr keep = node;
+	size_t before = Size(keep->mLeft);
+	if (count <= before)
+	{
+		NodePtr rest;
+		Split(keep->mLeft, count, left, rest);
+		right = Make(keep->mItem, rest, keep->mRight, keep->mPriority);
+	}
+	else
+	{
+		NodePtr rest;
+		Split(keep->mRight, count - before - 1, rest, right);
+		left = Make(keep->mItem, keep->mLeft, rest, keep->mPriority);
+	}
+}
+
+/**
+ * Build a balanced tree of part of a list
+ * \param items List of items
+ * \param begin Index of the first item of the part
+ * \param end Index after the last item of the part
+ * \param priority Priority of the root of the part
+ * \returns Tree of the part
+ */
+CItemSequence::NodePtr CItemSequence::Build(const std::vector<std::shared_ptr<CItem>>& items, size_t begin, size_t end, uint32_t priority)
+{
+	if (begin >= end)
+	{
+		return nullptr;
+	}
+
+	size_t middle = begin + (end - begin) / 2;
+	return Make(items[middle], Build(items, begin, middle, priority - 1), Build(items, middle + 1, end, priority - 1), priority);
+}
+
+/**
+ * Append the items of a tree in order
+ * \param node Tree
+ * \param items List to append to
+ */
+void CItemSequence::Collect(const NodePtr& node, std::vector<std::shared_ptr<CItem>>& items)
+{
+	if (node)
+	{
+		Collect(node->mLeft, items);
+		items.push_back(node->mItem);
+		Collect(node->mRight, items);
+	}
+}
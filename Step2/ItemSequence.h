@@ -0,0 +1,107 @@
+/**
+ * \file ItemSequence.h
+ *
+ * \author Grant Youngs
+ *
+ * Class for an immutable sequence of items that shares structure between versions.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class CItem;
+
+
+/**
+ * An immutable sequence of items, in drawing order.
+ *
+ * Changing a sequence gives a new sequence and leaves the old one as
+ * it was. The sequence is a treap with an implicit index: a binary
+ * tree in index order whose nodes are also a heap on a priority, so
+ * it stays balanced. A change copies only the nodes on the path to
+ * the change, O(log n) of them, and shares the rest of the tree with
+ * the old sequence. Holding many versions of a large aquarium costs
+ * little more than holding one.
+ */
+class CItemSequence
+{
+public:
+	CItemSequence();
+	CItemSequence(const std::vector<std::shared_ptr<CItem>>& items);
+
+	/// Get the number of items
+	/// \returns Number of items
+	size_t GetSize() const { return Size(mRoot); }
+
+	std::shared_ptr<CItem> Get(size_t index) const;
+
+	CItemSequence PushBack(const std::shared_ptr<CItem>& item) const;
+	CItemSequence Insert(size_t index, const std::shared_ptr<CItem>& item) const;
+	CItemSequence Erase(size_t index) const;
+
+	void ToVector(std::vector<std::shared_ptr<CItem>>& items) const;
+
+	/// Do two sequences share the same tree?
+	/// \param other Sequence to compare to
+	/// \returns true if they are the same version
+	bool IsSame(const CItemSequence& other) const { return mRoot == other.mRoot; }
+
+	static long long GetNodeBytes();
+
+	/// Get the number of nodes ever made by all sequences
+	/// \returns Nodes made
+	static long long GetNumCreated() { return sCreated; }
+
+	/// Get the number of nodes in use by all sequences
+	/// \returns Live nodes
+	static long long GetNumLive() { return sLive; }
+
+private:
+	struct Node;
+
+	/// Pointer to a node, which never changes once made
+	typedef std::shared_ptr<const Node> NodePtr;
+
+	/** A node of the tree */
+	struct Node
+	{
+		Node(const std::shared_ptr<CItem>& item, const NodePtr& left, const NodePtr& right, uint32_t priority);
+		~Node();
+
+		std::shared_ptr<CItem> mItem;   ///< Item at this node
+		NodePtr mLeft;                  ///< Items before this one
+		NodePtr mRight;                 ///< Items after this one
+		size_t mSize;                   ///< Items in this subtree
+		uint32_t mPriority;             ///< Heap priority, larger is nearer the root
+	};
+
+	/** Constructor
+	 * \param root Root of the tree */
+	CItemSequence(const NodePtr& root) : mRoot(root) {}
+
+	/// Get the number of items in a subtree
+	/// \param node Root of the subtree, may be null
+	/// \returns Number of items
+	static size_t Size(const NodePtr& node) { return node ? node->mSize : 0; }
+
+	static NodePtr Make(const std::shared_ptr<CItem>& item, const NodePtr& left, const NodePtr& right, uint32_t priority);
+	static NodePtr Single(const std::shared_ptr<CItem>& item);
+	static NodePtr Merge(const NodePtr& left, const NodePtr& right);
+	static void Split(const NodePtr& node, size_t count, NodePtr& left, NodePtr& right);
+	static NodePtr Build(const std::vector<std::shared_ptr<CItem>>& items, size_t begin, size_t end, uint32_t priority);
+	static void Collect(const NodePtr& node, std::vector<std::shared_ptr<CItem>>& items);
+
+	/// Root of the tree, null when empty
+	NodePtr mRoot;
+
+	/// Nodes ever made
+	static std::atomic<long long> sCreated;
+
+	/// Nodes in use
+	static std::atomic<long long> sLive;
+};
+
@@ -25,11 +25,9 @@ const double ImageWidth = 150;
 /// Height of the image
 const double ImageHeight = 185;
 
-/// Minimum speed of Magikarp in X direction
-const double MinSpeedX = 120;
+const double CMagikarp::MinSpeedX = 120;
 
-/// Minimum speed of Magikarp in Y direction
-const double MinSpeedY = 10;
+const double CMagikarp::MinSpeedY = 10;
 
 /** Constructor
  * \param aquarium The aquarium this is a member of
@@ -46,6 +44,11 @@ CMagikarp::CMagikarp(CAquarium* aquarium) :
 	// Sets the minimum speed member variables
 	SetMinSpeedX(MinSpeedX);
 	SetMinSpeedY(MinSpeedY);
+
+	// Schools with the other magikarp fish
+	SetSpecies(CSchooling::Magikarp);
+
+	Count(this);
 }
 
 /**
@@ -57,7 +60,7 @@ CMagikarp::XmlSave(const std::shared_ptr<xmlnode::CXmlNode>& node)
 {
 	auto itemNode = CFish::XmlSave(node);
 
-	itemNode->SetAttribute(L"type", L"magikarp");
+	itemNode->SetAttribute(L"type", GetType());
 
 	return itemNode;
 }
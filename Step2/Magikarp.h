@@ -18,9 +18,19 @@
 class CMagikarp : public CFish
 {
 public:
+	/// Minimum speed of Magikarp in the X direction in pixels per second
+	static const double MinSpeedX;
+
+	/// Minimum speed of Magikarp in the Y direction in pixels per second
+	static const double MinSpeedY;
+
 	/// Constructor
 	CMagikarp(CAquarium* aquarium);
 
+	/// Get the name of the item type, as saved in files
+	/// \returns Type name
+	virtual const wchar_t* GetType() const override { return L"magikarp"; }
+
 	virtual std::shared_ptr<xmlnode::CXmlNode> XmlSave(const std::shared_ptr<xmlnode::CXmlNode>& node) override;
 
 	/// Default constructor (disabled)
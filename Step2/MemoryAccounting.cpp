@@ -0,0 +1,251 @@
+/**
+ * \file MemoryAccounting.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the per subsystem memory accounting.
+ */
+
+#include "pch.h"
+#include <algorithm>
+#include <sstream>
+#include "MemoryAccounting.h"
+
+using namespace std;
+
+/// Names of the categories for the dump
+const wchar_t* CategoryNames[] = { L"Items", L"Sprites", L"Xml", L"Snapshots", L"Journal" };
+
+/**
+ * Get the process wide accounting
+ * \returns Memory accounting
+ */
+CMemoryAccounting& CMemoryAccounting::Get()
+{
+	static CMemoryAccounting accounting;
+	return accounting;
+}
+
+/**
+ * Get the display name of a category
+ * \param category Category to name
+ * \returns Category name
+ */
+const wchar_t* CMemoryAccounting::GetCategoryName(Category category)
+{
+	return CategoryNames[category];
+}
+
+/**
+ * Account a new allocation without a lock
+ * \param bytes Size of the allocation
+ */
+void CMemoryAccounting::AtomicUsage::Add(long long bytes)
+{
+	long long count = ++mCount;
+	long long total = mBytes += bytes;
+
+	long long peak = mPeakCount.load(memory_order_relaxed);
+	while (count > peak && !mPeakCount.compare_exchange_weak(peak, count, memory_order_relaxed))
+	{
+	}
+
+	peak = mPeakBytes.load(memory_order_relaxed);
+	while (total > peak && !mPeakBytes.compare_exchange_weak(peak, total, memory_order_relaxed))
+	{
+	}
+}
+
+/**
+ * Account the release of an allocation without a lock
+ * \param bytes Size of the allocation
+ */
+void CMemoryAccounting::AtomicUsage::Remove(long long bytes)
+{
+	--mCount;
+	mBytes -= bytes;
+}
+
+/**
+ * Get a copy of the usage
+ * \returns Current and peak usage
+ */
+CMemoryAccounting::Usage CMemoryAccounting::AtomicUsage::Get() const
+{
+	Usage usage;
+	usage.mCount = mCount;
+	usage.mBytes = mBytes;
+	usage.mPeakCount = mPeakCount;
+	usage.mPeakBytes = mPeakBytes;
+	return usage;
+}
+
+/**
+ * Add an item counter to the Items category
+ * \param counter Counter to add
+ */
+void CMemoryAccounting::Register(CItemCounter* counter)
+{
+	lock_guard<mutex> lock(mMutex);
+	mCounters.push_back(counter);
+}
+
+/**
+ * Remove an item counter from the Items category
+ * \param counter Counter to remove
+ */
+void CMemoryAccounting::Unregister(CItemCounter* counter)
+{
+	lock_guard<mutex> lock(mMutex);
+	mCounters.erase(remove(mCounters.begin(), mCounters.end(), counter), mCounters.end());
+}
+
+/**
+ * Account a new allocation
+ * \param category Category the memory belongs to
+ * \param key Key within the category, such as the item type
+ * \param bytes Size of the allocation
+ */
+void CMemoryAccounting::Add(Category category, const std::wstring& key, long long bytes)
+{
+	lock_guard<mutex> lock(mMutex);
+	for (auto usage : { &mCategories[category], &mKeys[category][key] })
+	{
+		usage->mCount++;
+		usage->mBytes += bytes;
+		usage->mPeakCount = max(usage->mPeakCount, usage->mCount);
+		usage->mPeakBytes = max(usage->mPeakBytes, usage->mBytes);
+	}
+}
+
+/**
+ * Account the release of an allocation
+ * \param category Category the memory belonged to
+ * \param key Key within the category
+ * \param bytes Size of the allocation
+ */
+void CMemoryAccounting::Remove(Category category, const std::wstring& key, long long bytes)
+{
+	lock_guard<mutex> lock(mMutex);
+	for (auto usage : { &mCategories[category], &mKeys[category][key] })
+	{
+		usage->mCount--;
+		usage->mBytes -= bytes;
+	}
+}
+
+/**
+ * Get the usage of a whole category
+ * \param category Category to query
+ * \returns Current and peak usage
+ */
+CMemoryAccounting::Usage CMemoryAccounting::GetUsage(Category category) const
+{
+	if (category == Items)
+	{
+		return mItems.Get();
+	}
+
+	lock_guard<mutex> lock(mMutex);
+	return mCategories[category];
+}
+
+/**
+ * Get the usage of one key in a category
+ * \param category Category to query
+ * \param key Key within the category
+ * \returns Current and peak usage, zero if the key was never used
+ */
+CMemoryAccounting::Usage CMemoryAccounting::GetUsage(Category category, const std::wstring& key) const
+{
+	lock_guard<mutex> lock(mMutex);
+	if (category == Items)
+	{
+		for (auto counter : mCounters)
+		{
+			if (counter->GetType() == key)
+			{
+				return counter->GetUsage();
+			}
+		}
+
+		return Usage();
+	}
+
+	auto found = mKeys[category].find(key);
+	return found != mKeys[category].end() ? found->second : Usage();
+}
+
+/**
+ * Describe the usage of every category and key.
+ * \returns One line per category followed by its keys
+ */
+std::wstring CMemoryAccounting::Dump() const
+{
+	lock_guard<mutex> lock(mMutex);
+
+	wstringstream out;
+	for (int c = 0; c < NumCategories; c++)
+	{
+		// Items are kept by the item counters rather than the tables
+		map<wstring, Usage> keys = mKeys[c];
+		auto usage = mCategories[c];
+		if (c == Items)
+		{
+			usage = mItems.Get();
+			for (auto counter : mCounters)
+			{
+				keys[counter->GetType()] = counter->GetUsage();
+			}
+		}
+
+		out << CategoryNames[c] << L": " << usage.mCount << L" live, " << usage.mBytes
+			<< L" bytes (peak " << usage.mPeakCount << L", " << usage.mPeakBytes << L" bytes)" << endl;
+
+		for (auto& key : keys)
+		{
+			out << L"    " << key.first << L": " << key.second.mCount << L" live, " << key.second.mBytes
+				<< L" bytes (peak " << key.second.mPeakCount << L", " << key.second.mPeakBytes << L" bytes)" << endl;
+		}
+	}
+
+	return out.str();
+}
+
+
+/**
+ * Constructor
+ * \param type Item type counted
+ * \param bytes Size of one item of the type
+ */
+CItemCounter::CItemCounter(const std::wstring& type, long long bytes) :
+	mType(type), mBytes(bytes), mAccounting(&CMemoryAccounting::Get())
+{
+	mAccounting->Register(this);
+}
+
+/**
+ * Destructor
+ */
+CItemCounter::~CItemCounter()
+{
+	mAccounting->Unregister(this);
+}
+
+/**
+ * Account a new item of the type
+ */
+void CItemCounter::Add()
+{
+	mUsage.Add(mBytes);
+	mAccounting->mItems.Add(mBytes);
+}
+
+/**
+ * Account the destruction of an item of the type
+ */
+void CItemCounter::Remove()
+{
+	mUsage.Remove(mBytes);
+	mAccounting->mItems.Remove(mBytes);
+}
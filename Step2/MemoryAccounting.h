@@ -0,0 +1,170 @@
+/**
+ * \file MemoryAccounting.h
+ *
+ * \author Grant Youngs
+ *
+ * Tracks how much memory each subsystem and item type is holding.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class CItemCounter;
+
+
+/**
+ * Process wide memory accounting.
+ *
+ * The allocation paths we care about report what they hold by
+ * category and key, for example the Items category keyed by item
+ * type. Current and peak bytes and counts are kept for every key
+ * and every category. Nothing here depends on the platform heap.
+ *
+ * Items are created and destroyed far too often to take a lock, so
+ * each item type has its own CItemCounter and the Items category is
+ * counted with atomics.
+ */
+class CMemoryAccounting
+{
+public:
+	/** Subsystems memory is accounted to */
+	enum Category { Items, Sprites, Xml, Snapshots, Journal, NumCategories };
+
+	/** Current and peak usage of one key or category */
+	struct Usage
+	{
+		long long mCount = 0;       ///< Live allocations
+		long long mBytes = 0;       ///< Live bytes
+		long long mPeakCount = 0;   ///< Highest live allocation count
+		long long mPeakBytes = 0;   ///< Highest live bytes
+	};
+
+	/** Current and peak usage that is changed without a lock */
+	struct AtomicUsage
+	{
+		std::atomic<long long> mCount{ 0 };       ///< Live allocations
+		std::atomic<long long> mBytes{ 0 };       ///< Live bytes
+		std::atomic<long long> mPeakCount{ 0 };   ///< Highest live allocation count
+		std::atomic<long long> mPeakBytes{ 0 };   ///< Highest live bytes
+
+		void Add(long long bytes);
+		void Remove(long long bytes);
+		Usage Get() const;
+	};
+
+	static CMemoryAccounting& Get();
+
+	/// Copy constructor (disabled)
+	CMemoryAccounting(const CMemoryAccounting&) = delete;
+
+	void Add(Category category, const std::wstring& key, long long bytes);
+	void Remove(Category category, const std::wstring& key, long long bytes);
+
+	Usage GetUsage(Category category) const;
+	Usage GetUsage(Category category, const std::wstring& key) const;
+
+	static const wchar_t* GetCategoryName(Category category);
+
+	std::wstring Dump() const;
+
+private:
+	friend class CItemCounter;
+
+	CMemoryAccounting() {}
+
+	void Register(CItemCounter* counter);
+	void Unregister(CItemCounter* counter);
+
+	/// Protects the usage tables
+	mutable std::mutex mMutex;
+
+	/// Usage of each category
+	Usage mCategories[NumCategories];
+
+	/// Usage of each key within each category
+	std::map<std::wstring, Usage> mKeys[NumCategories];
+
+	/// Usage of the Items category, kept by the item counters
+	AtomicUsage mItems;
+
+	/// Counter of each item type, which are the keys of the Items category
+	std::vector<CItemCounter*> mCounters;
+};
+
+
+/**
+ * Lock free count of the live items of one type.
+ *
+ * Each concrete item class has one counter, created the first time
+ * an item of the class is, keyed by the item type.
+ */
+class CItemCounter
+{
+public:
+	CItemCounter(const std::wstring& type, long long bytes);
+	~CItemCounter();
+
+	/// Copy constructor (disabled)
+	CItemCounter(const CItemCounter&) = delete;
+
+	void Add();
+	void Remove();
+
+	/// Get the item type counted
+	/// \returns Type name, the key in the Items category
+	const std::wstring& GetType() const { return mType; }
+
+	/// Get the usage of the items of this type
+	/// \returns Current and peak usage
+	CMemoryAccounting::Usage GetUsage() const { return mUsage.Get(); }
+
+private:
+	std::wstring mType;                         ///< Item type counted
+	long long mBytes;                           ///< Size of one item of the type
+	CMemoryAccounting* mAccounting;             ///< Accounting the counter belongs to
+	CMemoryAccounting::AtomicUsage mUsage;      ///< Usage of the items of this type
+};
+
+
+/**
+ * Accounts memory to a category for the lifetime of a scope.
+ */
+class CMemoryScope
+{
+public:
+	/** Constructor
+	 * \param category Category to account to
+	 * \param key Key within the category
+	 * \param bytes Bytes held by the scope */
+	CMemoryScope(CMemoryAccounting::Category category, const std::wstring& key, long long bytes) :
+		mCategory(category), mKey(key), mBytes(bytes)
+	{
+		CMemoryAccounting::Get().Add(mCategory, mKey, mBytes);
+	}
+
+	/// Destructor
+	~CMemoryScope() { CMemoryAccounting::Get().Remove(mCategory, mKey, mBytes); }
+
+	/** Change the bytes held, for memory that grows while the scope is open
+	 * \param bytes Bytes now held by the scope */
+	void Resize(long long bytes)
+	{
+		CMemoryAccounting::Get().Remove(mCategory, mKey, mBytes);
+		mBytes = bytes;
+		CMemoryAccounting::Get().Add(mCategory, mKey, mBytes);
+	}
+
+	/// Copy constructor (disabled)
+	CMemoryScope(const CMemoryScope&) = delete;
+
+private:
+	CMemoryAccounting::Category mCategory;  ///< Category accounted to
+	std::wstring mKey;                      ///< Key within the category
+	long long mBytes;                       ///< Bytes accounted
+};
+
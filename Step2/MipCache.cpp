@@ -0,0 +1,361 @@
+/**
+ * \file MipCache.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the sprite mip level cache.
+ */
+
+#include "pch.h"
+#include <algorithm>
+#include "MipCache.h"
+#include "MemoryAccounting.h"
+#include "TraceLog.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+/// Defined when the downsampler uses SSE2
+#define AQUA_MIP_SSE2
+#endif
+
+using namespace Gdiplus;
+using namespace std;
+
+/// Memory accounting key of the kept levels
+const wstring LevelsKey = L"mip levels";
+
+/**
+ * Average 2x2 blocks of two source rows into one target row.
+ *
+ * The last column and row are repeated when the source size is odd.
+ * Each channel is (a + b + c + d + 2) / 4, which is exact for
+ * premultiplied pixels.
+ * \param row0 First source row
+ * \param row1 Second source row, the same as the first at the bottom edge
+ * \param sourceWidth Width of the source in pixels
+ * \param target Target row
+ * \param first First target column to compute
+ */
+static void DownsampleRow(const uint32_t* row0, const uint32_t* row1, int sourceWidth, uint32_t* target, int first)
+{
+	int targetWidth = (sourceWidth + 1) / 2;
+	for (int x = first; x < targetWidth; x++)
+	{
+		int left = x * 2;
+		int right = min(left + 1, sourceWidth - 1);
+
+		uint32_t pixel = 0;
+		for (int shift = 0; shift < 32; shift += 8)
+		{
+			uint32_t sum = ((row0[left] >> shift) & 0xff) + ((row0[right] >> shift) & 0xff) +
+				((row1[left] >> shift) & 0xff) + ((row1[right] >> shift) & 0xff);
+			pixel |= ((sum + 2) >> 2) << shift;
+		}
+
+		target[x] = pixel;
+	}
+}
+
+/**
+ * Constructor
+ * \param budget Most bytes of levels to keep
+ */
+CMipCache::CMipCache(long long budget) : mBudget(budget)
+{
+}
+
+/**
+ * Destructor
+ */
+CMipCache::~CMipCache()
+{
+	Clear();
+}
+
+/**
+ * Get the process wide mip cache items are drawn through
+ * \returns Mip cache
+ */
+CMipCache& CMipCache::Get()
+{
+	static CMipCache cache;
+	return cache;
+}
+
+/**
+ * Choose the level to draw a sprite from.
+ *
+ * This is the smallest level that is still at least as large as
+ * the sprite appears, so drawing only ever shrinks it.
+ * \param sprite Sprite to draw
+ * \param scale Screen pixels per sprite pixel
+ * \returns Level, 0 for the sprite in the atlas
+ */
+int CMipCache::ChooseLevel(const CSpriteAtlas::Sprite* sprite, double scale)
+{
+	int level = 0;
+	while (level < MaxLevel && scale <= 0.5 &&
+		(sprite->mWidth >> (level + 1)) >= 1 && (sprite->mHeight >> (level + 1)) >= 1)
+	{
+		scale *= 2;
+		level++;
+	}
+
+	return level;
+}
+
+/**
+ * Find a level of a sprite, building it and any level below it
+ * that is not kept.
+ *
+ * Called with the atlas lock held, since level 1 is read from the
+ * atlas page. The level stays valid until the next call.
+ * \param sprite Sprite that is ready in its atlas
+ * \param level Level wanted, 1 or more
+ * \returns The level, null for level 0 or a sprite not loaded yet
+ */
+const CMipCache::Level* CMipCache::Find(const CSpriteAtlas::Sprite* sprite, int level)
+{
+	if (sprite == nullptr || !sprite->mReady || level <= 0)
+	{
+		return nullptr;
+	}
+
+	lock_guard<mutex> lock(mMutex);
+
+	Key key(sprite->mId, level);
+	auto found = mLevels.find(key);
+	if (found != mLevels.end())
+	{
+		mHits++;
+		mUse.splice(mUse.begin(), mUse, found->second.mUse);
+		return &found->second.mLevel;
+	}
+
+	mMisses++;
+	auto built = Build(sprite, level);
+	Evict(key);
+	return built;
+}
+
+/**
+ * Build a level from the one below it and keep it.
+ * Called with the lock held.
+ * \param sprite Sprite to build the level for
+ * \param level Level to build, 1 or more
+ * \returns The new level
+ */
+const CMipCache::Level* CMipCache::Build(const CSpriteAtlas::Sprite* sprite, int level)
+{
+	AQUA_TRACE_SCOPE("BuildMip");
+
+	// Pixels of the level below, from the atlas page for level 1
+	Bitmap* below = sprite->mImage;
+	int belowX = sprite->mX;
+	int belowY = sprite->mY;
+	int belowWidth = sprite->mWidth;
+	int belowHeight = sprite->mHeight;
+	if (level > 1)
+	{
+		Key belowKey(sprite->mId, level - 1);
+		auto found = mLevels.find(belowKey);
+		const Level* lower = nullptr;
+		if (found != mLevels.end())
+		{
+			mUse.splice(mUse.begin(), mUse, found->second.mUse);
+			lower = &found->second.mLevel;
+		}
+		else
+		{
+			lower = Build(sprite, level - 1);
+		}
+
+		below = lower->mImage.get();
+		belowX = 0;
+		belowY = 0;
+		belowWidth = lower->mWidth;
+		belowHeight = lower->mHeight;
+	}
+
+	int width = (belowWidth + 1) / 2;
+	int height = (belowHeight + 1) / 2;
+
+	Key key(sprite->mId, level);
+	auto& entry = mLevels[key];
+	entry.mLevel.mImage = make_unique<Bitmap>(width * 2, height, PixelFormat32bppPARGB);
+	entry.mLevel.mWidth = width;
+	entry.mLevel.mHeight = height;
+
+	Rect from(belowX, belowY, belowWidth, belowHeight);
+	BitmapData fromData;
+	below->LockBits(&from, ImageLockModeRead, PixelFormat32bppPARGB, &fromData);
+
+	Rect to(0, 0, width * 2, height);
+	BitmapData toData;
+	entry.mLevel.mImage->LockBits(&to, ImageLockModeWrite, PixelFormat32bppPARGB, &toData);
+
+	Downsample((const uint32_t*)fromData.Scan0, belowWidth, belowHeight, fromData.Stride / 4,
+		(uint32_t*)toData.Scan0, toData.Stride / 4);
+
+	// The mirror goes beside the sprite, as in the atlas
+	for (int row = 0; row < height; row++)
+	{
+		auto pixels = (uint32_t*)((BYTE*)toData.Scan0 + row * toData.Stride);
+		for (int col = 0; col < width; col++)
+		{
+			pixels[width * 2 - 1 - col] = pixels[col];
+		}
+	}
+
+	entry.mLevel.mImage->UnlockBits(&toData);
+	below->UnlockBits(&fromData);
+
+	entry.mBytes = (long long)width * 2 * height * 4;
+	mUse.push_front(key);
+	entry.mUse = mUse.begin();
+	mResidentBytes += entry.mBytes;
+	CMemoryAccounting::Get().Add(CMemoryAccounting::Sprites, LevelsKey, entry.mBytes);
+
+	return &entry.mLevel;
+}
+
+/**
+ * Free the least recently used levels until the resident bytes
+ * are within the budget. Called with the lock held.
+ * \param keep Level that was just asked for, which is never freed
+ */
+void CMipCache::Evict(const Key& keep)
+{
+	while (mResidentBytes > mBudget && !mUse.empty() && mUse.back() != keep)
+	{
+		auto found = mLevels.find(mUse.back());
+		mResidentBytes -= found->second.mBytes;
+		CMemoryAccounting::Get().Remove(CMemoryAccounting::Sprites, LevelsKey, found->second.mBytes);
+		mLevels.erase(found);
+		mUse.pop_back();
+		mEvictions++;
+	}
+}
+
+/**
+ * Set the memory budget, freeing levels if it went down
+ * \param budget Most bytes of levels to keep
+ */
+void CMipCache::SetBudget(long long budget)
+{
+	lock_guard<mutex> lock(mMutex);
+	mBudget = budget;
+	Evict(Key(0, 0));
+}
+
+/**
+ * Free every level and reset the counts
+ */
+void CMipCache::Clear()
+{
+	lock_guard<mutex> lock(mMutex);
+	if (mResidentBytes > 0)
+	{
+		CMemoryAccounting::Get().Remove(CMemoryAccounting::Sprites, LevelsKey, mResidentBytes);
+	}
+
+	mLevels.clear();
+	mUse.clear();
+	mResidentBytes = 0;
+	mHits = 0;
+	mMisses = 0;
+	mEvictions = 0;
+}
+
+/**
+ * Get the share of finds served by a kept level
+ * \returns Hit rate from 0 to 1, 0 before any find
+ */
+double CMipCache::GetHitRate() const
+{
+	long long finds = mHits + mMisses;
+	return finds > 0 ? (double)mHits / finds : 0;
+}
+
+/**
+ * Is the downsampler compiled with SIMD instructions?
+ * \returns true if SSE2 is used
+ */
+bool CMipCache::IsVectorized()
+{
+#ifdef AQUA_MIP_SSE2
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Halve an image by averaging 2x2 blocks of premultiplied pixels,
+ * two target pixels per step where SSE2 is available.
+ *
+ * The target is (sourceWidth + 1) / 2 by (sourceHeight + 1) / 2.
+ * The result is exactly that of DownsampleScalar.
+ * \param source First source row
+ * \param sourceWidth Width of the source in pixels
+ * \param sourceHeight Height of the source in pixels
+ * \param sourceStride Pixels from one source row to the next
+ * \param target First target row
+ * \param targetStride Pixels from one target row to the next
+ */
+void CMipCache::Downsample(const uint32_t* source, int sourceWidth, int sourceHeight, int sourceStride,
+	uint32_t* target, int targetStride)
+{
+#ifdef AQUA_MIP_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i two = _mm_set1_epi16(2);
+
+	int targetHeight = (sourceHeight + 1) / 2;
+	for (int y = 0; y < targetHeight; y++)
+	{
+		const uint32_t* row0 = source + (size_t)y * 2 * sourceStride;
+		const uint32_t* row1 = source + (size_t)min(y * 2 + 1, sourceHeight - 1) * sourceStride;
+		uint32_t* row = target + (size_t)y * targetStride;
+
+		// Four source pixels of each row make two target pixels
+		int x = 0;
+		for (; x + 2 <= sourceWidth / 2; x += 2)
+		{
+			__m128i a = _mm_loadu_si128((const __m128i*)(row0 + x * 2));
+			__m128i b = _mm_loadu_si128((const __m128i*)(row1 + x * 2));
+			__m128i low = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+			__m128i high = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+			__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(low, high), _mm_unpackhi_epi64(low, high));
+			sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+			_mm_storel_epi64((__m128i*)(row + x), _mm_packus_epi16(sum, sum));
+		}
+
+		DownsampleRow(row0, row1, sourceWidth, row, x);
+	}
+#else
+	DownsampleScalar(source, sourceWidth, sourceHeight, sourceStride, target, targetStride);
+#endif
+}
+
+/**
+ * Halve an image one pixel at a time.
+ *
+ * This is the reference the vector downsampler has to match exactly.
+ * \param source First source row
+ * \param sourceWidth Width of the source in pixels
+ * \param sourceHeight Height of the source in pixels
+ * \param sourceStride Pixels from one source row to the next
+ * \param target First target row
+ * \param targetStride Pixels from one target row to the next
+ */
+void CMipCache::DownsampleScalar(const uint32_t* source, int sourceWidth, int sourceHeight, int sourceStride,
+	uint32_t* target, int targetStride)
+{
+	int targetHeight = (sourceHeight + 1) / 2;
+	for (int y = 0; y < targetHeight; y++)
+	{
+		const uint32_t* row0 = source + (size_t)y * 2 * sourceStride;
+		const uint32_t* row1 = source + (size_t)min(y * 2 + 1, sourceHeight - 1) * sourceStride;
+		DownsampleRow(row0, row1, sourceWidth, target + (size_t)y * targetStride, 0);
+	}
+}
@@ -0,0 +1,133 @@
+/**
+ * \file MipCache.h
+ *
+ * \author Grant Youngs
+ *
+ * Class that keeps reduced copies of sprites for zoomed out drawing.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include "SpriteAtlas.h"
+
+
+/**
+ * Mip levels of atlas sprites, built on demand and kept within a
+ * memory budget.
+ *
+ * Level 0 is the sprite in the atlas. Each level above it is half
+ * the width and height of the one below, made by averaging 2x2
+ * blocks of premultiplied pixels. Drawing a sprite at a quarter of
+ * its size from level 2 instead of level 0 reads a sixteenth of the
+ * pixels and does not alias.
+ *
+ * A level is built the first time it is asked for, from the level
+ * below it. Levels are kept in least recently used order, and the
+ * oldest are freed whenever the resident bytes go over the budget.
+ * Levels are keyed by sprite id, so levels of sprites that no longer
+ * exist are never found again and simply age out.
+ */
+class CMipCache
+{
+public:
+	/** One reduced copy of a sprite and its mirror, side by side */
+	struct Level
+	{
+		std::unique_ptr<Gdiplus::Bitmap> mImage;    ///< Sprite at the left, mirror at mWidth
+		int mWidth = 0;     ///< Width of the sprite at this level
+		int mHeight = 0;    ///< Height of the sprite at this level
+	};
+
+	/// Memory budget of a new cache in bytes
+	static const long long DefaultBudget = 16 * 1024 * 1024;
+
+	/// Highest level ever built
+	static const int MaxLevel = 8;
+
+	CMipCache(long long budget = DefaultBudget);
+	virtual ~CMipCache();
+
+	/// Copy constructor (disabled)
+	CMipCache(const CMipCache&) = delete;
+
+	static CMipCache& Get();
+
+	const Level* Find(const CSpriteAtlas::Sprite* sprite, int level);
+
+	void SetBudget(long long budget);
+
+	/// Get the memory budget
+	/// \returns Most bytes of levels kept
+	long long GetBudget() const { return mBudget; }
+
+	void Clear();
+
+	static int ChooseLevel(const CSpriteAtlas::Sprite* sprite, double scale);
+
+	static void Downsample(const uint32_t* source, int sourceWidth, int sourceHeight, int sourceStride,
+		uint32_t* target, int targetStride);
+	static void DownsampleScalar(const uint32_t* source, int sourceWidth, int sourceHeight, int sourceStride,
+		uint32_t* target, int targetStride);
+	static bool IsVectorized();
+
+	/// Get the number of finds served by a kept level
+	/// \returns Number of hits
+	long long GetHits() const { return mHits; }
+
+	/// Get the number of finds that had to build a level
+	/// \returns Number of misses
+	long long GetMisses() const { return mMisses; }
+
+	/// Get the number of levels freed to stay in the budget
+	/// \returns Number of evictions
+	long long GetEvictions() const { return mEvictions; }
+
+	/// Get the bytes held by kept levels
+	/// \returns Resident bytes
+	long long GetResidentBytes() const { return mResidentBytes; }
+
+	/// Get the number of kept levels
+	/// \returns Number of levels
+	int GetNumLevels() const { return (int)mLevels.size(); }
+
+	double GetHitRate() const;
+
+private:
+	/// Sprite id and level number
+	typedef std::pair<unsigned long long, int> Key;
+
+	/** A kept level and where it is in the use order */
+	struct Entry
+	{
+		Level mLevel;                       ///< The level
+		long long mBytes = 0;               ///< Bytes of pixels held
+		std::list<Key>::iterator mUse;      ///< Place in the use order
+	};
+
+	const Level* Build(const CSpriteAtlas::Sprite* sprite, int level);
+	void Evict(const Key& keep);
+
+	/// Protects the levels
+	std::mutex mMutex;
+
+	/// Most bytes of levels kept
+	long long mBudget;
+
+	/// Kept levels
+	std::map<Key, Entry> mLevels;
+
+	/// Kept levels, most recently used first
+	std::list<Key> mUse;
+
+	long long mHits = 0;            ///< Finds served by a kept level
+	long long mMisses = 0;          ///< Finds that built a level
+	long long mEvictions = 0;       ///< Levels freed to stay in the budget
+	long long mResidentBytes = 0;   ///< Bytes held by kept levels
+};
+
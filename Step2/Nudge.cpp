@@ -0,0 +1,257 @@
+/**
+ * \file Nudge.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the repeller kernel.
+ */
+
+#include "pch.h"
+#include <algorithm>
+#include <cmath>
+#include "Nudge.h"
+#include "Item.h"
+#include "Stinky.h"
+#include "ThreadPool.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+/// Defined when the kernel uses SSE2
+#define AQUA_NUDGE_SSE2
+#endif
+
+using namespace std;
+
+/// Number of items tested against the repellers together
+const size_t ChunkSize = 256;
+
+/**
+ * Push items away from repellers.
+ *
+ * Repellers themselves are never pushed.
+ * \param items Items to push
+ * \param repellers Repellers to push them away from, in order
+ * \param pool Pool to run the kernel on, null to run it on the calling thread
+ * \returns Number of items that moved
+ */
+int CNudge::Apply(const std::vector<CItem*>& items, const std::vector<Repeller>& repellers, CThreadPool* pool)
+{
+	mItems.clear();
+	mX.clear();
+	mY.clear();
+	mMinX.clear();
+	mMaxX.clear();
+	mMinY.clear();
+	mMaxY.clear();
+
+	for (auto item : items)
+	{
+		if (dynamic_cast<CStinky*>(item) != nullptr)
+		{
+			continue;
+		}
+
+		double minX, maxX, minY, maxY;
+		item->GetBounds(minX, maxX, minY, maxY);
+
+		mItems.push_back(item);
+		mX.push_back(item->GetX());
+		mY.push_back(item->GetY());
+		mMinX.push_back(minX);
+		mMaxX.push_back(maxX);
+		mMinY.push_back(minY);
+		mMaxY.push_back(maxY);
+	}
+
+	mMoved.assign(mItems.size(), 0);
+
+	size_t count = mItems.size();
+	if (pool != nullptr && count > ChunkSize)
+	{
+		// Whole chunks go to each worker, so every chunk is the same as
+		// on one thread
+		size_t chunks = (count + ChunkSize - 1) / ChunkSize;
+		pool->ParallelFor(chunks, [this, count, &repellers](size_t first, size_t last) {
+			size_t begin = first * ChunkSize;
+			size_t end = min(last * ChunkSize, count);
+			Batch part = { mX.data() + begin, mY.data() + begin, mMinX.data() + begin, mMaxX.data() + begin,
+				mMinY.data() + begin, mMaxY.data() + begin, mMoved.data() + begin, end - begin };
+			Kernel(part, repellers);
+		});
+	}
+	else
+	{
+		Batch batch = { mX.data(), mY.data(), mMinX.data(), mMaxX.data(),
+			mMinY.data(), mMaxY.data(), mMoved.data(), count };
+		Kernel(batch, repellers);
+	}
+
+	// Only moved items touch the spatial index
+	int moved = 0;
+	for (size_t i = 0; i < mItems.size(); i++)
+	{
+		if (mMoved[i])
+		{
+			mItems[i]->SetLocation(mX[i], mY[i]);
+			moved++;
+		}
+	}
+
+	return moved;
+}
+
+/**
+ * Is the kernel compiled with SIMD instructions?
+ * \returns true if SSE2 is used
+ */
+bool CNudge::IsVectorized()
+{
+#ifdef AQUA_NUDGE_SSE2
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Apply one repeller to a range of items, one item at a time.
+ *
+ * This is the reference the vector kernel has to match exactly.
+ * \param batch Items
+ * \param begin First item
+ * \param end One past the last item
+ * \param repeller Repeller to apply
+ * \returns true if any item moved
+ */
+bool CNudge::KernelScalar(const Batch& batch, size_t begin, size_t end, const Repeller& repeller)
+{
+	bool any = false;
+	for (size_t i = begin; i < end; i++)
+	{
+		// Create a vector in the direction we are from the nudger
+		double dx = batch.mX[i] - repeller.mX;
+		double dy = batch.mY[i] - repeller.mY;
+
+		// Determine how far away we are
+		double distance = sqrt(dx * dx + dy * dy);
+		if (distance > 0 && distance < repeller.mDistance)
+		{
+			double scale = repeller.mDistance / distance;
+			double x = repeller.mX + dx * scale;
+			double y = repeller.mY + dy * scale;
+
+			batch.mX[i] = max(min(x, batch.mMaxX[i]), batch.mMinX[i]);
+			batch.mY[i] = max(min(y, batch.mMaxY[i]), batch.mMinY[i]);
+			batch.mMoved[i] = 1;
+			any = true;
+		}
+	}
+
+	return any;
+}
+
+#ifdef AQUA_NUDGE_SSE2
+/**
+ * Apply one repeller to a range of items, two items at a time.
+ * \param batch Items
+ * \param begin First item
+ * \param end One past the last item
+ * \param repeller Repeller to apply
+ * \returns true if any item moved
+ */
+static bool KernelSse2(const CNudge::Batch& batch, size_t begin, size_t end, const CNudge::Repeller& repeller)
+{
+	const __m128d zero = _mm_setzero_pd();
+	const __m128d repellerX = _mm_set1_pd(repeller.mX);
+	const __m128d repellerY = _mm_set1_pd(repeller.mY);
+	const __m128d distance = _mm_set1_pd(repeller.mDistance);
+
+	int any = 0;
+	size_t i = begin;
+	for (; i + 2 <= end; i += 2)
+	{
+		__m128d x = _mm_loadu_pd(batch.mX + i);
+		__m128d y = _mm_loadu_pd(batch.mY + i);
+
+		__m128d dx = _mm_sub_pd(x, repellerX);
+		__m128d dy = _mm_sub_pd(y, repellerY);
+		__m128d length = _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)));
+
+		__m128d inside = _mm_and_pd(_mm_cmpgt_pd(length, zero), _mm_cmplt_pd(length, distance));
+		int mask = _mm_movemask_pd(inside);
+		if (mask == 0)
+		{
+			continue;
+		}
+
+		__m128d scale = _mm_div_pd(distance, length);
+		__m128d pushedX = _mm_add_pd(repellerX, _mm_mul_pd(dx, scale));
+		__m128d pushedY = _mm_add_pd(repellerY, _mm_mul_pd(dy, scale));
+		pushedX = _mm_max_pd(_mm_min_pd(pushedX, _mm_loadu_pd(batch.mMaxX + i)), _mm_loadu_pd(batch.mMinX + i));
+		pushedY = _mm_max_pd(_mm_min_pd(pushedY, _mm_loadu_pd(batch.mMaxY + i)), _mm_loadu_pd(batch.mMinY + i));
+
+		_mm_storeu_pd(batch.mX + i, _mm_or_pd(_mm_and_pd(inside, pushedX), _mm_andnot_pd(inside, x)));
+		_mm_storeu_pd(batch.mY + i, _mm_or_pd(_mm_and_pd(inside, pushedY), _mm_andnot_pd(inside, y)));
+		batch.mMoved[i] |= mask & 1;
+		batch.mMoved[i + 1] |= mask >> 1;
+		any = 1;
+	}
+
+	// An odd item left over
+	bool tail = CNudge::KernelScalar(batch, i, end, repeller);
+	return any != 0 || tail;
+}
+#endif
+
+/**
+ * Apply every repeller to every item in a single pass.
+ *
+ * For each chunk of items, a repeller farther than its distance from
+ * the chunk's bounding box is skipped. After a repeller moves items
+ * the box is measured again, so the result is exactly that of
+ * applying the repellers one after another to every item.
+ * \param batch Items
+ * \param repellers Repellers to apply, in order
+ */
+void CNudge::Kernel(const Batch& batch, const std::vector<Repeller>& repellers)
+{
+	for (size_t begin = 0; begin < batch.mCount; begin += ChunkSize)
+	{
+		size_t end = min(begin + ChunkSize, batch.mCount);
+
+		double left = 0, right = 0, top = 0, bottom = 0;
+		auto measure = [&]() {
+			left = right = batch.mX[begin];
+			top = bottom = batch.mY[begin];
+			for (size_t i = begin + 1; i < end; i++)
+			{
+				left = min(left, batch.mX[i]);
+				right = max(right, batch.mX[i]);
+				top = min(top, batch.mY[i]);
+				bottom = max(bottom, batch.mY[i]);
+			}
+		};
+
+		measure();
+		for (auto& repeller : repellers)
+		{
+			if (repeller.mX < left - repeller.mDistance || repeller.mX > right + repeller.mDistance ||
+				repeller.mY < top - repeller.mDistance || repeller.mY > bottom + repeller.mDistance)
+			{
+				continue;
+			}
+
+#ifdef AQUA_NUDGE_SSE2
+			if (KernelSse2(batch, begin, end, repeller))
+			{
+				measure();
+			}
+#else
+			if (KernelScalar(batch, begin, end, repeller))
+			{
+				measure();
+			}
+#endif
+		}
+	}
+}
@@ -0,0 +1,83 @@
+/**
+ * \file Nudge.h
+ *
+ * \author Grant Youngs
+ *
+ * Class that pushes items away from repellers such as Stinky.
+ */
+
+#pragma once
+
+#include <vector>
+
+class CItem;
+class CThreadPool;
+
+
+/**
+ * Pushes items out of the circles around any number of repellers.
+ *
+ * An item closer to a repeller than its distance is moved straight
+ * away from it onto the circle, then kept inside the tank. Repellers
+ * are applied in order, each to where the last one left the item.
+ *
+ * The item locations are copied into flat arrays and run through one
+ * kernel, SSE2 where available, that handles two items per step. The
+ * items are taken in chunks and a repeller is skipped for any chunk
+ * it cannot reach. The aquarium only passes the items its spatial
+ * index finds near some repeller, so the cost follows the number of
+ * nearby items rather than the size of the tank. Given a thread pool,
+ * the chunks are split over its workers; each item is pushed on its
+ * own, so the result is the same on any number of threads.
+ */
+class CNudge
+{
+public:
+	/** A point items are pushed away from */
+	struct Repeller
+	{
+		double mX;          ///< X location
+		double mY;          ///< Y location
+		double mDistance;   ///< Items closer than this are pushed out
+	};
+
+	/** Flat arrays of item locations and the bounds they are kept in */
+	struct Batch
+	{
+		double* mX;             ///< X locations, updated
+		double* mY;             ///< Y locations, updated
+		const double* mMinX;    ///< Smallest X of each item
+		const double* mMaxX;    ///< Largest X of each item
+		const double* mMinY;    ///< Smallest Y of each item
+		const double* mMaxY;    ///< Largest Y of each item
+		unsigned char* mMoved;  ///< Set to 1 for each item that moved
+		size_t mCount;          ///< Number of items
+	};
+
+	/// Distance Stinky pushes items to
+	static const int DefaultDistance = 200;
+
+	CNudge() {}
+
+	/// Copy constructor (disabled)
+	CNudge(const CNudge&) = delete;
+
+	int Apply(const std::vector<CItem*>& items, const std::vector<Repeller>& repellers, CThreadPool* pool = nullptr);
+
+	static void Kernel(const Batch& batch, const std::vector<Repeller>& repellers);
+
+	static bool KernelScalar(const Batch& batch, size_t begin, size_t end, const Repeller& repeller);
+
+	static bool IsVectorized();
+
+private:
+	std::vector<CItem*> mItems;         ///< Items being pushed
+	std::vector<double> mX;             ///< X location of each item
+	std::vector<double> mY;             ///< Y location of each item
+	std::vector<double> mMinX;          ///< Smallest X of each item
+	std::vector<double> mMaxX;          ///< Largest X of each item
+	std::vector<double> mMinY;          ///< Smallest Y of each item
+	std::vector<double> mMaxY;          ///< Largest Y of each item
+	std::vector<unsigned char> mMoved;  ///< Which items moved
+};
+
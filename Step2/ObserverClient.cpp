@@ -0,0 +1,255 @@
+/**
+ * \file ObserverClient.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the observer stream reference client.
+ */
+
+#include "pch.h"
+#include <winsock2.h>
+#include <afunix.h>
+#include <algorithm>
+#include <cstring>
+#include "ObserverClient.h"
+#include "ObserverStream.h"
+
+#pragma comment(lib, "ws2_32.lib")
+
+using namespace std;
+
+/// Bytes read from the stream at a time
+const int ReceiveSize = 64 * 1024;
+
+/**
+ * Read a value from a message in machine order
+ * \param bytes Where the value is
+ * \returns The value
+ */
+template <class T>
+static T Get(const char* bytes)
+{
+	T value;
+	memcpy(&value, bytes, sizeof(T));
+	return value;
+}
+
+/**
+ * Constructor
+ */
+CObserverClient::CObserverClient()
+{
+}
+
+/**
+ * Destructor
+ */
+CObserverClient::~CObserverClient()
+{
+	Close();
+}
+
+/**
+ * Connect to an observer stream
+ * \param path Socket file of the stream
+ * \returns True if connected
+ */
+bool CObserverClient::Connect(const std::wstring& path)
+{
+	Close();
+
+	WSADATA data;
+	if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+	{
+		return false;
+	}
+
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	SOCKET connection = INVALID_SOCKET;
+	if (WideCharToMultiByte(CP_ACP, 0, path.c_str(), -1, address.sun_path, sizeof(address.sun_path), nullptr, nullptr) != 0)
+	{
+		connection = socket(AF_UNIX, SOCK_STREAM, 0);
+	}
+
+	if (connection == INVALID_SOCKET)
+	{
+		WSACleanup();
+		return false;
+	}
+
+	u_long nonBlocking = 1;
+	if (connect(connection, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR ||
+		ioctlsocket(connection, FIONBIO, &nonBlocking) == SOCKET_ERROR)
+	{
+		closesocket(connection);
+		WSACleanup();
+		return false;
+	}
+
+	mSocket = connection;
+	return true;
+}
+
+/**
+ * Disconnect and forget everything received
+ */
+void CObserverClient::Close()
+{
+	if (!IsConnected())
+	{
+		return;
+	}
+
+	closesocket(mSocket);
+	mSocket = INVALID_SOCKET;
+	WSACleanup();
+
+	mIn.clear();
+	mTicks.clear();
+	mTypes.clear();
+}
+
+/**
+ * Ask for ticks of a region at a limited rate
+ * \param rate Most ticks per second, 0 for every tick
+ * \param left Left edge of the region
+ * \param top Top edge of the region
+ * \param right Right edge of the region, no larger than left for the whole world
+ * \param bottom Bottom edge of the region
+ * \returns True if the request was sent
+ */
+bool CObserverClient::Subscribe(float rate, double left, double top, double right, double bottom)
+{
+	char request[CObserverStream::SubscribeSize];
+	uint32_t kind = CObserverStream::SubscribeRequest;
+	double region[4] = { left, top, right, bottom };
+	memcpy(request, &kind, sizeof(kind));
+	memcpy(request + 4, &rate, sizeof(rate));
+	memcpy(request + 8, region, sizeof(region));
+
+	return IsConnected() && send(mSocket, request, sizeof(request), 0) == sizeof(request);
+}
+
+/**
+ * Read whatever the stream has sent, without waiting
+ * \returns False once the stream has closed the connection
+ */
+bool CObserverClient::Poll()
+{
+	if (!IsConnected())
+	{
+		return false;
+	}
+
+	size_t used = mIn.size();
+	for (;;)
+	{
+		mIn.resize(used + ReceiveSize);
+		int received = recv(mSocket, mIn.data() + used, ReceiveSize, 0);
+		if (received == 0 || (received == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK))
+		{
+			mIn.resize(used);
+			Parse();
+			return false;
+		}
+
+		if (received == SOCKET_ERROR)
+		{
+			break;
+		}
+
+		used += received;
+		mBytesReceived += received;
+	}
+
+	mIn.resize(used);
+	Parse();
+	return true;
+}
+
+/**
+ * Decode every whole message received
+ */
+void CObserverClient::Parse()
+{
+	size_t at = 0;
+	while (mIn.size() - at >= 4)
+	{
+		auto length = Get<uint32_t>(mIn.data() + at);
+		if (mIn.size() - at - 4 < length)
+		{
+			break;
+		}
+
+		const char* message = mIn.data() + at + 4;
+		at += 4 + length;
+		if (length == 0)
+		{
+			continue;
+		}
+
+		auto kind = (uint8_t)message[0];
+		if (kind == CObserverStream::TypeMessage && length >= 3)
+		{
+			auto type = Get<uint16_t>(message + 1);
+			if (mTypes.size() <= type)
+			{
+				mTypes.resize(type + 1);
+			}
+			mTypes[type] = wstring(message + 3, message + length);
+		}
+		else if (kind == CObserverStream::TickMessage && length >= 21)
+		{
+			Tick tick;
+			tick.mTick = Get<uint64_t>(message + 1);
+			tick.mTime = Get<double>(message + 9);
+			auto count = Get<uint32_t>(message + 17);
+
+			const char* item = message + 21;
+			count = (uint32_t)min<size_t>(count, (length - 21) / CObserverStream::ItemSize);
+			tick.mItems.resize(count);
+			for (auto& decoded : tick.mItems)
+			{
+				decoded.mId = Get<uint32_t>(item);
+				decoded.mType = Get<uint16_t>(item + 4);
+				decoded.mMirror = (item[6] & CObserverStream::MirrorFlag) != 0;
+				decoded.mX = Get<float>(item + 7);
+				decoded.mY = Get<float>(item + 11);
+				item += CObserverStream::ItemSize;
+			}
+
+			mTicks.push_back(move(tick));
+			mNumTicks++;
+		}
+	}
+
+	mIn.erase(mIn.begin(), mIn.begin() + at);
+}
+
+/**
+ * Take the oldest tick received
+ * \param tick Receives the tick
+ * \returns False if no tick is waiting
+ */
+bool CObserverClient::Next(Tick& tick)
+{
+	if (mTicks.empty())
+	{
+		return false;
+	}
+
+	tick = move(mTicks.front());
+	mTicks.pop_front();
+	return true;
+}
+
+/**
+ * Get the name of a type number
+ * \param type Type number from an item
+ * \returns Type name, empty if the type was never named
+ */
+std::wstring CObserverClient::GetTypeName(uint16_t type) const
+{
+	return type < mTypes.size() ? mTypes[type] : wstring();
+}
@@ -0,0 +1,92 @@
+/**
+ * \file ObserverClient.h
+ *
+ * \author Grant Youngs
+ *
+ * Reference client of the observer stream.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+
+/**
+ * Connects to an observer stream and decodes what it publishes.
+ *
+ * This is the reference for dashboards reading the stream. It never
+ * waits: Poll reads whatever has arrived, and complete ticks are then
+ * taken in order with Next. See CObserverStream for the messages.
+ */
+class CObserverClient
+{
+public:
+	/** An item as published in a tick */
+	struct Item
+	{
+		unsigned mId = 0;       ///< Item id
+		uint16_t mType = 0;     ///< Type number, named by GetTypeName
+		bool mMirror = false;   ///< True if the image is mirrored
+		float mX = 0;           ///< X location
+		float mY = 0;           ///< Y location
+	};
+
+	/** The items in a subscriber's region at one tick */
+	struct Tick
+	{
+		uint64_t mTick = 0;         ///< Tick number
+		double mTime = 0;           ///< Aquarium time
+		std::vector<Item> mItems;   ///< Items in the region
+	};
+
+	CObserverClient();
+	virtual ~CObserverClient();
+
+	/// Copy constructor (disabled)
+	CObserverClient(const CObserverClient&) = delete;
+
+	bool Connect(const std::wstring& path);
+	void Close();
+
+	/// Is the client connected to a stream?
+	/// \returns true if connected
+	bool IsConnected() const { return mSocket != ~(uintptr_t)0; }
+
+	bool Subscribe(float rate, double left = 0, double top = 0, double right = 0, double bottom = 0);
+
+	bool Poll();
+
+	bool Next(Tick& tick);
+
+	std::wstring GetTypeName(uint16_t type) const;
+
+	/// Get the number of ticks received
+	/// \returns Number of ticks
+	long long GetNumTicks() const { return mNumTicks; }
+
+	/// Get the bytes received
+	/// \returns Bytes received
+	long long GetBytesReceived() const { return mBytesReceived; }
+
+private:
+	void Parse();
+
+	/// Socket to the stream, all bits set when not connected
+	uintptr_t mSocket = ~(uintptr_t)0;
+
+	/// Bytes received that do not make a whole message yet
+	std::vector<char> mIn;
+
+	/// Ticks received and not taken yet
+	std::deque<Tick> mTicks;
+
+	/// Type names in order of their numbers
+	std::vector<std::wstring> mTypes;
+
+	long long mNumTicks = 0;        ///< Ticks received
+	long long mBytesReceived = 0;   ///< Bytes received
+};
+
@@ -0,0 +1,441 @@
+/**
+ * \file ObserverStream.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the observer stream.
+ */
+
+#include "pch.h"
+#include <winsock2.h>
+#include <afunix.h>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include "ObserverStream.h"
+#include "Aquarium.h"
+#include "TraceLog.h"
+
+#pragma comment(lib, "ws2_32.lib")
+
+using namespace std;
+
+/// Bytes read from a subscriber at a time
+const int ReadSize = 256;
+
+/**
+ * Append a value to a message in machine order, which is little
+ * endian on every platform we build for
+ * \param message Message to append to
+ * \param value Value to append
+ */
+template <class T>
+static void Put(std::vector<char>& message, T value)
+{
+	size_t at = message.size();
+	message.resize(at + sizeof(T));
+	memcpy(message.data() + at, &value, sizeof(T));
+}
+
+/**
+ * Constructor
+ */
+CObserverStream::CObserverStream()
+{
+}
+
+/**
+ * Destructor
+ */
+CObserverStream::~CObserverStream()
+{
+	Close();
+}
+
+/**
+ * Start listening for subscribers
+ * \param path Socket file subscribers connect to
+ * \returns True if the stream is listening
+ */
+bool CObserverStream::Open(const std::wstring& path)
+{
+	Close();
+
+	WSADATA data;
+	if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+	{
+		return false;
+	}
+
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	SOCKET listener = INVALID_SOCKET;
+	if (WideCharToMultiByte(CP_ACP, 0, path.c_str(), -1, address.sun_path, sizeof(address.sun_path), nullptr, nullptr) != 0)
+	{
+		listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	}
+
+	if (listener == INVALID_SOCKET)
+	{
+		WSACleanup();
+		return false;
+	}
+
+	// The socket file of an earlier run would keep bind from working
+	DeleteFile(path.c_str());
+
+	u_long nonBlocking = 1;
+	if (bind(listener, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR ||
+		listen(listener, SOMAXCONN) == SOCKET_ERROR ||
+		ioctlsocket(listener, FIONBIO, &nonBlocking) == SOCKET_ERROR)
+	{
+		closesocket(listener);
+		WSACleanup();
+		return false;
+	}
+
+	mListener = listener;
+	mPath = path;
+	return true;
+}
+
+/**
+ * Disconnect every subscriber and stop listening
+ */
+void CObserverStream::Close()
+{
+	if (!IsOpen())
+	{
+		return;
+	}
+
+	for (auto& subscriber : mSubscribers)
+	{
+		closesocket(subscriber.mSocket);
+	}
+	mSubscribers.clear();
+
+	closesocket(mListener);
+	mListener = INVALID_SOCKET;
+	DeleteFile(mPath.c_str());
+	WSACleanup();
+}
+
+/**
+ * Publish the current state of an aquarium to every subscriber
+ * that is due a tick, without waiting on any of them.
+ *
+ * Called once per simulation tick.
+ * \param aquarium Aquarium to publish
+ */
+void CObserverStream::Publish(CAquarium* aquarium)
+{
+	if (!IsOpen())
+	{
+		return;
+	}
+
+	AQUA_TRACE_SCOPE("Publish");
+	auto start = chrono::steady_clock::now();
+
+	Accept();
+	mTicks++;
+
+	// Subscribers to the whole world share one message
+	bool worldEncoded = false;
+
+	for (auto& subscriber : mSubscribers)
+	{
+		Read(subscriber);
+		if (subscriber.mClosed)
+		{
+			continue;
+		}
+
+		if (start < subscriber.mNext)
+		{
+			mSkipped++;
+		}
+		else
+		{
+			if (subscriber.mInterval > 0)
+			{
+				subscriber.mNext = start +
+					chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(subscriber.mInterval));
+			}
+
+			if (!subscriber.mWholeWorld)
+			{
+				aquarium->Query(subscriber.mLeft, subscriber.mTop, subscriber.mRight, subscriber.mBottom, mFound);
+				EncodeTick(aquarium, mFound, mMessage);
+				Queue(subscriber, mMessage);
+			}
+			else
+			{
+				if (!worldEncoded)
+				{
+					aquarium->Query(0, 0, aquarium->GetWidth(), aquarium->GetHeight(), mFound);
+					EncodeTick(aquarium, mFound, mWorldMessage);
+					worldEncoded = true;
+				}
+
+				Queue(subscriber, mWorldMessage);
+			}
+
+			mMessages++;
+		}
+
+		Flush(subscriber);
+	}
+
+	// Sockets are closed before removing, which moves the survivors over them
+	for (auto& subscriber : mSubscribers)
+	{
+		if (subscriber.mClosed)
+		{
+			closesocket(subscriber.mSocket);
+		}
+	}
+
+	mSubscribers.erase(remove_if(mSubscribers.begin(), mSubscribers.end(), [](const Subscriber& subscriber) {
+		return subscriber.mClosed;
+	}), mSubscribers.end());
+
+	mPublishSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Accept every subscriber waiting to connect and send it the known types
+ */
+void CObserverStream::Accept()
+{
+	for (;;)
+	{
+		SOCKET connection = accept(mListener, nullptr, nullptr);
+		if (connection == INVALID_SOCKET)
+		{
+			break;
+		}
+
+		u_long nonBlocking = 1;
+		if (ioctlsocket(connection, FIONBIO, &nonBlocking) == SOCKET_ERROR)
+		{
+			closesocket(connection);
+			continue;
+		}
+
+		Subscriber subscriber;
+		subscriber.mSocket = connection;
+		for (size_t type = 0; type < mTypes.size(); type++)
+		{
+			Queue(subscriber, TypeMessageFor((uint16_t)type));
+		}
+
+		mSubscribers.push_back(move(subscriber));
+	}
+}
+
+/**
+ * Read whatever requests a subscriber has sent, and note if it
+ * disconnected or sent something that is not a request
+ * \param subscriber Subscriber to read from
+ */
+void CObserverStream::Read(Subscriber& subscriber)
+{
+	char buffer[ReadSize];
+	for (;;)
+	{
+		int received = recv(subscriber.mSocket, buffer, ReadSize, 0);
+		if (received == 0 || (received == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK))
+		{
+			subscriber.mClosed = true;
+			return;
+		}
+
+		if (received == SOCKET_ERROR)
+		{
+			break;
+		}
+
+		subscriber.mIn.insert(subscriber.mIn.end(), buffer, buffer + received);
+	}
+
+	size_t used = 0;
+	while (subscriber.mIn.size() - used >= SubscribeSize)
+	{
+		const char* request = subscriber.mIn.data() + used;
+		uint32_t kind;
+		float rate;
+		double region[4];
+		memcpy(&kind, request, sizeof(kind));
+		memcpy(&rate, request + 4, sizeof(rate));
+		memcpy(region, request + 8, sizeof(region));
+		used += SubscribeSize;
+
+		if (kind != SubscribeRequest)
+		{
+			subscriber.mClosed = true;
+			return;
+		}
+
+		// A new request takes effect on the next tick
+		subscriber.mInterval = rate > 0 ? 1 / rate : 0;
+		subscriber.mNext = chrono::steady_clock::time_point();
+		subscriber.mWholeWorld = !(region[2] > region[0] && region[3] > region[1]);
+		subscriber.mLeft = region[0];
+		subscriber.mTop = region[1];
+		subscriber.mRight = region[2];
+		subscriber.mBottom = region[3];
+	}
+
+	subscriber.mIn.erase(subscriber.mIn.begin(), subscriber.mIn.begin() + used);
+}
+
+/**
+ * Add a message to the backlog of a subscriber, dropping the
+ * subscriber if that would make the backlog too large
+ * \param subscriber Subscriber to send to
+ * \param message Message to send
+ */
+void CObserverStream::Queue(Subscriber& subscriber, const std::vector<char>& message)
+{
+	if (subscriber.mClosed)
+	{
+		return;
+	}
+
+	if (subscriber.mOut.size() - subscriber.mSent + message.size() > mMaxBacklog)
+	{
+		subscriber.mClosed = true;
+		mDropped++;
+		return;
+	}
+
+	// Reclaim what was sent once it is most of the buffer
+	if (subscriber.mSent > 0 && subscriber.mSent >= subscriber.mOut.size() / 2)
+	{
+		subscriber.mOut.erase(subscriber.mOut.begin(), subscriber.mOut.begin() + subscriber.mSent);
+		subscriber.mSent = 0;
+	}
+
+	subscriber.mOut.insert(subscriber.mOut.end(), message.begin(), message.end());
+}
+
+/**
+ * Send as much of the backlog of a subscriber as its socket takes
+ * without waiting
+ * \param subscriber Subscriber to send to
+ */
+void CObserverStream::Flush(Subscriber& subscriber)
+{
+	while (!subscriber.mClosed && subscriber.mSent < subscriber.mOut.size())
+	{
+		int size = (int)min(subscriber.mOut.size() - subscriber.mSent, (size_t)INT_MAX);
+		int sent = send(subscriber.mSocket, subscriber.mOut.data() + subscriber.mSent, size, 0);
+		if (sent == SOCKET_ERROR)
+		{
+			if (WSAGetLastError() != WSAEWOULDBLOCK)
+			{
+				subscriber.mClosed = true;
+			}
+			break;
+		}
+
+		subscriber.mSent += sent;
+		mBytesSent += sent;
+	}
+
+	if (subscriber.mSent == subscriber.mOut.size())
+	{
+		subscriber.mOut.clear();
+		subscriber.mSent = 0;
+	}
+}
+
+/**
+ * Get the number of an item type, telling every subscriber about
+ * the type the first time it is seen
+ * \param name Type name
+ * \returns Type number
+ */
+uint16_t CObserverStream::FindType(const wchar_t* name)
+{
+	auto found = mTypeNumbers.find(name);
+	if (found != mTypeNumbers.end())
+	{
+		return found->second;
+	}
+
+	auto type = (uint16_t)mTypes.size();
+	mTypes.push_back(name);
+	mTypeNumbers[name] = type;
+
+	auto message = TypeMessageFor(type);
+	for (auto& subscriber : mSubscribers)
+	{
+		Queue(subscriber, message);
+	}
+
+	return type;
+}
+
+/**
+ * Build the message that names a type
+ * \param type Type number
+ * \returns Type message
+ */
+std::vector<char> CObserverStream::TypeMessageFor(uint16_t type) const
+{
+	const auto& name = mTypes[type];
+
+	vector<char> message;
+	Put<uint32_t>(message, (uint32_t)(1 + 2 + name.size()));
+	Put<uint8_t>(message, TypeMessage);
+	Put<uint16_t>(message, type);
+	for (auto c : name)
+	{
+		message.push_back((char)c);
+	}
+
+	return message;
+}
+
+/**
+ * Build the tick message for a set of items
+ * \param aquarium Aquarium the items are in
+ * \param items Items to include
+ * \param message Receives the tick message
+ */
+void CObserverStream::EncodeTick(CAquarium* aquarium, const std::vector<CItem*>& items, std::vector<char>& message)
+{
+	message.clear();
+	message.reserve(4 + 1 + 8 + 8 + 4 + items.size() * ItemSize);
+
+	Put<uint32_t>(message, 0);
+	Put<uint8_t>(message, TickMessage);
+	Put<uint64_t>(message, (uint64_t)mTicks);
+	Put<double>(message, aquarium->GetTime());
+	Put<uint32_t>(message, (uint32_t)items.size());
+
+	// Items of one type are usually together, so the last name is checked first
+	const wchar_t* lastName = nullptr;
+	uint16_t lastType = 0;
+	for (auto item : items)
+	{
+		const wchar_t* name = item->GetType();
+		if (name != lastName)
+		{
+			lastType = FindType(name);
+			lastName = name;
+		}
+
+		Put<uint32_t>(message, item->GetId());
+		Put<uint16_t>(message, lastType);
+		Put<uint8_t>(message, item->IsMirror() ? MirrorFlag : 0);
+		Put<float>(message, (float)item->GetX());
+		Put<float>(message, (float)item->GetY());
+	}
+
+	auto length = (uint32_t)(message.size() - 4);
+	memcpy(message.data(), &length, sizeof(length));
+}
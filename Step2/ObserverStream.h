@@ -0,0 +1,173 @@
+/**
+ * \file ObserverStream.h
+ *
+ * \author Grant Youngs
+ *
+ * Class that publishes the aquarium state to local subscribers.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+class CAquarium;
+class CItem;
+
+
+/**
+ * Publishes the state of an aquarium every tick to any number of
+ * local subscribers over a Unix domain socket.
+ *
+ * Everything is little endian. Each message from the stream is a
+ * uint32 length of the rest of the message, a uint8 kind, and then:
+ *
+ *   TypeMessage: uint16 type number, then the type name in ASCII.
+ *   Sent for every known type when a subscriber connects, and again
+ *   to everyone the first time a type is seen.
+ *
+ *   TickMessage: uint64 tick, double aquarium time, uint32 count, then
+ *   for each item a uint32 id, uint16 type number, uint8 flags
+ *   (MirrorFlag), and float X and Y locations.
+ *
+ * A subscriber may send a SubscribeSize request at any time: a uint32
+ * SubscribeRequest, a float most ticks per second (0 for every tick),
+ * and double left, top, right and bottom of the region it watches
+ * (an empty region for the whole world).
+ *
+ * Publish never blocks. Every socket is non-blocking, and what a
+ * subscriber has not read yet waits in its backlog. A subscriber
+ * whose backlog grows past the limit is dropped.
+ */
+class CObserverStream
+{
+public:
+	/** Kinds of message from the stream */
+	enum MessageKind { TypeMessage = 1, TickMessage = 2 };
+
+	/// Kind of the request from a subscriber
+	static const uint32_t SubscribeRequest = 1;
+
+	/// Bytes in a subscribe request
+	static const int SubscribeSize = 40;
+
+	/// Bytes of each item in a tick message
+	static const int ItemSize = 15;
+
+	/// Item flag set when the image is mirrored
+	static const uint8_t MirrorFlag = 1;
+
+	/// Backlog a subscriber may have before it is dropped
+	static const size_t DefaultMaxBacklog = 1024 * 1024;
+
+	CObserverStream();
+	virtual ~CObserverStream();
+
+	/// Copy constructor (disabled)
+	CObserverStream(const CObserverStream&) = delete;
+
+	bool Open(const std::wstring& path);
+	void Close();
+
+	/// Is the stream listening for subscribers?
+	/// \returns true if open
+	bool IsOpen() const { return mListener != ~(uintptr_t)0; }
+
+	void Publish(CAquarium* aquarium);
+
+	/// Set the backlog a subscriber may have before it is dropped
+	/// \param bytes Largest backlog in bytes
+	void SetMaxBacklog(size_t bytes) { mMaxBacklog = bytes; }
+
+	/// Get the number of connected subscribers
+	/// \returns Number of subscribers
+	int GetNumSubscribers() const { return (int)mSubscribers.size(); }
+
+	/// Get the number of ticks published
+	/// \returns Number of ticks
+	long long GetNumTicks() const { return mTicks; }
+
+	/// Get the number of subscribers dropped for falling behind
+	/// \returns Number of slow subscribers dropped
+	long long GetNumDropped() const { return mDropped; }
+
+	/// Get the number of tick messages queued for subscribers
+	/// \returns Number of messages
+	long long GetNumMessages() const { return mMessages; }
+
+	/// Get the number of ticks subscribers skipped for their rate limit
+	/// \returns Number of skipped ticks
+	long long GetNumSkipped() const { return mSkipped; }
+
+	/// Get the bytes sent to subscribers
+	/// \returns Bytes sent
+	long long GetBytesSent() const { return mBytesSent; }
+
+	/// Get the time spent publishing
+	/// \returns Seconds in Publish
+	double GetPublishSeconds() const { return mPublishSeconds; }
+
+private:
+	/** A connected subscriber */
+	struct Subscriber
+	{
+		uintptr_t mSocket;              ///< Socket to the subscriber
+		std::vector<char> mIn;          ///< Partial request received
+		std::vector<char> mOut;         ///< Messages not sent yet
+		size_t mSent = 0;               ///< Bytes at the front of mOut already sent
+		double mInterval = 0;           ///< Least seconds between ticks, 0 for every tick
+		std::chrono::steady_clock::time_point mNext;  ///< Earliest time of the next tick
+		bool mWholeWorld = true;        ///< True to watch the whole world
+		double mLeft = 0;               ///< Left edge of the watched region
+		double mTop = 0;                ///< Top edge of the watched region
+		double mRight = 0;              ///< Right edge of the watched region
+		double mBottom = 0;             ///< Bottom edge of the watched region
+		bool mClosed = false;           ///< True once the subscriber is to be removed
+	};
+
+	void Accept();
+	void Read(Subscriber& subscriber);
+	void Flush(Subscriber& subscriber);
+	void Queue(Subscriber& subscriber, const std::vector<char>& message);
+	uint16_t FindType(const wchar_t* name);
+	std::vector<char> TypeMessageFor(uint16_t type) const;
+	void EncodeTick(CAquarium* aquarium, const std::vector<CItem*>& items, std::vector<char>& message);
+
+	/// Listening socket, all bits set when closed
+	uintptr_t mListener = ~(uintptr_t)0;
+
+	/// Path of the socket file
+	std::wstring mPath;
+
+	/// Connected subscribers
+	std::vector<Subscriber> mSubscribers;
+
+	/// Type names in order of their numbers
+	std::vector<std::wstring> mTypes;
+
+	/// Type numbers by name
+	std::map<std::wstring, uint16_t> mTypeNumbers;
+
+	/// Items found in the region of a subscriber
+	std::vector<CItem*> mFound;
+
+	/// Tick message of a region being built
+	std::vector<char> mMessage;
+
+	/// Tick message of the whole world
+	std::vector<char> mWorldMessage;
+
+	/// Backlog a subscriber may have before it is dropped
+	size_t mMaxBacklog = DefaultMaxBacklog;
+
+	long long mTicks = 0;           ///< Ticks published
+	long long mDropped = 0;         ///< Subscribers dropped for falling behind
+	long long mMessages = 0;        ///< Tick messages queued
+	long long mSkipped = 0;         ///< Ticks skipped for rate limits
+	long long mBytesSent = 0;       ///< Bytes sent to subscribers
+	double mPublishSeconds = 0;     ///< Time spent publishing
+};
+
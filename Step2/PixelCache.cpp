@@ -0,0 +1,309 @@
+/**
+ * \file PixelCache.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the decoded pixel cache.
+ */
+
+#include "pch.h"
+#include <cstring>
+#include <fstream>
+#include "PixelCache.h"
+#include "MemoryAccounting.h"
+
+using namespace std;
+
+/// First bytes of a pixel cache file
+const char Magic[4] = { 'A', 'Q', 'P', 'X' };
+
+/// Version of the pixel cache format
+const uint32_t Version = 1;
+
+/// Pixel data starts on a multiple of this many bytes
+const uint64_t Alignment = 16;
+
+/// Memory accounting key of the mapped file
+const wstring MappingKey = L"pixel cache";
+
+/** Start of a pixel cache file */
+struct Header
+{
+	char mMagic[4];         ///< Always Magic
+	uint32_t mVersion;      ///< Always Version
+	uint32_t mCount;        ///< Number of entries after the header
+	uint32_t mReserved;     ///< Zero
+};
+
+/** One image in a pixel cache file */
+struct Entry
+{
+	uint64_t mHash;         ///< Hash of the source file
+	uint32_t mWidth;        ///< Width in pixels
+	uint32_t mHeight;       ///< Height in pixels
+	uint32_t mOpaque;       ///< Nonzero if the source had no alpha
+	uint32_t mReserved;     ///< Zero
+	uint64_t mOffset;       ///< Offset of the pixels from the start of the file
+};
+
+/**
+ * Destructor
+ */
+CPixelCache::~CPixelCache()
+{
+	Close();
+}
+
+/**
+ * Hash a source file. Equal files hash equal on every machine.
+ * \param data File contents
+ * \param size Size of the contents in bytes
+ * \returns 64 bit FNV-1a hash
+ */
+uint64_t CPixelCache::Hash(const void* data, size_t size)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	auto bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+/**
+ * Map a cache file written by Save.
+ *
+ * A missing or damaged file leaves the cache empty, so every
+ * image misses and is decoded.
+ * \param path Cache file
+ * \returns True if the file was mapped
+ */
+bool CPixelCache::Open(const std::wstring& path)
+{
+	lock_guard<mutex> lock(mMutex);
+	if (mView != nullptr)
+	{
+		return false;
+	}
+
+	HANDLE file = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart < (LONGLONG)sizeof(Header))
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	const void* view = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (view == nullptr)
+	{
+		if (mapping != nullptr)
+		{
+			CloseHandle(mapping);
+		}
+		CloseHandle(file);
+		return false;
+	}
+
+	mFile = file;
+	mMapping = mapping;
+	mView = (const unsigned char*)view;
+	mViewSize = size.QuadPart;
+	CMemoryAccounting::Get().Add(CMemoryAccounting::Sprites, MappingKey, mViewSize);
+
+	auto header = (const Header*)mView;
+	uint64_t tableEnd = sizeof(Header) + (uint64_t)header->mCount * sizeof(Entry);
+	if (memcmp(header->mMagic, Magic, sizeof(Magic)) != 0 || header->mVersion != Version ||
+		tableEnd > (uint64_t)mViewSize)
+	{
+		return true;
+	}
+
+	auto entries = (const Entry*)(mView + sizeof(Header));
+	for (uint32_t i = 0; i < header->mCount; i++)
+	{
+		auto& entry = entries[i];
+		uint64_t bytes = (uint64_t)entry.mWidth * entry.mHeight * 4;
+		if (entry.mOffset < tableEnd || entry.mOffset + bytes > (uint64_t)mViewSize)
+		{
+			continue;
+		}
+
+		Image image;
+		image.mPixels = (const uint32_t*)(mView + entry.mOffset);
+		image.mWidth = entry.mWidth;
+		image.mHeight = entry.mHeight;
+		image.mOpaque = entry.mOpaque != 0;
+		mMapped[entry.mHash] = image;
+	}
+
+	return true;
+}
+
+/**
+ * Unmap the open file. Pixels found in it may no longer be used.
+ */
+void CPixelCache::Close()
+{
+	lock_guard<mutex> lock(mMutex);
+	if (mView == nullptr)
+	{
+		return;
+	}
+
+	UnmapViewOfFile(mView);
+	CloseHandle(mMapping);
+	CloseHandle(mFile);
+	CMemoryAccounting::Get().Remove(CMemoryAccounting::Sprites, MappingKey, mViewSize);
+
+	mView = nullptr;
+	mMapping = nullptr;
+	mFile = nullptr;
+	mViewSize = 0;
+	mMapped.clear();
+	mUsed.clear();
+}
+
+/**
+ * Find the decoded pixels of a source file
+ * \param hash Hash of the source file
+ * \param image Receives the pixels, valid until the cache is closed
+ * \returns True if the image is in the cache
+ */
+bool CPixelCache::Find(uint64_t hash, Image& image)
+{
+	lock_guard<mutex> lock(mMutex);
+
+	auto mapped = mMapped.find(hash);
+	if (mapped != mMapped.end())
+	{
+		mUsed.insert(hash);
+		image = mapped->second;
+		return true;
+	}
+
+	auto added = mAdded.find(hash);
+	if (added != mAdded.end())
+	{
+		auto& pixels = added->second;
+		image.mPixels = pixels.mPixels.data();
+		image.mWidth = pixels.mWidth;
+		image.mHeight = pixels.mHeight;
+		image.mOpaque = pixels.mOpaque;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * Add the decoded pixels of a source file, to be written by Save
+ * \param hash Hash of the source file
+ * \param width Width in pixels
+ * \param height Height in pixels
+ * \param opaque True if the source had no alpha
+ * \param pixels Rows of premultiplied ARGB, taken over by the cache
+ * \returns The added image, valid until the cache is destroyed
+ */
+CPixelCache::Image CPixelCache::Add(uint64_t hash, int width, int height, bool opaque, std::vector<uint32_t>&& pixels)
+{
+	lock_guard<mutex> lock(mMutex);
+
+	auto& added = mAdded[hash];
+	added.mWidth = width;
+	added.mHeight = height;
+	added.mOpaque = opaque;
+	added.mPixels = move(pixels);
+
+	Image image;
+	image.mPixels = added.mPixels.data();
+	image.mWidth = width;
+	image.mHeight = height;
+	image.mOpaque = opaque;
+	return image;
+}
+
+/**
+ * Determine if Save would write anything different from the open file
+ * \returns True if images were added or some were not used
+ */
+bool CPixelCache::IsDirty()
+{
+	lock_guard<mutex> lock(mMutex);
+	return !mAdded.empty() || mUsed.size() != mMapped.size();
+}
+
+/**
+ * Write every image used or added this run to a new cache file.
+ *
+ * The file is written beside the target and moved over it, so a
+ * failed save never leaves a damaged cache. The open file is
+ * closed first, since it may be the one being replaced.
+ * \param path Cache file
+ * \returns True if the file was written
+ */
+bool CPixelCache::Save(const std::wstring& path)
+{
+	vector<pair<Entry, const uint32_t*>> images;
+	wstring temp = path + L".tmp";
+	{
+		lock_guard<mutex> lock(mMutex);
+
+		for (auto hash : mUsed)
+		{
+			auto& image = mMapped[hash];
+			Entry entry = { hash, (uint32_t)image.mWidth, (uint32_t)image.mHeight, image.mOpaque ? 1u : 0u, 0, 0 };
+			images.push_back(make_pair(entry, image.mPixels));
+		}
+
+		for (auto& added : mAdded)
+		{
+			auto& image = added.second;
+			Entry entry = { added.first, (uint32_t)image.mWidth, (uint32_t)image.mHeight, image.mOpaque ? 1u : 0u, 0, 0 };
+			images.push_back(make_pair(entry, image.mPixels.data()));
+		}
+
+		// Lay the pixels out after the table
+		uint64_t offset = sizeof(Header) + images.size() * sizeof(Entry);
+		for (auto& image : images)
+		{
+			offset = (offset + Alignment - 1) / Alignment * Alignment;
+			image.first.mOffset = offset;
+			offset += (uint64_t)image.first.mWidth * image.first.mHeight * 4;
+		}
+
+		ofstream out(temp, ios::binary);
+		Header header = { { Magic[0], Magic[1], Magic[2], Magic[3] }, Version, (uint32_t)images.size(), 0 };
+		out.write((const char*)&header, sizeof(header));
+		for (auto& image : images)
+		{
+			out.write((const char*)&image.first, sizeof(Entry));
+		}
+
+		for (auto& image : images)
+		{
+			static const char zeros[Alignment] = {};
+			out.write(zeros, image.first.mOffset - (uint64_t)out.tellp());
+			out.write((const char*)image.second, (streamsize)image.first.mWidth * image.first.mHeight * 4);
+		}
+
+		if (!out)
+		{
+			return false;
+		}
+	}
+
+	// Mapped pixels were copied above, so the file can be let go of.
+	// Images added this run stay valid.
+	Close();
+	return MoveFileEx(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
@@ -0,0 +1,101 @@
+/**
+ * \file PixelCache.h
+ *
+ * \author Grant Youngs
+ *
+ * Class that keeps decoded image pixels on disk between runs.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+
+/**
+ * A file of decoded, premultiplied ARGB pixels keyed by a hash of
+ * the source image file.
+ *
+ * The file is memory mapped when opened, so finding an image costs
+ * nothing beyond touching its pages, and the pixels are used where
+ * they lie in the mapping. An edited image hashes differently and
+ * simply misses. Images decoded on a miss are added, and Save
+ * writes a new file holding every image used this run.
+ *
+ * Find and Add may be called from several threads at once.
+ */
+class CPixelCache
+{
+public:
+	/** Decoded pixels of one image */
+	struct Image
+	{
+		const uint32_t* mPixels = nullptr;  ///< Rows of premultiplied ARGB, no padding
+		int mWidth = 0;                     ///< Width in pixels
+		int mHeight = 0;                    ///< Height in pixels
+		bool mOpaque = false;               ///< True if the source had no alpha
+	};
+
+	CPixelCache() {}
+	virtual ~CPixelCache();
+
+	/// Copy constructor (disabled)
+	CPixelCache(const CPixelCache&) = delete;
+
+	bool Open(const std::wstring& path);
+	void Close();
+
+	bool Find(uint64_t hash, Image& image);
+	Image Add(uint64_t hash, int width, int height, bool opaque, std::vector<uint32_t>&& pixels);
+
+	bool Save(const std::wstring& path);
+
+	/// Determine if Save would write anything different from the open file
+	/// \returns True if images were added or some were not used
+	bool IsDirty();
+
+	/// Get the number of images in the open file
+	/// \returns Number of mapped images
+	int GetNumMapped() const { return (int)mMapped.size(); }
+
+	static uint64_t Hash(const void* data, size_t size);
+
+private:
+	/** An image added this run */
+	struct Added
+	{
+		int mWidth;                     ///< Width in pixels
+		int mHeight;                    ///< Height in pixels
+		bool mOpaque;                   ///< True if the source had no alpha
+		std::vector<uint32_t> mPixels;  ///< Rows of premultiplied ARGB
+	};
+
+	/// Protects the tables
+	std::mutex mMutex;
+
+	/// Open file handle
+	void* mFile = nullptr;
+
+	/// File mapping handle
+	void* mMapping = nullptr;
+
+	/// Start of the mapped file
+	const unsigned char* mView = nullptr;
+
+	/// Size of the mapped file in bytes
+	long long mViewSize = 0;
+
+	/// Images in the mapped file by hash
+	std::map<uint64_t, Image> mMapped;
+
+	/// Mapped images found this run
+	std::set<uint64_t> mUsed;
+
+	/// Images added this run by hash
+	std::map<uint64_t, Added> mAdded;
+};
+
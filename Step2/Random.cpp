@@ -0,0 +1,238 @@
+/**
+ * \file Random.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the xoshiro256** random number generator.
+ */
+
+#include "pch.h"
+#include <cmath>
+#include <sstream>
+#include <iomanip>
+#include "Random.h"
+
+using namespace std;
+
+/// Number of interleaved generators used by FillUniform
+const int Lanes = 4;
+
+/**
+ * One step of the splitmix64 generator, used to expand seeds
+ * \param x Splitmix state, advanced by the call
+ * \returns Next splitmix output
+ */
+static uint64_t SplitMix(uint64_t& x)
+{
+	uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/**
+ * Constructor
+ * \param seed Seed value
+ * \param stream Stream of the seed to generate
+ */
+CRandom::CRandom(uint64_t seed, uint64_t stream)
+{
+	Seed(seed, stream);
+}
+
+/**
+ * Restart the generator on a stream of a seed.
+ *
+ * The seed and stream number are mixed through splitmix64, so
+ * neighboring streams produce unrelated sequences.
+ * \param seed Seed value
+ * \param stream Stream of the seed to generate
+ */
+void CRandom::Seed(uint64_t seed, uint64_t stream)
+{
+	uint64_t x = seed;
+	uint64_t mixed = SplitMix(x) ^ (stream * 0xd1342543de82ef95ULL);
+
+	x = mixed;
+	for (auto& s : mState)
+	{
+		s = SplitMix(x);
+	}
+}
+
+/**
+ * Create an independent generator from this one.
+ *
+ * Used to give each worker thread its own generator. Advances
+ * this generator, so repeated splits produce different children.
+ * \returns New generator
+ */
+CRandom CRandom::Split()
+{
+	CRandom child;
+	uint64_t x = Next();
+	for (auto& s : child.mState)
+	{
+		s = SplitMix(x);
+	}
+
+	return child;
+}
+
+/**
+ * Generate a double from a normal distribution.
+ *
+ * Uses one Box-Muller transform per value, so every value takes
+ * exactly two draws and nothing is kept between calls.
+ * \param mean Mean of the distribution
+ * \param deviation Standard deviation of the distribution
+ * \returns Random value
+ */
+double CRandom::Normal(double mean, double deviation)
+{
+	const double TwoPi = 6.283185307179586;
+
+	// In (0, 1], so the log is finite
+	double u1 = 1.0 - NextDouble();
+	double u2 = NextDouble();
+	return mean + deviation * sqrt(-2.0 * log(u1)) * cos(TwoPi * u2);
+}
+
+/**
+ * Pick an index with a probability proportional to its weight.
+ * \param weights Weights, none negative and at least one positive
+ * \param count Number of weights
+ * \returns Index of the picked weight
+ */
+int CRandom::Pick(const double* weights, int count)
+{
+	double total = 0;
+	for (int i = 0; i < count; i++)
+	{
+		total += weights[i];
+	}
+
+	double u = NextDouble() * total;
+	int last = 0;
+	double sum = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (weights[i] > 0)
+		{
+			sum += weights[i];
+			last = i;
+			if (u < sum)
+			{
+				return i;
+			}
+		}
+	}
+
+	// Rounding can leave u at the total
+	return last;
+}
+
+/**
+ * Fill an array with doubles uniformly distributed in [low, high).
+ *
+ * Values come from four interleaved generators seeded from this
+ * one. Each step has no dependency between lanes, so the compiler
+ * can keep the lanes in vector registers. The output depends only
+ * on this generator's state and the count.
+ * \param values Array to fill
+ * \param count Number of values to generate
+ * \param low Lowest value
+ * \param high Upper bound
+ */
+void CRandom::FillUniform(double* values, size_t count, double low, double high)
+{
+	uint64_t s0[Lanes], s1[Lanes], s2[Lanes], s3[Lanes];
+	for (int l = 0; l < Lanes; l++)
+	{
+		uint64_t x = Next();
+		s0[l] = SplitMix(x);
+		s1[l] = SplitMix(x);
+		s2[l] = SplitMix(x);
+		s3[l] = SplitMix(x);
+	}
+
+	double scale = (high - low) * (1.0 / 9007199254740992.0);
+
+	size_t i = 0;
+	for (; i + Lanes <= count; i += Lanes)
+	{
+		for (int l = 0; l < Lanes; l++)
+		{
+			uint64_t result = Rotate(s1[l] * 5, 7) * 9;
+			uint64_t t = s1[l] << 17;
+
+			s2[l] ^= s0[l];
+			s3[l] ^= s1[l];
+			s1[l] ^= s2[l];
+			s0[l] ^= s3[l];
+			s2[l] ^= t;
+			s3[l] = Rotate(s3[l], 45);
+
+			values[i + l] = low + (result >> 11) * scale;
+		}
+	}
+
+	for (; i < count; i++)
+	{
+		values[i] = Uniform(low, high);
+	}
+}
+
+/**
+ * Get the generator state so it can be saved.
+ * \returns State as four comma separated hex words
+ */
+std::wstring CRandom::GetState() const
+{
+	wstringstream out;
+	out << hex << setfill(L'0');
+	for (int i = 0; i < 4; i++)
+	{
+		out << (i > 0 ? L"," : L"") << setw(16) << mState[i];
+	}
+
+	return out.str();
+}
+
+/**
+ * Restore a state saved by GetState.
+ * \param state State string
+ * \returns true if the string was a valid state, otherwise the
+ * generator is unchanged
+ */
+bool CRandom::SetState(const std::wstring& state)
+{
+	wstringstream in(state);
+	uint64_t words[4];
+	for (int i = 0; i < 4; i++)
+	{
+		wchar_t comma = L',';
+		if (i > 0)
+		{
+			in >> comma;
+		}
+
+		if (comma != L',' || !(in >> hex >> words[i]))
+		{
+			return false;
+		}
+	}
+
+	if ((words[0] | words[1] | words[2] | words[3]) == 0)
+	{
+		// The all zero state never leaves zero
+		return false;
+	}
+
+	for (int i = 0; i < 4; i++)
+	{
+		mState[i] = words[i];
+	}
+
+	return true;
+}
@@ -0,0 +1,105 @@
+/**
+ * \file Random.h
+ *
+ * \author Grant Youngs
+ *
+ * Class that implements a fast seedable random number generator.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+
+/**
+ * xoshiro256** random number generator.
+ *
+ * Every generator is fully described by its 256 bit state, which
+ * can be saved and restored. A generator can be constructed for any
+ * numbered stream of a seed, so items and threads each get their own
+ * independent and reproducible sequence without sharing state.
+ *
+ * Satisfies the standard UniformRandomBitGenerator requirements, so
+ * it can drive the <random> distributions. Their output differs between
+ * standard libraries, so anything that has to be reproduced, such as a
+ * generated scene, uses the distributions here instead.
+ */
+class CRandom
+{
+public:
+	/// Type of the generated values
+	typedef uint64_t result_type;
+
+	CRandom(uint64_t seed = 1, uint64_t stream = 0);
+
+	void Seed(uint64_t seed, uint64_t stream = 0);
+
+	/** Generate the next 64 random bits
+	 * \returns Random value */
+	uint64_t Next()
+	{
+		uint64_t result = Rotate(mState[1] * 5, 7) * 9;
+		uint64_t t = mState[1] << 17;
+
+		mState[2] ^= mState[0];
+		mState[3] ^= mState[1];
+		mState[1] ^= mState[2];
+		mState[0] ^= mState[3];
+		mState[2] ^= t;
+		mState[3] = Rotate(mState[3], 45);
+
+		return result;
+	}
+
+	/** Generate a double uniformly distributed in [0, 1)
+	 * \returns Random value */
+	double NextDouble() { return (Next() >> 11) * (1.0 / 9007199254740992.0); }
+
+	/** Generate a double uniformly distributed in [low, high)
+	 * \param low Lowest value
+	 * \param high Upper bound
+	 * \returns Random value */
+	double Uniform(double low, double high) { return low + NextDouble() * (high - low); }
+
+	/** Generate an integer uniformly distributed in [0, count)
+	 * \param count Number of values, at least 1
+	 * \returns Random value */
+	int UniformInt(int count) { return (int)(NextDouble() * count); }
+
+	double Normal(double mean, double deviation);
+
+	int Pick(const double* weights, int count);
+
+	void FillUniform(double* values, size_t count, double low, double high);
+
+	CRandom Split();
+
+	std::wstring GetState() const;
+	bool SetState(const std::wstring& state);
+
+	// The parentheses keep the Windows min and max macros from expanding
+
+	/// Smallest value Next can return
+	/// \returns 0
+	static constexpr uint64_t (min)() { return 0; }
+
+	/// Largest value Next can return
+	/// \returns Largest 64 bit value
+	static constexpr uint64_t (max)() { return UINT64_MAX; }
+
+	/// Generate the next 64 random bits
+	/// \returns Random value
+	uint64_t operator()() { return Next(); }
+
+private:
+	/** Rotate left
+	 * \param x Value to rotate
+	 * \param k Bits to rotate by
+	 * \returns Rotated value */
+	static uint64_t Rotate(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+	/// Generator state
+	uint64_t mState[4];
+};
+
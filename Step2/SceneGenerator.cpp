@@ -0,0 +1,240 @@
+/**
+ * \file SceneGenerator.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the stress-test aquarium file generator.
+ */
+
+#include "pch.h"
+#include <algorithm>
+#include <fstream>
+#include <thread>
+#include "SceneGenerator.h"
+#include "FishBeta.h"
+#include "Buddha.h"
+#include "Magikarp.h"
+#include "Random.h"
+#include "ThreadPool.h"
+#include "TraceLog.h"
+
+using namespace std;
+
+/// Number of items generated by one task
+const long long ChunkSize = 65536;
+
+/// Names of the species as saved in the type attribute
+const char* SpeciesNames[] = { "beta", "buddha", "magikarp", "castle" };
+
+/**
+ * Constructor
+ * \param width Width of the tank to fill in pixels
+ * \param height Height of the tank to fill in pixels
+ */
+CSceneGenerator::CSceneGenerator(int width, int height) :
+	mWidth(width), mHeight(height)
+{
+	SetMix(1, 1, 1, 1);
+}
+
+/**
+ * Set the relative number of each item type.
+ * \param beta Weight of beta fish
+ * \param buddha Weight of buddhas
+ * \param magikarp Weight of magikarps
+ * \param castle Weight of castles
+ */
+void CSceneGenerator::SetMix(double beta, double buddha, double magikarp, double castle)
+{
+	mMix = { beta, buddha, magikarp, castle };
+}
+
+/**
+ * Get the range of speeds a species can swim at.
+ *
+ * Decor does not move, so both ranges are zero for castles.
+ * \param species Species to look up
+ * \param minX Receives the minimum X speed
+ * \param maxX Receives the maximum X speed
+ * \param minY Receives the minimum Y speed
+ * \param maxY Receives the maximum Y speed
+ */
+void CSceneGenerator::GetSpeedRange(Species species, double& minX, double& maxX, double& minY, double& maxY)
+{
+	minX = minY = maxX = maxY = 0;
+	switch (species)
+	{
+	case Species::Beta:
+		minX = CFishBeta::MinSpeedX;
+		minY = CFishBeta::MinSpeedY;
+		break;
+
+	case Species::Buddha:
+		minX = CBuddha::MinSpeedX;
+		minY = CBuddha::MinSpeedY;
+		break;
+
+	case Species::Magikarp:
+		minX = CMagikarp::MinSpeedX;
+		minY = CMagikarp::MinSpeedY;
+		break;
+
+	default:
+		// Decor does not move
+		return;
+	}
+
+	maxX = CFish::MaxSpeedX;
+	maxY = CFish::MaxSpeedY;
+}
+
+/**
+ * Write the generated aquarium to a file.
+ *
+ * Chunks are formatted on a worker pool a batch at a time and
+ * appended in order, so memory stays bounded by the batch.
+ * \param filename File to write
+ */
+void CSceneGenerator::Generate(const std::wstring& filename)
+{
+	ofstream out(filename, ios::binary);
+	if (!out)
+	{
+		wstring msg(L"Failed to open ");
+		msg += filename;
+		AfxMessageBox(msg.c_str());
+		return;
+	}
+
+	out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\r\n";
+
+	// The world size lets tanks larger than the window load at full size
+	out << "<aqua width=\"" << mWidth << "\" height=\"" << mHeight << "\"";
+	if (mCount <= 0)
+	{
+		out << "/>\r\n";
+		return;
+	}
+
+	out << ">";
+
+	int threads = mThreads > 0 ? mThreads : max(1, (int)thread::hardware_concurrency());
+	long long chunks = (mCount + ChunkSize - 1) / ChunkSize;
+	vector<string> texts(threads);
+
+	// The first split is the clusters, shared by every chunk
+	CRandom root(mSeed);
+	CRandom clusterRandom = root.Split();
+	vector<pair<double, double>> clusters;
+	for (int c = 0; c < max(1, mClusters); c++)
+	{
+		double cx = clusterRandom.Uniform(0, mWidth);
+		clusters.push_back(make_pair(cx, clusterRandom.Uniform(0, mHeight)));
+	}
+
+	// Then one split for each chunk
+	vector<CRandom> randoms;
+	for (long long c = 0; c < chunks; c++)
+	{
+		randoms.push_back(root.Split());
+	}
+
+	CThreadPool pool(threads);
+	for (long long first = 0; first < chunks; first += threads)
+	{
+		int batch = (int)min<long long>(threads, chunks - first);
+		pool.ParallelFor(batch, [&](size_t begin, size_t end) {
+			for (size_t t = begin; t < end; t++)
+			{
+				GenerateChunk(first + t, randoms[size_t(first + t)], clusters, texts[t]);
+			}
+		});
+
+		for (int t = 0; t < batch; t++)
+		{
+			out.write(texts[t].data(), texts[t].size());
+		}
+	}
+
+	out << "</aqua>\r\n";
+}
+
+/**
+ * Format one chunk of items.
+ * \param chunk Chunk number
+ * \param random Generator of the chunk
+ * \param clusters Centers of the clusters
+ * \param text String that receives the XML for the chunk
+ */
+void CSceneGenerator::GenerateChunk(long long chunk, CRandom& random, const std::vector<std::pair<double, double>>& clusters,
+	std::string& text)
+{
+	AQUA_TRACE_SCOPE("GenerateChunk");
+
+	double spread = min(mWidth, mHeight) / 20.0;
+
+	long long begin = chunk * ChunkSize;
+	long long end = min(mCount, begin + ChunkSize);
+
+	text.clear();
+	text.reserve(size_t(end - begin) * 100);
+
+	// Uniform positions are generated for the whole chunk at once
+	vector<double> uniformX, uniformY;
+	if (mDistribution == Distribution::Uniform)
+	{
+		uniformX.resize(size_t(end - begin));
+		uniformY.resize(size_t(end - begin));
+		random.FillUniform(uniformX.data(), uniformX.size(), 0, mWidth);
+		random.FillUniform(uniformY.data(), uniformY.size(), 0, mHeight);
+	}
+
+	char buffer[256];
+	for (long long i = begin; i < end; i++)
+	{
+		double x = 0, y = 0;
+		switch (mDistribution)
+		{
+		case Distribution::Uniform:
+			x = uniformX[size_t(i - begin)];
+			y = uniformY[size_t(i - begin)];
+			break;
+
+		case Distribution::Clustered:
+		{
+			auto& center = clusters[random.UniformInt((int)clusters.size())];
+			x = random.Normal(center.first, spread);
+			y = random.Normal(center.second, spread);
+			break;
+		}
+
+		case Distribution::Gaussian:
+			x = random.Normal(mWidth / 2.0, mWidth / 6.0);
+			y = random.Normal(mHeight / 2.0, mHeight / 6.0);
+			break;
+		}
+
+		x = min(max(x, 0.0), (double)mWidth);
+		y = min(max(y, 0.0), (double)mHeight);
+
+		auto species = (Species)random.Pick(mMix.data(), (int)mMix.size());
+		if (species == Species::Castle)
+		{
+			snprintf(buffer, sizeof(buffer), "<item x=\"%.15g\" y=\"%.15g\" type=\"%s\"/>",
+				x, y, SpeciesNames[(int)species]);
+		}
+		else
+		{
+			double minX, maxX, minY, maxY;
+			GetSpeedRange(species, minX, maxX, minY, maxY);
+			double speedX = random.Uniform(minX, maxX);
+			double speedY = random.Uniform(minY, maxY);
+
+			snprintf(buffer, sizeof(buffer),
+				"<item x=\"%.15g\" y=\"%.15g\" speedx=\"%.15g\" speedy=\"%.15g\" type=\"%s\"/>",
+				x, y, speedX, speedY, SpeciesNames[(int)species]);
+		}
+
+		text += buffer;
+	}
+}
@@ -0,0 +1,84 @@
+/**
+ * \file SceneGenerator.h
+ *
+ * \author Grant Youngs
+ *
+ * Class that writes procedurally generated stress-test aquarium files.
+ */
+
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "Random.h"
+
+
+/**
+ * Writes procedurally generated .aqua files.
+ *
+ * Items are produced in fixed size chunks, each with its own random
+ * generator split in chunk order from one seeded generator, so the
+ * output only depends on the settings and never on the number of
+ * threads. Only CRandom distributions are used, so it does not depend
+ * on the standard library either. Chunks are formatted in parallel
+ * and streamed to the file in order.
+ */
+class CSceneGenerator
+{
+public:
+	/** Distributions for item positions */
+	enum class Distribution { Uniform, Clustered, Gaussian };
+
+	/** Item types the generator can write */
+	enum class Species { Beta, Buddha, Magikarp, Castle };
+
+	CSceneGenerator(int width, int height);
+
+	/// Destructor
+	virtual ~CSceneGenerator() {}
+
+	/// Set the number of items to generate
+	/// \param count Number of items
+	void SetCount(long long count) { mCount = count; }
+
+	/// Set the position distribution
+	/// \param distribution New distribution
+	void SetDistribution(Distribution distribution) { mDistribution = distribution; }
+
+	/// Set the random seed
+	/// \param seed New seed
+	void SetSeed(unsigned long long seed) { mSeed = seed; }
+
+	/// Set the number of clusters for the clustered distribution
+	/// \param clusters Number of clusters
+	void SetClusters(int clusters) { mClusters = clusters; }
+
+	/// Set the number of threads in the worker pool, 0 for one per core
+	/// \param threads Number of threads
+	void SetThreads(int threads) { mThreads = threads; }
+
+	void SetMix(double beta, double buddha, double magikarp, double castle);
+
+	void Generate(const std::wstring& filename);
+
+	static void GetSpeedRange(Species species, double& minX, double& maxX, double& minY, double& maxY);
+
+private:
+	void GenerateChunk(long long chunk, CRandom& random, const std::vector<std::pair<double, double>>& clusters,
+		std::string& text);
+
+	int mWidth;             ///< Width of the tank in pixels
+	int mHeight;            ///< Height of the tank in pixels
+	long long mCount = 0;   ///< Number of items to generate
+	unsigned long long mSeed = 1;   ///< Random seed
+	int mClusters = 8;      ///< Number of clusters for Distribution::Clustered
+	int mThreads = 0;       ///< Worker threads, 0 for one per core
+
+	/// Position distribution
+	Distribution mDistribution = Distribution::Uniform;
+
+	/// Relative weights of beta, buddha, magikarp and castle
+	std::vector<double> mMix;
+};
+
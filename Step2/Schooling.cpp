@@ -0,0 +1,274 @@
+/**
+ * \file Schooling.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the schooling behavior.
+ */
+
+#include "pch.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "Schooling.h"
+#include "Fish.h"
+#include "TraceLog.h"
+
+using namespace std;
+
+/// Steering weights each species starts out with
+const CSchooling::Weights DefaultWeights[CSchooling::NumSpecies] = {
+	// Radius, separation radius, alignment, cohesion, separation
+	{ 0, 60, 0, 0, 4000 },              // Other
+	{ 250, 80, 0.8f, 0.3f, 6000 },      // Beta
+	{ 300, 90, 1.0f, 0.4f, 6000 },      // Magikarp
+	{ 200, 70, 0.5f, 0.2f, 6000 },      // Buddha
+};
+
+/// Most cells we allow per fish, beyond it cells are made larger
+/// so a few fish spread over a huge world do not cost a huge grid
+const int MaxCellsPerFish = 4;
+
+/**
+ * Constructor
+ */
+CSchooling::CSchooling()
+{
+	for (int s = 0; s < NumSpecies; s++)
+	{
+		mWeights[s] = DefaultWeights[s];
+	}
+}
+
+/**
+ * Change the velocities of the fish so they school.
+ *
+ * Items that are not fish are ignored.
+ * \param items Items of the aquarium
+ * \param elapsed Time step in seconds the steering is applied over
+ */
+void CSchooling::Steer(const std::vector<std::shared_ptr<CItem>>& items, double elapsed)
+{
+	AQUA_TRACE_SCOPE("Update/Schooling");
+	auto start = chrono::steady_clock::now();
+
+	Gather(items);
+	BuildCells();
+	ComputeSteering();
+
+	for (size_t f = 0; f < mFish.size(); f++)
+	{
+		auto fish = mFish[f];
+		fish->SetVelocity(fish->GetSpeedX() + mAccelX[f] * elapsed,
+			fish->GetSpeedY() + mAccelY[f] * elapsed);
+	}
+
+	mSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Get the steering cost of the last step for each fish
+ * \returns Nanoseconds per fish, 0 if there were no fish
+ */
+double CSchooling::GetNanosPerFish() const
+{
+	return mFish.empty() ? 0 : mSeconds * 1e9 / mFish.size();
+}
+
+/**
+ * Copy the locations and velocities of the fish into flat arrays.
+ * \param items Items of the aquarium
+ */
+void CSchooling::Gather(const std::vector<std::shared_ptr<CItem>>& items)
+{
+	mFish.clear();
+	mX.clear();
+	mY.clear();
+	mSpeedX.clear();
+	mSpeedY.clear();
+	mSpecies.clear();
+
+	for (auto& item : items)
+	{
+		auto fish = dynamic_cast<CFish*>(item.get());
+		if (fish == nullptr)
+		{
+			continue;
+		}
+
+		mFish.push_back(fish);
+		mX.push_back((float)fish->GetX());
+		mY.push_back((float)fish->GetY());
+		mSpeedX.push_back((float)fish->GetSpeedX());
+		mSpeedY.push_back((float)fish->GetSpeedY());
+		mSpecies.push_back(fish->GetSpecies());
+	}
+}
+
+/**
+ * Sort the fish into grid cells at least as large as the largest
+ * perception radius, using a counting sort.
+ */
+void CSchooling::BuildCells()
+{
+	int count = (int)mFish.size();
+
+	mCellSize = 1;
+	for (auto& weights : mWeights)
+	{
+		mCellSize = max(mCellSize, max(weights.mRadius, weights.mSeparationRadius));
+	}
+
+	float right = 0, bottom = 0;
+	mLeft = mTop = 0;
+	if (count > 0)
+	{
+		mLeft = *min_element(mX.begin(), mX.end());
+		mTop = *min_element(mY.begin(), mY.end());
+		right = *max_element(mX.begin(), mX.end());
+		bottom = *max_element(mY.begin(), mY.end());
+	}
+
+	for (;;)
+	{
+		mColumns = (int)((right - mLeft) / mCellSize) + 1;
+		mRows = (int)((bottom - mTop) / mCellSize) + 1;
+		if ((long long)mColumns * mRows <= (long long)MaxCellsPerFish * count + 16)
+		{
+			break;
+		}
+
+		mCellSize *= 2;
+	}
+
+	int cells = mColumns * mRows;
+	mCellStart.assign(cells + 1, 0);
+	mFishCell.resize(count);
+
+	for (int f = 0; f < count; f++)
+	{
+		int column = min((int)((mX[f] - mLeft) / mCellSize), mColumns - 1);
+		int row = min((int)((mY[f] - mTop) / mCellSize), mRows - 1);
+		mFishCell[f] = row * mColumns + column;
+		mCellStart[mFishCell[f] + 1]++;
+	}
+
+	for (int c = 0; c < cells; c++)
+	{
+		mCellStart[c + 1] += mCellStart[c];
+	}
+
+	mCellX.resize(count);
+	mCellY.resize(count);
+	mCellSpeedX.resize(count);
+	mCellSpeedY.resize(count);
+	mCellSpecies.resize(count);
+	mCellFish.resize(count);
+
+	// Fill each cell in item order, so the result does not depend
+	// on anything but the items
+	vector<int> next(mCellStart.begin(), mCellStart.end() - 1);
+	for (int f = 0; f < count; f++)
+	{
+		int k = next[mFishCell[f]]++;
+		mCellX[k] = mX[f];
+		mCellY[k] = mY[f];
+		mCellSpeedX[k] = mSpeedX[f];
+		mCellSpeedY[k] = mSpeedY[f];
+		mCellSpecies[k] = mSpecies[f];
+		mCellFish[k] = f;
+	}
+}
+
+/**
+ * Compute the steering acceleration of every fish.
+ *
+ * The cells of a grid row are stored one after another, so the
+ * three cells of a row around a fish are one contiguous run. The
+ * loop over a run only multiplies by masks, which lets the compiler
+ * vectorize it.
+ */
+void CSchooling::ComputeSteering()
+{
+	int count = (int)mFish.size();
+	mAccelX.assign(count, 0);
+	mAccelY.assign(count, 0);
+	mCandidates = 0;
+
+	const float* xs = mCellX.data();
+	const float* ys = mCellY.data();
+	const float* speedXs = mCellSpeedX.data();
+	const float* speedYs = mCellSpeedY.data();
+	const int* species = mCellSpecies.data();
+
+	for (int k = 0; k < count; k++)
+	{
+		float x = xs[k];
+		float y = ys[k];
+		int own = species[k];
+		const Weights& weights = mWeights[own];
+		float radius2 = weights.mRadius * weights.mRadius;
+		float separation2 = weights.mSeparationRadius * weights.mSeparationRadius;
+
+		int cell = mFishCell[mCellFish[k]];
+		int column = cell % mColumns;
+		int row = cell / mColumns;
+		int first = max(column - 1, 0);
+		int last = min(column + 1, mColumns - 1);
+
+		float neighbors = 0, sumX = 0, sumY = 0, sumSpeedX = 0, sumSpeedY = 0;
+		float pushX = 0, pushY = 0;
+
+		for (int r = max(row - 1, 0); r <= min(row + 1, mRows - 1); r++)
+		{
+			int begin = mCellStart[r * mColumns + first];
+			int end = mCellStart[r * mColumns + last + 1];
+			mCandidates += end - begin;
+
+			for (int j = begin; j < end; j++)
+			{
+				float dx = xs[j] - x;
+				float dy = ys[j] - y;
+				float d2 = dx * dx + dy * dy;
+
+				float school = (d2 < radius2 && species[j] == own) ? 1.0f : 0.0f;
+				neighbors += school;
+				sumX += school * xs[j];
+				sumY += school * ys[j];
+				sumSpeedX += school * speedXs[j];
+				sumSpeedY += school * speedYs[j];
+
+				// Push grows as the other fish gets closer. The fish
+				// itself has dx and dy of zero and adds nothing.
+				float close = d2 < separation2 ? 1.0f / (d2 + 1.0f) : 0.0f;
+				pushX -= close * dx;
+				pushY -= close * dy;
+			}
+		}
+
+		// The fish counted itself as part of its school
+		if (radius2 > 0)
+		{
+			neighbors -= 1;
+			sumX -= x;
+			sumY -= y;
+			sumSpeedX -= speedXs[k];
+			sumSpeedY -= speedYs[k];
+		}
+
+		float accelX = weights.mSeparation * pushX;
+		float accelY = weights.mSeparation * pushY;
+		if (neighbors > 0)
+		{
+			float inverse = 1.0f / neighbors;
+			accelX += weights.mAlignment * (sumSpeedX * inverse - speedXs[k]);
+			accelY += weights.mAlignment * (sumSpeedY * inverse - speedYs[k]);
+			accelX += weights.mCohesion * (sumX * inverse - x);
+			accelY += weights.mCohesion * (sumY * inverse - y);
+		}
+
+		int f = mCellFish[k];
+		mAccelX[f] = accelX;
+		mAccelY[f] = accelY;
+	}
+}
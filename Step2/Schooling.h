@@ -0,0 +1,128 @@
+/**
+ * \file Schooling.h
+ *
+ * \author Grant Youngs
+ *
+ * Class that steers fish of the same species into schools.
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+class CItem;
+class CFish;
+
+
+/**
+ * Flocking behavior for the fish of an aquarium.
+ *
+ * Every fish steers toward the average heading (alignment) and the
+ * center (cohesion) of the fish of its own species within its
+ * perception radius, and away from any fish that is too close
+ * (separation). The steering only changes fish velocities, the fish
+ * still move and bounce off the walls on their own.
+ *
+ * Each step copies the fish into flat arrays sorted by grid cell,
+ * so the neighbors of a fish are three contiguous runs of the arrays
+ * and the inner loop is branch free and can be vectorized.
+ */
+class CSchooling
+{
+public:
+	/** Species that school together. Fish only align with and
+	 * gather around fish of their own species. */
+	enum Species { Other, Beta, Magikarp, Buddha, NumSpecies };
+
+	/** Steering weights of one species */
+	struct Weights
+	{
+		float mRadius;              ///< Distance fish see their school at
+		float mSeparationRadius;    ///< Distance fish keep from any other fish
+		float mAlignment;           ///< Rate of matching the school's velocity, 1/s
+		float mCohesion;            ///< Pull toward the school's center, 1/s^2
+		float mSeparation;          ///< Push away from close fish
+	};
+
+	CSchooling();
+
+	/// Copy constructor (disabled)
+	CSchooling(const CSchooling&) = delete;
+
+	/// Get the steering weights of a species
+	/// \param species Species to get
+	/// \returns Weights of the species
+	const Weights& GetWeights(Species species) const { return mWeights[species]; }
+
+	/// Set the steering weights of a species
+	/// \param species Species to set
+	/// \param weights New weights
+	void SetWeights(Species species, const Weights& weights) { mWeights[species] = weights; }
+
+	void Steer(const std::vector<std::shared_ptr<CItem>>& items, double elapsed);
+
+	/// Get the number of fish steered by the last step
+	/// \returns Number of fish
+	int GetNumFish() const { return (int)mFish.size(); }
+
+	/// Get the number of neighbor candidates the last step looked at
+	/// \returns Number of fish pairs tested
+	long long GetNumCandidates() const { return mCandidates; }
+
+	/// Get the time the last step took
+	/// \returns Time in seconds
+	double GetSeconds() const { return mSeconds; }
+
+	double GetNanosPerFish() const;
+
+private:
+	void Gather(const std::vector<std::shared_ptr<CItem>>& items);
+
+	void BuildCells();
+
+	void ComputeSteering();
+
+	/// Steering weights of each species
+	Weights mWeights[NumSpecies];
+
+	/// The fish being steered, in item order
+	std::vector<CFish*> mFish;
+
+	std::vector<float> mX;              ///< X location of each fish in item order
+	std::vector<float> mY;              ///< Y location of each fish in item order
+	std::vector<float> mSpeedX;         ///< X speed of each fish in item order
+	std::vector<float> mSpeedY;         ///< Y speed of each fish in item order
+	std::vector<int> mSpecies;          ///< Species of each fish in item order
+
+	std::vector<float> mCellX;          ///< X location of each fish sorted by cell
+	std::vector<float> mCellY;          ///< Y location of each fish sorted by cell
+	std::vector<float> mCellSpeedX;     ///< X speed of each fish sorted by cell
+	std::vector<float> mCellSpeedY;     ///< Y speed of each fish sorted by cell
+	std::vector<int> mCellSpecies;      ///< Species of each fish sorted by cell
+
+	/// Item order index of each fish sorted by cell
+	std::vector<int> mCellFish;
+
+	/// Index of the first sorted fish of each cell, plus one past the end
+	std::vector<int> mCellStart;
+
+	/// Cell of each fish in item order
+	std::vector<int> mFishCell;
+
+	std::vector<float> mAccelX;         ///< X steering of each fish in item order
+	std::vector<float> mAccelY;         ///< Y steering of each fish in item order
+
+	float mLeft = 0;            ///< Smallest X of the cell grid
+	float mTop = 0;             ///< Smallest Y of the cell grid
+	float mCellSize = 0;        ///< Width and height of a cell
+	int mColumns = 0;           ///< Cells across the grid
+	int mRows = 0;              ///< Cells down the grid
+
+	/// Fish pairs tested by the last step
+	long long mCandidates = 0;
+
+	/// Time the last step took in seconds
+	double mSeconds = 0;
+};
+
@@ -0,0 +1,345 @@
+/**
+ * \file SessionLog.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the session event log.
+ */
+
+#include "pch.h"
+#include <codecvt>
+#include <fstream>
+#include <locale>
+#include <sstream>
+#include <Shlwapi.h>
+#include "SessionLog.h"
+#include "Aquarium.h"
+
+#pragma comment(lib, "Shlwapi.lib")
+
+using namespace std;
+
+/// First line of every session file
+const wstring SessionHeader = L"aquarium-session 1";
+
+/// Extension added to the session filename for the starting snapshot
+const wstring SnapshotExtension = L".aqua";
+
+/// Names of the event types as saved in the log
+const wchar_t* EventNames[] = { L"update", L"down", L"move", L"add", L"load", L"clear", L"undo", L"redo",
+	L"mode", L"view" };
+
+/**
+ * Directory part of a filename
+ * \param filename Filename with a path
+ * \returns Directory with its trailing separator, empty if there is none
+ */
+static wstring Directory(const wstring& filename)
+{
+	return filename.substr(0, filename.find_last_of(L"\\/") + 1);
+}
+
+/**
+ * Path of a file relative to the directory of the session log,
+ * so the session can be moved or replayed on another machine.
+ * \param log Session log filename
+ * \param path File the session uses
+ * \returns Relative path, or the full path if it has none, such
+ * as for a file on another drive
+ */
+static wstring RelativePath(const wstring& log, const wstring& path)
+{
+	wchar_t full[MAX_PATH], directory[MAX_PATH], relative[MAX_PATH];
+	if (GetFullPathName(path.c_str(), MAX_PATH, full, nullptr) == 0)
+	{
+		return path;
+	}
+
+	if (GetFullPathName(Directory(log).c_str(), MAX_PATH, directory, nullptr) == 0 ||
+		!PathRelativePathTo(relative, directory, FILE_ATTRIBUTE_DIRECTORY, full, FILE_ATTRIBUTE_NORMAL))
+	{
+		return full;
+	}
+
+	return relative;
+}
+
+/**
+ * Destructor
+ */
+CSessionLog::~CSessionLog()
+{
+	DeleteSnapshot();
+}
+
+/**
+ * Start recording a new session.
+ *
+ * Discards any events already in the log and saves the current
+ * state of the aquarium as the starting snapshot.
+ * \param aquarium Aquarium the events will be applied to
+ */
+void CSessionLog::Start(CAquarium* aquarium)
+{
+	DeleteSnapshot();
+
+	// A unique name, so running instances keep their own snapshots
+	wchar_t path[MAX_PATH], snapshot[MAX_PATH];
+	GetTempPath(MAX_PATH, path);
+	if (GetTempFileName(path, L"aqs", 0, snapshot) != 0)
+	{
+		mSnapshot = snapshot;
+	}
+	else
+	{
+		mSnapshot = wstring(path) + L"aquarium-session-" + to_wstring(GetCurrentProcessId()) + L".aqua";
+	}
+
+	mTemporary = true;
+	aquarium->Save(mSnapshot);
+
+	mEvents.clear();
+	mHasHash = false;
+	mStart = chrono::steady_clock::now();
+	mRecording = true;
+}
+
+/**
+ * Stop recording. The recorded events are kept until the next Start.
+ *
+ * The state hash of the aquarium is kept, so a replay can be checked
+ * against it.
+ * \param aquarium Aquarium the events were applied to
+ */
+void CSessionLog::Stop(CAquarium* aquarium)
+{
+	if (!mRecording)
+	{
+		return;
+	}
+
+	mRecording = false;
+	mHash = aquarium->GetStateHash();
+	mHasHash = true;
+}
+
+/**
+ * Delete the starting snapshot if it is a temporary file of ours.
+ */
+void CSessionLog::DeleteSnapshot()
+{
+	if (mTemporary)
+	{
+		DeleteFile(mSnapshot.c_str());
+		mTemporary = false;
+	}
+
+	mSnapshot.clear();
+}
+
+/**
+ * Record an event if the log is recording.
+ *
+ * The event is timestamped with the time since recording started.
+ * \param event Event to record
+ */
+void CSessionLog::Record(const CSessionEvent& event)
+{
+	if (!mRecording)
+	{
+		return;
+	}
+
+	mEvents.push_back(event);
+	mEvents.back().mTime = chrono::duration<double>(chrono::steady_clock::now() - mStart).count();
+}
+
+/**
+ * Save the log and its starting snapshot.
+ *
+ * The snapshot is written beside the log, as the log filename
+ * with .aqua added. Loaded files are saved relative to the log.
+ * \param filename File to write
+ * \returns true if successful
+ */
+bool CSessionLog::Save(const std::wstring& filename)
+{
+	wstring snapshot = filename + SnapshotExtension;
+	if (!mSnapshot.empty())
+	{
+		ifstream in(mSnapshot, ios::binary);
+		ofstream copy(snapshot, ios::binary);
+		if (!in || !copy || !(copy << in.rdbuf()))
+		{
+			return false;
+		}
+	}
+
+	wofstream out(filename, ios::binary);
+	if (!out)
+	{
+		return false;
+	}
+
+	out.imbue(locale(out.getloc(), new codecvt_utf8<wchar_t>));
+	out.precision(17);
+
+	out << SessionHeader << L"\n";
+	if (!mSnapshot.empty())
+	{
+		// Saved without the path, so the session can be moved
+		out << L"snapshot " << snapshot.substr(snapshot.find_last_of(L"\\/") + 1) << L"\n";
+	}
+
+	if (mHasHash)
+	{
+		out << L"hash " << hex << mHash << dec << L"\n";
+	}
+
+	for (auto& event : mEvents)
+	{
+		out << event.mTime << L" " << EventNames[(int)event.mType];
+		switch (event.mType)
+		{
+		case CSessionEvent::Type::Update:
+			out << L" " << event.mValue;
+			break;
+
+		case CSessionEvent::Type::MouseDown:
+			out << L" " << event.mX << L" " << event.mY;
+			break;
+
+		case CSessionEvent::Type::MouseMove:
+			out << L" " << event.mX << L" " << event.mY << L" " << (event.mButton ? 1 : 0);
+			break;
+
+		case CSessionEvent::Type::Add:
+			out << L" " << event.mText;
+			break;
+
+		case CSessionEvent::Type::Load:
+			out << L" " << RelativePath(filename, event.mText);
+			break;
+
+		case CSessionEvent::Type::Mode:
+			out << L" " << event.mValue << L" " << event.mText;
+			break;
+
+		case CSessionEvent::Type::View:
+			out << L" " << event.mX << L" " << event.mY << L" " << event.mRight << L" " << event.mBottom;
+			break;
+
+		default:
+			break;
+		}
+
+		out << L"\n";
+	}
+
+	return (bool)out;
+}
+
+/**
+ * Load a log saved by Save.
+ * \param filename File to read
+ * \returns true if successful, otherwise the log is empty
+ */
+bool CSessionLog::Load(const std::wstring& filename)
+{
+	mRecording = false;
+	mEvents.clear();
+	mHasHash = false;
+	DeleteSnapshot();
+
+	wifstream in(filename, ios::binary);
+	in.imbue(locale(in.getloc(), new codecvt_utf8<wchar_t>));
+
+	wstring line;
+	if (!getline(in, line) || line != SessionHeader)
+	{
+		return false;
+	}
+
+	while (getline(in, line))
+	{
+		if (line.compare(0, 9, L"snapshot ") == 0)
+		{
+			// The snapshot is beside the log
+			mSnapshot = Directory(filename) + line.substr(9);
+			continue;
+		}
+
+		if (line.compare(0, 5, L"hash ") == 0)
+		{
+			wistringstream hash(line.substr(5));
+			mHasHash = (bool)(hash >> hex >> mHash);
+			continue;
+		}
+
+		wistringstream fields(line);
+		CSessionEvent event;
+		wstring name;
+		if (!(fields >> event.mTime >> name))
+		{
+			continue;
+		}
+
+		int type = 0;
+		while (type < (int)CSessionEvent::Type::View && name != EventNames[type])
+		{
+			type++;
+		}
+
+		if (name != EventNames[type])
+		{
+			mEvents.clear();
+			mSnapshot.clear();
+			mHasHash = false;
+			return false;
+		}
+
+		int button = 0;
+		event.mType = (CSessionEvent::Type)type;
+		switch (event.mType)
+		{
+		case CSessionEvent::Type::Update:
+			fields >> event.mValue;
+			break;
+
+		case CSessionEvent::Type::MouseDown:
+			fields >> event.mX >> event.mY;
+			break;
+
+		case CSessionEvent::Type::MouseMove:
+			fields >> event.mX >> event.mY >> button;
+			event.mButton = button != 0;
+			break;
+
+		case CSessionEvent::Type::Add:
+		case CSessionEvent::Type::Load:
+			// The rest of the line, filenames may contain spaces
+			fields.ignore(1);
+			getline(fields, event.mText);
+			if (event.mType == CSessionEvent::Type::Load && PathIsRelative(event.mText.c_str()))
+			{
+				event.mText = Directory(filename) + event.mText;
+			}
+			break;
+
+		case CSessionEvent::Type::Mode:
+			fields >> event.mValue >> event.mText;
+			break;
+
+		case CSessionEvent::Type::View:
+			fields >> event.mX >> event.mY >> event.mRight >> event.mBottom;
+			break;
+
+		default:
+			break;
+		}
+
+		mEvents.push_back(event);
+	}
+
+	return true;
+}
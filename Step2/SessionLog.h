@@ -0,0 +1,109 @@
+/**
+ * \file SessionLog.h
+ *
+ * \author Grant Youngs
+ *
+ * Records the input and menu events of a session so they can be replayed.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class CAquarium;
+
+
+/**
+ * One recorded event that changes the aquarium.
+ */
+struct CSessionEvent
+{
+	/** Kinds of events */
+	enum class Type { Update, MouseDown, MouseMove, Add, Load, Clear, Undo, Redo, Mode, View, NumTypes };
+
+	double mTime = 0;           ///< Seconds since recording started
+	Type mType = Type::Update;  ///< Kind of event
+	double mValue = 0;          ///< Elapsed seconds for updates, 1 or 0 to turn a mode on or off
+	double mX = 0;              ///< Mouse X location, left edge of a view
+	double mY = 0;              ///< Mouse Y location, top edge of a view
+	double mRight = 0;          ///< Right edge of a view
+	double mBottom = 0;         ///< Bottom edge of a view
+	bool mButton = false;       ///< True if the left button is down during a move
+	std::wstring mText;         ///< Item type for adds, filename for loads, mode name for modes
+};
+
+
+/**
+ * Timestamped log of the events of a session.
+ *
+ * Recording starts by saving the aquarium to a snapshot, so a replay
+ * starts from exactly the same items and random streams, and stops by
+ * taking the state hash the replay must end with. The log is saved as
+ * UTF-8 text, one event per line, with the snapshot saved beside it.
+ */
+class CSessionLog
+{
+public:
+	CSessionLog() {}
+
+	/// Copy constructor (disabled)
+	CSessionLog(const CSessionLog&) = delete;
+
+	~CSessionLog();
+
+	void Start(CAquarium* aquarium);
+	void Stop(CAquarium* aquarium);
+
+	/// Is the log recording?
+	/// \returns true if events are being recorded
+	bool IsRecording() const { return mRecording; }
+
+	void Record(const CSessionEvent& event);
+
+	bool Save(const std::wstring& filename);
+	bool Load(const std::wstring& filename);
+
+	/// Get the recorded events
+	/// \returns Events in the order they happened
+	const std::vector<CSessionEvent>& GetEvents() const { return mEvents; }
+
+	/// Get the aquarium file the session starts from
+	/// \returns Snapshot filename, empty to start from an empty aquarium
+	const std::wstring& GetSnapshot() const { return mSnapshot; }
+
+	/// Does the log have the state hash recording ended with?
+	/// \returns true if GetHash is valid
+	bool HasHash() const { return mHasHash; }
+
+	/// Get the state hash recording ended with
+	/// \returns Aquarium state hash
+	uint64_t GetHash() const { return mHash; }
+
+private:
+	void DeleteSnapshot();
+
+	/// True while events are being recorded
+	bool mRecording = false;
+
+	/// Time recording started, event times are relative to it
+	std::chrono::steady_clock::time_point mStart;
+
+	/// Recorded events
+	std::vector<CSessionEvent> mEvents;
+
+	/// Aquarium file the session starts from
+	std::wstring mSnapshot;
+
+	/// True if the snapshot is a temporary file this log owns
+	bool mTemporary = false;
+
+	/// True once the hash recording ended with is known
+	bool mHasHash = false;
+
+	/// Aquarium state hash recording ended with
+	uint64_t mHash = 0;
+};
+
@@ -0,0 +1,283 @@
+/**
+ * \file SessionPlayer.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements applying and replaying session events.
+ */
+
+#include "pch.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include "SessionPlayer.h"
+#include "Aquarium.h"
+#include "Item.h"
+#include "TiledTank.h"
+
+using namespace std;
+
+/// Initial X location of added items
+const int InitialX = 200;
+
+/// Initial Y location of added items
+const int InitialY = 200;
+
+const wchar_t* const CSessionPlayer::ModeEventDriven = L"eventdriven";
+const wchar_t* const CSessionPlayer::ModeSchooling = L"schooling";
+const wchar_t* const CSessionPlayer::ModeCollisions = L"collisions";
+const wchar_t* const CSessionPlayer::ModeUpdateLod = L"lod";
+
+/// Names of the event types for the report
+const wchar_t* EventTypeNames[] = { L"Update", L"MouseDown", L"MouseMove", L"Add", L"Load", L"Clear", L"Undo", L"Redo",
+	L"Mode", L"View" };
+
+/**
+ * Apply one event to the aquarium.
+ * \param event Event to apply
+ * \returns true if the aquarium needs to be redrawn
+ */
+bool CSessionPlayer::Apply(const CSessionEvent& event)
+{
+	switch (event.mType)
+	{
+	case CSessionEvent::Type::Update:
+		mAquarium->Update(event.mValue);
+		return true;
+
+	case CSessionEvent::Type::MouseDown:
+		mGrabbedItem = mAquarium->HitTest((int)event.mX, (int)event.mY);
+		if (mGrabbedItem != nullptr)
+		{
+			mHistory.BeginDrag(mGrabbedItem);
+		}
+		return false;
+
+	case CSessionEvent::Type::MouseMove:
+		// See if an item is currently being moved by the mouse
+		if (mGrabbedItem == nullptr)
+		{
+			return false;
+		}
+
+		// Moves the grabbed item to the front
+		mAquarium->MoveToFront(mGrabbedItem);
+
+		// We only continue to move the item while the left button is
+		// down. When it is released, we release the item.
+		if (event.mButton)
+		{
+			mHistory.DragTo(event.mX, event.mY);
+		}
+		else
+		{
+			mHistory.EndDrag();
+			mGrabbedItem = nullptr;
+		}
+		return true;
+
+	case CSessionEvent::Type::Add:
+	{
+		auto item = mAquarium->CreateItem(event.mText);
+		if (item == nullptr)
+		{
+			return false;
+		}
+
+		item->SetLocation(InitialX, InitialY);
+		mHistory.Add(item);
+		return true;
+	}
+
+	case CSessionEvent::Type::Load:
+		mGrabbedItem = nullptr;
+		CloseTiles();
+		mHistory.Load(event.mText);
+		return true;
+
+	case CSessionEvent::Type::Clear:
+		mGrabbedItem = nullptr;
+		CloseTiles();
+		mHistory.Clear();
+		return true;
+
+	case CSessionEvent::Type::Undo:
+		mGrabbedItem = nullptr;
+		if (mHistory.ReplacesItems(false))
+		{
+			CloseTiles();
+		}
+		return mHistory.Undo();
+
+	case CSessionEvent::Type::Redo:
+		mGrabbedItem = nullptr;
+		if (mHistory.ReplacesItems(true))
+		{
+			CloseTiles();
+		}
+		return mHistory.Redo();
+
+	case CSessionEvent::Type::Mode:
+		return SetMode(event.mText, event.mValue != 0);
+
+	case CSessionEvent::Type::View:
+		// Level of detail updates depend on what is in view
+		mAquarium->GetUpdateLod().SetView(event.mX, event.mY, event.mRight, event.mBottom);
+		return false;
+
+	default:
+		break;
+	}
+
+	return false;
+}
+
+/**
+ * Close any tiled tank before the items of the aquarium are replaced.
+ *
+ * Its resident tiles are written back while their items are still
+ * in the aquarium, otherwise they would be written back empty.
+ */
+void CSessionPlayer::CloseTiles()
+{
+	if (mTiles != nullptr)
+	{
+		mTiles->Close();
+	}
+}
+
+/**
+ * Turn one of the ways the items move on or off.
+ * \param mode Mode name, one of ModeEventDriven, ModeSchooling,
+ * ModeCollisions or ModeUpdateLod
+ * \param enabled true to turn the mode on
+ * \returns true if the mode is known
+ */
+bool CSessionPlayer::SetMode(const std::wstring& mode, bool enabled)
+{
+	if (mode == ModeEventDriven)
+	{
+		mAquarium->SetEventDriven(enabled);
+	}
+	else if (mode == ModeSchooling)
+	{
+		mAquarium->SetSchooling(enabled);
+	}
+	else if (mode == ModeCollisions)
+	{
+		mAquarium->SetColliding(enabled);
+	}
+	else if (mode == ModeUpdateLod)
+	{
+		mAquarium->SetUpdateLod(enabled);
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Replay a recorded log into the aquarium.
+ *
+ * The aquarium is first loaded from the log's snapshot, or cleared
+ * if there is none, so the replay starts from the recorded state.
+ * \param log Log to replay
+ * \param realTime true to wait until each event's recorded time,
+ * false to replay as fast as possible
+ * \returns Time taken by each event and the final state hash,
+ * with the hash the recording ended with to check it against
+ */
+CSessionPlayer::Result CSessionPlayer::Replay(const CSessionLog& log, bool realTime)
+{
+	mGrabbedItem = nullptr;
+	if (log.GetSnapshot().empty())
+	{
+		mAquarium->Clear();
+	}
+	else
+	{
+		mAquarium->Load(log.GetSnapshot());
+	}
+
+	// Edits from before the replay cannot be undone in it
+	mHistory.Reset();
+
+	Result result;
+	result.mEventNanos.reserve(log.GetEvents().size());
+
+	auto start = chrono::steady_clock::now();
+	for (auto& event : log.GetEvents())
+	{
+		if (realTime)
+		{
+			this_thread::sleep_until(start + chrono::duration_cast<chrono::steady_clock::duration>(
+				chrono::duration<double>(event.mTime)));
+		}
+
+		auto before = chrono::steady_clock::now();
+		Apply(event);
+		auto after = chrono::steady_clock::now();
+		result.mEventNanos.push_back(chrono::duration_cast<chrono::nanoseconds>(after - before).count());
+	}
+
+	result.mSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	result.mHash = mAquarium->GetStateHash();
+	result.mHasExpected = log.HasHash();
+	result.mExpectedHash = log.GetHash();
+	return result;
+}
+
+/**
+ * Summarize a replay for display.
+ * \param log Log that was replayed
+ * \param result Result of the replay
+ * \returns Per event type counts and times, the state hash and
+ * whether it matches the recorded one
+ */
+std::wstring CSessionPlayer::Report(const CSessionLog& log, const Result& result)
+{
+	const int NumTypes = (int)CSessionEvent::Type::NumTypes;
+	long long count[NumTypes] = { 0 }, total[NumTypes] = { 0 }, worst[NumTypes] = { 0 };
+
+	auto& events = log.GetEvents();
+	for (size_t i = 0; i < events.size() && i < result.mEventNanos.size(); i++)
+	{
+		int type = (int)events[i].mType;
+		count[type]++;
+		total[type] += result.mEventNanos[i];
+		worst[type] = max(worst[type], result.mEventNanos[i]);
+	}
+
+	wstringstream out;
+	out << events.size() << L" events replayed in " << fixed << setprecision(3)
+		<< result.mSeconds * 1000 << L" ms" << endl;
+
+	for (int t = 0; t < NumTypes; t++)
+	{
+		if (count[t] > 0)
+		{
+			out << EventTypeNames[t] << L": " << count[t] << L" events, avg "
+				<< total[t] / count[t] / 1000.0 << L" us, max " << worst[t] / 1000.0 << L" us" << endl;
+		}
+	}
+
+	out << L"State hash: " << hex << setfill(L'0') << setw(16) << result.mHash << endl;
+	if (result.mHasExpected)
+	{
+		if (result.Matches())
+		{
+			out << L"Matches the recorded hash" << endl;
+		}
+		else
+		{
+			out << L"MISMATCH, recorded hash " << setw(16) << result.mExpectedHash << endl;
+		}
+	}
+
+	return out.str();
+}
@@ -0,0 +1,98 @@
+/**
+ * \file SessionPlayer.h
+ *
+ * \author Grant Youngs
+ *
+ * Applies session events to an aquarium, live or replayed from a log.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "SessionLog.h"
+#include "UndoHistory.h"
+
+class CAquarium;
+class CItem;
+class CTiledTank;
+
+
+/**
+ * Applies session events to an aquarium.
+ *
+ * The view sends its input and menu commands through Apply, so a
+ * replay of a recorded log runs exactly the same code as the live
+ * session, without a window.
+ */
+class CSessionPlayer
+{
+public:
+	/** Result of replaying a log */
+	struct Result
+	{
+		std::vector<long long> mEventNanos;  ///< Time to apply each event
+		uint64_t mHash = 0;                  ///< Aquarium state hash after the replay
+		double mSeconds = 0;                 ///< Wall time of the whole replay
+		bool mHasExpected = false;           ///< True if the log recorded the hash to expect
+		uint64_t mExpectedHash = 0;          ///< State hash the recording ended with
+
+		/// Did the replay end in the recorded state?
+		/// \returns false only if the log has a hash and it differs
+		bool Matches() const { return !mHasExpected || mHash == mExpectedHash; }
+	};
+
+	/** Constructor
+	 * \param aquarium Aquarium the events are applied to */
+	CSessionPlayer(CAquarium* aquarium) : mAquarium(aquarium), mHistory(aquarium) {}
+
+	/// Default constructor (disabled)
+	CSessionPlayer() = delete;
+
+	/// Copy constructor (disabled)
+	CSessionPlayer(const CSessionPlayer&) = delete;
+
+	/// Mode name of event driven motion
+	static const wchar_t* const ModeEventDriven;
+
+	/// Mode name of schooling
+	static const wchar_t* const ModeSchooling;
+
+	/// Mode name of fish collisions
+	static const wchar_t* const ModeCollisions;
+
+	/// Mode name of update level of detail
+	static const wchar_t* const ModeUpdateLod;
+
+	bool Apply(const CSessionEvent& event);
+
+	Result Replay(const CSessionLog& log, bool realTime);
+
+	static std::wstring Report(const CSessionLog& log, const Result& result);
+
+	/// Get the history the edits are made through
+	/// \returns Undo history reference
+	CUndoHistory& GetHistory() { return mHistory; }
+
+	/// Set the tiled tank streaming items into the aquarium
+	/// \param tiles Tiled tank, closed before the items are replaced
+	void SetTiledTank(CTiledTank* tiles) { mTiles = tiles; }
+
+private:
+	bool SetMode(const std::wstring& mode, bool enabled);
+	void CloseTiles();
+
+	/// Aquarium the events are applied to
+	CAquarium* mAquarium;
+
+	/// Edits made, so they can be undone
+	CUndoHistory mHistory;
+
+	/// Any item we are currently dragging
+	std::shared_ptr<CItem> mGrabbedItem;
+
+	/// Tiled tank streaming items into the aquarium, if any
+	CTiledTank* mTiles = nullptr;
+};
+
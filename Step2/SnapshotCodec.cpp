@@ -0,0 +1,592 @@
+/**
+ * \file SnapshotCodec.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the snapshot codec.
+ */
+
+#include "pch.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include "SnapshotCodec.h"
+#include "Aquarium.h"
+#include "MemoryAccounting.h"
+
+using namespace std;
+
+/// Memory accounting key of the keyframes held
+const wstring KeyframesKey = L"keyframes";
+
+/**
+ * Constructor
+ * \param fractionBits Fraction bits of a quantized location
+ * \param keyframeInterval Frames from one keyframe to the next
+ */
+CSnapshotCodec::CSnapshotCodec(int fractionBits, int keyframeInterval) :
+	mFractionBits(min(max(fractionBits, 0), 16)), mKeyframeInterval(max(keyframeInterval, 1))
+{
+}
+
+/**
+ * Destructor
+ */
+CSnapshotCodec::~CSnapshotCodec()
+{
+	Reset();
+}
+
+/**
+ * Forget the keyframes and start the next stream from frame 0
+ */
+void CSnapshotCodec::Reset()
+{
+	Release(mEncodeKey);
+	Release(mDecodeKey);
+	mSequence = 0;
+	mForceKeyframe = false;
+}
+
+/**
+ * Take a snapshot of every item in an aquarium
+ * \param aquarium Aquarium to take
+ * \param snapshot Receives the items in id order
+ */
+void CSnapshotCodec::Take(CAquarium* aquarium, Snapshot& snapshot)
+{
+	vector<CItem*> items;
+	aquarium->Query(0, 0, aquarium->GetWidth(), aquarium->GetHeight(), items);
+
+	snapshot.mTime = aquarium->GetTime();
+	snapshot.mItems.resize(items.size());
+	for (size_t i = 0; i < items.size(); i++)
+	{
+		auto& item = snapshot.mItems[i];
+		item.mId = items[i]->GetId();
+		item.mType = FindType(items[i]->GetType());
+		item.mMirror = items[i]->IsMirror();
+		item.mX = items[i]->GetX();
+		item.mY = items[i]->GetY();
+	}
+
+	sort(snapshot.mItems.begin(), snapshot.mItems.end(), [](const Item& a, const Item& b) { return a.mId < b.mId; });
+}
+
+/**
+ * Get the number of a type name, numbering it if it is new
+ * \param name Type name
+ * \returns Type number
+ */
+uint16_t CSnapshotCodec::FindType(const std::wstring& name)
+{
+	auto found = mTypeNumbers.find(name);
+	if (found != mTypeNumbers.end())
+	{
+		return found->second;
+	}
+
+	auto type = (uint16_t)mTypes.size();
+	mTypes.push_back(name);
+	mTypeNumbers[name] = type;
+	return type;
+}
+
+/**
+ * Write the names of the type numbers from one on
+ * \param first First type number to name
+ * \param frame Frame to append to
+ */
+void CSnapshotCodec::PutTypes(size_t first, std::vector<uint8_t>& frame) const
+{
+	PutVarint(frame, first);
+	PutVarint(frame, mTypes.size() - first);
+	for (size_t type = first; type < mTypes.size(); type++)
+	{
+		PutVarint(frame, mTypes[type].size());
+		for (auto c : mTypes[type])
+		{
+			PutVarint(frame, (uint64_t)c);
+		}
+	}
+}
+
+/**
+ * Read type names written by PutTypes
+ * \param at Where to read, moved past the names
+ * \param end End of the frame
+ * \param first Receives the first type number named
+ * \param names Receives the names in order of their numbers
+ * \returns False if the names are cut off or malformed
+ */
+bool CSnapshotCodec::GetTypes(const uint8_t*& at, const uint8_t* end, size_t& first, std::vector<std::wstring>& names)
+{
+	uint64_t start, count;
+	// Every name takes at least one byte
+	if (!GetVarint(at, end, start) || !GetVarint(at, end, count) ||
+		count > (uint64_t)(end - at) || start + count > 0x10000)
+	{
+		return false;
+	}
+
+	first = (size_t)start;
+	names.resize((size_t)count);
+	for (auto& name : names)
+	{
+		uint64_t length;
+		if (!GetVarint(at, end, length) || length > (uint64_t)(end - at))
+		{
+			return false;
+		}
+
+		name.resize((size_t)length);
+		for (auto& c : name)
+		{
+			uint64_t value;
+			if (!GetVarint(at, end, value))
+			{
+				return false;
+			}
+			c = (wchar_t)value;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Get the name of a type number
+ * \param type Type number
+ * \returns Type name, empty if the number is not known
+ */
+std::wstring CSnapshotCodec::GetTypeName(uint16_t type) const
+{
+	return type < mTypes.size() ? mTypes[type] : wstring();
+}
+
+/**
+ * Write an unsigned number seven bits at a time, low bits first,
+ * with the high bit of each byte set when more follow
+ * \param frame Frame to append to
+ * \param value Number to write
+ */
+void CSnapshotCodec::PutVarint(std::vector<uint8_t>& frame, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		frame.push_back((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+
+	frame.push_back((uint8_t)value);
+}
+
+/**
+ * Read a number written by PutVarint
+ * \param at Where to read, moved past the number
+ * \param end End of the frame
+ * \param value Receives the number
+ * \returns False if the frame ends first or the number is too long
+ */
+bool CSnapshotCodec::GetVarint(const uint8_t*& at, const uint8_t* end, uint64_t& value)
+{
+	value = 0;
+	for (int shift = 0; shift < 64 && at < end; shift += 7)
+	{
+		uint8_t byte = *at++;
+		value |= (uint64_t)(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Is a frame a keyframe?
+ * \param frame Encoded frame
+ * \param size Bytes in the frame
+ * \returns true if the frame decodes without any other
+ */
+bool CSnapshotCodec::IsKeyframe(const uint8_t* frame, size_t size)
+{
+	return size > 0 && frame[0] == KeyframeKind;
+}
+
+/**
+ * Encode a snapshot as a keyframe or a delta from the last keyframe
+ * \param snapshot Snapshot to encode, which gets the frame number
+ * \param frame Receives the encoded frame
+ */
+void CSnapshotCodec::Encode(Snapshot& snapshot, std::vector<uint8_t>& frame)
+{
+	auto start = chrono::steady_clock::now();
+
+	Quantize(snapshot, mScratch);
+	snapshot.mSequence = mSequence;
+
+	bool keyframe = mForceKeyframe || !mEncodeKey.mValid || mSequence - mEncodeKey.mSequence >= (uint64_t)mKeyframeInterval;
+
+	frame.clear();
+	frame.push_back(keyframe ? (uint8_t)KeyframeKind : (uint8_t)DeltaKind);
+	PutVarint(frame, mSequence);
+	size_t at = frame.size();
+	frame.resize(at + sizeof(double));
+	memcpy(frame.data() + at, &snapshot.mTime, sizeof(double));
+	PutTypes(keyframe ? 0 : mEncodeKey.mNumTypes, frame);
+
+	if (keyframe)
+	{
+		EncodeKeyframe(mScratch, frame);
+		Hold(mEncodeKey, mScratch, mSequence);
+		mEncodeKey.mNumTypes = mTypes.size();
+		mForceKeyframe = false;
+		mKeyframes++;
+	}
+	else
+	{
+		EncodeDelta(mScratch, frame);
+		mDeltas++;
+	}
+
+	mSequence++;
+	mRawBytes += RawHeaderBytes + (long long)snapshot.mItems.size() * RawItemBytes;
+	mEncodedBytes += frame.size();
+	mEncodeSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Quantize the locations of a snapshot
+ * \param snapshot Snapshot to quantize
+ * \param items Receives the items in id order
+ */
+void CSnapshotCodec::Quantize(const Snapshot& snapshot, std::vector<Quantized>& items) const
+{
+	double scale = 1 << mFractionBits;
+
+	items.resize(snapshot.mItems.size());
+	for (size_t i = 0; i < items.size(); i++)
+	{
+		auto& item = snapshot.mItems[i];
+		items[i] = Quantized{ item.mId, item.mType, item.mMirror,
+			(int32_t)llround(item.mX * scale), (int32_t)llround(item.mY * scale) };
+	}
+
+	auto byId = [](const Quantized& a, const Quantized& b) { return a.mId < b.mId; };
+	if (!is_sorted(items.begin(), items.end(), byId))
+	{
+		sort(items.begin(), items.end(), byId);
+	}
+}
+
+/**
+ * Write items as in a keyframe, each against the one before it
+ * \param first First item
+ * \param last Past the last item
+ * \param frame Frame to append to
+ */
+void CSnapshotCodec::PutItems(const Quantized* first, const Quantized* last, std::vector<uint8_t>& frame)
+{
+	PutVarint(frame, last - first);
+
+	unsigned id = 0;
+	int64_t x = 0, y = 0;
+	for (auto item = first; item != last; ++item)
+	{
+		PutVarint(frame, item->mId - id);
+		PutVarint(frame, (uint64_t)item->mType * 2 + (item->mMirror ? 1 : 0));
+		PutVarint(frame, ZigZag(item->mX - x));
+		PutVarint(frame, ZigZag(item->mY - y));
+		id = item->mId;
+		x = item->mX;
+		y = item->mY;
+	}
+}
+
+/**
+ * Read items written by PutItems
+ * \param at Where to read, moved past the items
+ * \param end End of the frame
+ * \param items Receives the items
+ * \returns False if the items are cut off or malformed
+ */
+bool CSnapshotCodec::GetItems(const uint8_t*& at, const uint8_t* end, std::vector<Quantized>& items)
+{
+	uint64_t count;
+	// Every item takes at least four bytes
+	if (!GetVarint(at, end, count) || count > (uint64_t)(end - at) / 4)
+	{
+		return false;
+	}
+
+	items.resize((size_t)count);
+	unsigned id = 0;
+	int64_t x = 0, y = 0;
+	for (auto& item : items)
+	{
+		uint64_t idStep, type, dx, dy;
+		if (!GetVarint(at, end, idStep) || !GetVarint(at, end, type) ||
+			!GetVarint(at, end, dx) || !GetVarint(at, end, dy))
+		{
+			return false;
+		}
+
+		id += (unsigned)idStep;
+		x += UnZigZag(dx);
+		y += UnZigZag(dy);
+		item = Quantized{ id, (uint16_t)(type >> 1), (type & 1) != 0, (int32_t)x, (int32_t)y };
+	}
+
+	return true;
+}
+
+/**
+ * Write the items of a keyframe
+ * \param items Items in id order
+ * \param frame Frame to append to
+ */
+void CSnapshotCodec::EncodeKeyframe(const std::vector<Quantized>& items, std::vector<uint8_t>& frame) const
+{
+	PutItems(items.data(), items.data() + items.size(), frame);
+}
+
+/**
+ * Write the changes of items since the keyframe
+ * \param items Items in id order
+ * \param frame Frame to append to
+ */
+void CSnapshotCodec::EncodeDelta(const std::vector<Quantized>& items, std::vector<uint8_t>& frame) const
+{
+	const auto& key = mEncodeKey.mItems;
+	PutVarint(frame, mSequence - mEncodeKey.mSequence);
+
+	// Walk both lists in id order. An item whose type changed is
+	// treated as removed and added again.
+	vector<size_t> removed;
+	vector<pair<size_t, size_t>> kept;
+	vector<Quantized> added;
+	size_t k = 0, i = 0;
+	while (k < key.size() || i < items.size())
+	{
+		if (i == items.size() || (k < key.size() && key[k].mId < items[i].mId))
+		{
+			removed.push_back(k++);
+		}
+		else if (k == key.size() || items[i].mId < key[k].mId)
+		{
+			added.push_back(items[i++]);
+		}
+		else if (key[k].mType != items[i].mType)
+		{
+			removed.push_back(k++);
+			added.push_back(items[i++]);
+		}
+		else
+		{
+			kept.emplace_back(k++, i++);
+		}
+	}
+
+	PutVarint(frame, removed.size());
+	size_t next = 0;
+	for (auto index : removed)
+	{
+		PutVarint(frame, index - next);
+		next = index + 1;
+	}
+
+	for (auto& pair : kept)
+	{
+		auto& before = key[pair.first];
+		auto& after = items[pair.second];
+		bool flipped = before.mMirror != after.mMirror;
+		PutVarint(frame, ZigZag((int64_t)after.mX - before.mX) * 2 + (flipped ? 1 : 0));
+		PutVarint(frame, ZigZag((int64_t)after.mY - before.mY));
+	}
+
+	PutItems(added.data(), added.data() + added.size(), frame);
+}
+
+/**
+ * Decode a frame. Keyframes always decode; a delta frame decodes
+ * only after its keyframe.
+ * \param frame Encoded frame
+ * \param size Bytes in the frame
+ * \param snapshot Receives the snapshot
+ * \returns False if the frame is malformed or its keyframe was not decoded
+ */
+bool CSnapshotCodec::Decode(const uint8_t* frame, size_t size, Snapshot& snapshot)
+{
+	auto start = chrono::steady_clock::now();
+	const uint8_t* at = frame;
+	const uint8_t* end = frame + size;
+
+	if (size < 1 || (frame[0] != KeyframeKind && frame[0] != DeltaKind))
+	{
+		return false;
+	}
+
+	at++;
+	uint64_t sequence;
+	if (!GetVarint(at, end, sequence) || end - at < (ptrdiff_t)sizeof(double))
+	{
+		return false;
+	}
+
+	double time;
+	memcpy(&time, at, sizeof(double));
+	at += sizeof(double);
+
+	size_t firstType;
+	vector<wstring> names;
+	if (!GetTypes(at, end, firstType, names))
+	{
+		return false;
+	}
+
+	bool decoded = false;
+	if (frame[0] == KeyframeKind)
+	{
+		decoded = GetItems(at, end, mScratch) && at == end;
+		if (decoded)
+		{
+			Hold(mDecodeKey, mScratch, sequence);
+		}
+	}
+	else
+	{
+		const auto& key = mDecodeKey.mItems;
+		uint64_t distance, removedCount;
+		decoded = GetVarint(at, end, distance) && mDecodeKey.mValid && sequence - distance == mDecodeKey.mSequence &&
+			GetVarint(at, end, removedCount) && removedCount <= key.size();
+
+		// Mark the keyframe items that are gone
+		vector<bool> removed(decoded ? key.size() : 0);
+		uint64_t next = 0;
+		for (uint64_t r = 0; decoded && r < removedCount; r++)
+		{
+			uint64_t gap;
+			decoded = GetVarint(at, end, gap) && gap < key.size() - next;
+			if (decoded)
+			{
+				next += gap;
+				removed[(size_t)next++] = true;
+			}
+		}
+
+		mScratch.clear();
+		for (size_t k = 0; decoded && k < key.size(); k++)
+		{
+			if (removed[k])
+			{
+				continue;
+			}
+
+			uint64_t dx, dy;
+			decoded = GetVarint(at, end, dx) && GetVarint(at, end, dy);
+			auto item = key[k];
+			item.mMirror = item.mMirror != ((dx & 1) != 0);
+			item.mX = (int32_t)(item.mX + UnZigZag(dx >> 1));
+			item.mY = (int32_t)(item.mY + UnZigZag(dy));
+			mScratch.push_back(item);
+		}
+
+		vector<Quantized> added;
+		decoded = decoded && GetItems(at, end, added) && at == end;
+		if (decoded)
+		{
+			size_t middle = mScratch.size();
+			mScratch.insert(mScratch.end(), added.begin(), added.end());
+			inplace_merge(mScratch.begin(), mScratch.begin() + middle, mScratch.end(),
+				[](const Quantized& a, const Quantized& b) { return a.mId < b.mId; });
+		}
+	}
+
+	if (decoded)
+	{
+		// Decoded items keep the type numbers of their stream
+		for (size_t i = 0; i < names.size(); i++)
+		{
+			auto type = (uint16_t)(firstType + i);
+			if (type >= mTypes.size())
+			{
+				mTypes.resize(type + 1);
+			}
+			mTypes[type] = names[i];
+			mTypeNumbers[names[i]] = type;
+		}
+
+		snapshot.mSequence = sequence;
+		snapshot.mTime = time;
+		ToSnapshot(mScratch, snapshot);
+	}
+
+	mDecodeSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	return decoded;
+}
+
+/**
+ * Convert quantized items back to a snapshot
+ * \param items Items in id order
+ * \param snapshot Receives the items
+ */
+void CSnapshotCodec::ToSnapshot(const std::vector<Quantized>& items, Snapshot& snapshot) const
+{
+	double quantum = GetQuantum();
+
+	snapshot.mItems.resize(items.size());
+	for (size_t i = 0; i < items.size(); i++)
+	{
+		auto& item = snapshot.mItems[i];
+		item.mId = items[i].mId;
+		item.mType = items[i].mType;
+		item.mMirror = items[i].mMirror;
+		item.mX = items[i].mX * quantum;
+		item.mY = items[i].mY * quantum;
+	}
+}
+
+/**
+ * Keep items as the reference for the frames after them
+ * \param keyframe Keyframe to replace
+ * \param items Items of the new keyframe
+ * \param sequence Frame number of the new keyframe
+ */
+void CSnapshotCodec::Hold(Keyframe& keyframe, const std::vector<Quantized>& items, uint64_t sequence)
+{
+	Release(keyframe);
+
+	keyframe.mItems = items;
+	keyframe.mSequence = sequence;
+	keyframe.mValid = true;
+	CMemoryAccounting::Get().Add(CMemoryAccounting::Snapshots, KeyframesKey,
+		(long long)keyframe.mItems.size() * sizeof(Quantized));
+}
+
+/**
+ * Let go of a keyframe
+ * \param keyframe Keyframe to release
+ */
+void CSnapshotCodec::Release(Keyframe& keyframe)
+{
+	if (keyframe.mValid)
+	{
+		CMemoryAccounting::Get().Remove(CMemoryAccounting::Snapshots, KeyframesKey,
+			(long long)keyframe.mItems.size() * sizeof(Quantized));
+	}
+
+	keyframe.mItems.clear();
+	keyframe.mValid = false;
+}
+
+/**
+ * Get how many times smaller the encoded frames are than the snapshots
+ * \returns Raw bytes over encoded bytes, 0 before any frame
+ */
+double CSnapshotCodec::GetCompressionRatio() const
+{
+	return mEncodedBytes > 0 ? (double)mRawBytes / mEncodedBytes : 0;
+}
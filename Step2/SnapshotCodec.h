@@ -0,0 +1,223 @@
+/**
+ * \file SnapshotCodec.h
+ *
+ * \author Grant Youngs
+ *
+ * Class that compresses snapshots of the aquarium state.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+class CAquarium;
+
+
+/**
+ * Encodes snapshots of the items in an aquarium into compact
+ * frames, and decodes them again.
+ *
+ * Locations are quantized to fixed point with a few fraction bits,
+ * so a decoded location is within half a quantum of the original.
+ * Every so often a keyframe holds every item. The frames between
+ * hold each item as its change since that keyframe, so any frame
+ * decodes with only its keyframe. Numbers are written as varints,
+ * and signed numbers are zigzag encoded first so small changes in
+ * either direction take one or two bytes.
+ *
+ * Every frame names the types it may use, so a separate decoder can
+ * name them: keyframes hold every type number taken so far, and
+ * delta frames the numbers taken since their keyframe. A type table
+ * is a varint first type number and a varint count, then for each
+ * type a varint name length and the name's characters as varints.
+ *
+ * Keyframe: uint8 KeyframeKind, varint sequence, double time, type
+ * table, varint count, then for each item in id order a varint id
+ * less the previous id, varint type * 2 + mirror, and zigzag varint
+ * X and Y less those of the previous item.
+ *
+ * Delta: uint8 DeltaKind, varint sequence, double time, type table,
+ * varint sequence less that of the keyframe, varint count of keyframe items
+ * removed and the gaps between their keyframe positions, then for
+ * each remaining keyframe item a zigzag varint X change * 2 + mirror
+ * flipped and a zigzag varint Y change, then a count of added items
+ * written as in a keyframe.
+ *
+ * One codec can encode a stream and decode another. Decoded types
+ * keep the numbers of their stream, and their names are added to
+ * those GetTypeName knows. The keyframes it holds to do so are
+ * accounted to the Snapshots memory category.
+ */
+class CSnapshotCodec
+{
+public:
+	/** An item in a snapshot */
+	struct Item
+	{
+		unsigned mId = 0;       ///< Item id
+		uint16_t mType = 0;     ///< Type number, named by GetTypeName
+		bool mMirror = false;   ///< True if the image is mirrored
+		double mX = 0;          ///< X location
+		double mY = 0;          ///< Y location
+	};
+
+	/** The items of an aquarium at one time, in id order */
+	struct Snapshot
+	{
+		uint64_t mSequence = 0;     ///< Frame number, set by Encode and Decode
+		double mTime = 0;           ///< Aquarium time
+		std::vector<Item> mItems;   ///< Items in id order
+	};
+
+	/// Kind byte of a keyframe
+	static const uint8_t KeyframeKind = 1;
+
+	/// Kind byte of a delta frame
+	static const uint8_t DeltaKind = 2;
+
+	/// Fraction bits of a new codec, sixteenths of a pixel
+	static const int DefaultFractionBits = 4;
+
+	/// Frames from one keyframe to the next in a new codec
+	static const int DefaultKeyframeInterval = 30;
+
+	/// Bytes of an item stored without compression: id, type,
+	/// flags and two double locations
+	static const int RawItemBytes = 4 + 2 + 1 + 8 + 8;
+
+	/// Bytes of a snapshot header stored without compression: time and count
+	static const int RawHeaderBytes = 8 + 4;
+
+	CSnapshotCodec(int fractionBits = DefaultFractionBits, int keyframeInterval = DefaultKeyframeInterval);
+	virtual ~CSnapshotCodec();
+
+	/// Copy constructor (disabled)
+	CSnapshotCodec(const CSnapshotCodec&) = delete;
+
+	void Take(CAquarium* aquarium, Snapshot& snapshot);
+
+	void Encode(Snapshot& snapshot, std::vector<uint8_t>& frame);
+	bool Decode(const uint8_t* frame, size_t size, Snapshot& snapshot);
+
+	/// Make the next frame encoded a keyframe
+	void ForceKeyframe() { mForceKeyframe = true; }
+
+	void Reset();
+
+	static bool IsKeyframe(const uint8_t* frame, size_t size);
+
+	uint16_t FindType(const std::wstring& name);
+	std::wstring GetTypeName(uint16_t type) const;
+
+	/// Get the size of a location quantum
+	/// \returns Pixels per step of a quantized location
+	double GetQuantum() const { return 1.0 / (1 << mFractionBits); }
+
+	static void PutVarint(std::vector<uint8_t>& frame, uint64_t value);
+	static bool GetVarint(const uint8_t*& at, const uint8_t* end, uint64_t& value);
+
+	/// Map a signed number to an unsigned one, small magnitudes to small values
+	/// \param value Signed number
+	/// \returns Zigzag encoded number
+	static uint64_t ZigZag(int64_t value) { return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); }
+
+	/// Undo ZigZag
+	/// \param value Zigzag encoded number
+	/// \returns Signed number
+	static int64_t UnZigZag(uint64_t value) { return (int64_t)(value >> 1) ^ -(int64_t)(value & 1); }
+
+	/// Get the number of keyframes encoded
+	/// \returns Number of keyframes
+	long long GetNumKeyframes() const { return mKeyframes; }
+
+	/// Get the number of delta frames encoded
+	/// \returns Number of delta frames
+	long long GetNumDeltas() const { return mDeltas; }
+
+	/// Get the bytes the encoded snapshots take without compression
+	/// \returns Raw bytes
+	long long GetRawBytes() const { return mRawBytes; }
+
+	/// Get the bytes of the encoded frames
+	/// \returns Encoded bytes
+	long long GetEncodedBytes() const { return mEncodedBytes; }
+
+	double GetCompressionRatio() const;
+
+	/// Get the time spent encoding
+	/// \returns Seconds in Encode
+	double GetEncodeSeconds() const { return mEncodeSeconds; }
+
+	/// Get the time spent decoding
+	/// \returns Seconds in Decode
+	double GetDecodeSeconds() const { return mDecodeSeconds; }
+
+private:
+	/** An item with its location in fixed point */
+	struct Quantized
+	{
+		unsigned mId;       ///< Item id
+		uint16_t mType;     ///< Type number
+		bool mMirror;       ///< True if mirrored
+		int32_t mX;         ///< X location in quanta
+		int32_t mY;         ///< Y location in quanta
+	};
+
+	/** A keyframe held as the reference for the frames after it */
+	struct Keyframe
+	{
+		uint64_t mSequence = 0;             ///< Frame number of the keyframe
+		bool mValid = false;                ///< False until a keyframe is held
+		size_t mNumTypes = 0;               ///< Type numbers named by the keyframe
+		std::vector<Quantized> mItems;      ///< Items in id order
+	};
+
+	void Quantize(const Snapshot& snapshot, std::vector<Quantized>& items) const;
+	void EncodeKeyframe(const std::vector<Quantized>& items, std::vector<uint8_t>& frame) const;
+	void EncodeDelta(const std::vector<Quantized>& items, std::vector<uint8_t>& frame) const;
+	void PutTypes(size_t first, std::vector<uint8_t>& frame) const;
+	static bool GetTypes(const uint8_t*& at, const uint8_t* end, size_t& first, std::vector<std::wstring>& names);
+	static void PutItems(const Quantized* first, const Quantized* last, std::vector<uint8_t>& frame);
+	static bool GetItems(const uint8_t*& at, const uint8_t* end, std::vector<Quantized>& items);
+	void Hold(Keyframe& keyframe, const std::vector<Quantized>& items, uint64_t sequence);
+	void Release(Keyframe& keyframe);
+	void ToSnapshot(const std::vector<Quantized>& items, Snapshot& snapshot) const;
+
+	/// Fraction bits of a quantized location
+	int mFractionBits;
+
+	/// Frames from one keyframe to the next
+	int mKeyframeInterval;
+
+	/// Number of the next frame encoded
+	uint64_t mSequence = 0;
+
+	/// True to make the next frame a keyframe
+	bool mForceKeyframe = false;
+
+	/// Reference of the frames being encoded
+	Keyframe mEncodeKey;
+
+	/// Reference of the frames being decoded
+	Keyframe mDecodeKey;
+
+	/// Items of the snapshot being encoded or decoded
+	std::vector<Quantized> mScratch;
+
+	/// Type names in order of their numbers
+	std::vector<std::wstring> mTypes;
+
+	/// Type numbers by name
+	std::map<std::wstring, uint16_t> mTypeNumbers;
+
+	long long mKeyframes = 0;       ///< Keyframes encoded
+	long long mDeltas = 0;          ///< Delta frames encoded
+	long long mRawBytes = 0;        ///< Bytes of the snapshots encoded, uncompressed
+	long long mEncodedBytes = 0;    ///< Bytes of the frames encoded
+	double mEncodeSeconds = 0;      ///< Time spent encoding
+	double mDecodeSeconds = 0;      ///< Time spent decoding
+};
+
@@ -0,0 +1,259 @@
+/**
+ * \file SpatialGrid.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the uniform grid spatial index.
+ */
+
+#include "pch.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "SpatialGrid.h"
+#include "Item.h"
+
+using namespace std;
+
+/**
+ * Constructor
+ * \param cellSize Width and height of a cell in world pixels
+ */
+CSpatialGrid::CSpatialGrid(double cellSize) : mCellSize(cellSize)
+{
+}
+
+/**
+ * Get the key of the cell holding a location.
+ *
+ * The cell column and row are packed into one 64 bit key.
+ * \param x X location
+ * \param y Y location
+ * \returns Cell key
+ */
+long long CSpatialGrid::GetCellKey(double x, double y) const
+{
+	long long column = (long long)floor(x / mCellSize);
+	long long row = (long long)floor(y / mCellSize);
+	return (long long)(((unsigned long long)column << 32) ^ ((unsigned long long)row & 0xffffffffULL));
+}
+
+/**
+ * Add an item, or move an item already in the grid in front of
+ * every other item.
+ * \param item Item to add
+ */
+void CSpatialGrid::Insert(CItem* item)
+{
+	Remove(item);
+
+	Entry entry;
+	entry.mCell = GetCellKey(item->GetX(), item->GetY());
+	entry.mOrder = mNextOrder++;
+
+	auto& cell = mCells[entry.mCell];
+	entry.mSlot = cell.size();
+	cell.push_back(Slot{ item, entry.mOrder });
+	mEntries[item] = entry;
+
+	mMaxHalfWidth = max(mMaxHalfWidth, item->GetImageWidth() / 2);
+	mMaxHalfHeight = max(mMaxHalfHeight, item->GetImageHeight() / 2);
+}
+
+/**
+ * Remove an item. Items not in the grid are ignored.
+ * \param item Item to remove
+ */
+void CSpatialGrid::Remove(CItem* item)
+{
+	auto found = mEntries.find(item);
+	if (found != mEntries.end())
+	{
+		RemoveFromCell(found->second);
+		mEntries.erase(found);
+	}
+}
+
+/**
+ * Take an item out of its cell.
+ *
+ * The last item of the cell takes its slot, so removal does not
+ * depend on how many items share the cell.
+ * \param entry Entry of the item to remove
+ */
+void CSpatialGrid::RemoveFromCell(const Entry& entry)
+{
+	auto cell = mCells.find(entry.mCell);
+	auto& items = cell->second;
+
+	if (entry.mSlot + 1 < items.size())
+	{
+		items[entry.mSlot] = items.back();
+		mEntries[items[entry.mSlot].mItem].mSlot = entry.mSlot;
+	}
+
+	items.pop_back();
+	if (items.empty())
+	{
+		mCells.erase(cell);
+	}
+}
+
+/**
+ * Has an item left the cell it is filed in?
+ *
+ * Only reads the grid, so it may be called from several threads at
+ * once while nothing changes the grid.
+ * \param item Item to test
+ * \returns true if Move would change its cell
+ */
+bool CSpatialGrid::IsMoved(CItem* item) const
+{
+	auto found = mEntries.find(item);
+	return found != mEntries.end() && GetCellKey(item->GetX(), item->GetY()) != found->second.mCell;
+}
+
+/**
+ * Update the cell of an item after its location changed.
+ *
+ * Cheap when the item stays in its cell, which is almost every
+ * frame. Items not in the grid are ignored.
+ * \param item Item that moved
+ */
+void CSpatialGrid::Move(CItem* item)
+{
+	auto found = mEntries.find(item);
+	if (found == mEntries.end())
+	{
+		return;
+	}
+
+	auto& entry = found->second;
+	long long key = GetCellKey(item->GetX(), item->GetY());
+	if (key == entry.mCell)
+	{
+		return;
+	}
+
+	RemoveFromCell(entry);
+
+	auto& cell = mCells[key];
+	entry.mCell = key;
+	entry.mSlot = cell.size();
+	cell.push_back(Slot{ item, entry.mOrder });
+}
+
+/**
+ * Remove every item
+ */
+void CSpatialGrid::Clear()
+{
+	mCells.clear();
+	mEntries.clear();
+	mMaxHalfWidth = 0;
+	mMaxHalfHeight = 0;
+}
+
+/**
+ * Find the items whose images may overlap a rectangle.
+ *
+ * Only the cells the rectangle overlaps are visited, widened by the
+ * largest item so images that reach in from a neighboring cell are
+ * found too.
+ * \param left Smallest X of the rectangle
+ * \param top Smallest Y of the rectangle
+ * \param right Largest X of the rectangle
+ * \param bottom Largest Y of the rectangle
+ * \param items Receives the items in drawing order, back to front
+ */
+void CSpatialGrid::Query(double left, double top, double right, double bottom, std::vector<CItem*>& items)
+{
+	mFound.clear();
+
+	left -= mMaxHalfWidth;
+	right += mMaxHalfWidth;
+	top -= mMaxHalfHeight;
+	bottom += mMaxHalfHeight;
+
+	auto add = [this, left, top, right, bottom](const Slot& slot) {
+		double x = slot.mItem->GetX();
+		double y = slot.mItem->GetY();
+		if (x >= left && x <= right && y >= top && y <= bottom)
+		{
+			mFound.push_back(slot);
+		}
+	};
+
+	double columns = floor(right / mCellSize) - floor(left / mCellSize) + 1;
+	double rows = floor(bottom / mCellSize) - floor(top / mCellSize) + 1;
+
+	if (columns * rows > (double)mCells.size())
+	{
+		// Zoomed far out, it is quicker to visit the occupied cells
+		for (auto& cell : mCells)
+		{
+			for (auto& slot : cell.second)
+			{
+				add(slot);
+			}
+		}
+	}
+	else
+	{
+		for (double y = floor(top / mCellSize); y <= floor(bottom / mCellSize); y++)
+		{
+			for (double x = floor(left / mCellSize); x <= floor(right / mCellSize); x++)
+			{
+				auto cell = mCells.find(GetCellKey((x + 0.5) * mCellSize, (y + 0.5) * mCellSize));
+				if (cell == mCells.end())
+				{
+					continue;
+				}
+
+				for (auto& slot : cell->second)
+				{
+					add(slot);
+				}
+			}
+		}
+	}
+
+	sort(mFound.begin(), mFound.end(), [](const Slot& a, const Slot& b) {
+		return a.mOrder < b.mOrder;
+	});
+
+	items.clear();
+	for (auto& slot : mFound)
+	{
+		items.push_back(slot.mItem);
+	}
+}
+
+/**
+ * Get how long an item moving in a straight line stays in its cell.
+ * \param x X location
+ * \param y Y location
+ * \param speedX Speed in the X direction
+ * \param speedY Speed in the Y direction
+ * \returns Seconds until the item crosses into another cell,
+ * infinity if it is not moving
+ */
+double CSpatialGrid::GetTimeToLeaveCell(double x, double y, double speedX, double speedY) const
+{
+	auto axis = [this](double location, double speed) {
+		double low = floor(location / mCellSize) * mCellSize;
+		if (speed > 0)
+		{
+			return (low + mCellSize - location) / speed;
+		}
+		if (speed < 0)
+		{
+			return (location - low) / -speed;
+		}
+		return numeric_limits<double>::infinity();
+	};
+
+	double timeX = axis(x, speedX);
+	double timeY = axis(y, speedY);
+	return min(timeX, timeY);
+}
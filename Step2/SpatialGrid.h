@@ -0,0 +1,93 @@
+/**
+ * \file SpatialGrid.h
+ *
+ * \author Grant Youngs
+ *
+ * Class that indexes the items of an aquarium by location.
+ */
+
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+class CItem;
+
+
+/**
+ * Uniform grid of square cells over the aquarium world.
+ *
+ * Each item is kept in the cell that holds its center, so finding
+ * the items in a rectangle only visits the cells it overlaps. Items
+ * are moved between cells as their locations change. The grid also
+ * remembers the order items were added in, which is their drawing
+ * order, so queries can return items back to front.
+ */
+class CSpatialGrid
+{
+public:
+	CSpatialGrid(double cellSize = 256);
+
+	/// Copy constructor (disabled)
+	CSpatialGrid(const CSpatialGrid&) = delete;
+
+	void Insert(CItem* item);
+	void Remove(CItem* item);
+	void Move(CItem* item);
+	bool IsMoved(CItem* item) const;
+	void Clear();
+
+	void Query(double left, double top, double right, double bottom, std::vector<CItem*>& items);
+
+	double GetTimeToLeaveCell(double x, double y, double speedX, double speedY) const;
+
+	/// Get the number of items in the grid
+	/// \returns Number of items
+	int GetCount() const { return (int)mEntries.size(); }
+
+	/// Get the width and height of a cell
+	/// \returns Cell size in world pixels
+	double GetCellSize() const { return mCellSize; }
+
+private:
+	/** An item in a cell */
+	struct Slot
+	{
+		CItem* mItem;               ///< Item in the cell
+		unsigned long long mOrder;  ///< Drawing order, larger is in front
+	};
+
+	/** Where an item is in the grid */
+	struct Entry
+	{
+		long long mCell;            ///< Key of the cell holding the item
+		size_t mSlot;               ///< Index of the item in the cell
+		unsigned long long mOrder;  ///< Drawing order, larger is in front
+	};
+
+	long long GetCellKey(double x, double y) const;
+
+	void RemoveFromCell(const Entry& entry);
+
+	/// Width and height of a cell in world pixels
+	double mCellSize;
+
+	/// Items in each occupied cell
+	std::unordered_map<long long, std::vector<Slot>> mCells;
+
+	/// Location of every item in the grid
+	std::unordered_map<CItem*, Entry> mEntries;
+
+	/// Drawing order given to the next inserted item
+	unsigned long long mNextOrder = 0;
+
+	/// Items found by the last query with their drawing order
+	std::vector<Slot> mFound;
+
+	/// Largest half width of any inserted item
+	double mMaxHalfWidth = 0;
+
+	/// Largest half height of any inserted item
+	double mMaxHalfHeight = 0;
+};
+
@@ -0,0 +1,412 @@
+/**
+ * \file SpriteAtlas.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the sprite atlas.
+ */
+
+#include "pch.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include "SpriteAtlas.h"
+#include "SpriteCache.h"
+#include "MemoryAccounting.h"
+#include "TraceLog.h"
+
+using namespace Gdiplus;
+using namespace std;
+
+/// Empty pixels kept between sprites so filtered draws do not
+/// bleed a neighbor in
+const int Padding = 2;
+
+/**
+ * Copy every pixel of an image into a page as premultiplied ARGB
+ * \param source Image to copy
+ * \param page Page to copy into
+ * \param x Left of the copy in the page
+ * \param y Top of the copy in the page
+ * \param mirror True to copy the image flipped left to right
+ */
+static void CopyInto(Bitmap* source, Bitmap* page, int x, int y, bool mirror)
+{
+	int width = source->GetWidth();
+	int height = source->GetHeight();
+
+	Rect from(0, 0, width, height);
+	BitmapData fromData;
+	source->LockBits(&from, ImageLockModeRead, PixelFormat32bppPARGB, &fromData);
+
+	Rect to(x, y, width, height);
+	BitmapData toData;
+	page->LockBits(&to, ImageLockModeWrite, PixelFormat32bppPARGB, &toData);
+
+	for (int row = 0; row < height; row++)
+	{
+		auto src = (const uint32_t*)((const BYTE*)fromData.Scan0 + row * fromData.Stride);
+		auto dst = (uint32_t*)((BYTE*)toData.Scan0 + row * toData.Stride);
+		if (mirror)
+		{
+			for (int col = 0; col < width; col++)
+			{
+				dst[col] = src[width - 1 - col];
+			}
+		}
+		else
+		{
+			memcpy(dst, src, width * sizeof(uint32_t));
+		}
+	}
+
+	page->UnlockBits(&toData);
+	source->UnlockBits(&fromData);
+}
+
+/**
+ * Constructor
+ * \param pageSize Width and height of a page in pixels
+ */
+CSpriteAtlas::CSpriteAtlas(int pageSize) : mPageSize(pageSize)
+{
+}
+
+/**
+ * Destructor
+ */
+CSpriteAtlas::~CSpriteAtlas()
+{
+	Clear();
+}
+
+/**
+ * Get the process wide atlas every item draws from
+ * \returns Sprite atlas
+ */
+CSpriteAtlas& CSpriteAtlas::Get()
+{
+	static CSpriteAtlas atlas;
+	return atlas;
+}
+
+/**
+ * Find where a sprite is in the atlas, packing it first if it is
+ * not there yet.
+ *
+ * A file that fails to decode gets a sprite with no image, so the
+ * caller can report it.
+ * \param filename Image file
+ * \returns Sprite, which stays valid until the atlas is cleared
+ */
+const CSpriteAtlas::Sprite* CSpriteAtlas::Find(const std::wstring& filename)
+{
+	lock_guard<mutex> lock(mMutex);
+
+	auto found = mSprites.find(filename);
+	if (found != mSprites.end())
+	{
+		return &found->second;
+	}
+
+	return Add(filename);
+}
+
+/**
+ * Decode an image and copy it and its mirror into a page.
+ * Called with the atlas lock held.
+ * \param filename Image file
+ * \returns New sprite
+ */
+CSpriteAtlas::Sprite* CSpriteAtlas::Add(const std::wstring& filename)
+{
+	AQUA_TRACE_SCOPE("PackSprite");
+
+	auto& sprite = mSprites[filename];
+	sprite.mId = NextId();
+
+	auto source = CSpriteCache::Get().Load(filename);
+	if (source->GetLastStatus() != Ok)
+	{
+		return &sprite;
+	}
+
+	int width = source->GetWidth();
+	int height = source->GetHeight();
+
+	int page, x, y;
+	Place(width * 2 + Padding, height, page, x, y);
+
+	auto image = mPages[page]->mImage.get();
+	CopyInto(source.get(), image, x, y, false);
+	CopyInto(source.get(), image, x + width + Padding, y, true);
+
+	sprite.mImage = image;
+	sprite.mPage = page;
+	sprite.mX = x;
+	sprite.mY = y;
+	sprite.mMirrorX = x + width + Padding;
+	sprite.mWidth = width;
+	sprite.mHeight = height;
+	sprite.mOpaque = !IsAlphaPixelFormat(source->GetPixelFormat());
+	sprite.mReady = true;
+	MakeMask(sprite);
+
+	CMemoryAccounting::Get().Add(CMemoryAccounting::Sprites, filename, (long long)width * height * 4 * 2);
+
+	return &sprite;
+}
+
+/**
+ * Make the alpha mask of a sprite from its pixels in the page.
+ * Called with the atlas lock held once the pixels are in.
+ * \param sprite Sprite to make the mask of
+ */
+void CSpriteAtlas::MakeMask(Sprite& sprite)
+{
+	if (sprite.mOpaque || !sprite.mReady || sprite.mImage == nullptr)
+	{
+		// Every pixel in the box hits
+		atomic_store(&sprite.mMask, shared_ptr<const AlphaMask>());
+		return;
+	}
+
+	auto mask = make_shared<AlphaMask>();
+	mask->mWords = (sprite.mWidth + 31) / 32;
+	mask->mBits.assign((size_t)mask->mWords * sprite.mHeight, 0);
+
+	Rect rect(sprite.mX, sprite.mY, sprite.mWidth, sprite.mHeight);
+	BitmapData data;
+	sprite.mImage->LockBits(&rect, ImageLockModeRead, PixelFormat32bppPARGB, &data);
+	for (int row = 0; row < sprite.mHeight; row++)
+	{
+		auto pixels = (const uint32_t*)((const BYTE*)data.Scan0 + row * data.Stride);
+		auto bits = &mask->mBits[(size_t)row * mask->mWords];
+		for (int col = 0; col < sprite.mWidth; col++)
+		{
+			if ((pixels[col] >> 24) != 0)
+			{
+				bits[col >> 5] |= 1u << (col & 31);
+			}
+		}
+	}
+	sprite.mImage->UnlockBits(&data);
+
+	atomic_store(&sprite.mMask, shared_ptr<const AlphaMask>(mask));
+}
+
+/**
+ * Make room for a sprite whose pixels are not decoded yet.
+ *
+ * Items that find the sprite get its size right away and draw a
+ * placeholder until Fill provides the pixels. A sprite already in
+ * the atlas is returned as it is.
+ * \param filename Image file
+ * \param width Width of the image in pixels
+ * \param height Height of the image in pixels
+ * \returns Sprite, which stays valid until the atlas is cleared
+ */
+const CSpriteAtlas::Sprite* CSpriteAtlas::Reserve(const std::wstring& filename, int width, int height)
+{
+	lock_guard<mutex> lock(mMutex);
+
+	auto found = mSprites.find(filename);
+	if (found != mSprites.end())
+	{
+		return &found->second;
+	}
+
+	int page, x, y;
+	Place(width * 2 + Padding, height, page, x, y);
+
+	auto& sprite = mSprites[filename];
+	sprite.mId = NextId();
+	sprite.mImage = mPages[page]->mImage.get();
+	sprite.mPage = page;
+	sprite.mX = x;
+	sprite.mY = y;
+	sprite.mMirrorX = x + width + Padding;
+	sprite.mWidth = width;
+	sprite.mHeight = height;
+	sprite.mOpaque = true;
+	return &sprite;
+}
+
+/**
+ * Copy the decoded pixels of a reserved sprite into its page
+ * \param filename Image file
+ * \param image Decoded image, the size given to Reserve
+ * \param opaque True if the source had no alpha
+ * \returns True if the sprite was waiting for these pixels
+ */
+bool CSpriteAtlas::Fill(const std::wstring& filename, Gdiplus::Bitmap* image, bool opaque)
+{
+	AQUA_TRACE_SCOPE("FillSprite");
+	lock_guard<mutex> lock(mMutex);
+
+	auto found = mSprites.find(filename);
+	if (found == mSprites.end())
+	{
+		return false;
+	}
+
+	auto& sprite = found->second;
+	if (sprite.mReady || sprite.mImage == nullptr ||
+		(int)image->GetWidth() != sprite.mWidth || (int)image->GetHeight() != sprite.mHeight)
+	{
+		return false;
+	}
+
+	CopyInto(image, sprite.mImage, sprite.mX, sprite.mY, false);
+	CopyInto(image, sprite.mImage, sprite.mMirrorX, sprite.mY, true);
+	sprite.mOpaque = opaque;
+	sprite.mReady = true;
+	MakeMask(sprite);
+
+	CMemoryAccounting::Get().Add(CMemoryAccounting::Sprites, filename, (long long)sprite.mWidth * sprite.mHeight * 4 * 2);
+	return true;
+}
+
+/**
+ * Find room for a rectangle, starting a new shelf or page when
+ * the open ones are full
+ * \param width Width of the rectangle
+ * \param height Height of the rectangle
+ * \param page Receives the page index
+ * \param x Receives the left of the rectangle in the page
+ * \param y Receives the top of the rectangle in the page
+ */
+void CSpriteAtlas::Place(int width, int height, int& page, int& x, int& y)
+{
+	int paddedWidth = width + Padding;
+	int paddedHeight = height + Padding;
+
+	if (paddedWidth > mPageSize || paddedHeight > mPageSize)
+	{
+		// Too large to share a page
+		NewPage(width, height);
+		page = (int)mPages.size() - 1;
+		x = 0;
+		y = 0;
+		return;
+	}
+
+	for (page = 0; page < (int)mPages.size(); page++)
+	{
+		auto& open = *mPages[page];
+		if (open.mShelfX + paddedWidth > open.mWidth)
+		{
+			// Start a new shelf below the current one
+			if (open.mShelfY + open.mShelfHeight + paddedHeight > open.mHeight || paddedWidth > open.mWidth)
+			{
+				continue;
+			}
+
+			open.mShelfY += open.mShelfHeight;
+			open.mShelfX = 0;
+			open.mShelfHeight = 0;
+		}
+
+		if (open.mShelfY + paddedHeight > open.mHeight)
+		{
+			continue;
+		}
+
+		x = open.mShelfX;
+		y = open.mShelfY;
+		open.mShelfX += paddedWidth;
+		open.mShelfHeight = max(open.mShelfHeight, paddedHeight);
+		return;
+	}
+
+	auto added = NewPage(mPageSize, mPageSize);
+	x = 0;
+	y = 0;
+	added->mShelfX = paddedWidth;
+	added->mShelfHeight = paddedHeight;
+}
+
+/**
+ * Add an empty page
+ * \param width Width of the page
+ * \param height Height of the page
+ * \returns New page
+ */
+CSpriteAtlas::Page* CSpriteAtlas::NewPage(int width, int height)
+{
+	auto page = make_unique<Page>();
+	page->mImage = make_unique<Bitmap>(width, height, PixelFormat32bppPARGB);
+	page->mWidth = width;
+	page->mHeight = height;
+
+	if (width != mPageSize || height != mPageSize)
+	{
+		// A page of its own sprite has no room left
+		page->mShelfY = height;
+	}
+
+	mPages.push_back(move(page));
+	return mPages.back().get();
+}
+
+/**
+ * Remove every sprite and page. No item may still be using them.
+ */
+void CSpriteAtlas::Clear()
+{
+	lock_guard<mutex> lock(mMutex);
+
+	for (auto& entry : mSprites)
+	{
+		auto& sprite = entry.second;
+		if (sprite.mReady)
+		{
+			CMemoryAccounting::Get().Remove(CMemoryAccounting::Sprites, entry.first,
+				(long long)sprite.mWidth * sprite.mHeight * 4 * 2);
+		}
+	}
+
+	mSprites.clear();
+	mPages.clear();
+}
+
+/**
+ * Get the number of pages
+ * \returns Number of pages
+ */
+int CSpriteAtlas::GetNumPages()
+{
+	lock_guard<mutex> lock(mMutex);
+	return (int)mPages.size();
+}
+
+/**
+ * Get the number of sprites packed into the pages
+ * \returns Number of sprites, not counting ones that failed to
+ * decode or are still waiting for their pixels
+ */
+int CSpriteAtlas::GetNumSprites()
+{
+	lock_guard<mutex> lock(mMutex);
+
+	int count = 0;
+	for (auto& sprite : mSprites)
+	{
+		if (sprite.second.mReady)
+		{
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/**
+ * Get a sprite id no other sprite in the process has had
+ * \returns Sprite id, never 0
+ */
+unsigned long long CSpriteAtlas::NextId()
+{
+	static atomic<unsigned long long> next{ 1 };
+	return next++;
+}
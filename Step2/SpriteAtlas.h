@@ -0,0 +1,146 @@
+/**
+ * \file SpriteAtlas.h
+ *
+ * \author Grant Youngs
+ *
+ * Class that packs every sprite into a few large surfaces.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+/**
+ * Packs sprites and their mirrored variants into atlas pages.
+ *
+ * Each sprite is copied into a page next to a mirrored copy of
+ * itself, so drawing either way round is a plain blit of a sub
+ * rectangle. Consecutive draws from the same page can then be
+ * batched, and mirrored items no longer need a negative width.
+ *
+ * Pages are filled a shelf at a time: sprites are placed left to
+ * right along a shelf as tall as the tallest sprite on it, and a
+ * new shelf is started below when a sprite does not fit. Sprites
+ * too large for a page get a page of their own.
+ *
+ * A sprite can also be reserved before its pixels are decoded, so
+ * items can be created and laid out at the right size while a
+ * loader fills the atlas in the background. Until it is filled a
+ * sprite is drawn as a placeholder.
+ *
+ * Pages are written under the atlas lock. Items draw on the user
+ * interface thread, also under the lock, so an item created on
+ * another thread or a loader can safely add a sprite. Hit tests use
+ * an alpha mask made when the sprite is packed, which never changes
+ * once published, so they do not need the lock.
+ */
+class CSpriteAtlas
+{
+public:
+	/** Which pixels of a sprite are drawn, one bit each */
+	struct AlphaMask
+	{
+		int mWords = 0;                 ///< 32 bit words in a row
+		std::vector<uint32_t> mBits;    ///< Rows of bits, set where the alpha is not zero
+
+		/// Is a pixel drawn?
+		/// \param x Column in the sprite
+		/// \param y Row in the sprite
+		/// \returns true if the alpha of the pixel is not zero
+		bool Test(int x, int y) const { return ((mBits[y * mWords + (x >> 5)] >> (x & 31)) & 1) != 0; }
+	};
+
+	/** Where one sprite lives in the atlas */
+	struct Sprite
+	{
+		Gdiplus::Bitmap* mImage = nullptr;  ///< Page holding the sprite, null if it failed to decode
+		int mPage = -1;         ///< Index of the page
+		int mX = 0;             ///< Left of the sprite in the page
+		int mY = 0;             ///< Top of the sprite and its mirror in the page
+		int mMirrorX = 0;       ///< Left of the mirrored copy in the page
+		int mWidth = 0;         ///< Width of the sprite in pixels
+		int mHeight = 0;        ///< Height of the sprite in pixels
+		bool mOpaque = false;   ///< True if the source had no alpha, so every pixel hits
+		bool mReady = false;    ///< False while the pixels are still being loaded
+		unsigned long long mId = 0; ///< Unique over every atlas and run, for caches keyed by sprite
+
+		/// Drawn pixels, null while every pixel in the box hits.
+		/// Read it with GetMask, it is published once the pixels are in.
+		std::shared_ptr<const AlphaMask> mMask;
+
+		/// Get the drawn pixels without the atlas lock
+		/// \returns Alpha mask, null if the whole box hits
+		std::shared_ptr<const AlphaMask> GetMask() const { return std::atomic_load(&mMask); }
+	};
+
+	/// Width and height of a page in pixels
+	static const int DefaultPageSize = 2048;
+
+	/// Images wider or taller than this are backgrounds, not sprites
+	static const int MaxSpriteSize = 512;
+
+	CSpriteAtlas(int pageSize = DefaultPageSize);
+	virtual ~CSpriteAtlas();
+
+	/// Copy constructor (disabled)
+	CSpriteAtlas(const CSpriteAtlas&) = delete;
+
+	static CSpriteAtlas& Get();
+
+	const Sprite* Find(const std::wstring& filename);
+
+	const Sprite* Reserve(const std::wstring& filename, int width, int height);
+	bool Fill(const std::wstring& filename, Gdiplus::Bitmap* image, bool opaque);
+
+	void Clear();
+
+	int GetNumPages();
+	int GetNumSprites();
+
+	/// Get the lock that protects the page pixels
+	/// \returns Atlas lock
+	std::mutex& GetMutex() { return mMutex; }
+
+	/// Get the width and height of a page
+	/// \returns Page size in pixels
+	int GetPageSize() const { return mPageSize; }
+
+private:
+	/** A page and the shelf being filled on it */
+	struct Page
+	{
+		std::unique_ptr<Gdiplus::Bitmap> mImage;  ///< Page pixels
+		int mWidth = 0;         ///< Width of the page
+		int mHeight = 0;        ///< Height of the page
+		int mShelfX = 0;        ///< Left of the next sprite on the shelf
+		int mShelfY = 0;        ///< Top of the shelf
+		int mShelfHeight = 0;   ///< Height of the tallest sprite on the shelf
+	};
+
+	Sprite* Add(const std::wstring& filename);
+	void Place(int width, int height, int& page, int& x, int& y);
+	Page* NewPage(int width, int height);
+
+	static void MakeMask(Sprite& sprite);
+
+	static unsigned long long NextId();
+
+	/// Width and height of a new page
+	int mPageSize;
+
+	/// Protects the pages and the sprite table
+	std::mutex mMutex;
+
+	/// Atlas pages
+	std::vector<std::unique_ptr<Page>> mPages;
+
+	/// Sprites by filename. Map nodes do not move, so items keep pointers.
+	std::map<std::wstring, Sprite> mSprites;
+};
+
@@ -0,0 +1,108 @@
+/**
+ * \file SpriteBatch.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the sprite draw batch.
+ */
+
+#include "pch.h"
+#include "SpriteBatch.h"
+
+using namespace Gdiplus;
+using namespace std;
+
+/// Color of the box drawn for a sprite that is still loading
+const Color PlaceholderColor(64, 128, 128, 160);
+
+/**
+ * Constructor
+ * \param atlas Atlas the sprites are in
+ * \param mips Mip levels of the sprites
+ */
+CSpriteBatch::CSpriteBatch(CSpriteAtlas& atlas, CMipCache& mips) : mAtlas(atlas), mMips(mips)
+{
+}
+
+/**
+ * Add a sprite to draw centered on a location.
+ * Sprites that failed to decode are skipped.
+ * \param sprite Sprite to draw
+ * \param mirror True to draw the sprite flipped left to right
+ * \param x X location of the center of the sprite
+ * \param y Y location of the center of the sprite
+ */
+void CSpriteBatch::Add(const CSpriteAtlas::Sprite* sprite, bool mirror, double x, double y)
+{
+	if (sprite == nullptr || sprite->mImage == nullptr)
+	{
+		return;
+	}
+
+	mDraws.push_back(Draw{ sprite, mirror,
+		float(x - sprite->mWidth / 2.0), float(y - sprite->mHeight / 2.0) });
+}
+
+/**
+ * Draw every added sprite in the order added and empty the batch
+ * \param graphics Graphics context to draw on
+ * \param scale Screen pixels per world pixel, used to choose mip levels
+ */
+void CSpriteBatch::Flush(Gdiplus::Graphics* graphics, double scale)
+{
+	mNumDraws = (int)mDraws.size();
+	mNumRuns = 0;
+
+	lock_guard<mutex> lock(mAtlas.GetMutex());
+
+	// Sprites still loading are drawn as a translucent box, which
+	// counts as a page of its own
+	SolidBrush placeholder(PlaceholderColor);
+
+	Bitmap* page = nullptr;
+	for (auto& draw : mDraws)
+	{
+		auto sprite = draw.mSprite;
+		RectF target(draw.mX, draw.mY, (REAL)sprite->mWidth, (REAL)sprite->mHeight);
+
+		if (!sprite->mReady)
+		{
+			if (page != nullptr || mNumRuns == 0)
+			{
+				page = nullptr;
+				mNumRuns++;
+			}
+
+			graphics->FillRectangle(&placeholder, target.X, target.Y, target.Width, target.Height);
+			continue;
+		}
+
+		// The sprite in the atlas, or a reduced copy when zoomed out
+		Bitmap* source = sprite->mImage;
+		int x = draw.mMirror ? sprite->mMirrorX : sprite->mX;
+		int y = sprite->mY;
+		int width = sprite->mWidth;
+		int height = sprite->mHeight;
+
+		int level = mMipmapping ? CMipCache::ChooseLevel(sprite, scale) : 0;
+		auto mip = mMips.Find(sprite, level);
+		if (mip != nullptr)
+		{
+			source = mip->mImage.get();
+			x = draw.mMirror ? mip->mWidth : 0;
+			y = 0;
+			width = mip->mWidth;
+			height = mip->mHeight;
+		}
+
+		if (source != page || mNumRuns == 0)
+		{
+			page = source;
+			mNumRuns++;
+		}
+
+		graphics->DrawImage(source, target, (REAL)x, (REAL)y, (REAL)width, (REAL)height, UnitPixel);
+	}
+
+	mDraws.clear();
+}
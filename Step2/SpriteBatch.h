@@ -0,0 +1,87 @@
+/**
+ * \file SpriteBatch.h
+ *
+ * \author Grant Youngs
+ *
+ * Class that collects sprite draws and issues them page by page.
+ */
+
+#pragma once
+
+#include <vector>
+#include "SpriteAtlas.h"
+#include "MipCache.h"
+
+
+/**
+ * A list of sprite draws made during one frame.
+ *
+ * Items add their sprites back to front, and Flush draws them in
+ * that same order, so the z-order is unchanged. Consecutive draws
+ * from the same atlas page form a run, which is drawn under one
+ * hold of the atlas lock with no change of source surface. The
+ * number of runs is how many times the source surface changed,
+ * which with a packed atlas is far fewer than the number of draws.
+ * Sprites still being loaded are drawn as placeholder boxes.
+ *
+ * When the sprites are drawn smaller than their size, each is drawn
+ * from the mip level closest to its size on screen, so the page is
+ * only a source when the view is not zoomed out.
+ */
+class CSpriteBatch
+{
+public:
+	CSpriteBatch(CSpriteAtlas& atlas = CSpriteAtlas::Get(), CMipCache& mips = CMipCache::Get());
+
+	/// Copy constructor (disabled)
+	CSpriteBatch(const CSpriteBatch&) = delete;
+
+	void Add(const CSpriteAtlas::Sprite* sprite, bool mirror, double x, double y);
+
+	void Flush(Gdiplus::Graphics* graphics, double scale = 1);
+
+	/// Determine if zoomed out sprites are drawn from mip levels
+	/// \returns True if mip levels are used
+	bool IsMipmapping() const { return mMipmapping; }
+
+	/// Set if zoomed out sprites are drawn from mip levels
+	/// \param mipmapping True to use mip levels
+	void SetMipmapping(bool mipmapping) { mMipmapping = mipmapping; }
+
+	/// Get the number of sprites drawn by the last Flush
+	/// \returns Number of draws
+	int GetNumDraws() const { return mNumDraws; }
+
+	/// Get the number of runs of draws from one page in the last Flush
+	/// \returns Number of runs
+	int GetNumRuns() const { return mNumRuns; }
+
+private:
+	/** One sprite to draw */
+	struct Draw
+	{
+		const CSpriteAtlas::Sprite* mSprite;    ///< Sprite to draw
+		bool mMirror;                           ///< True draws the mirrored copy
+		float mX;                               ///< Left of the sprite in the world
+		float mY;                               ///< Top of the sprite in the world
+	};
+
+	/// Atlas the sprites are in
+	CSpriteAtlas& mAtlas;
+
+	/// Reduced copies of the sprites for zoomed out drawing
+	CMipCache& mMips;
+
+	/// True if zoomed out sprites are drawn from mip levels
+	bool mMipmapping = true;
+
+	/// Draws waiting for the next Flush, back to front
+	std::vector<Draw> mDraws;
+
+	/// Number of sprites drawn by the last Flush
+	int mNumDraws = 0;
+
+	/// Number of runs of draws from one page in the last Flush
+	int mNumRuns = 0;
+};
+
@@ -0,0 +1,178 @@
+/**
+ * \file SpriteCache.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the shared sprite cache.
+ */
+
+#include "pch.h"
+#include <cwchar>
+#include <vector>
+#include "SpriteCache.h"
+#include "TraceLog.h"
+#include "MemoryAccounting.h"
+
+using namespace Gdiplus;
+using namespace std;
+
+/**
+ * Get the process wide sprite cache
+ * \returns Sprite cache
+ */
+CSpriteCache& CSpriteCache::Get()
+{
+	static CSpriteCache cache;
+	return cache;
+}
+
+/**
+ * Get the decoded image for a file, decoding it if no one is
+ * using it yet.
+ *
+ * A file that fails to decode is returned anyway, so callers can
+ * check GetLastStatus and report it.
+ * \param filename Image file
+ * \returns Shared image
+ */
+std::shared_ptr<Gdiplus::Bitmap> CSpriteCache::Load(const std::wstring& filename)
+{
+	unique_lock<mutex> lock(mMutex);
+	mInserted.wait(lock, [this, &filename]() { return mExpected.count(filename) == 0; });
+
+	auto sprite = mSprites[filename].lock();
+	if (sprite != nullptr)
+	{
+		return sprite;
+	}
+
+	AQUA_TRACE_SCOPE("DecodeSprite");
+	return Share(filename, Bitmap::FromFile(filename.c_str()));
+}
+
+/**
+ * Wrap a decoded image so its memory is accounted while it is
+ * shared, and make it the image for its file.
+ * Called with the lock held.
+ * \param filename Image file
+ * \param bitmap Decoded image, taken over by the cache
+ * \returns Shared image
+ */
+std::shared_ptr<Gdiplus::Bitmap> CSpriteCache::Share(const std::wstring& filename, Gdiplus::Bitmap* bitmap)
+{
+	// Decoded images are held as 32 bits per pixel
+	long long bytes = 0;
+	if (bitmap->GetLastStatus() == Ok)
+	{
+		bytes = (long long)bitmap->GetWidth() * bitmap->GetHeight() * 4;
+	}
+
+	CMemoryAccounting::Get().Add(CMemoryAccounting::Sprites, filename, bytes);
+	shared_ptr<Bitmap> sprite(bitmap, [filename, bytes](Bitmap* bitmap) {
+		CMemoryAccounting::Get().Remove(CMemoryAccounting::Sprites, filename, bytes);
+		delete bitmap;
+	});
+
+	mSprites[filename] = sprite;
+	return sprite;
+}
+
+/**
+ * Announce that a file is being decoded elsewhere. Load waits for
+ * it until Insert or Cancel is called.
+ * \param filename Image file
+ */
+void CSpriteCache::Expect(const std::wstring& filename)
+{
+	lock_guard<mutex> lock(mMutex);
+	mExpected.insert(filename);
+}
+
+/**
+ * Hand over an image decoded elsewhere.
+ *
+ * The caller must keep the returned pointer for as long as the
+ * image should stay cached.
+ * \param filename Image file
+ * \param bitmap Decoded image, taken over by the cache
+ * \returns Shared image
+ */
+std::shared_ptr<Gdiplus::Bitmap> CSpriteCache::Insert(const std::wstring& filename, Gdiplus::Bitmap* bitmap)
+{
+	shared_ptr<Bitmap> sprite;
+	{
+		lock_guard<mutex> lock(mMutex);
+		sprite = Share(filename, bitmap);
+		mExpected.erase(filename);
+	}
+
+	mInserted.notify_all();
+	return sprite;
+}
+
+/**
+ * Stop waiting for a file that could not be decoded elsewhere.
+ * Load decodes it itself.
+ * \param filename Image file
+ */
+void CSpriteCache::Cancel(const std::wstring& filename)
+{
+	{
+		lock_guard<mutex> lock(mMutex);
+		mExpected.erase(filename);
+	}
+
+	mInserted.notify_all();
+}
+
+/**
+ * Get the number of sprites currently decoded
+ * \returns Number of live sprites
+ */
+int CSpriteCache::GetNumSprites()
+{
+	lock_guard<mutex> lock(mMutex);
+
+	int count = 0;
+	for (auto& sprite : mSprites)
+	{
+		if (!sprite.second.expired())
+		{
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/**
+ * Get the class id of the GDI+ encoder for an image type
+ * \param mimeType Type to encode, such as image/png
+ * \param clsid Receives the encoder class id
+ * \returns True if an encoder was found
+ */
+bool CSpriteCache::GetEncoderClsid(const wchar_t* mimeType, CLSID* clsid)
+{
+	UINT count = 0;
+	UINT size = 0;
+	GetImageEncodersSize(&count, &size);
+	if (size == 0)
+	{
+		return false;
+	}
+
+	vector<BYTE> buffer(size);
+	auto codecs = (ImageCodecInfo*)buffer.data();
+	GetImageEncoders(count, size, codecs);
+
+	for (UINT i = 0; i < count; i++)
+	{
+		if (wcscmp(codecs[i].MimeType, mimeType) == 0)
+		{
+			*clsid = codecs[i].Clsid;
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,70 @@
+/**
+ * \file SpriteCache.h
+ *
+ * \author Grant Youngs
+ *
+ * Shares decoded sprite images between items and aquariums.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+
+
+/**
+ * Process wide cache of decoded sprites.
+ *
+ * Everything that needs an image file, such as the sprite atlas
+ * while it packs, shares one decoded image. The cache only holds
+ * weak references, so an image is freed when the last user lets go
+ * of it and decoded again on next use.
+ *
+ * A loader decoding on another thread can announce a file with
+ * Expect and hand over the result with Insert. Load waits for an
+ * expected file rather than decoding it a second time.
+ *
+ * GDI+ images are not safe to use from two threads at once. Items
+ * draw from the sprite atlas, which copies pixels out of decoded
+ * images under its own lock.
+ */
+class CSpriteCache
+{
+public:
+	static CSpriteCache& Get();
+
+	/// Copy constructor (disabled)
+	CSpriteCache(const CSpriteCache&) = delete;
+
+	std::shared_ptr<Gdiplus::Bitmap> Load(const std::wstring& filename);
+
+	void Expect(const std::wstring& filename);
+	std::shared_ptr<Gdiplus::Bitmap> Insert(const std::wstring& filename, Gdiplus::Bitmap* bitmap);
+	void Cancel(const std::wstring& filename);
+
+	int GetNumSprites();
+
+	static bool GetEncoderClsid(const wchar_t* mimeType, CLSID* clsid);
+
+private:
+	CSpriteCache() {}
+
+	std::shared_ptr<Gdiplus::Bitmap> Share(const std::wstring& filename, Gdiplus::Bitmap* bitmap);
+
+	/// Protects the sprite table
+	std::mutex mMutex;
+
+	/// Sprites decoded so far, by filename
+	std::map<std::wstring, std::weak_ptr<Gdiplus::Bitmap>> mSprites;
+
+	/// Files a loader is decoding, which Load waits for
+	std::set<std::wstring> mExpected;
+
+	/// Signaled when an expected file is inserted or canceled
+	std::condition_variable mInserted;
+};
+
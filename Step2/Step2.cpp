@@ -8,6 +8,11 @@
 #include "afxdialogex.h"
 #include "Step2.h"
 #include "MainFrm.h"
+#include "TraceLog.h"
+#include "SpriteAtlas.h"
+#include "MipCache.h"
+#include "Aquarium.h"
+#include "FrameCapture.h"
 
 
 #ifdef _DEBUG
@@ -50,6 +55,60 @@ CStep2App theApp;
 
 // CStep2App initialization
 
+/**
+ * Get where decoded image pixels are cached between runs
+ * \returns Path of the pixel cache file
+ */
+static std::wstring GetPixelCachePath()
+{
+	wchar_t path[MAX_PATH];
+	GetTempPath(MAX_PATH, path);
+	return std::wstring(path) + L"aquarium-pixels.cache";
+}
+
+/**
+ * Render a tank to files without opening a window.
+ *
+ * The command line is /capture tank.aqua out.y4m seconds [width height fps],
+ * where an output ending in .png writes a numbered PNG sequence instead.
+ * \param assets Loader of the images, which a capture waits for
+ * \returns True if the command line asked for a capture
+ */
+static bool RunCapture(CAssetLoader* assets)
+{
+	if (__argc < 5 || _wcsicmp(__wargv[1], L"/capture") != 0)
+	{
+		return false;
+	}
+
+	// A capture needs every sprite, not placeholders
+	assets->Wait();
+
+	std::wstring tank = __wargv[2];
+	std::wstring output = __wargv[3];
+	double seconds = _wtof(__wargv[4]);
+	int width = __argc > 5 ? _wtoi(__wargv[5]) : 1280;
+	int height = __argc > 6 ? _wtoi(__wargv[6]) : 720;
+	double fps = __argc > 7 ? _wtof(__wargv[7]) : 30;
+
+	auto format = CFrameCapture::Y4m;
+	if (output.size() >= 4 && _wcsicmp(output.c_str() + output.size() - 4, L".png") == 0)
+	{
+		format = CFrameCapture::Png;
+	}
+
+	CAquarium aquarium;
+	aquarium.Load(tank);
+
+	CFrameCapture capture(width, height, fps);
+	if (!capture.Capture(&aquarium, capture.FitCamera(&aquarium), (int)(seconds * fps), format, output))
+	{
+		AfxMessageBox(L"Unable to write the capture");
+	}
+
+	return true;
+}
+
 BOOL CStep2App::InitInstance()
 {
 	// InitCommonControlsEx() is required on Windows XP if an application
@@ -65,6 +124,14 @@ BOOL CStep2App::InitInstance()
 	CWinApp::InitInstance();
 	Gdiplus::GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, NULL);
 
+#ifdef AQUARIUM_TRACE
+	CTraceLog::Get().SetMainThread();
+#endif
+
+	// Load every image on worker threads while the window comes up.
+	// Items created before their sprite is ready draw a placeholder.
+	mAssets = std::make_unique<CAssetLoader>();
+	mAssets->Start(L"images/", GetPixelCachePath());
 
 	// Initialize OLE libraries
 	if (!AfxOleInit())
@@ -75,6 +142,11 @@ BOOL CStep2App::InitInstance()
 
 	AfxEnableControlContainer();
 
+	if (RunCapture(mAssets.get()))
+	{
+		return FALSE;
+	}
+
 	EnableTaskbarInteraction(FALSE);
 
 	// AfxInitRichEdit2() is required to use RichEdit control
@@ -113,6 +185,18 @@ BOOL CStep2App::InitInstance()
 
 int CStep2App::ExitInstance()
 {
+#ifdef AQUARIUM_TRACE
+	// Trace builds always leave a trace of the session behind
+	wchar_t path[MAX_PATH];
+	GetTempPath(MAX_PATH, path);
+	CTraceLog::Get().Save(std::wstring(path) + L"aquarium-trace.json");
+#endif
+
+	// The loader, mip levels and atlas pages must be freed before GDI+ shuts down
+	mAssets.reset();
+	CMipCache::Get().Clear();
+	CSpriteAtlas::Get().Clear();
+
 	Gdiplus::GdiplusShutdown(gdiplusToken);
 
 	//TODO: handle additional resources you may have added
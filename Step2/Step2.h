@@ -8,6 +8,8 @@
 #endif
 
 #include "resource.h"       // main symbols
+#include <memory>
+#include "AssetLoader.h"
 
 
 // CStep2App:
@@ -34,6 +36,9 @@ public:
 private:
 	Gdiplus::GdiplusStartupInput gdiplusStartupInput;
 	ULONG_PTR gdiplusToken = 0;
+
+	/// Loads the images in the background at startup
+	std::unique_ptr<CAssetLoader> mAssets;
 };
 
 extern CStep2App theApp;
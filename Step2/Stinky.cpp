@@ -0,0 +1,67 @@
+/**
+ * \file Stinky.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements a Stinky fish in the aquarium
+ */
+
+#include "pch.h"
+#include <string>
+#include "Stinky.h"
+#include "Aquarium.h"
+#include "Nudge.h"
+#include "XmlNode.h"
+
+
+using namespace std;
+using namespace Gdiplus;
+using namespace xmlnode;
+
+
+/// Fish filename
+const wstring StinkyImageName = L"images/stinky.png";
+
+/** Constructor
+ * \param aquarium The aquarium this is a member of
+*/
+CStinky::CStinky(CAquarium* aquarium) :
+	CItem(aquarium, StinkyImageName), mRepelDistance(CNudge::DefaultDistance)
+{
+	Count(this);
+}
+
+/**
+ * Save this item to an XML node
+ * \param node The node we are going to be a child of
+ */
+std::shared_ptr<xmlnode::CXmlNode> CStinky::XmlSave(const std::shared_ptr<xmlnode::CXmlNode>& node)
+{
+	auto itemNode = CItem::XmlSave(node);
+
+	itemNode->SetAttribute(L"type", GetType());
+	itemNode->SetAttribute(L"distance", mRepelDistance);
+
+	return itemNode;
+}
+
+/**
+ * Load the attributes for a Stinky node.
+ * \param node The Xml node we are loading the item from
+ */
+void CStinky::XmlLoad(const std::shared_ptr<xmlnode::CXmlNode>& node)
+{
+	CItem::XmlLoad(node);
+	mRepelDistance = node->GetAttributeDoubleValue(L"distance", CNudge::DefaultDistance);
+}
+
+/**
+ * Move Stinky, pushing away the items it now gets near.
+ * \param x X location
+ * \param y Y location
+ */
+void CStinky::SetLocation(double x, double y)
+{
+	CItem::SetLocation(x, y);
+	GetAquarium()->Nudge();
+}
@@ -14,6 +14,10 @@
 
 /**
  * Implements a Stinky fish.
+ *
+ * Stinky does not swim. Any other item closer than its repel
+ * distance is pushed away, whenever Stinky is moved and on every
+ * update of the aquarium. A tank can hold any number of them.
  */
 class CStinky : public CItem
 {
@@ -27,14 +31,26 @@ public:
 	/// Copy constructor (disabled)
 	CStinky(const CStinky&) = delete;
 
-	virtual void Draw(Gdiplus::Graphics* graphics) override;
+	/// Get the name of the item type, as saved in files
+	/// \returns Type name
+	virtual const wchar_t* GetType() const override { return L"stinky"; }
+
+	virtual std::shared_ptr<xmlnode::CXmlNode> XmlSave(const std::shared_ptr<xmlnode::CXmlNode>& node) override;
+
+	virtual void XmlLoad(const std::shared_ptr<xmlnode::CXmlNode>& node) override;
+
+	virtual void SetLocation(double x, double y) override;
 
-	bool HitTest(int x, int y);
+	/// Get how close other items may come
+	/// \returns Distance in pixels
+	double GetRepelDistance() const { return mRepelDistance; }
 
-	void SetLocation(double x, double y);
+	/// Set how close other items may come
+	/// \param distance Distance in pixels
+	void SetRepelDistance(double distance) { mRepelDistance = distance; }
 
 private:
-	/// The image of the Stinky fish to be displayed
-	std::unique_ptr<Gdiplus::Bitmap> mFishImage;
+	/// Distance other items are pushed out to
+	double mRepelDistance;
 };
 
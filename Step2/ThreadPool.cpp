@@ -0,0 +1,269 @@
+/**
+ * \file ThreadPool.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the work-stealing thread pool.
+ */
+
+#include "pch.h"
+#include <algorithm>
+#include "ThreadPool.h"
+#include "TraceLog.h"
+
+using namespace std;
+
+/// Pieces ParallelFor aims to cut each worker's share of a loop into,
+/// so a worker that falls behind can be helped
+const size_t PiecesPerThread = 8;
+
+/// Pool the calling thread is a worker of, if any
+thread_local CThreadPool* tPool = nullptr;
+
+/// Index of the calling thread in its pool
+thread_local int tWorker = -1;
+
+/**
+ * Constructor
+ * \param threads Number of worker threads, 0 for one per core
+ */
+CThreadPool::CThreadPool(int threads)
+{
+	if (threads <= 0)
+	{
+		threads = max(1, (int)thread::hardware_concurrency());
+	}
+
+	for (int i = 0; i < threads; i++)
+	{
+		mQueues.push_back(make_unique<Queue>());
+	}
+
+	for (int i = 0; i < threads; i++)
+	{
+		mThreads.push_back(thread([this, i]() { Worker(i); }));
+	}
+}
+
+/**
+ * Destructor. Waits for the queued tasks to finish.
+ */
+CThreadPool::~CThreadPool()
+{
+	Wait();
+
+	{
+		lock_guard<mutex> lock(mMutex);
+		mStop = true;
+	}
+
+	mWake.notify_all();
+	for (auto& thread : mThreads)
+	{
+		thread.join();
+	}
+}
+
+/**
+ * Queue a task to run on a worker
+ * \param task Task to run
+ */
+void CThreadPool::Submit(std::function<void()> task)
+{
+	int index = tPool == this ? tWorker : (int)(mNextQueue++ % mQueues.size());
+
+	mPending++;
+	{
+		auto& queue = *mQueues[index];
+		lock_guard<mutex> lock(queue.mMutex);
+		queue.mTasks.push_back(move(task));
+	}
+
+	{
+		lock_guard<mutex> lock(mMutex);
+		mQueued++;
+	}
+
+	mWake.notify_one();
+}
+
+/**
+ * Wait until every submitted task has finished.
+ *
+ * Must not be called from a worker of this pool.
+ */
+void CThreadPool::Wait()
+{
+	unique_lock<mutex> lock(mMutex);
+	mIdle.wait(lock, [this]() { return mPending == 0; });
+}
+
+/**
+ * Run body(begin, end) over the ranges of [0, count) on the workers
+ * and wait for them all to finish.
+ *
+ * Ranges never overlap and every index is run exactly once, but in
+ * no particular order or thread. The body must only write what
+ * belongs to its own indices for the result not to depend on the
+ * number of threads. Called from a worker of this pool, the loop is
+ * run on the calling thread.
+ * \param count Number of iterations
+ * \param body Runs the iterations from begin up to end
+ * \param minGrain Smallest range worth handing to a thread
+ */
+void CThreadPool::ParallelFor(size_t count, const std::function<void(size_t begin, size_t end)>& body, size_t minGrain)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	size_t grain = GetGrain(count, minGrain);
+	size_t threads = mThreads.size();
+	if (tPool == this || threads == 1 || count <= grain)
+	{
+		// Waiting on ourselves would never finish
+		body(0, count);
+		return;
+	}
+
+	auto loop = make_shared<Loop>();
+	loop->mBody = body;
+	loop->mGrain = grain;
+	loop->mRemaining = count;
+
+	// Every worker starts on its own share
+	size_t shares = min(threads, (count + grain - 1) / grain);
+	for (size_t share = 0; share < shares; share++)
+	{
+		size_t begin = count * share / shares;
+		size_t end = count * (share + 1) / shares;
+		Submit([this, loop, begin, end]() { RunRange(loop, begin, end); });
+	}
+
+	unique_lock<mutex> lock(loop->mMutex);
+	loop->mDone.wait(lock, [&loop]() { return loop->mRemaining == 0; });
+}
+
+/**
+ * Get the grain size ParallelFor uses for a loop.
+ *
+ * The grain grows with the loop so each worker's share is cut into
+ * about PiecesPerThread pieces, enough to even out uneven work
+ * without paying for a task per iteration.
+ * \param count Number of iterations
+ * \param minGrain Smallest range worth handing to a thread
+ * \returns Largest range that is not split
+ */
+size_t CThreadPool::GetGrain(size_t count, size_t minGrain) const
+{
+	size_t pieces = mThreads.size() * PiecesPerThread;
+	return max(max(minGrain, (size_t)1), count / pieces);
+}
+
+/**
+ * Run a range of a loop on a worker, splitting off the back half
+ * for other workers until the range is down to the grain size
+ * \param loop Loop being run
+ * \param begin First iteration
+ * \param end One past the last iteration
+ */
+void CThreadPool::RunRange(const std::shared_ptr<Loop>& loop, size_t begin, size_t end)
+{
+	while (end - begin > loop->mGrain)
+	{
+		size_t middle = begin + (end - begin) / 2;
+		Submit([this, loop, middle, end]() { RunRange(loop, middle, end); });
+		end = middle;
+	}
+
+	{
+		AQUA_TRACE_SCOPE("ParallelFor");
+		loop->mBody(begin, end);
+	}
+
+	if ((loop->mRemaining -= end - begin) == 0)
+	{
+		lock_guard<mutex> lock(loop->mMutex);
+		loop->mDone.notify_all();
+	}
+}
+
+/**
+ * Take a task, from our own queue first and otherwise from the
+ * queue of another worker.
+ * \param index Index of the calling worker
+ * \param task Receives the task
+ * \returns true if a task was taken
+ */
+bool CThreadPool::Take(int index, std::function<void()>& task)
+{
+	{
+		auto& own = *mQueues[index];
+		lock_guard<mutex> lock(own.mMutex);
+		if (!own.mTasks.empty())
+		{
+			task = move(own.mTasks.back());
+			own.mTasks.pop_back();
+			mQueued--;
+			return true;
+		}
+	}
+
+	int count = (int)mQueues.size();
+	for (int i = 1; i < count; i++)
+	{
+		auto& victim = *mQueues[(index + i) % count];
+		lock_guard<mutex> lock(victim.mMutex);
+		if (!victim.mTasks.empty())
+		{
+			// Steal the oldest task, which is furthest from what
+			// the victim is working on
+			task = move(victim.mTasks.front());
+			victim.mTasks.pop_front();
+			mQueued--;
+			mSteals++;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * The loop each worker thread runs
+ * \param index Index of the worker
+ */
+void CThreadPool::Worker(int index)
+{
+	tPool = this;
+	tWorker = index;
+
+	function<void()> task;
+	for (;;)
+	{
+		if (Take(index, task))
+		{
+			{
+				AQUA_TRACE_SCOPE("Task");
+				task();
+				task = nullptr;
+			}
+
+			if (--mPending == 0)
+			{
+				lock_guard<mutex> lock(mMutex);
+				mIdle.notify_all();
+			}
+
+			continue;
+		}
+
+		unique_lock<mutex> lock(mMutex);
+		mWake.wait(lock, [this]() { return mStop || mQueued > 0; });
+		if (mStop && mQueued == 0)
+		{
+			return;
+		}
+	}
+}
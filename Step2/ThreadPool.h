@@ -0,0 +1,117 @@
+/**
+ * \file ThreadPool.h
+ *
+ * \author Grant Youngs
+ *
+ * Class that implements a work-stealing pool of worker threads.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/**
+ * A fixed set of worker threads that run submitted tasks.
+ *
+ * Every worker has its own queue. Tasks submitted from a worker go
+ * on the back of its own queue and the worker takes from the back,
+ * so related work stays on one thread. Tasks submitted from outside
+ * are spread over the queues. An idle worker steals from the front
+ * of the other queues, so no worker sits idle while others have a
+ * backlog.
+ *
+ * ParallelFor runs a loop over the workers. Each worker starts with
+ * an equal range and splits off the back half of its range onto its
+ * own queue until the range is down to the grain size. Thieves take
+ * the front of a queue, which is the largest piece left, so uneven
+ * work evens out with few steals.
+ */
+class CThreadPool
+{
+public:
+	CThreadPool(int threads = 0);
+	virtual ~CThreadPool();
+
+	/// Copy constructor (disabled)
+	CThreadPool(const CThreadPool&) = delete;
+
+	void Submit(std::function<void()> task);
+
+	void Wait();
+
+	void ParallelFor(size_t count, const std::function<void(size_t begin, size_t end)>& body, size_t minGrain = 1);
+
+	size_t GetGrain(size_t count, size_t minGrain = 1) const;
+
+	/// Get the number of worker threads
+	/// \returns Number of threads
+	int GetNumThreads() const { return (int)mThreads.size(); }
+
+	/// Get the number of tasks taken from another worker's queue
+	/// \returns Number of steals since the pool was created
+	long long GetSteals() const { return mSteals; }
+
+private:
+	/** The queue of one worker */
+	struct Queue
+	{
+		std::mutex mMutex;                          ///< Protects the tasks
+		std::deque<std::function<void()>> mTasks;   ///< Waiting tasks
+	};
+
+	/** A loop being run by ParallelFor */
+	struct Loop
+	{
+		std::function<void(size_t, size_t)> mBody;  ///< Runs a range of the loop
+		size_t mGrain = 1;                          ///< Ranges this size or less are not split
+		std::atomic<size_t> mRemaining{ 0 };        ///< Iterations not yet run
+		std::mutex mMutex;                          ///< Protects waiting for the loop
+		std::condition_variable mDone;              ///< Signaled when no iterations remain
+	};
+
+	void Worker(int index);
+
+	void RunRange(const std::shared_ptr<Loop>& loop, size_t begin, size_t end);
+
+	bool Take(int index, std::function<void()>& task);
+
+	/// Queue of each worker
+	std::vector<std::unique_ptr<Queue>> mQueues;
+
+	/// The worker threads
+	std::vector<std::thread> mThreads;
+
+	/// Protects sleeping and waking
+	std::mutex mMutex;
+
+	/// Signaled when tasks are queued or the pool stops
+	std::condition_variable mWake;
+
+	/// Signaled when the last pending task finishes
+	std::condition_variable mIdle;
+
+	/// Tasks waiting in the queues
+	std::atomic<long long> mQueued{ 0 };
+
+	/// Tasks submitted and not yet finished
+	std::atomic<long long> mPending{ 0 };
+
+	/// Tasks taken from another worker's queue
+	std::atomic<long long> mSteals{ 0 };
+
+	/// Queue the next outside submission goes to
+	std::atomic<unsigned> mNextQueue{ 0 };
+
+	/// True when the workers should exit
+	bool mStop = false;
+};
+
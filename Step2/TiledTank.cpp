@@ -0,0 +1,784 @@
+/**
+ * \file TiledTank.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the tiled tank streamer.
+ */
+
+#include "pch.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include "TiledTank.h"
+#include "Aquarium.h"
+#include "Item.h"
+#include "Fish.h"
+#include "Stinky.h"
+
+using namespace std;
+
+/// Most tiles a file may have
+const uint32_t MaxTiles = 1 << 24;
+
+/**
+ * Append a value in machine order
+ * \param bytes Bytes to append to
+ * \param value Value to append
+ */
+template <class T>
+static void Put(std::vector<uint8_t>& bytes, const T& value)
+{
+	auto at = (const uint8_t*)&value;
+	bytes.insert(bytes.end(), at, at + sizeof(T));
+}
+
+/**
+ * Read a value in machine order, if there is room for it
+ * \param at Where the value is, moved past it
+ * \param end End of the bytes that may be read
+ * \param value Receives the value
+ * \returns False if the value runs past the end
+ */
+template <class T>
+static bool Get(const uint8_t*& at, const uint8_t* end, T& value)
+{
+	if (end - at < (ptrdiff_t)sizeof(T))
+	{
+		return false;
+	}
+
+	memcpy(&value, at, sizeof(T));
+	at += sizeof(T);
+	return true;
+}
+
+/**
+ * Get the tile holding a location
+ * \param x X location
+ * \param y Y location
+ * \param tileSize Width and height of a tile
+ * \param columns Tile columns
+ * \param rows Tile rows
+ * \returns Tile number, row by row. Locations outside the world are
+ * in the nearest edge tile.
+ */
+static int TileOf(double x, double y, double tileSize, int columns, int rows)
+{
+	int column = (int)min(max(floor(x / tileSize), 0.0), (double)(columns - 1));
+	int row = (int)min(max(floor(y / tileSize), 0.0), (double)(rows - 1));
+	return row * columns + column;
+}
+
+/**
+ * Constructor
+ * \param loadMargin Rings of tiles around the view that are loaded
+ * \param keepMargin Rings of tiles around the view that are kept
+ * loaded, at least the load margin
+ */
+CTiledTank::CTiledTank(int loadMargin, int keepMargin) :
+	mLoadMargin(loadMargin), mKeepMargin(max(loadMargin, keepMargin))
+{
+}
+
+/**
+ * Destructor, writes any loaded tiles back
+ */
+CTiledTank::~CTiledTank()
+{
+	Close();
+}
+
+/**
+ * Write every item of an aquarium to a new tiled tank file
+ * \param aquarium Aquarium to write
+ * \param filename File to write
+ * \param tileSize Width and height of a tile in world pixels
+ * \returns False if the file could not be written
+ */
+bool CTiledTank::Write(CAquarium* aquarium, const std::wstring& filename, double tileSize)
+{
+	int columns = max(1, (int)ceil(aquarium->GetWidth() / tileSize));
+	int rows = max(1, (int)ceil(aquarium->GetHeight() / tileSize));
+
+	aquarium->Synchronize();
+	vector<vector<uint8_t>> tiles((size_t)columns * rows);
+	vector<Entry> index(tiles.size());
+	unsigned maxId = 0;
+	for (auto& item : aquarium->GetItems())
+	{
+		int tile = TileOf(item->GetX(), item->GetY(), tileSize, columns, rows);
+		PutItem(item.get(), tiles[tile]);
+		index[tile].mCount++;
+		maxId = max(maxId, item->GetId());
+	}
+
+	uint64_t offset = HeaderSize + (uint64_t)IndexEntrySize * tiles.size();
+	for (size_t tile = 0; tile < tiles.size(); tile++)
+	{
+		index[tile].mOffset = tiles[tile].empty() ? 0 : offset;
+		index[tile].mBytes = (uint32_t)tiles[tile].size();
+		offset += tiles[tile].size();
+	}
+
+	vector<uint8_t> header;
+	Put(header, (uint32_t)FileTag);
+	Put(header, (uint32_t)Version);
+	Put(header, (int32_t)aquarium->GetWidth());
+	Put(header, (int32_t)aquarium->GetHeight());
+	Put(header, tileSize);
+	Put(header, (uint32_t)columns);
+	Put(header, (uint32_t)rows);
+	Put(header, (uint32_t)maxId);
+
+	ofstream out(filename, ios::binary | ios::trunc);
+	out.write((const char*)header.data(), header.size());
+	WriteIndex(out, index);
+	for (auto& tile : tiles)
+	{
+		out.write((const char*)tile.data(), tile.size());
+	}
+
+	return (bool)out;
+}
+
+/**
+ * Open a tiled tank and empty the aquarium to stream it into.
+ *
+ * Only the header and index are read. No items are loaded until
+ * SetView says where the view is.
+ * \param filename File to stream
+ * \param aquarium Aquarium to load items into
+ * \returns False if the file is not a tiled tank
+ */
+bool CTiledTank::Open(const std::wstring& filename, CAquarium* aquarium)
+{
+	Close();
+
+	mFile.open(filename, ios::in | ios::out | ios::binary);
+	if (!mFile)
+	{
+		mFile.clear();
+		return false;
+	}
+
+	mFile.seekg(0, ios::end);
+	long long size = mFile.tellg();
+	mFile.seekg(0);
+
+	vector<uint8_t> bytes(HeaderSize);
+	mFile.read((char*)bytes.data(), bytes.size());
+	const uint8_t* at = bytes.data();
+	const uint8_t* end = at + bytes.size();
+
+	uint32_t tag = 0, version = 0, columns = 0, rows = 0, maxId = 0;
+	int32_t width = 0, height = 0;
+	double tileSize = 0;
+	bool good = mFile && Get(at, end, tag) && Get(at, end, version) && Get(at, end, width) &&
+		Get(at, end, height) && Get(at, end, tileSize) && Get(at, end, columns) && Get(at, end, rows) &&
+		Get(at, end, maxId) && tag == FileTag && version == Version && width > 0 && height > 0 &&
+		tileSize > 0 && columns > 0 && rows > 0 && (uint64_t)columns * rows <= MaxTiles;
+
+	if (good)
+	{
+		bytes.resize((size_t)IndexEntrySize * columns * rows);
+		mFile.read((char*)bytes.data(), bytes.size());
+		at = bytes.data();
+		end = at + bytes.size();
+		good = (bool)mFile;
+
+		mIndex.resize((size_t)columns * rows);
+		for (auto& entry : mIndex)
+		{
+			good = good && Get(at, end, entry.mOffset) && Get(at, end, entry.mBytes) && Get(at, end, entry.mCount) &&
+				entry.mOffset + entry.mBytes <= (uint64_t)size;
+		}
+	}
+
+	if (!good)
+	{
+		mFile.close();
+		mFile.clear();
+		mIndex.clear();
+		return false;
+	}
+
+	mTileSize = tileSize;
+	mColumns = columns;
+	mRows = rows;
+	mTiles.assign(mIndex.size(), Tile());
+	mMaxId = maxId;
+
+	mAquarium = aquarium;
+	mAquarium->Clear();
+	mAquarium->SetWorldSize(width, height);
+	mAquarium->ReserveId(maxId);
+
+	mReads = 0;
+	mWrites = 0;
+	mBytesRead = 0;
+	mBytesWritten = 0;
+	mEvicted = 0;
+	mMigrated = 0;
+	mLoads = 0;
+	mLatency = 0;
+	mMaxLatency = 0;
+	mFailed = false;
+	mStop = false;
+	mThread = thread(&CTiledTank::Worker, this);
+	return true;
+}
+
+/**
+ * Write every item back to the file and close it. The aquarium is
+ * left empty.
+ * \returns False if anything could not be written
+ */
+bool CTiledTank::Close()
+{
+	if (!IsOpen())
+	{
+		return true;
+	}
+
+	Wait();
+
+	vector<int> resident;
+	for (int tile = 0; tile < (int)mTiles.size(); tile++)
+	{
+		if (mTiles[tile].mState == State::Resident)
+		{
+			resident.push_back(tile);
+		}
+	}
+	Evict(resident);
+
+	{
+		lock_guard<mutex> lock(mMutex);
+		mStop = true;
+	}
+	mWake.notify_all();
+	mThread.join();
+
+	// Items made since the file was written have larger ids
+	mFile.clear();
+	mFile.seekp(HeaderSize - sizeof(uint32_t));
+	uint32_t maxId = mMaxId;
+	mFile.write((const char*)&maxId, sizeof(maxId));
+	bool good = mFile && !mFailed;
+	mFile.close();
+	mFile.clear();
+
+	mAquarium = nullptr;
+	mTiles.clear();
+	mIndex.clear();
+	mJobs.clear();
+	mLoaded.clear();
+	return good;
+}
+
+/**
+ * Tell the tank where the view is.
+ *
+ * Adds the items of any tiles that finished loading, starts loading
+ * the tiles around the view, nearest first, and writes back tiles
+ * that have been far from the view for long enough. Call once a
+ * frame.
+ * \param left Left edge of the view in world pixels
+ * \param top Top edge of the view
+ * \param right Right edge of the view
+ * \param bottom Bottom edge of the view
+ */
+void CTiledTank::SetView(double left, double top, double right, double bottom)
+{
+	if (!IsOpen())
+	{
+		return;
+	}
+
+	Poll();
+
+	auto now = chrono::steady_clock::now();
+	int firstColumn = (int)floor(left / mTileSize);
+	int lastColumn = (int)floor(right / mTileSize);
+	int firstRow = (int)floor(top / mTileSize);
+	int lastRow = (int)floor(bottom / mTileSize);
+
+	// Tiles near enough to keep are still wanted
+	for (int row = max(firstRow - mKeepMargin, 0); row <= min(lastRow + mKeepMargin, mRows - 1); row++)
+	{
+		for (int column = max(firstColumn - mKeepMargin, 0); column <= min(lastColumn + mKeepMargin, mColumns - 1); column++)
+		{
+			mTiles[row * mColumns + column].mWanted = now;
+		}
+	}
+
+	// Tiles near enough to load are asked for, nearest the middle first
+	double middleX = (left + right) / 2 / mTileSize - 0.5;
+	double middleY = (top + bottom) / 2 / mTileSize - 0.5;
+	vector<pair<double, int>> wanted;
+	for (int row = max(firstRow - mLoadMargin, 0); row <= min(lastRow + mLoadMargin, mRows - 1); row++)
+	{
+		for (int column = max(firstColumn - mLoadMargin, 0); column <= min(lastColumn + mLoadMargin, mColumns - 1); column++)
+		{
+			int tile = row * mColumns + column;
+			if (mTiles[tile].mState == State::OnDisk)
+			{
+				double dx = column - middleX, dy = row - middleY;
+				wanted.push_back(make_pair(dx * dx + dy * dy, tile));
+			}
+		}
+	}
+
+	sort(wanted.begin(), wanted.end());
+	for (auto& tile : wanted)
+	{
+		mTiles[tile.second].mState = State::Loading;
+		mTiles[tile.second].mRequested = now;
+
+		Job job;
+		job.mTile = tile.second;
+		Queue(job);
+	}
+
+	// Tiles that have not been near the view for a while go back to disk
+	vector<int> far;
+	for (int tile = 0; tile < (int)mTiles.size(); tile++)
+	{
+		if (mTiles[tile].mState == State::Resident &&
+			chrono::duration<double>(now - mTiles[tile].mWanted).count() >= mEvictSeconds)
+		{
+			far.push_back(tile);
+		}
+	}
+
+	if (!far.empty())
+	{
+		Evict(far);
+	}
+}
+
+/**
+ * Wait for every tile asked for to be read and every tile written
+ * back to be written, then add the items read to the aquarium.
+ */
+void CTiledTank::Wait()
+{
+	if (!IsOpen())
+	{
+		return;
+	}
+
+	{
+		unique_lock<mutex> lock(mMutex);
+		mIdle.wait(lock, [this] { return mJobs.empty() && !mBusy; });
+	}
+
+	Poll();
+}
+
+/**
+ * Get the tile holding a location
+ * \param x X location
+ * \param y Y location
+ * \returns Tile number, row by row
+ */
+int CTiledTank::GetTile(double x, double y) const
+{
+	return TileOf(x, y, mTileSize, mColumns, mRows);
+}
+
+/**
+ * Get the number of tiles in the aquarium
+ * \returns Resident tiles
+ */
+int CTiledTank::GetNumResident() const
+{
+	return (int)count_if(mTiles.begin(), mTiles.end(), [](const Tile& tile) { return tile.mState == State::Resident; });
+}
+
+/**
+ * Get the number of tiles being read
+ * \returns Tiles asked for and not yet added
+ */
+int CTiledTank::GetNumLoading() const
+{
+	return (int)count_if(mTiles.begin(), mTiles.end(), [](const Tile& tile) { return tile.mState == State::Loading; });
+}
+
+/**
+ * Describe the tiles and their input and output
+ * \returns Several lines of text
+ */
+std::wstring CTiledTank::Report() const
+{
+	wstringstream out;
+	out << L"Tiled tank: " << mColumns << L" x " << mRows << L" tiles of " << mTileSize << L" px, "
+		<< GetNumResident() << L" resident, " << GetNumLoading() << L" loading" << endl;
+	out << L"Read " << mReads << L" tiles, " << mBytesRead << L" bytes; wrote " << mWrites << L" tiles, "
+		<< mBytesWritten << L" bytes" << endl;
+	out << L"Evicted " << mEvicted << L" tiles, migrated " << mMigrated << L" items" << endl;
+	out << L"Load latency: " << GetAverageLatency() * 1000 << L" ms average, " << mMaxLatency * 1000
+		<< L" ms worst over " << mLoads << L" loads" << endl;
+	return out.str();
+}
+
+/**
+ * Append an item as it is stored in a tile
+ * \param item Item to store
+ * \param bytes Bytes to append to
+ */
+void CTiledTank::PutItem(CItem* item, std::vector<uint8_t>& bytes)
+{
+	// Type names are plain ASCII
+	wstring type = item->GetType();
+	Put(bytes, (uint8_t)type.size());
+	for (auto c : type)
+	{
+		Put(bytes, (uint8_t)c);
+	}
+
+	double speedX, speedY;
+	item->GetVelocity(speedX, speedY);
+	auto stinky = dynamic_cast<CStinky*>(item);
+
+	Put(bytes, (uint32_t)item->GetId());
+	Put(bytes, (uint8_t)(item->IsMirror() ? (uint8_t)MirrorFlag : 0));
+	Put(bytes, item->GetX());
+	Put(bytes, item->GetY());
+	Put(bytes, speedX);
+	Put(bytes, speedY);
+	Put(bytes, stinky != nullptr ? stinky->GetRepelDistance() : 0.0);
+}
+
+/**
+ * Read an item as it is stored in a tile
+ * \param at Where the item is, moved past it
+ * \param end End of the bytes that may be read
+ * \param record Receives the item
+ * \returns False if the item runs past the end
+ */
+bool CTiledTank::GetItem(const uint8_t*& at, const uint8_t* end, Record& record)
+{
+	uint8_t length = 0;
+	if (!Get(at, end, length) || end - at < length)
+	{
+		return false;
+	}
+
+	record.mType.assign(at, at + length);
+	at += length;
+
+	uint32_t id = 0;
+	uint8_t flags = 0;
+	bool good = Get(at, end, id) && Get(at, end, flags) && Get(at, end, record.mX) && Get(at, end, record.mY) &&
+		Get(at, end, record.mSpeedX) && Get(at, end, record.mSpeedY) && Get(at, end, record.mDistance);
+	record.mId = id;
+	record.mMirror = (flags & MirrorFlag) != 0;
+	return good;
+}
+
+/**
+ * Write a tile index at the current location of a stream
+ * \param out Stream to write to
+ * \param index Entry of every tile
+ * \returns False if the index could not be written
+ */
+bool CTiledTank::WriteIndex(std::ostream& out, const std::vector<Entry>& index)
+{
+	vector<uint8_t> bytes;
+	bytes.reserve(index.size() * IndexEntrySize);
+	for (auto& entry : index)
+	{
+		Put(bytes, entry.mOffset);
+		Put(bytes, entry.mBytes);
+		Put(bytes, entry.mCount);
+	}
+
+	out.write((const char*)bytes.data(), bytes.size());
+	return (bool)out;
+}
+
+/**
+ * Hand a job to the background thread. Jobs run in the order they
+ * are queued, so a tile read after it is written reads what was written.
+ * \param job Job to run, moved from
+ */
+void CTiledTank::Queue(Job& job)
+{
+	{
+		lock_guard<mutex> lock(mMutex);
+		mJobs.push_back(move(job));
+	}
+	mWake.notify_one();
+}
+
+/**
+ * Body of the background thread. Runs jobs until told to stop,
+ * then finishes those already queued.
+ */
+void CTiledTank::Worker()
+{
+	unique_lock<mutex> lock(mMutex);
+	for (;;)
+	{
+		mWake.wait(lock, [this] { return mStop || !mJobs.empty(); });
+		if (mJobs.empty())
+		{
+			break;
+		}
+
+		Job job = move(mJobs.front());
+		mJobs.pop_front();
+		mBusy = true;
+		lock.unlock();
+
+		if (job.mWrite)
+		{
+			if (!Store(job))
+			{
+				mFailed = true;
+			}
+			lock.lock();
+		}
+		else
+		{
+			Loaded loaded;
+			loaded.mTile = job.mTile;
+			loaded.mGood = Read(job.mTile, loaded);
+			lock.lock();
+			mLoaded.push_back(move(loaded));
+		}
+
+		mBusy = false;
+		if (mJobs.empty())
+		{
+			mIdle.notify_all();
+		}
+	}
+}
+
+/**
+ * Read the items of a tile, on the background thread
+ * \param tile Tile to read
+ * \param loaded Receives the items
+ * \returns False if the tile could not be read
+ */
+bool CTiledTank::Read(int tile, Loaded& loaded)
+{
+	auto& entry = mIndex[tile];
+	if (entry.mCount == 0)
+	{
+		return true;
+	}
+
+	vector<uint8_t> bytes(entry.mBytes);
+	mFile.clear();
+	mFile.seekg(entry.mOffset);
+	mFile.read((char*)bytes.data(), bytes.size());
+	if (!mFile)
+	{
+		return false;
+	}
+
+	mReads++;
+	mBytesRead += bytes.size();
+
+	const uint8_t* at = bytes.data();
+	const uint8_t* end = at + bytes.size();
+	loaded.mItems.resize(entry.mCount);
+	for (auto& record : loaded.mItems)
+	{
+		if (!GetItem(at, end, record))
+		{
+			loaded.mItems.clear();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Write the items of a tile to the end of the file and point its
+ * index entry at them, on the background thread
+ * \param job Items to write
+ * \returns False if the tile could not be written
+ */
+bool CTiledTank::Store(Job& job)
+{
+	auto& entry = mIndex[job.mTile];
+	uint32_t count = job.mCount;
+	if (job.mAppend && entry.mCount > 0)
+	{
+		// The items already in the tile go first
+		vector<uint8_t> bytes(entry.mBytes);
+		mFile.clear();
+		mFile.seekg(entry.mOffset);
+		mFile.read((char*)bytes.data(), bytes.size());
+		if (!mFile)
+		{
+			return false;
+		}
+
+		mReads++;
+		mBytesRead += bytes.size();
+		job.mBytes.insert(job.mBytes.begin(), bytes.begin(), bytes.end());
+		count += entry.mCount;
+	}
+
+	Entry written;
+	mFile.clear();
+	if (!job.mBytes.empty())
+	{
+		mFile.seekp(0, ios::end);
+		written.mOffset = mFile.tellp();
+		written.mBytes = (uint32_t)job.mBytes.size();
+		written.mCount = count;
+		mFile.write((const char*)job.mBytes.data(), job.mBytes.size());
+	}
+
+	// The index entry is written after the items, so a crash leaves
+	// the tile as it was
+	mFile.seekp(HeaderSize + (uint64_t)IndexEntrySize * job.mTile);
+	if (!WriteIndex(mFile, vector<Entry>{ written }))
+	{
+		return false;
+	}
+	mFile.flush();
+
+	entry = written;
+	mWrites++;
+	mBytesWritten += job.mBytes.size();
+	return (bool)mFile;
+}
+
+/**
+ * Add the items of the tiles read since the last call to the aquarium
+ */
+void CTiledTank::Poll()
+{
+	vector<Loaded> loaded;
+	{
+		lock_guard<mutex> lock(mMutex);
+		loaded.swap(mLoaded);
+	}
+
+	auto now = chrono::steady_clock::now();
+	for (auto& tile : loaded)
+	{
+		auto& state = mTiles[tile.mTile];
+		if (!tile.mGood)
+		{
+			// Asked for again the next time it is near the view
+			state.mState = State::OnDisk;
+			continue;
+		}
+
+		for (auto& record : tile.mItems)
+		{
+			Place(record);
+		}
+
+		state.mState = State::Resident;
+		state.mWanted = max(state.mWanted, state.mRequested);
+
+		double latency = chrono::duration<double>(now - state.mRequested).count();
+		mLoads++;
+		mLatency += latency;
+		mMaxLatency = max(mMaxLatency, latency);
+	}
+}
+
+/**
+ * Write tiles back to the file and remove their items.
+ *
+ * Every item is filed under the tile it is in now. Items in the
+ * tiles written back, or in tiles that are not loaded at all, are
+ * written and removed. Items in tiles that are being loaded stay,
+ * and become part of the tile when it arrives.
+ * \param tiles Resident tiles to write back
+ */
+void CTiledTank::Evict(const std::vector<int>& tiles)
+{
+	map<int, Job> jobs;
+	for (auto tile : tiles)
+	{
+		mTiles[tile].mState = State::OnDisk;
+		jobs[tile].mTile = tile;
+		mEvicted++;
+	}
+
+	mAquarium->Synchronize();
+	vector<CItem*> removing;
+	for (auto& item : mAquarium->GetItems())
+	{
+		int tile = GetTile(item->GetX(), item->GetY());
+		if (mTiles[tile].mState != State::OnDisk)
+		{
+			continue;
+		}
+
+		auto found = jobs.find(tile);
+		if (found == jobs.end())
+		{
+			// Swam out of the loaded tiles, so it joins the items on disk
+			found = jobs.emplace(tile, Job()).first;
+			found->second.mTile = tile;
+			found->second.mAppend = true;
+		}
+
+		if (found->second.mAppend)
+		{
+			mMigrated++;
+		}
+
+		PutItem(item.get(), found->second.mBytes);
+		found->second.mCount++;
+		mMaxId = max(mMaxId, item->GetId());
+		removing.push_back(item.get());
+	}
+
+	for (auto& job : jobs)
+	{
+		job.second.mWrite = true;
+		Queue(job.second);
+	}
+
+	mAquarium->Remove(removing);
+}
+
+/**
+ * Add an item read from a tile to the aquarium
+ * \param record Item as stored
+ */
+void CTiledTank::Place(const Record& record)
+{
+	auto item = mAquarium->CreateItem(record.mType);
+	if (item == nullptr)
+	{
+		return;
+	}
+
+	// The base location is set so a Stinky does not nudge as it is placed
+	item->SetId(record.mId);
+	item->CItem::SetLocation(record.mX, record.mY);
+
+	auto fish = dynamic_cast<CFish*>(item.get());
+	if (fish != nullptr)
+	{
+		fish->SetVelocity(record.mSpeedX, record.mSpeedY);
+	}
+
+	auto stinky = dynamic_cast<CStinky*>(item.get());
+	if (stinky != nullptr)
+	{
+		stinky->SetRepelDistance(record.mDistance);
+	}
+
+	item->SetMirror(record.mMirror);
+	mAquarium->Add(item);
+	mMaxId = max(mMaxId, record.mId);
+}
@@ -0,0 +1,289 @@
+/**
+ * \file TiledTank.h
+ *
+ * \author Grant Youngs
+ *
+ * Class that streams the items of a huge world from a file of spatial tiles.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class CAquarium;
+class CItem;
+
+
+/**
+ * A tank file split into square tiles of the world, loaded a region
+ * at a time.
+ *
+ * The header holds the world size, the tile size and an index of
+ * every tile, so any tile is read with one seek. Only the tiles near
+ * the view are in the aquarium. As the view moves, the tiles around
+ * it are read on a background thread and their items are added to
+ * the aquarium by SetView on the calling thread. Tiles that have
+ * been far from the view for a while are written back to the file
+ * and their items removed.
+ *
+ * An item belongs to the tile its center is in when its tile is
+ * written, not the tile it was read from, so items that swim across
+ * tile edges move with them. An item that swims into a tile that is
+ * not loaded is kept until the next tiles are written, then added to
+ * that tile on disk.
+ *
+ * Tiles are written to the end of the file and the index entry is
+ * updated in place, so the file is always readable. Write makes a
+ * compact file; space left by tiles written again is only reclaimed
+ * by writing the tank again.
+ *
+ * File: uint32 FileTag, uint32 Version, int32 world width and height,
+ * double tile size, uint32 columns and rows, uint32 largest item id,
+ * then for each tile row by row a uint64 offset, uint32 bytes and
+ * uint32 item count. Each tile is its items one after another: uint8
+ * type name length and name, uint32 id, uint8 flags, and doubles for
+ * the X and Y location, the X and Y speed and the repel distance.
+ */
+class CTiledTank
+{
+public:
+	/// Tag at the start of a tiled tank file, "AQTL"
+	static const uint32_t FileTag = 0x4c545141;
+
+	/// File format version
+	static const uint32_t Version = 1;
+
+	/// Bytes of the header before the tile index
+	static const int HeaderSize = 4 + 4 + 4 + 4 + 8 + 4 + 4 + 4;
+
+	/// Bytes of each entry of the tile index
+	static const int IndexEntrySize = 8 + 4 + 4;
+
+	/// Bytes of an item less its type name
+	static const int ItemSize = 1 + 4 + 1 + 5 * 8;
+
+	/// Flag bit of a mirrored item
+	static const uint8_t MirrorFlag = 1;
+
+	/// Tile size used by Write unless another is given
+	static const int DefaultTileSize = 1024;
+
+	CTiledTank(int loadMargin = 1, int keepMargin = 2);
+	virtual ~CTiledTank();
+
+	/// Copy constructor (disabled)
+	CTiledTank(const CTiledTank&) = delete;
+
+	static bool Write(CAquarium* aquarium, const std::wstring& filename, double tileSize = DefaultTileSize);
+
+	bool Open(const std::wstring& filename, CAquarium* aquarium);
+	bool Close();
+
+	/// Is a tiled tank open?
+	/// \returns true if open
+	bool IsOpen() const { return mAquarium != nullptr; }
+
+	void SetView(double left, double top, double right, double bottom);
+
+	void Wait();
+
+	/// Set how long a tile may be away from the view before it is written back
+	/// \param seconds Seconds, 0 to write tiles back as soon as they are far
+	void SetEvictSeconds(double seconds) { mEvictSeconds = seconds; }
+
+	/// Get the number of tile columns
+	/// \returns Columns
+	int GetNumColumns() const { return mColumns; }
+
+	/// Get the number of tile rows
+	/// \returns Rows
+	int GetNumRows() const { return mRows; }
+
+	/// Get the width and height of a tile
+	/// \returns Tile size in world pixels
+	double GetTileSize() const { return mTileSize; }
+
+	int GetTile(double x, double y) const;
+
+	/// Is a tile in the aquarium?
+	/// \param tile Tile number, row by row
+	/// \returns true if its items are loaded
+	bool IsResident(int tile) const { return mTiles[tile].mState == State::Resident; }
+
+	int GetNumResident() const;
+	int GetNumLoading() const;
+
+	/// Get the number of tiles read
+	/// \returns Tile reads
+	long long GetNumReads() const { return mReads; }
+
+	/// Get the number of tiles written
+	/// \returns Tile writes
+	long long GetNumWrites() const { return mWrites; }
+
+	/// Get the bytes of tiles read
+	/// \returns Bytes read
+	long long GetBytesRead() const { return mBytesRead; }
+
+	/// Get the bytes of tiles written
+	/// \returns Bytes written
+	long long GetBytesWritten() const { return mBytesWritten; }
+
+	/// Get the number of tiles written back because they were far from the view
+	/// \returns Evictions
+	long long GetNumEvicted() const { return mEvicted; }
+
+	/// Get the number of items written to a tile that was not loaded
+	/// \returns Items that swam out of the loaded tiles
+	long long GetNumMigrated() const { return mMigrated; }
+
+	/// Get the number of tile loads that finished
+	/// \returns Loads
+	long long GetNumLoads() const { return mLoads; }
+
+	/// Get the average time from asking for a tile to its items being in the aquarium
+	/// \returns Seconds
+	double GetAverageLatency() const { return mLoads > 0 ? mLatency / mLoads : 0; }
+
+	/// Get the longest time from asking for a tile to its items being in the aquarium
+	/// \returns Seconds
+	double GetMaxLatency() const { return mMaxLatency; }
+
+	std::wstring Report() const;
+
+private:
+	/** Where a tile is */
+	enum class State { OnDisk, Loading, Resident };
+
+	/** What we know about a tile on the calling thread */
+	struct Tile
+	{
+		State mState = State::OnDisk;                           ///< Where the tile is
+		std::chrono::steady_clock::time_point mRequested;       ///< When its load was asked for
+		std::chrono::steady_clock::time_point mWanted;          ///< Last time it was near the view
+	};
+
+	/** An item as it is stored in a tile */
+	struct Record
+	{
+		std::wstring mType;     ///< Item type name
+		unsigned mId = 0;       ///< Item id
+		bool mMirror = false;   ///< True if the image is mirrored
+		double mX = 0;          ///< X location
+		double mY = 0;          ///< Y location
+		double mSpeedX = 0;     ///< Speed in the X direction
+		double mSpeedY = 0;     ///< Speed in the Y direction
+		double mDistance = 0;   ///< Repel distance of a Stinky
+	};
+
+	/** Tile index entry */
+	struct Entry
+	{
+		uint64_t mOffset = 0;   ///< File offset of the tile
+		uint32_t mBytes = 0;    ///< Bytes of the tile
+		uint32_t mCount = 0;    ///< Items in the tile
+	};
+
+	/** Work for the background thread */
+	struct Job
+	{
+		int mTile = 0;                  ///< Tile to read or write
+		bool mWrite = false;            ///< True to write, false to read
+		bool mAppend = false;           ///< True to add the items to those already in the tile
+		uint32_t mCount = 0;            ///< Items to write
+		std::vector<uint8_t> mBytes;    ///< Items to write
+	};
+
+	/** A tile read by the background thread */
+	struct Loaded
+	{
+		int mTile = 0;                  ///< Tile read
+		bool mGood = false;             ///< False if it could not be read
+		std::vector<Record> mItems;     ///< Items of the tile
+	};
+
+	static void PutItem(CItem* item, std::vector<uint8_t>& bytes);
+	static bool GetItem(const uint8_t*& at, const uint8_t* end, Record& record);
+	static bool WriteIndex(std::ostream& out, const std::vector<Entry>& index);
+
+	void Queue(Job& job);
+	void Worker();
+	bool Read(int tile, Loaded& loaded);
+	bool Store(Job& job);
+	void Poll();
+	void Evict(const std::vector<int>& tiles);
+	void Place(const Record& record);
+
+	/// Aquarium the items are loaded into, null when closed
+	CAquarium* mAquarium = nullptr;
+
+	/// Tiles around the view that are loaded
+	int mLoadMargin;
+
+	/// Tiles around the view that are kept loaded
+	int mKeepMargin;
+
+	/// Seconds a tile may be away from the view before it is written back
+	double mEvictSeconds = 2;
+
+	double mTileSize = DefaultTileSize;     ///< Width and height of a tile
+	int mColumns = 0;                       ///< Tile columns
+	int mRows = 0;                          ///< Tile rows
+	unsigned mMaxId = 0;                    ///< Largest item id in the file or the aquarium
+
+	/// Every tile, row by row, used by the calling thread
+	std::vector<Tile> mTiles;
+
+	/// File being streamed, used by the background thread
+	std::fstream mFile;
+
+	/// Tile index, used by the background thread
+	std::vector<Entry> mIndex;
+
+	/// Protects the jobs and loaded tiles
+	std::mutex mMutex;
+
+	/// Signaled when a job is queued or the thread should stop
+	std::condition_variable mWake;
+
+	/// Signaled when the background thread runs out of jobs
+	std::condition_variable mIdle;
+
+	/// Jobs in the order they were queued
+	std::deque<Job> mJobs;
+
+	/// True while the background thread runs a job
+	bool mBusy = false;
+
+	/// Tiles read and not yet added to the aquarium
+	std::vector<Loaded> mLoaded;
+
+	/// True when the background thread should exit
+	bool mStop = false;
+
+	/// True if a write failed
+	std::atomic<bool> mFailed{ false };
+
+	/// The background thread
+	std::thread mThread;
+
+	std::atomic<long long> mReads{ 0 };         ///< Tiles read
+	std::atomic<long long> mWrites{ 0 };        ///< Tiles written
+	std::atomic<long long> mBytesRead{ 0 };     ///< Bytes of tiles read
+	std::atomic<long long> mBytesWritten{ 0 };  ///< Bytes of tiles written
+	long long mEvicted = 0;                     ///< Tiles written back
+	long long mMigrated = 0;                    ///< Items added to tiles not loaded
+	long long mLoads = 0;                       ///< Tile loads finished
+	double mLatency = 0;                        ///< Total seconds of the loads
+	double mMaxLatency = 0;                     ///< Longest load
+};
+
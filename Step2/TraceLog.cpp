@@ -0,0 +1,226 @@
+/**
+ * \file TraceLog.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the Chrome trace-event log.
+ */
+
+#include "pch.h"
+#include <algorithm>
+#include <fstream>
+#include "TraceLog.h"
+
+using namespace std;
+
+/**
+ * Get the process wide trace log
+ * \returns Trace log
+ */
+CTraceLog& CTraceLog::Get()
+{
+	static CTraceLog log;
+	return log;
+}
+
+/**
+ * Constructor
+ */
+CTraceLog::CTraceLog() : mStart(chrono::steady_clock::now())
+{
+}
+
+/**
+ * Get the buffer for the calling thread, on first use taking one
+ * left by a thread that exited or creating one
+ * \returns Buffer owned by the log
+ */
+CTraceLog::ThreadBuffer* CTraceLog::GetThreadBuffer()
+{
+	/** Hands the buffer back when the thread exits */
+	struct Owner
+	{
+		ThreadBuffer* mBuffer = nullptr;    ///< Buffer of this thread
+
+		/// Destructor
+		~Owner()
+		{
+			if (mBuffer != nullptr)
+			{
+				mBuffer->mInUse = false;
+			}
+		}
+	};
+
+	thread_local Owner owner;
+	if (owner.mBuffer == nullptr)
+	{
+		lock_guard<mutex> lock(mMutex);
+		for (auto& buffer : mBuffers)
+		{
+			bool inUse = false;
+			if (buffer->mInUse.compare_exchange_strong(inUse, true))
+			{
+				owner.mBuffer = buffer.get();
+				break;
+			}
+		}
+
+		if (owner.mBuffer == nullptr)
+		{
+			auto buffer = make_unique<ThreadBuffer>();
+			buffer->mEvents.reset(new Event[RingEvents]);
+			owner.mBuffer = buffer.get();
+			mBuffers.push_back(move(buffer));
+		}
+
+		// Events from here on belong to this thread. Threads whose
+		// events have all been written over are forgotten.
+		auto buffer = owner.mBuffer;
+		auto next = buffer->mNext.load();
+		auto& threads = buffer->mThreads;
+		auto overwritten = next > RingEvents ? next - RingEvents : 0;
+		while (!threads.empty() && (threads.size() == 1 ? next : threads[1].first) <= overwritten)
+		{
+			threads.erase(threads.begin());
+		}
+		threads.push_back(make_pair(next, mNextThreadId++));
+	}
+
+	return owner.mBuffer;
+}
+
+/**
+ * Record an event on the calling thread.
+ *
+ * Only the calling thread writes its ring. The event is published
+ * by advancing the count after it is written.
+ * \param name Zone name
+ * \param phase 'B' or 'E'
+ */
+void CTraceLog::Record(const char* name, char phase)
+{
+	auto now = chrono::steady_clock::now();
+	long long time = chrono::duration_cast<chrono::microseconds>(now - mStart).count();
+
+	auto buffer = GetThreadBuffer();
+	auto next = buffer->mNext.load(memory_order_relaxed);
+	auto& event = buffer->mEvents[next % RingEvents];
+	event.mName.store(name, memory_order_relaxed);
+	event.mStamp.store(time * 2 + (phase == 'E' ? 1 : 0), memory_order_relaxed);
+	buffer->mNext.store(next + 1, memory_order_release);
+}
+
+/**
+ * Record the beginning of a zone
+ * \param name Zone name, must be a string literal
+ */
+void CTraceLog::Begin(const char* name)
+{
+	Record(name, 'B');
+}
+
+/**
+ * Record the end of a zone
+ * \param name Zone name, must be a string literal
+ */
+void CTraceLog::End(const char* name)
+{
+	Record(name, 'E');
+}
+
+/**
+ * Discard every recorded event
+ */
+void CTraceLog::Clear()
+{
+	lock_guard<mutex> lock(mMutex);
+	for (auto& buffer : mBuffers)
+	{
+		buffer->mFirst = buffer->mNext.load(memory_order_acquire);
+	}
+}
+
+/**
+ * Name the calling thread as the main thread in saved traces.
+ * Call it from the user interface thread.
+ */
+void CTraceLog::SetMainThread()
+{
+	auto buffer = GetThreadBuffer();
+
+	lock_guard<mutex> lock(mMutex);
+	mMainThreadId = buffer->mThreads.back().second;
+}
+
+/**
+ * Write every recorded event as Chrome trace JSON.
+ *
+ * Threads keep recording while we write. Events their threads may
+ * have overwritten while we copied them are dropped, as are ends of
+ * zones whose beginning is no longer in the ring. Each thread that
+ * held a ring is written as its own row.
+ * \param filename File to write
+ * \returns true if the file was written
+ */
+bool CTraceLog::Save(const std::wstring& filename)
+{
+	ofstream out(filename);
+	if (!out)
+	{
+		return false;
+	}
+
+	out << "{\"traceEvents\":[" << endl;
+
+	bool first = true;
+	lock_guard<mutex> lock(mMutex);
+	for (auto& buffer : mBuffers)
+	{
+		// Copy the ring, then keep what was not written over meanwhile
+		auto end = buffer->mNext.load(memory_order_acquire);
+		auto begin = max(buffer->mFirst.load(), end > RingEvents ? end - RingEvents : 0);
+		vector<pair<const char*, long long>> events;
+		for (auto i = begin; i < end; i++)
+		{
+			auto& event = buffer->mEvents[i % RingEvents];
+			events.push_back(make_pair(event.mName.load(memory_order_relaxed), event.mStamp.load(memory_order_relaxed)));
+		}
+
+		auto written = buffer->mNext.load(memory_order_acquire);
+		auto valid = max(begin, written >= RingEvents ? written - RingEvents + 1 : 0);
+
+		// Split the events among the threads that held the ring
+		auto& threads = buffer->mThreads;
+		for (size_t t = 0; t < threads.size(); t++)
+		{
+			int tid = threads[t].second;
+			auto from = max(valid, threads[t].first);
+			auto to = t + 1 < threads.size() ? min(end, threads[t + 1].first) : end;
+
+			// Thread name metadata so the viewer labels each row
+			out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+				<< tid << ",\"args\":{\"name\":\""
+				<< (tid == mMainThreadId ? "main" : "worker") << " " << tid << "\"}}";
+			first = false;
+
+			int depth = 0;
+			for (auto i = from; i < to; i++)
+			{
+				auto& event = events[(size_t)(i - begin)];
+				bool isEnd = (event.second & 1) != 0;
+				if (isEnd && depth == 0)
+				{
+					continue;
+				}
+
+				depth += isEnd ? -1 : 1;
+				out << ",\n{\"name\":\"" << event.first << "\",\"ph\":\"" << (isEnd ? 'E' : 'B')
+					<< "\",\"ts\":" << event.second / 2 << ",\"pid\":1,\"tid\":" << tid << "}";
+			}
+		}
+	}
+
+	out << "\n]}" << endl;
+	return true;
+}
@@ -0,0 +1,129 @@
+/**
+ * \file TraceLog.h
+ *
+ * \author Grant Youngs
+ *
+ * Records begin/end trace events and writes them as Chrome trace JSON.
+ *
+ * Tracing is compiled in only when AQUARIUM_TRACE is defined, which the
+ * Debug configurations do. Otherwise AQUA_TRACE_SCOPE expands to
+ * nothing.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+/**
+ * Collects trace events from every thread.
+ *
+ * Each thread appends to its own ring of the most recent events,
+ * without a lock, so recording threads never contend with each other
+ * and a long session holds a bounded amount of memory. A ring is
+ * handed to a new thread once its thread exits, and each thread that
+ * holds it is written with an id of its own. The rings are written
+ * as Chrome trace-event JSON, readable in chrome://tracing and
+ * Perfetto.
+ */
+class CTraceLog
+{
+public:
+	/// Events kept for each thread, older ones are overwritten
+	static const size_t RingEvents = 32768;
+
+	static CTraceLog& Get();
+
+	/// Copy constructor (disabled)
+	CTraceLog(const CTraceLog&) = delete;
+
+	void Begin(const char* name);
+	void End(const char* name);
+
+	bool Save(const std::wstring& filename);
+
+	void Clear();
+
+	void SetMainThread();
+
+private:
+	/** One begin or end event, written by its thread while the log may be saved */
+	struct Event
+	{
+		std::atomic<const char*> mName;     ///< Zone name, must be a string literal
+		std::atomic<long long> mStamp;      ///< Microseconds since the log was created, times 2, plus 1 for an end
+	};
+
+	/** The ring of events recorded by one thread */
+	struct ThreadBuffer
+	{
+		std::atomic<bool> mInUse{ true };                   ///< False once the thread exits
+		std::unique_ptr<Event[]> mEvents;                   ///< RingEvents events
+		std::atomic<unsigned long long> mNext{ 0 };         ///< Number of events ever recorded
+		std::atomic<unsigned long long> mFirst{ 0 };        ///< Number recorded when the log was cleared
+
+		/// Number recorded when each thread took the ring, and the id
+		/// written as its trace tid. Changed under the log lock.
+		std::vector<std::pair<unsigned long long, int>> mThreads;
+	};
+
+	CTraceLog();
+
+	ThreadBuffer* GetThreadBuffer();
+
+	void Record(const char* name, char phase);
+
+	/// Time the log was created, trace timestamps are relative to it
+	std::chrono::steady_clock::time_point mStart;
+
+	/// Protects the list of buffers
+	std::mutex mMutex;
+
+	/// Every thread buffer ever created
+	std::vector<std::unique_ptr<ThreadBuffer>> mBuffers;
+
+	/// Id given to the next thread to take a buffer
+	int mNextThreadId = 1;
+
+	/// Id of the user interface thread, 0 until it is set
+	int mMainThreadId = 0;
+};
+
+
+/**
+ * Records a begin event on construction and an end event on destruction.
+ */
+class CTraceScope
+{
+public:
+	/** Constructor
+	 * \param name Zone name, must be a string literal */
+	CTraceScope(const char* name) : mName(name) { CTraceLog::Get().Begin(name); }
+
+	/// Destructor
+	~CTraceScope() { CTraceLog::Get().End(mName); }
+
+	/// Copy constructor (disabled)
+	CTraceScope(const CTraceScope&) = delete;
+
+private:
+	const char* mName;  ///< Zone name
+};
+
+#ifdef AQUARIUM_TRACE
+/// Concatenate two tokens after expanding them
+#define AQUA_TRACE_CONCAT2(a, b) a##b
+/// Concatenate two tokens
+#define AQUA_TRACE_CONCAT(a, b) AQUA_TRACE_CONCAT2(a, b)
+/// Trace the rest of the enclosing scope as a named zone
+#define AQUA_TRACE_SCOPE(name) CTraceScope AQUA_TRACE_CONCAT(traceScope, __LINE__)(name)
+#else
+/// Tracing is compiled out
+#define AQUA_TRACE_SCOPE(name)
+#endif
+
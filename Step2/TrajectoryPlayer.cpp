@@ -0,0 +1,368 @@
+/**
+ * \file TrajectoryPlayer.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the trajectory player.
+ */
+
+#include "pch.h"
+#include <algorithm>
+#include <cstring>
+#include "TrajectoryPlayer.h"
+
+using namespace std;
+
+/**
+ * Read a value in machine order, if there is room for it
+ * \param at Where the value is, moved past it
+ * \param end End of the bytes that may be read
+ * \param value Receives the value
+ * \returns False if the value runs past the end
+ */
+template <class T>
+static bool Get(const char*& at, const char* end, T& value)
+{
+	if (end - at < (ptrdiff_t)sizeof(T))
+	{
+		return false;
+	}
+
+	memcpy(&value, at, sizeof(T));
+	at += sizeof(T);
+	return true;
+}
+
+/**
+ * Read a location and speed stored as floats
+ * \param at Where they are, moved past them
+ * \param end End of the bytes that may be read
+ * \param segment Receives the location and speed
+ * \returns False if they run past the end
+ */
+static bool GetMotion(const char*& at, const char* end, CTrajectoryRecorder::Segment& segment)
+{
+	float x, y, speedX, speedY;
+	if (!Get(at, end, x) || !Get(at, end, y) || !Get(at, end, speedX) || !Get(at, end, speedY))
+	{
+		return false;
+	}
+
+	segment.mX = x;
+	segment.mY = y;
+	segment.mSpeedX = speedX;
+	segment.mSpeedY = speedY;
+	return true;
+}
+
+/**
+ * Constructor
+ */
+CTrajectoryPlayer::CTrajectoryPlayer()
+{
+}
+
+/**
+ * Destructor
+ */
+CTrajectoryPlayer::~CTrajectoryPlayer()
+{
+}
+
+/**
+ * Open a recording and read its index
+ * \param filename File to play
+ * \returns False if the file is not a complete recording
+ */
+bool CTrajectoryPlayer::Open(const std::wstring& filename)
+{
+	Close();
+
+	mIn.open(filename, ios::binary);
+	if (!mIn)
+	{
+		return false;
+	}
+
+	// The footer at the end says where the index is
+	vector<char> bytes(CTrajectoryRecorder::HeaderSize + CTrajectoryRecorder::FooterSize);
+	mIn.seekg(0, ios::end);
+	long long size = mIn.tellg();
+	mIn.seekg(0);
+	mIn.read(bytes.data(), CTrajectoryRecorder::HeaderSize);
+
+	const char* at = bytes.data();
+	const char* end = at + CTrajectoryRecorder::HeaderSize;
+	uint32_t tag = 0, version = 0;
+	bool good = mIn && Get(at, end, tag) && Get(at, end, version) &&
+		tag == CTrajectoryRecorder::FileTag && version == CTrajectoryRecorder::Version &&
+		size >= CTrajectoryRecorder::HeaderSize + CTrajectoryRecorder::FooterSize;
+
+	uint64_t indexOffset = 0;
+	if (good)
+	{
+		mIn.seekg(size - CTrajectoryRecorder::FooterSize);
+		mIn.read(bytes.data(), CTrajectoryRecorder::FooterSize);
+		at = bytes.data();
+		end = at + CTrajectoryRecorder::FooterSize;
+		good = mIn && Get(at, end, indexOffset) && Get(at, end, mEndTime) && Get(at, end, tag) &&
+			tag == CTrajectoryRecorder::EndTag && indexOffset >= (uint64_t)CTrajectoryRecorder::HeaderSize &&
+			indexOffset <= (uint64_t)(size - CTrajectoryRecorder::FooterSize);
+	}
+
+	if (good)
+	{
+		bytes.resize((size_t)(size - CTrajectoryRecorder::FooterSize - indexOffset));
+		mIn.seekg(indexOffset);
+		mIn.read(bytes.data(), bytes.size());
+		at = bytes.data();
+		end = at + bytes.size();
+
+		uint32_t count = 0;
+		good = mIn && Get(at, end, tag) && Get(at, end, count) && tag == CTrajectoryRecorder::IndexTag;
+		for (uint32_t i = 0; good && i < count; i++)
+		{
+			pair<double, uint64_t> chunk;
+			good = Get(at, end, chunk.first) && Get(at, end, chunk.second) && chunk.second < indexOffset &&
+				(mIndex.empty() || (chunk.first >= mIndex.back().first && chunk.second > mIndex.back().second));
+			mIndex.push_back(chunk);
+		}
+	}
+
+	if (!good)
+	{
+		Close();
+		return false;
+	}
+
+	mIndexOffset = indexOffset;
+	return true;
+}
+
+/**
+ * Close the file
+ */
+void CTrajectoryPlayer::Close()
+{
+	if (mIn.is_open())
+	{
+		mIn.close();
+	}
+
+	mIn.clear();
+	mIndex.clear();
+	mIndexOffset = 0;
+	mEndTime = 0;
+	mChunk = -1;
+	mTypes.clear();
+	mKeyframe.clear();
+	mEvents.clear();
+	mSegments.clear();
+	mNext = 0;
+	mTime = 0;
+}
+
+/**
+ * Bring every item to where it is at some time
+ * \param time Aquarium time, clamped to the recording
+ * \returns False if the chunk for that time could not be read
+ */
+bool CTrajectoryPlayer::Seek(double time)
+{
+	if (GetNumChunks() == 0)
+	{
+		return false;
+	}
+
+	time = min(max(time, GetStartTime()), mEndTime);
+
+	// The last chunk that starts at or before the time
+	auto found = upper_bound(mIndex.begin(), mIndex.end(), time,
+		[](double t, const pair<double, uint64_t>& chunk) { return t < chunk.first; });
+	int chunk = max((int)(found - mIndex.begin()) - 1, 0);
+
+	if (chunk != mChunk)
+	{
+		if (!Load(chunk))
+		{
+			return false;
+		}
+		Rewind();
+	}
+	else if (time < mTime)
+	{
+		Rewind();
+	}
+
+	// Event times are rounded as the recorder rounded them, so seeking
+	// to the time of a sample replays the events of that sample
+	double start = mIndex[mChunk].first;
+	float offset = (float)(time - start);
+	for (; mNext < mEvents.size() && mEvents[mNext].mSegment.mTime <= offset; mNext++)
+	{
+		auto& event = mEvents[mNext];
+		if (event.mKind == CTrajectoryRecorder::End)
+		{
+			mSegments.erase(event.mId);
+		}
+		else
+		{
+			mSegments[event.mId] = event.mSegment;
+		}
+		mReplayed++;
+	}
+
+	mTime = time;
+	return true;
+}
+
+/**
+ * Get where every item is at the time of the last seek
+ * \param items Receives the items in id order
+ */
+void CTrajectoryPlayer::GetItems(std::vector<Item>& items) const
+{
+	items.clear();
+	items.reserve(mSegments.size());
+	// Segment times are since the start of the chunk, rounded as the
+	// recorder rounded them
+	float offset = mChunk < 0 ? 0 : (float)(mTime - mIndex[mChunk].first);
+	for (auto& segment : mSegments)
+	{
+		CTrajectoryRecorder::Segment at;
+		if (segment.second.mType < mTypes.size())
+		{
+			CTrajectoryRecorder::Follow(mTypes[segment.second.mType], segment.second, offset, at);
+		}
+		else
+		{
+			at = segment.second;
+		}
+
+		Item item;
+		item.mId = segment.first;
+		item.mType = at.mType;
+		item.mMirror = at.mMirror;
+		item.mX = at.mX;
+		item.mY = at.mY;
+		item.mSpeedX = at.mSpeedX;
+		item.mSpeedY = at.mSpeedY;
+		items.push_back(item);
+	}
+}
+
+/**
+ * Get the name of a type number
+ * \param type Type number from an item
+ * \returns Type name, empty if the type is not in the chunk loaded
+ */
+std::wstring CTrajectoryPlayer::GetTypeName(uint16_t type) const
+{
+	return type < mTypes.size() ? mTypes[type].mName : wstring();
+}
+
+/**
+ * Read a chunk from the file
+ * \param chunk Number of the chunk
+ * \returns False if the chunk could not be read
+ */
+bool CTrajectoryPlayer::Load(int chunk)
+{
+	mChunk = -1;
+	mTypes.clear();
+	mKeyframe.clear();
+	mEvents.clear();
+	mLoads++;
+
+	// The end of the last chunk is the start of the index
+	uint64_t next = chunk + 1 < GetNumChunks() ? mIndex[chunk + 1].second : mIndexOffset;
+	vector<char> bytes((size_t)(next - mIndex[chunk].second));
+	mIn.clear();
+	mIn.seekg(mIndex[chunk].second);
+	mIn.read(bytes.data(), bytes.size());
+	const char* at = bytes.data();
+	const char* end = at + bytes.size();
+
+	uint32_t tag = 0, typeCount = 0;
+	double time = 0;
+	bool good = mIn && Get(at, end, tag) && Get(at, end, time) && Get(at, end, typeCount) &&
+		tag == CTrajectoryRecorder::ChunkTag && time == mIndex[chunk].first && typeCount <= 0x10000;
+	for (uint32_t i = 0; good && i < typeCount; i++)
+	{
+		uint16_t length = 0;
+		good = Get(at, end, length) && end - at >= length;
+		if (!good)
+		{
+			break;
+		}
+
+		CTrajectoryRecorder::Type type;
+		type.mName.assign(at, at + length);
+		at += length;
+
+		float left, right, top, bottom;
+		good = Get(at, end, left) && Get(at, end, right) && Get(at, end, top) && Get(at, end, bottom);
+		type.mLeft = left;
+		type.mRight = right;
+		type.mTop = top;
+		type.mBottom = bottom;
+		mTypes.push_back(type);
+	}
+
+	uint32_t count = 0;
+	good = good && Get(at, end, count) && (uint64_t)count * CTrajectoryRecorder::KeyItemSize <= (uint64_t)(end - at);
+	for (uint32_t i = 0; good && i < count; i++)
+	{
+		uint32_t id = 0;
+		uint8_t flags = 0;
+		CTrajectoryRecorder::Segment segment;
+		good = Get(at, end, id) && Get(at, end, segment.mType) && Get(at, end, flags) && GetMotion(at, end, segment);
+		segment.mMirror = (flags & CTrajectoryRecorder::MirrorFlag) != 0;
+		segment.mTime = 0;
+		mKeyframe.push_back(make_pair((unsigned)id, segment));
+	}
+
+	good = good && Get(at, end, count) && (uint64_t)count * CTrajectoryRecorder::EventSize == (uint64_t)(end - at);
+	for (uint32_t i = 0; good && i < count; i++)
+	{
+		float offset = 0;
+		uint32_t id = 0;
+		uint8_t kind = 0, flags = 0;
+		Event event;
+		good = Get(at, end, offset) && Get(at, end, id) && Get(at, end, event.mSegment.mType) &&
+			Get(at, end, kind) && Get(at, end, flags) && GetMotion(at, end, event.mSegment) &&
+			kind >= CTrajectoryRecorder::Start && kind <= CTrajectoryRecorder::Drag;
+
+		// Times are kept since the start of the chunk
+		event.mId = id;
+		event.mKind = (CTrajectoryRecorder::Kind)kind;
+		event.mSegment.mMirror = (flags & CTrajectoryRecorder::MirrorFlag) != 0;
+		event.mSegment.mTime = offset;
+		mEvents.push_back(event);
+	}
+
+	if (!good)
+	{
+		mTypes.clear();
+		mKeyframe.clear();
+		mEvents.clear();
+		return false;
+	}
+
+	mChunk = chunk;
+	return true;
+}
+
+/**
+ * Put every item back where the keyframe of the chunk loaded has it
+ */
+void CTrajectoryPlayer::Rewind()
+{
+	mSegments.clear();
+	for (auto& item : mKeyframe)
+	{
+		mSegments[item.first] = item.second;
+	}
+
+	mNext = 0;
+}
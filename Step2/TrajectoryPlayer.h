@@ -0,0 +1,132 @@
+/**
+ * \file TrajectoryPlayer.h
+ *
+ * \author Grant Youngs
+ *
+ * Class that plays back a file of recorded trajectories.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include "TrajectoryRecorder.h"
+
+
+/**
+ * Plays back a file written by CTrajectoryRecorder.
+ *
+ * Seek finds the chunk for a time by a binary search of the chunk
+ * index, loads it, and replays its events up to that time. Every
+ * item is then wherever its segment has taken it. Seeking forward
+ * within the chunk already loaded only replays the events since the
+ * last seek, so playing back at any speed is a seek per frame.
+ */
+class CTrajectoryPlayer
+{
+public:
+	/** Where an item is at the time of the last seek */
+	struct Item
+	{
+		unsigned mId = 0;       ///< Item id
+		uint16_t mType = 0;     ///< Type number, named by GetTypeName
+		bool mMirror = false;   ///< True if the image is mirrored
+		double mX = 0;          ///< X location
+		double mY = 0;          ///< Y location
+		double mSpeedX = 0;     ///< Speed in the X direction
+		double mSpeedY = 0;     ///< Speed in the Y direction
+	};
+
+	CTrajectoryPlayer();
+	virtual ~CTrajectoryPlayer();
+
+	/// Copy constructor (disabled)
+	CTrajectoryPlayer(const CTrajectoryPlayer&) = delete;
+
+	bool Open(const std::wstring& filename);
+	void Close();
+
+	/// Is a file open?
+	/// \returns true if open
+	bool IsOpen() const { return mIn.is_open(); }
+
+	bool Seek(double time);
+	void GetItems(std::vector<Item>& items) const;
+	std::wstring GetTypeName(uint16_t type) const;
+
+	/// Get the time of the last seek
+	/// \returns Aquarium time
+	double GetTime() const { return mTime; }
+
+	/// Get the time the recording starts
+	/// \returns Aquarium time of the first chunk
+	double GetStartTime() const { return mIndex.empty() ? 0 : mIndex.front().first; }
+
+	/// Get the time the recording ends
+	/// \returns Aquarium time of the last sample
+	double GetEndTime() const { return mEndTime; }
+
+	/// Get the number of chunks in the file
+	/// \returns Number of chunks
+	int GetNumChunks() const { return (int)mIndex.size(); }
+
+	/// Get the number of chunks loaded by seeks
+	/// \returns Number of chunk loads
+	long long GetNumLoads() const { return mLoads; }
+
+	/// Get the number of events replayed by seeks
+	/// \returns Number of events
+	long long GetNumReplayed() const { return mReplayed; }
+
+private:
+	/** An event of the chunk loaded */
+	struct Event
+	{
+		unsigned mId;                           ///< Item id
+		CTrajectoryRecorder::Kind mKind;        ///< Why the event was written
+		CTrajectoryRecorder::Segment mSegment;  ///< Segment the item starts
+	};
+
+	bool Load(int chunk);
+	void Rewind();
+
+	/// File being played
+	std::ifstream mIn;
+
+	/// Start time and file offset of each chunk
+	std::vector<std::pair<double, uint64_t>> mIndex;
+
+	/// File offset of the index, where the last chunk ends
+	uint64_t mIndexOffset = 0;
+
+	/// Time the recording ends
+	double mEndTime = 0;
+
+	/// Chunk loaded, or -1
+	int mChunk = -1;
+
+	/// Types of the chunk loaded
+	std::vector<CTrajectoryRecorder::Type> mTypes;
+
+	/// Keyframe of the chunk loaded, timed from the start of the chunk
+	std::vector<std::pair<unsigned, CTrajectoryRecorder::Segment>> mKeyframe;
+
+	/// Events of the chunk loaded in time order
+	std::vector<Event> mEvents;
+
+	/// Next event of the chunk loaded to replay
+	size_t mNext = 0;
+
+	/// Segment of every item by id, timed from the start of the chunk
+	std::map<unsigned, CTrajectoryRecorder::Segment> mSegments;
+
+	/// Time of the last seek
+	double mTime = 0;
+
+	long long mLoads = 0;       ///< Chunks loaded
+	long long mReplayed = 0;    ///< Events replayed
+};
+
@@ -0,0 +1,427 @@
+/**
+ * \file TrajectoryRecorder.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the trajectory recorder.
+ */
+
+#include "pch.h"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include "TrajectoryRecorder.h"
+#include "Aquarium.h"
+#include "Fish.h"
+
+using namespace std;
+
+/// Difference in speed small enough to be rounding
+const double SpeedEpsilon = 1e-6;
+
+/**
+ * Append a value to a buffer in machine order, which is little
+ * endian on every platform we build for
+ * \param buffer Buffer to append to
+ * \param value Value to append
+ */
+template <class T>
+static void Put(std::vector<char>& buffer, T value)
+{
+	size_t at = buffer.size();
+	buffer.resize(at + sizeof(T));
+	memcpy(buffer.data() + at, &value, sizeof(T));
+}
+
+/**
+ * Append the location and speed of a segment as floats
+ * \param buffer Buffer to append to
+ * \param segment Segment to append
+ */
+static void PutMotion(std::vector<char>& buffer, const CTrajectoryRecorder::Segment& segment)
+{
+	Put(buffer, (float)segment.mX);
+	Put(buffer, (float)segment.mY);
+	Put(buffer, (float)segment.mSpeedX);
+	Put(buffer, (float)segment.mSpeedY);
+}
+
+/**
+ * Constructor
+ * \param keyframeInterval Seconds of aquarium time from one keyframe to the next
+ * \param tolerance Distance an item may be from its predicted location
+ * before an event is written
+ */
+CTrajectoryRecorder::CTrajectoryRecorder(double keyframeInterval, double tolerance) :
+	mKeyframeInterval(keyframeInterval > 0 ? keyframeInterval : DefaultKeyframeInterval), mTolerance(tolerance)
+{
+}
+
+/**
+ * Destructor
+ */
+CTrajectoryRecorder::~CTrajectoryRecorder()
+{
+	Close();
+}
+
+/**
+ * Start recording to a file
+ * \param filename File to write
+ * \returns True if the file is open
+ */
+bool CTrajectoryRecorder::Open(const std::wstring& filename)
+{
+	Close();
+
+	mOut.open(filename, ios::binary | ios::trunc);
+	if (!mOut)
+	{
+		return false;
+	}
+
+	mTracks.clear();
+	mTypes.clear();
+	mTypeNumbers.clear();
+	mIndex.clear();
+	mChunkOpen = false;
+	mTime = 0;
+	mEvents = 0;
+	memset(mKindEvents, 0, sizeof(mKindEvents));
+	mSamples = 0;
+	mSampleSeconds = 0;
+
+	vector<char> header;
+	Put(header, FileTag);
+	Put(header, Version);
+	Put(header, mKeyframeInterval);
+	mOut.write(header.data(), header.size());
+	mBytes = header.size();
+
+	return mOut.good();
+}
+
+/**
+ * Write what is left of the recording and the index, and close the file
+ * \returns True if everything was written
+ */
+bool CTrajectoryRecorder::Close()
+{
+	if (!IsOpen())
+	{
+		return false;
+	}
+
+	if (mChunkOpen)
+	{
+		WriteChunk();
+	}
+
+	uint64_t indexOffset = mBytes;
+	vector<char> tail;
+	Put(tail, IndexTag);
+	Put(tail, (uint32_t)mIndex.size());
+	for (auto& chunk : mIndex)
+	{
+		Put(tail, chunk.first);
+		Put(tail, chunk.second);
+	}
+
+	Put(tail, indexOffset);
+	Put(tail, mTime);
+	Put(tail, EndTag);
+	mOut.write(tail.data(), tail.size());
+	mBytes += tail.size();
+
+	bool good = mOut.good();
+	mOut.close();
+	mTracks.clear();
+	return good;
+}
+
+/**
+ * Sample every item in an aquarium and write events for the ones
+ * that left the path they were predicted to follow.
+ *
+ * Call after every change to the aquarium: after each Update, and
+ * after anything that moves items outside Update.
+ * \param aquarium Aquarium to sample
+ * \param moved Kind of event to write for an item that moved without
+ * changing speed, Nudge after an update and Drag after a drag
+ */
+void CTrajectoryRecorder::Sample(CAquarium* aquarium, Kind moved)
+{
+	if (!IsOpen())
+	{
+		return;
+	}
+
+	auto start = chrono::steady_clock::now();
+	double time = aquarium->GetTime();
+	mTime = time;
+	mSamples++;
+
+	mFound.clear();
+	aquarium->Query(0, 0, aquarium->GetWidth(), aquarium->GetHeight(), mFound);
+
+	if (!mChunkOpen)
+	{
+		StartChunk(time);
+	}
+	else if (time >= mChunkTime + mKeyframeInterval)
+	{
+		WriteChunk();
+		StartChunk(time);
+	}
+
+	// Every chunk has one set of walls, so new walls after the world
+	// is resized start a new chunk. The keyframe is taken before they
+	// change, since the segments up to now bounced off the old ones.
+	bool restarted = false;
+	mFoundTypes.resize(mFound.size());
+	for (size_t i = 0; i < mFound.size(); i++)
+	{
+		auto item = mFound[i];
+		mFoundTypes[i] = FindType(item);
+
+		Type walls;
+		item->GetBounds(walls.mLeft, walls.mRight, walls.mTop, walls.mBottom);
+		auto& type = mTypes[mFoundTypes[i]];
+		if (walls.mLeft != type.mLeft || walls.mRight != type.mRight ||
+			walls.mTop != type.mTop || walls.mBottom != type.mBottom)
+		{
+			if (!restarted && time > mChunkTime)
+			{
+				WriteChunk();
+				StartChunk(time);
+			}
+
+			restarted = true;
+			type.mLeft = walls.mLeft;
+			type.mRight = walls.mRight;
+			type.mTop = walls.mTop;
+			type.mBottom = walls.mBottom;
+		}
+	}
+
+	for (size_t i = 0; i < mFound.size(); i++)
+	{
+		auto item = mFound[i];
+		Segment actual;
+		actual.mType = mFoundTypes[i];
+		actual.mMirror = item->IsMirror();
+		actual.mTime = time;
+		actual.mX = item->GetX();
+		actual.mY = item->GetY();
+		item->GetVelocity(actual.mSpeedX, actual.mSpeedY);
+
+		unsigned id = item->GetId();
+		auto found = mTracks.find(id);
+		if (found == mTracks.end())
+		{
+			auto& track = mTracks[id];
+			track.mSegment = actual;
+			track.mSeen = mSamples;
+			PutEvent(id, actual, Start);
+			continue;
+		}
+
+		auto& track = found->second;
+		track.mSeen = mSamples;
+
+		Segment predicted;
+		Follow(mTypes[track.mSegment.mType], track.mSegment, time, predicted);
+		bool bounced = predicted.mSpeedX != track.mSegment.mSpeedX || predicted.mSpeedY != track.mSegment.mSpeedY;
+
+		Kind kind;
+		if (fabs(actual.mSpeedX - predicted.mSpeedX) > SpeedEpsilon || fabs(actual.mSpeedY - predicted.mSpeedY) > SpeedEpsilon)
+		{
+			// Only reversed is a bounce the model put somewhere else
+			bool reversed = fabs(fabs(actual.mSpeedX) - fabs(predicted.mSpeedX)) <= SpeedEpsilon &&
+				fabs(fabs(actual.mSpeedY) - fabs(predicted.mSpeedY)) <= SpeedEpsilon;
+			kind = reversed ? Bounce : Speed;
+		}
+		else if (fabs(actual.mX - predicted.mX) > mTolerance || fabs(actual.mY - predicted.mY) > mTolerance)
+		{
+			kind = bounced ? Bounce : moved;
+		}
+		else if (actual.mMirror != predicted.mMirror || actual.mType != predicted.mType)
+		{
+			kind = moved;
+		}
+		else
+		{
+			continue;
+		}
+
+		track.mSegment = actual;
+		PutEvent(id, actual, kind);
+	}
+
+	// Anything not found is gone
+	for (auto track = mTracks.begin(); track != mTracks.end(); )
+	{
+		if (track->second.mSeen == mSamples)
+		{
+			++track;
+			continue;
+		}
+
+		Segment last;
+		Follow(mTypes[track->second.mSegment.mType], track->second.mSegment, time, last);
+		PutEvent(track->first, last, End);
+		track = mTracks.erase(track);
+	}
+
+	mSampleSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Follow a segment to a later time.
+ *
+ * Each axis bounces between the walls of the type as CFish does.
+ * \param type Type of the item, for its walls
+ * \param segment Segment to follow
+ * \param time Time to follow it to
+ * \param at Receives the segment as it is at that time
+ */
+void CTrajectoryRecorder::Follow(const Type& type, const Segment& segment, double time, Segment& at)
+{
+	// The segment and the result may be the same
+	double duration = time - segment.mTime;
+	double x = segment.mX;
+	double speedX = segment.mSpeedX;
+	at = segment;
+	at.mTime = time;
+	if (duration <= 0)
+	{
+		return;
+	}
+
+	CFish::AdvanceAxis(at.mX, at.mSpeedX, type.mLeft, type.mRight, duration);
+	CFish::AdvanceAxis(at.mY, at.mSpeedY, type.mTop, type.mBottom, duration);
+
+	// A fish faces the way it swims once it has reached a wall, which
+	// it has already done if it starts outside them
+	double toWall = numeric_limits<double>::infinity();
+	if (speedX > 0)
+	{
+		toWall = (type.mRight - x) / speedX;
+	}
+	else if (speedX < 0)
+	{
+		toWall = (x - type.mLeft) / -speedX;
+	}
+
+	if (type.mRight > type.mLeft && duration >= toWall)
+	{
+		at.mMirror = at.mSpeedX < 0;
+	}
+}
+
+/**
+ * Find the number of the type of an item, adding the type if it
+ * is new
+ * \param item Item to find the type of
+ * \returns Type number
+ */
+uint16_t CTrajectoryRecorder::FindType(CItem* item)
+{
+	wstring name = item->GetType();
+	auto found = mTypeNumbers.find(name);
+	if (found != mTypeNumbers.end())
+	{
+		return found->second;
+	}
+
+	Type type;
+	type.mName = name;
+	item->GetBounds(type.mLeft, type.mRight, type.mTop, type.mBottom);
+
+	uint16_t number = (uint16_t)mTypes.size();
+	mTypes.push_back(type);
+	mTypeNumbers[name] = number;
+	return number;
+}
+
+/**
+ * Start gathering a chunk, with a keyframe of where every item is
+ * \param time Start time of the chunk
+ */
+void CTrajectoryRecorder::StartChunk(double time)
+{
+	mChunkOpen = true;
+	mChunkTime = time;
+	mChunkEvents.clear();
+	mChunkCount = 0;
+
+	// Every segment restarts at the keyframe, so the events of the
+	// chunk only depend on the keyframe
+	mKeyframe.clear();
+	for (auto& track : mTracks)
+	{
+		auto& segment = track.second.mSegment;
+		Follow(mTypes[segment.mType], segment, time, segment);
+
+		Put(mKeyframe, (uint32_t)track.first);
+		Put(mKeyframe, segment.mType);
+		Put(mKeyframe, (uint8_t)(segment.mMirror ? MirrorFlag : 0));
+		PutMotion(mKeyframe, segment);
+	}
+}
+
+/**
+ * Write the chunk gathered to the file and add it to the index
+ */
+void CTrajectoryRecorder::WriteChunk()
+{
+	vector<char> chunk;
+	Put(chunk, ChunkTag);
+	Put(chunk, mChunkTime);
+
+	Put(chunk, (uint32_t)mTypes.size());
+	for (auto& type : mTypes)
+	{
+		Put(chunk, (uint16_t)type.mName.size());
+		for (auto c : type.mName)
+		{
+			chunk.push_back((char)c);
+		}
+
+		Put(chunk, (float)type.mLeft);
+		Put(chunk, (float)type.mRight);
+		Put(chunk, (float)type.mTop);
+		Put(chunk, (float)type.mBottom);
+	}
+
+	Put(chunk, (uint32_t)(mKeyframe.size() / KeyItemSize));
+	chunk.insert(chunk.end(), mKeyframe.begin(), mKeyframe.end());
+	Put(chunk, mChunkCount);
+	chunk.insert(chunk.end(), mChunkEvents.begin(), mChunkEvents.end());
+
+	mIndex.push_back(make_pair(mChunkTime, (uint64_t)mBytes));
+	mOut.write(chunk.data(), chunk.size());
+	mBytes += chunk.size();
+	mChunkOpen = false;
+}
+
+/**
+ * Add an event to the chunk being gathered
+ * \param id Id of the item
+ * \param segment Segment the item starts, at the time of the event
+ * \param kind Why the event is written
+ */
+void CTrajectoryRecorder::PutEvent(unsigned id, const Segment& segment, Kind kind)
+{
+	Put(mChunkEvents, (float)(segment.mTime - mChunkTime));
+	Put(mChunkEvents, (uint32_t)id);
+	Put(mChunkEvents, segment.mType);
+	Put(mChunkEvents, (uint8_t)kind);
+	Put(mChunkEvents, (uint8_t)(segment.mMirror ? MirrorFlag : 0));
+	PutMotion(mChunkEvents, segment);
+
+	mChunkCount++;
+	mEvents++;
+	mKindEvents[kind]++;
+}
@@ -0,0 +1,224 @@
+/**
+ * \file TrajectoryRecorder.h
+ *
+ * \author Grant Youngs
+ *
+ * Class that records the paths of the items in an aquarium.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class CAquarium;
+class CItem;
+
+
+/**
+ * Records the path of every item in an aquarium as a file of
+ * segment events.
+ *
+ * A fish swims in straight lines and bounces off the walls, so its
+ * path from any location and velocity follows from the walls alone
+ * (CFish::AdvanceAxis). Nothing is written while an item does what
+ * that model predicts. An event is written only when an item leaves
+ * its path: it appears or is removed, its speed changes, it is nudged
+ * or dragged, or a bounce lands somewhere other than the model says,
+ * as the overshoot of fixed time steps does. Each event starts a new
+ * segment from where the item is.
+ *
+ * The file is little endian:
+ *
+ *   Header: uint32 FileTag, uint32 Version, double keyframe interval.
+ *
+ *   Chunks, one per keyframe interval: uint32 ChunkTag, double start
+ *   time, uint32 type count, then for each type a uint16 name length,
+ *   the name in ASCII and float left, right, top and bottom walls.
+ *   Then the keyframe, a uint32 count and for each item a uint32 id,
+ *   uint16 type, uint8 flags and float X, Y, X speed and Y speed at
+ *   the start time. Then a uint32 count and the events in time order,
+ *   each a float time since the start, uint32 id, uint16 type, uint8
+ *   kind, uint8 flags and float X, Y, X speed and Y speed.
+ *
+ *   Index: uint32 IndexTag, uint32 count, then for each chunk a
+ *   double start time and uint64 file offset.
+ *
+ *   Footer: uint64 file offset of the index, double end time and
+ *   uint32 EndTag.
+ *
+ * The player finds the chunk for any time by a binary search of the
+ * index, and only has to replay the events of that one chunk.
+ */
+class CTrajectoryRecorder
+{
+public:
+	/** Why an event was written */
+	enum Kind { Start = 1, End, Bounce, Speed, Nudge, Drag };
+
+	/// First word of a trajectory file, "AQTR"
+	static const uint32_t FileTag = 0x52545141;
+
+	/// First word of a chunk, "CHNK"
+	static const uint32_t ChunkTag = 0x4b4e4843;
+
+	/// First word of the index, "INDX"
+	static const uint32_t IndexTag = 0x58444e49;
+
+	/// Last word of a complete file, "AQTE"
+	static const uint32_t EndTag = 0x45545141;
+
+	/// Version of the file format
+	static const uint32_t Version = 1;
+
+	/// Bytes of the header
+	static const int HeaderSize = 4 + 4 + 8;
+
+	/// Bytes of each keyframe item
+	static const int KeyItemSize = 4 + 2 + 1 + 4 * 4;
+
+	/// Bytes of each event
+	static const int EventSize = 4 + 4 + 2 + 1 + 1 + 4 * 4;
+
+	/// Bytes of the footer
+	static const int FooterSize = 8 + 8 + 4;
+
+	/// Flag set when the image is mirrored
+	static const uint8_t MirrorFlag = 1;
+
+	/// Seconds of aquarium time from one keyframe to the next
+	static const int DefaultKeyframeInterval = 600;
+
+	/** A straight line an item swims along, bouncing off the walls */
+	struct Segment
+	{
+		uint16_t mType = 0;     ///< Type number
+		bool mMirror = false;   ///< True if mirrored
+		double mTime = 0;       ///< Time the segment starts
+		double mX = 0;          ///< X location at the start
+		double mY = 0;          ///< Y location at the start
+		double mSpeedX = 0;     ///< Speed in the X direction at the start
+		double mSpeedY = 0;     ///< Speed in the Y direction at the start
+	};
+
+	/** A type of item and the walls its items bounce off */
+	struct Type
+	{
+		std::wstring mName;     ///< Type name
+		double mLeft = 0;       ///< Smallest X location
+		double mRight = 0;      ///< Largest X location
+		double mTop = 0;        ///< Smallest Y location
+		double mBottom = 0;     ///< Largest Y location
+	};
+
+	CTrajectoryRecorder(double keyframeInterval = DefaultKeyframeInterval, double tolerance = 0.5);
+	virtual ~CTrajectoryRecorder();
+
+	/// Copy constructor (disabled)
+	CTrajectoryRecorder(const CTrajectoryRecorder&) = delete;
+
+	bool Open(const std::wstring& filename);
+	bool Close();
+
+	/// Is a file being recorded?
+	/// \returns true if open
+	bool IsOpen() const { return mOut.is_open(); }
+
+	void Sample(CAquarium* aquarium, Kind moved = Nudge);
+
+	static void Follow(const Type& type, const Segment& segment, double time, Segment& at);
+
+	/// Get the number of events written
+	/// \returns Number of events
+	long long GetNumEvents() const { return mEvents; }
+
+	/// Get the number of events of one kind written
+	/// \param kind Kind of event
+	/// \returns Number of events
+	long long GetNumEvents(Kind kind) const { return mKindEvents[kind]; }
+
+	/// Get the number of chunks written
+	/// \returns Number of chunks
+	int GetNumChunks() const { return (int)mIndex.size(); }
+
+	/// Get the number of samples taken
+	/// \returns Number of samples
+	long long GetNumSamples() const { return mSamples; }
+
+	/// Get the bytes written to the file so far
+	/// \returns Bytes written
+	long long GetBytesWritten() const { return mBytes; }
+
+	/// Get the time spent sampling
+	/// \returns Seconds in Sample
+	double GetSampleSeconds() const { return mSampleSeconds; }
+
+private:
+	/** The segment an item is on, and the last sample that saw it */
+	struct Track
+	{
+		Segment mSegment;       ///< Segment the item is on
+		long long mSeen = 0;    ///< Number of the last sample the item was in
+	};
+
+	uint16_t FindType(CItem* item);
+	void StartChunk(double time);
+	void WriteChunk();
+	void PutEvent(unsigned id, const Segment& segment, Kind kind);
+
+	/// File being recorded
+	std::ofstream mOut;
+
+	/// Seconds of aquarium time from one keyframe to the next
+	double mKeyframeInterval;
+
+	/// Distance an item may be from its predicted location without an event
+	double mTolerance;
+
+	/// True while a chunk is being gathered
+	bool mChunkOpen = false;
+
+	/// Time of the current chunk
+	double mChunkTime = 0;
+
+	/// Time of the last sample
+	double mTime = 0;
+
+	/// Keyframe of the current chunk
+	std::vector<char> mKeyframe;
+
+	/// Events of the current chunk
+	std::vector<char> mChunkEvents;
+
+	/// Number of events in the current chunk
+	uint32_t mChunkCount = 0;
+
+	/// Start time and file offset of each chunk written
+	std::vector<std::pair<double, uint64_t>> mIndex;
+
+	/// Segment of every item by id
+	std::unordered_map<unsigned, Track> mTracks;
+
+	/// Types in order of their numbers
+	std::vector<Type> mTypes;
+
+	/// Type numbers by name
+	std::map<std::wstring, uint16_t> mTypeNumbers;
+
+	/// Items found by a sample
+	std::vector<CItem*> mFound;
+
+	/// Type numbers of the items found by a sample
+	std::vector<uint16_t> mFoundTypes;
+
+	long long mEvents = 0;          ///< Events written
+	long long mKindEvents[Drag + 1] = {};  ///< Events written of each kind
+	long long mSamples = 0;         ///< Samples taken
+	long long mBytes = 0;           ///< Bytes written
+	double mSampleSeconds = 0;      ///< Time spent sampling
+};
+
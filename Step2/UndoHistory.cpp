@@ -0,0 +1,525 @@
+/**
+ * \file UndoHistory.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the undo history.
+ */
+
+#include "pch.h"
+#include <algorithm>
+#include <sstream>
+#include "UndoHistory.h"
+#include "Aquarium.h"
+#include "Item.h"
+#include "MemoryAccounting.h"
+
+using namespace std;
+
+/// Key the steps are accounted under in the journal category
+const wstring HistoryKey = L"Undo history";
+
+/// Names of the kinds of steps for menus and reports
+const wchar_t* StepNames[] = { L"Add", L"Drag", L"Move to Front", L"Load", L"Clear" };
+
+/**
+ * Constructor
+ * \param aquarium Aquarium the edits are made to
+ * \param maxBytes Most bytes the steps may take
+ */
+CUndoHistory::CUndoHistory(CAquarium* aquarium, long long maxBytes) :
+	mAquarium(aquarium), mMaxBytes(maxBytes)
+{
+}
+
+/**
+ * Destructor
+ */
+CUndoHistory::~CUndoHistory()
+{
+	CMemoryAccounting::Get().Remove(CMemoryAccounting::Journal, HistoryKey, mBytes);
+}
+
+/**
+ * Add an item to the aquarium as a step
+ * \param item New item to add
+ */
+void CUndoHistory::Add(const std::shared_ptr<CItem>& item)
+{
+	Track();
+	long long created = CItemSequence::GetNumCreated();
+
+	Step step;
+	step.mKind = Kind::Add;
+	step.mBefore = mCurrent;
+	step.mItem = item;
+
+	mAquarium->Add(item);
+	mCurrent = mCurrent.PushBack(item);
+	step.mAfter = mCurrent;
+	Push(step, created);
+}
+
+/**
+ * Move an item to the front as a step. Nothing is kept if it is
+ * already in front.
+ * \param item Item in the aquarium
+ */
+void CUndoHistory::MoveToFront(const std::shared_ptr<CItem>& item)
+{
+	Track();
+	long long created = CItemSequence::GetNumCreated();
+
+	Step step;
+	step.mKind = Kind::MoveToFront;
+	step.mBefore = mCurrent;
+	step.mItem = item;
+	Locate(step, item);
+
+	mAquarium->MoveToFront(item);
+	Raised(step);
+	if (step.mRaised)
+	{
+		step.mAfter = mCurrent;
+		Push(step, created);
+	}
+}
+
+/**
+ * Start dragging an item. The drag is one step, made by EndDrag.
+ *
+ * The item may be moved to the front while it is dragged, either by
+ * the caller or by DragTo.
+ * \param item Item in the aquarium
+ */
+void CUndoHistory::BeginDrag(const std::shared_ptr<CItem>& item)
+{
+	EndDrag();
+	Track();
+
+	mDrag = Step();
+	mDrag.mKind = Kind::Drag;
+	mDrag.mBefore = mCurrent;
+	mDrag.mItem = item;
+	mDrag.mFromX = item->GetX();
+	mDrag.mFromY = item->GetY();
+	mDragCreated = CItemSequence::GetNumCreated();
+	mDragMoved = false;
+	Locate(mDrag, item);
+}
+
+/**
+ * Move the item being dragged
+ * \param x New X location
+ * \param y New Y location
+ */
+void CUndoHistory::DragTo(double x, double y)
+{
+	if (mDrag.mItem != nullptr)
+	{
+		mDrag.mItem->SetLocation(x, y);
+		mDragMoved = true;
+	}
+}
+
+/**
+ * Finish a drag and keep it as a step.
+ *
+ * A drag that never moved the item is kept as a move to the front,
+ * or not at all if the item was already in front.
+ */
+void CUndoHistory::EndDrag()
+{
+	if (mDrag.mItem == nullptr)
+	{
+		return;
+	}
+
+	Step step = mDrag;
+	mDrag = Step();
+
+	// Anything else changing the items while we dragged leaves us
+	// nothing we can undo
+	if (mCurrent.GetSize() != (size_t)mAquarium->GetNumItems())
+	{
+		Reset();
+		return;
+	}
+
+	Raised(step);
+	step.mToX = step.mItem->GetX();
+	step.mToY = step.mItem->GetY();
+	if (!mDragMoved)
+	{
+		step.mKind = Kind::MoveToFront;
+	}
+
+	if (mDragMoved || step.mRaised)
+	{
+		step.mAfter = mCurrent;
+		Push(step, mDragCreated);
+	}
+}
+
+/**
+ * Load the aquarium from a file as a step. Nothing is kept if the
+ * file could not be loaded.
+ * \param filename File to load
+ */
+void CUndoHistory::Load(const std::wstring& filename)
+{
+	EndDrag();
+	Track();
+
+	Step step;
+	step.mKind = Kind::Load;
+	step.mBefore = mCurrent;
+	step.mFromWidth = mAquarium->GetWidth();
+	step.mFromHeight = mAquarium->GetHeight();
+	step.mFromSettings = mAquarium->GetSettings();
+
+	mAquarium->Load(filename);
+
+	// A load that fails leaves the aquarium as it was
+	auto& items = mAquarium->GetItems();
+	if (items.size() == mCurrent.GetSize() && (items.empty() || items.front() == mCurrent.Get(0)) &&
+		mAquarium->GetWidth() == step.mFromWidth && mAquarium->GetHeight() == step.mFromHeight)
+	{
+		return;
+	}
+
+	// Every item is new, so the new version shares nothing
+	long long created = CItemSequence::GetNumCreated();
+	mCurrent = CItemSequence(items);
+	step.mAfter = mCurrent;
+	step.mToWidth = mAquarium->GetWidth();
+	step.mToHeight = mAquarium->GetHeight();
+	step.mToSettings = mAquarium->GetSettings();
+	Push(step, created);
+}
+
+/**
+ * Clear the aquarium as a step.
+ *
+ * The items before are the current version, which already exists,
+ * so this costs no more than any other step.
+ */
+void CUndoHistory::Clear()
+{
+	EndDrag();
+	Track();
+	if (mCurrent.GetSize() == 0)
+	{
+		mAquarium->Clear();
+		return;
+	}
+
+	long long created = CItemSequence::GetNumCreated();
+	Step step;
+	step.mKind = Kind::Clear;
+	step.mBefore = mCurrent;
+
+	mAquarium->Clear();
+	mCurrent = CItemSequence();
+	step.mAfter = mCurrent;
+	Push(step, created);
+}
+
+/**
+ * Does undoing or redoing the next step replace every item of the
+ * aquarium, as undoing or redoing a load or clear does?
+ * \param redo true to ask about Redo, false about Undo
+ * \returns true if the step replaces the items
+ */
+bool CUndoHistory::ReplacesItems(bool redo) const
+{
+	if (redo ? !CanRedo() : !CanUndo())
+	{
+		return false;
+	}
+
+	auto kind = mSteps[redo ? mDone : mDone - 1].mKind;
+	return kind == Kind::Load || kind == Kind::Clear;
+}
+
+/**
+ * Undo the last step done
+ * \returns true if a step was undone
+ */
+bool CUndoHistory::Undo()
+{
+	EndDrag();
+	if (!CanUndo() || !Track())
+	{
+		return false;
+	}
+
+	auto& step = mSteps[mDone - 1];
+	vector<shared_ptr<CItem>> items;
+	switch (step.mKind)
+	{
+	case Kind::Add:
+		mAquarium->Remove(step.mItem);
+		break;
+
+	case Kind::Drag:
+	case Kind::MoveToFront:
+		if (step.mKind == Kind::Drag)
+		{
+			step.mItem->SetLocation(step.mFromX, step.mFromY);
+		}
+
+		if (step.mRaised)
+		{
+			mAquarium->MoveBack(step.mItem, step.mIndex);
+		}
+		else
+		{
+			// Already in front, this only replans its motion
+			mAquarium->MoveToFront(step.mItem);
+		}
+		break;
+
+	case Kind::Load:
+	case Kind::Clear:
+		if (step.mKind == Kind::Load)
+		{
+			mAquarium->SetWorldSize(step.mFromWidth, step.mFromHeight);
+		}
+
+		step.mBefore.ToVector(items);
+		mAquarium->SetItems(items);
+
+		// After the items, as a load sets them
+		if (step.mKind == Kind::Load)
+		{
+			mAquarium->SetSettings(step.mFromSettings);
+		}
+		break;
+	}
+
+	mCurrent = step.mBefore;
+	mDone--;
+	return true;
+}
+
+/**
+ * Redo the last step undone
+ * \returns true if a step was redone
+ */
+bool CUndoHistory::Redo()
+{
+	EndDrag();
+	if (!CanRedo() || !Track())
+	{
+		return false;
+	}
+
+	auto& step = mSteps[mDone];
+	vector<shared_ptr<CItem>> items;
+	switch (step.mKind)
+	{
+	case Kind::Add:
+		mAquarium->Add(step.mItem);
+		break;
+
+	case Kind::Drag:
+	case Kind::MoveToFront:
+		if (step.mKind == Kind::Drag)
+		{
+			step.mItem->SetLocation(step.mToX, step.mToY);
+		}
+
+		mAquarium->MoveToFront(step.mItem);
+		break;
+
+	case Kind::Load:
+	case Kind::Clear:
+		if (step.mKind == Kind::Load)
+		{
+			mAquarium->SetWorldSize(step.mToWidth, step.mToHeight);
+		}
+
+		step.mAfter.ToVector(items);
+		mAquarium->SetItems(items);
+
+		if (step.mKind == Kind::Load)
+		{
+			mAquarium->SetSettings(step.mToSettings);
+		}
+		break;
+	}
+
+	mCurrent = step.mAfter;
+	mDone++;
+	return true;
+}
+
+/**
+ * Forget every step and start over from the items the aquarium
+ * has now. Needed when the items are changed other than through
+ * the history.
+ */
+void CUndoHistory::Reset()
+{
+	mDrag = Step();
+	while (!mSteps.empty())
+	{
+		Drop(false);
+	}
+
+	mDone = 0;
+	mCurrent = CItemSequence(mAquarium->GetItems());
+}
+
+/**
+ * Change the memory cap, dropping the oldest steps until they fit
+ * \param maxBytes Most bytes the steps may take
+ */
+void CUndoHistory::SetMaxBytes(long long maxBytes)
+{
+	mMaxBytes = maxBytes;
+	while (mBytes > mMaxBytes && !mSteps.empty())
+	{
+		Drop(true);
+	}
+}
+
+/**
+ * Get the name of a step
+ * \param step Number of the step, 0 is the oldest
+ * \returns Name for menus and reports
+ */
+std::wstring CUndoHistory::GetStepName(int step) const
+{
+	return StepNames[(int)mSteps[step].mKind];
+}
+
+/**
+ * Get the memory a step added.
+ *
+ * This is the nodes of the item sequences the step made, which it
+ * does not share with the version before it, and the step itself.
+ * \param step Number of the step, 0 is the oldest
+ * \returns Bytes
+ */
+long long CUndoHistory::GetStepBytes(int step) const
+{
+	return mSteps[step].mBytes;
+}
+
+/**
+ * Describe the steps and the memory they take
+ * \returns One line for the history, then one per step, newest first
+ */
+std::wstring CUndoHistory::Report() const
+{
+	wstringstream out;
+	out << L"Undo history: " << mSteps.size() << L" steps, " << mDone << L" done, "
+		<< mBytes << L" of " << mMaxBytes << L" bytes, " << mDropped << L" dropped" << endl;
+
+	for (int step = GetNumSteps() - 1; step >= 0; step--)
+	{
+		out << (step < (int)mDone ? L"  " : L"  (undone) ") << GetStepName(step)
+			<< L": " << GetStepBytes(step) << L" bytes" << endl;
+	}
+
+	return out.str();
+}
+
+/**
+ * Make sure our version of the items matches the aquarium.
+ *
+ * If the aquarium was changed other than through the history, the
+ * steps no longer apply to it, so they are forgotten. Only the number
+ * of items is compared, which catches adds, clears and loads made
+ * directly without walking the items.
+ * \returns false if the history had to be reset
+ */
+bool CUndoHistory::Track()
+{
+	if (mCurrent.GetSize() != (size_t)mAquarium->GetNumItems())
+	{
+		Reset();
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Remember where an item is in the drawing order before it may be
+ * moved to the front
+ * \param step Step that may move it
+ * \param item Item in the aquarium
+ */
+void CUndoHistory::Locate(Step& step, const std::shared_ptr<CItem>& item)
+{
+	auto& items = mAquarium->GetItems();
+	step.mIndex = find(items.begin(), items.end(), item) - items.begin();
+}
+
+/**
+ * Bring our version of the items up to date if the item of a step
+ * was moved to the front since Locate
+ * \param step Step that may have moved it
+ */
+void CUndoHistory::Raised(Step& step)
+{
+	auto& items = mAquarium->GetItems();
+	step.mRaised = step.mIndex + 1 < items.size() && items.back() == step.mItem;
+	if (step.mRaised)
+	{
+		mCurrent = mCurrent.Erase(step.mIndex).PushBack(step.mItem);
+	}
+}
+
+/**
+ * Keep a step as the newest, dropping any undone steps after it and
+ * then the oldest steps until they fit under the memory cap.
+ *
+ * The newest step is always kept, however large it is.
+ * \param step Step to keep
+ * \param created Number of sequence nodes ever made before the step
+ */
+void CUndoHistory::Push(Step& step, long long created)
+{
+	while (mSteps.size() > mDone)
+	{
+		Drop(false);
+	}
+
+	step.mBytes = (CItemSequence::GetNumCreated() - created) * CItemSequence::GetNodeBytes() + sizeof(Step);
+	mSteps.push_back(step);
+	mDone++;
+	mBytes += step.mBytes;
+	CMemoryAccounting::Get().Add(CMemoryAccounting::Journal, HistoryKey, step.mBytes);
+
+	while (mBytes > mMaxBytes && mSteps.size() > 1)
+	{
+		Drop(true);
+	}
+}
+
+/**
+ * Drop a step
+ * \param oldest true to drop the oldest step, false the newest
+ */
+void CUndoHistory::Drop(bool oldest)
+{
+	auto& step = oldest ? mSteps.front() : mSteps.back();
+	mBytes -= step.mBytes;
+	CMemoryAccounting::Get().Remove(CMemoryAccounting::Journal, HistoryKey, step.mBytes);
+
+	if (oldest)
+	{
+		mSteps.pop_front();
+		mDone = mDone > 0 ? mDone - 1 : 0;
+		mDropped++;
+	}
+	else
+	{
+		mSteps.pop_back();
+		mDone = min(mDone, mSteps.size());
+	}
+}
@@ -0,0 +1,161 @@
+/**
+ * \file UndoHistory.h
+ *
+ * \author Grant Youngs
+ *
+ * Class that undoes and redoes edits to an aquarium.
+ */
+
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <string>
+#include "Aquarium.h"
+#include "ItemSequence.h"
+class CItem;
+
+
+/**
+ * Undo and redo history of the edits made to an aquarium.
+ *
+ * Adds, drags, moves to the front, loads and clears are made through
+ * the history, which keeps each version of the aquarium's item list
+ * as a CItemSequence. Versions share every node they have in common,
+ * so a step costs memory and time for only the items it changed: an
+ * add or drag copies O(log n) nodes, a clear none at all. Item
+ * locations are not versioned, so a drag step remembers where the
+ * item was before and after.
+ *
+ * The steps are kept under a memory cap, with the oldest dropped
+ * first. Their memory is accounted under the journal category.
+ */
+class CUndoHistory
+{
+public:
+	/// Memory cap used until SetMaxBytes is called
+	static const long long DefaultMaxBytes = 16 * 1024 * 1024;
+
+	CUndoHistory(CAquarium* aquarium, long long maxBytes = DefaultMaxBytes);
+	virtual ~CUndoHistory();
+
+	/// Default constructor (disabled)
+	CUndoHistory() = delete;
+
+	/// Copy constructor (disabled)
+	CUndoHistory(const CUndoHistory&) = delete;
+
+	void Add(const std::shared_ptr<CItem>& item);
+	void MoveToFront(const std::shared_ptr<CItem>& item);
+	void BeginDrag(const std::shared_ptr<CItem>& item);
+	void DragTo(double x, double y);
+	void EndDrag();
+
+	/// Is an item being dragged?
+	/// \returns true between BeginDrag and EndDrag
+	bool IsDragging() const { return mDrag.mItem != nullptr; }
+
+	void Load(const std::wstring& filename);
+	void Clear();
+
+	bool Undo();
+	bool Redo();
+
+	/// Is there a step to undo?
+	/// \returns true if Undo will do something
+	bool CanUndo() const { return mDone > 0; }
+
+	/// Is there a step to redo?
+	/// \returns true if Redo will do something
+	bool CanRedo() const { return mDone < mSteps.size(); }
+
+	bool ReplacesItems(bool redo) const;
+
+	void Reset();
+
+	void SetMaxBytes(long long maxBytes);
+
+	/// Get the memory cap
+	/// \returns Most bytes the steps may take
+	long long GetMaxBytes() const { return mMaxBytes; }
+
+	/// Get the memory the steps take
+	/// \returns Bytes of every step kept
+	long long GetBytes() const { return mBytes; }
+
+	/// Get the number of steps kept, undone or not
+	/// \returns Number of steps
+	int GetNumSteps() const { return (int)mSteps.size(); }
+
+	/// Get the number of steps dropped to stay under the memory cap
+	/// \returns Number of steps dropped
+	long long GetNumDropped() const { return mDropped; }
+
+	std::wstring GetStepName(int step) const;
+	long long GetStepBytes(int step) const;
+
+	std::wstring Report() const;
+
+private:
+	/** Kinds of steps */
+	enum class Kind { Add, Drag, MoveToFront, Load, Clear };
+
+	/** One edit that can be undone */
+	struct Step
+	{
+		Kind mKind = Kind::Add;         ///< Kind of edit
+		CItemSequence mBefore;          ///< Items before the edit
+		CItemSequence mAfter;           ///< Items after the edit
+		std::shared_ptr<CItem> mItem;   ///< Item added, dragged or moved
+		size_t mIndex = 0;              ///< Index the item had before it moved to the front
+		bool mRaised = false;           ///< True if the item moved to the front
+		double mFromX = 0;              ///< X location before a drag
+		double mFromY = 0;              ///< Y location before a drag
+		double mToX = 0;                ///< X location after a drag
+		double mToY = 0;                ///< Y location after a drag
+		int mFromWidth = 0;             ///< World width before a load
+		int mFromHeight = 0;            ///< World height before a load
+		int mToWidth = 0;               ///< World width after a load
+		int mToHeight = 0;              ///< World height after a load
+		CAquarium::Settings mFromSettings;  ///< Modes and random streams before a load
+		CAquarium::Settings mToSettings;    ///< Modes and random streams after a load
+		long long mBytes = 0;           ///< Memory the step added
+	};
+
+	bool Track();
+	void Locate(Step& step, const std::shared_ptr<CItem>& item);
+	void Raised(Step& step);
+	void Push(Step& step, long long created);
+	void Drop(bool oldest);
+
+	/// Aquarium the edits are made to
+	CAquarium* mAquarium;
+
+	/// Items of the aquarium as they are now
+	CItemSequence mCurrent;
+
+	/// Steps, oldest first
+	std::deque<Step> mSteps;
+
+	/// Number of steps done, the rest were undone and can be redone
+	size_t mDone = 0;
+
+	/// Step being made by a drag, its item is null when not dragging
+	Step mDrag;
+
+	/// Nodes made before the drag started
+	long long mDragCreated = 0;
+
+	/// True once the item being dragged has been moved
+	bool mDragMoved = false;
+
+	/// Most bytes the steps may take
+	long long mMaxBytes;
+
+	/// Bytes the steps take
+	long long mBytes = 0;
+
+	/// Steps dropped to stay under the memory cap
+	long long mDropped = 0;
+};
+
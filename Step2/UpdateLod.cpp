@@ -0,0 +1,153 @@
+/**
+ * \file UpdateLod.cpp
+ *
+ * \author Grant Youngs
+ *
+ * Implements the update level of detail.
+ */
+
+#include "pch.h"
+#include <chrono>
+#include "UpdateLod.h"
+#include "Item.h"
+#include "TraceLog.h"
+
+using namespace std;
+
+/**
+ * Set the region of the world that is drawn
+ * \param left Left edge of the view
+ * \param top Top edge of the view
+ * \param right Right edge of the view
+ * \param bottom Bottom edge of the view
+ */
+void CUpdateLod::SetView(double left, double top, double right, double bottom)
+{
+	mHasView = true;
+	mLeft = left;
+	mTop = top;
+	mRight = right;
+	mBottom = bottom;
+}
+
+/**
+ * Advance the items due this frame.
+ *
+ * Every item is current as of its own sync time. Items current as
+ * of the previous frame are updated by the elapsed time, the same
+ * as a full rate update. Items that waited are fast forwarded by
+ * all the time they missed.
+ * \param items Items of the aquarium
+ * \param previous Aquarium time before this frame
+ * \param elapsed Time of this frame in seconds
+ */
+void CUpdateLod::Update(const std::vector<std::shared_ptr<CItem>>& items, double previous, double elapsed)
+{
+	AQUA_TRACE_SCOPE("UpdateLod");
+	auto start = chrono::steady_clock::now();
+
+	// The same sum the aquarium makes, so it is the same time
+	double time = previous + elapsed;
+	int counts[NumTiers] = {};
+	long long ticks = 0;
+	long long skipped = 0;
+
+	for (auto& item : items)
+	{
+		auto tier = Classify(item.get());
+		counts[tier]++;
+
+		unsigned interval = tier == Visible ? 1 : (tier == Near ? mNearInterval : mFarBatches);
+		if ((item->GetId() + mFrame) % interval != 0)
+		{
+			skipped++;
+			continue;
+		}
+
+		if (item->GetSyncTime() == previous)
+		{
+			item->Update(elapsed);
+			item->SetSyncTime(time);
+		}
+		else
+		{
+			item->SyncTo(time);
+		}
+
+		mTicks[tier]++;
+		ticks++;
+	}
+
+	mFrame++;
+	mFrames++;
+	mSkipped += skipped;
+	for (int tier = 0; tier < NumTiers; tier++)
+	{
+		mItems[tier] = counts[tier];
+	}
+
+	mSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	if (ticks > 0)
+	{
+		mSavedSeconds += mSeconds / ticks * skipped;
+	}
+}
+
+/**
+ * Find how often an item is updated, from where it was last updated
+ * \param item Item to tier
+ * \returns Tier of the item
+ */
+CUpdateLod::Tier CUpdateLod::Classify(const CItem* item) const
+{
+	if (!mHasView)
+	{
+		return Visible;
+	}
+
+	double x = item->GetX();
+	double y = item->GetY();
+	double margin = mGuard;
+	if (x >= mLeft - margin && x <= mRight + margin && y >= mTop - margin && y <= mBottom + margin)
+	{
+		return Visible;
+	}
+
+	margin += mNearMargin;
+	if (x >= mLeft - margin && x <= mRight + margin && y >= mTop - margin && y <= mBottom + margin)
+	{
+		return Near;
+	}
+
+	return Far;
+}
+
+/**
+ * Get the share of item updates skipped
+ * \returns Skipped updates over the updates a full rate update makes, 0 to 1
+ */
+double CUpdateLod::GetSavedFraction() const
+{
+	long long total = mSkipped;
+	for (auto ticks : mTicks)
+	{
+		total += ticks;
+	}
+
+	return total > 0 ? (double)mSkipped / total : 0;
+}
+
+/**
+ * Start the tick, skip and saved time counts over
+ */
+void CUpdateLod::ResetCounts()
+{
+	for (auto& ticks : mTicks)
+	{
+		ticks = 0;
+	}
+
+	mSkipped = 0;
+	mFrames = 0;
+	mSavedSeconds = 0;
+}
@@ -0,0 +1,170 @@
+/**
+ * \file UpdateLod.h
+ *
+ * \author Grant Youngs
+ *
+ * Class that updates items less often the farther they are from the view.
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+class CItem;
+
+
+/**
+ * Update level of detail for stepped aquariums.
+ *
+ * Items are put in tiers by how far they are from the view. Visible
+ * items are updated every frame, exactly as without level of detail.
+ * Items within the near margin of the view are updated every few
+ * frames, and the rest in round robin batches, one batch a frame.
+ * Items are spread over the frames by their id so the work is even.
+ *
+ * An item that is not updated keeps the time its location is valid
+ * at, like an event driven item. When its turn comes it is brought
+ * up to date with FastForward, which gives exact bounces and brings
+ * items outside the walls back in, however long it waited. Items
+ * are tiered by their last location, so the view is widened by a
+ * guard band that items cannot cross between their updates.
+ */
+class CUpdateLod
+{
+public:
+	/** How often an item is updated */
+	enum Tier { Visible, Near, Far, NumTiers };
+
+	/// Pixels around the view whose items are updated every frame
+	static const int DefaultGuard = 128;
+
+	/// Pixels beyond the guard band whose items are near
+	static const int DefaultNearMargin = 1024;
+
+	/// Frames between updates of a near item
+	static const int DefaultNearInterval = 4;
+
+	/// Number of round robin batches of far items
+	static const int DefaultFarBatches = 16;
+
+	CUpdateLod() {}
+
+	/// Copy constructor (disabled)
+	CUpdateLod(const CUpdateLod&) = delete;
+
+	void SetView(double left, double top, double right, double bottom);
+
+	/// Forget the view, so every item is visible
+	void ClearView() { mHasView = false; }
+
+	/// Is there a view to tier the items by?
+	/// \returns true once SetView has been called
+	bool HasView() const { return mHasView; }
+
+	void Update(const std::vector<std::shared_ptr<CItem>>& items, double previous, double elapsed);
+
+	Tier Classify(const CItem* item) const;
+
+	/// Get the width of the guard band around the view
+	/// \returns Pixels
+	double GetGuard() const { return mGuard; }
+
+	/// Set the width of the guard band around the view. It should be
+	/// more than the fastest item swims in a near interval.
+	/// \param guard Pixels
+	void SetGuard(double guard) { mGuard = guard; }
+
+	/// Get the width of the band of near items
+	/// \returns Pixels
+	double GetNearMargin() const { return mNearMargin; }
+
+	/// Set the width of the band of near items outside the guard band
+	/// \param margin Pixels
+	void SetNearMargin(double margin) { mNearMargin = margin; }
+
+	/// Get the frames between updates of a near item
+	/// \returns Frames
+	int GetNearInterval() const { return mNearInterval; }
+
+	/// Set the frames between updates of a near item
+	/// \param frames Frames, at least 1
+	void SetNearInterval(int frames) { mNearInterval = frames > 1 ? frames : 1; }
+
+	/// Get the number of round robin batches of far items
+	/// \returns Batches, so each far item is updated once in this many frames
+	int GetFarBatches() const { return mFarBatches; }
+
+	/// Set the number of round robin batches of far items
+	/// \param batches Batches, at least 1
+	void SetFarBatches(int batches) { mFarBatches = batches > 1 ? batches : 1; }
+
+	/// Get the number of items in a tier in the last update
+	/// \param tier Tier
+	/// \returns Number of items
+	int GetNumItems(Tier tier) const { return mItems[tier]; }
+
+	/// Get the number of item updates made in a tier
+	/// \param tier Tier
+	/// \returns Updates since the counts were reset
+	long long GetNumTicks(Tier tier) const { return mTicks[tier]; }
+
+	/// Get the number of item updates skipped
+	/// \returns Updates a full rate update would have made and we did not
+	long long GetNumSkipped() const { return mSkipped; }
+
+	/// Get the number of updates made
+	/// \returns Frames since the counts were reset
+	long long GetNumFrames() const { return mFrames; }
+
+	double GetSavedFraction() const;
+
+	/// Get the number of the next frame, which picks the items updated
+	/// \returns Frame number
+	unsigned GetFrame() const { return mFrame; }
+
+	/// Set the number of the next frame, to continue a saved tank
+	/// \param frame Frame number
+	void SetFrame(unsigned frame) { mFrame = frame; }
+
+	/// Get the estimated time saved by the skipped item updates
+	/// \returns Seconds, at the average cost of the updates made
+	double GetSavedSeconds() const { return mSavedSeconds; }
+
+	/// Get the time the last update took
+	/// \returns Time in seconds
+	double GetSeconds() const { return mSeconds; }
+
+	void ResetCounts();
+
+private:
+	/// True once there is a view
+	bool mHasView = false;
+
+	double mLeft = 0;       ///< Left edge of the view
+	double mTop = 0;        ///< Top edge of the view
+	double mRight = 0;      ///< Right edge of the view
+	double mBottom = 0;     ///< Bottom edge of the view
+
+	/// Pixels around the view whose items are updated every frame
+	double mGuard = DefaultGuard;
+
+	/// Pixels beyond the guard band whose items are near
+	double mNearMargin = DefaultNearMargin;
+
+	/// Frames between updates of a near item
+	int mNearInterval = DefaultNearInterval;
+
+	/// Number of round robin batches of far items
+	int mFarBatches = DefaultFarBatches;
+
+	/// Number of the next frame, which picks the items updated
+	unsigned mFrame = 0;
+
+	int mItems[NumTiers] = {};          ///< Items in each tier in the last update
+	long long mTicks[NumTiers] = {};    ///< Item updates made in each tier
+	long long mSkipped = 0;             ///< Item updates skipped
+	long long mFrames = 0;              ///< Updates made
+	double mSavedSeconds = 0;           ///< Estimated time the skipped updates would have taken
+	double mSeconds = 0;                ///< Time the last update took
+};
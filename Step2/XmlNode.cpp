@@ -13,11 +13,22 @@
 // in XmlNode.h
 
 #include "pch.h"
+#include <fstream>
 #include "XmlNode.h"
 
 using namespace std;
 using namespace xmlnode;
 
+/**
+ * \brief Bytes a string takes in the document
+ * \param str String to measure
+ * \returns Size in bytes
+ */
+static long long TextSize(const std::wstring &str)
+{
+    return (long long)(str.size() * sizeof(wchar_t));
+}
+
 /** 
  * \brief Constructor
  *
@@ -122,6 +133,21 @@ std::wstring CXmlNode::GetXML()
 }
 
 
+/**
+ * \brief Size of the document text.
+ *
+ * For an opened document this is the size of the file parsed. For
+ * a created document it is the names and values added through this
+ * class, strings as wide characters and numbers as their binary size.
+ * The memory msxml uses to hold the text is not included.
+ * \returns Size in bytes
+ */
+long long CXmlNode::GetDocumentSize() const
+{
+    return mDocument->GetSize();
+}
+
+
 /**
  * \brief The node name.
  * \returns Node name
@@ -308,6 +334,7 @@ void CXmlNode::SetAttribute(const std::wstring &name, const std::wstring &val)
     CComPtr<IXMLDOMElement> element;
     if (mNode.QueryInterface(&element) == S_OK)
     {
+        mDocument->AddSize(TextSize(name) + TextSize(val));
         element->setAttribute(CComBSTR(name.c_str()), CComVariant(val.c_str()));
     }
 }
@@ -322,6 +349,7 @@ void CXmlNode::SetAttribute(const std::wstring &name, int val)
     CComPtr<IXMLDOMElement> element;
     if (mNode.QueryInterface(&element) == S_OK)
     {
+        mDocument->AddSize(TextSize(name) + (long long)sizeof(val));
         element->setAttribute(CComBSTR(name.c_str()), CComVariant(val));
     }
 }
@@ -336,6 +364,7 @@ void CXmlNode::SetAttribute(const std::wstring &name, double val)
     CComPtr<IXMLDOMElement> element;
     if (mNode.QueryInterface(&element) == S_OK)
     {
+        mDocument->AddSize(TextSize(name) + (long long)sizeof(val));
         element->setAttribute(CComBSTR(name.c_str()), CComVariant(val));
     }
 }
@@ -352,6 +381,7 @@ std::shared_ptr<CXmlNode> CXmlNode::AddChild(const std::wstring &name)
     CComPtr<IXMLDOMElement> element;
     mDocument->GetDoc()->createElement(CComBSTR(name.c_str()), &element);
     mNode->appendChild(element, &node);
+    mDocument->AddSize(TextSize(name));
 
     return shared_ptr<CXmlNode>(new CXmlNode(this, node));
 }
@@ -514,6 +544,9 @@ void CXmlNode::Document::Open(const std::wstring &filename)
         throw Exception(Exception::NoRoot, err);
     }
 
+    // The text parsed is the whole file
+    ifstream file(filename, ios::binary | ios::ate);
+    mSize = file ? (long long)file.tellg() : 0;
 }
 
 /** \brief Create a new, empty document.
@@ -541,6 +574,7 @@ void CXmlNode::Document::Create(const std::wstring &rootname)
     CComPtr<IXMLDOMElement> pe;
     mDoc->createElement(CComBSTR(rootname.c_str()), &pe);
     mDoc->appendChild(pe, &mRoot);
+    mSize = TextSize(rootname);
 }
 
 
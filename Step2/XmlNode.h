@@ -49,6 +49,7 @@ namespace xmlnode
 
         void Save(const std::wstring &filename);
         std::wstring GetXML();
+        long long GetDocumentSize() const;
 
         /*
          * Node name, type, and value
@@ -234,9 +235,18 @@ namespace xmlnode
              * \returns Pointer to underlying document */
             IXMLDOMDocument *GetDoc() { return mDoc; }
 
+            /** \brief Count text added to the document
+             * \param bytes Bytes added */
+            void AddSize(long long bytes) { mSize += bytes; }
+
+            /** \brief Get the size of the document text
+             * \returns Size in bytes */
+            long long GetSize() const { return mSize; }
+
         private:
             CComPtr<IXMLDOMDocument>  mDoc; ///< Underlying msxml document
             CComPtr<IXMLDOMNode> mRoot;     ///< Document root node
+            long long mSize = 0;            ///< Bytes of text parsed or added
         };
 
         // The open document
@@ -15,13 +15,27 @@
 #define ID_Menu                         32777
 #define ID_FILE_SAVEAS                  32778
 #define ID_FILE_OPEN32779               32779
+#define ID_VIEW_FRAMEPROFILER           32780
+#define ID_FILE_EXPORTPROFILE           32781
+#define ID_FILE_SAVETRACE               32782
+#define ID_VIEW_MEMORYUSAGE             32783
+#define ID_FILE_RECORDSESSION           32784
+#define ID_FILE_REPLAYSESSION           32785
+#define ID_VIEW_EVENTDRIVENMOTION       32786
+#define ID_VIEW_RESETCAMERA             32787
+#define ID_VIEW_SCHOOLING               32788
+#define ID_VIEW_FISHCOLLISIONS          32789
+#define ID_FILE_RECORDTRAJECTORIES      32790
+#define ID_FILE_OPENTILEDTANK           32791
+#define ID_FILE_SAVETILEDTANK           32792
+#define ID_VIEW_UPDATELOD               32793
 
 // Next default values for new objects
 // 
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        310
-#define _APS_NEXT_COMMAND_VALUE         32780
+#define _APS_NEXT_COMMAND_VALUE         32794
 #define _APS_NEXT_CONTROL_VALUE         1000
 #define _APS_NEXT_SYMED_VALUE           310
 #endif
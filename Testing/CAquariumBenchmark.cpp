@@ -0,0 +1,464 @@
+#include "pch.h"
+#include <memory>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <regex>
+#include <map>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include "CppUnitTest.h"
+#include "Aquarium.h"
+#include "FishBeta.h"
+#include "Magikarp.h"
+#include "Buddha.h"
+#include "DecorCastle.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace std;
+
+namespace Testing
+{
+	/// Number of times each measurement is repeated
+	const int BenchmarkRepetitions = 7;
+
+	/// Relative slowdown against the baseline that counts as a regression
+	const double RegressionThreshold = 0.10;
+
+	/// Largest tank we benchmark
+	const int MaxBenchmarkItems = 1000000;
+
+	/// Number of random points each HitTest repetition queries
+	const int HitTestQueries = 1000;
+
+	/// File name of the baseline results in the test data directory
+	const wstring BaselineName = L"benchmark-baseline.json";
+
+	/** Spatial distributions of the items in a benchmark tank */
+	enum class Distribution { Uniform, Clustered, Stacked };
+
+	/** The result of one benchmark measurement */
+	struct BenchmarkResult
+	{
+		string mName;            ///< Operation/distribution/count
+		int mItems = 0;          ///< Number of items in the tank
+		string mUnit = "item";   ///< What the times are per, an item, a query or a call
+		double mNsPerItem = 0;   ///< Mean nanoseconds per unit
+		double mItemsPerSec = 0; ///< Mean units processed per second
+		double mVariance = 0;    ///< Variance of ns/unit over the repetitions
+	};
+
+	TEST_CLASS(CAquariumBenchmark)
+	{
+	public:
+
+		/**
+		* Create a path to a place to put temporary files
+		*/
+		wstring TempPath()
+		{
+			wchar_t path_nts[MAX_PATH];
+			GetTempPath(MAX_PATH, path_nts);
+			return wstring(path_nts);
+		}
+
+		/**
+		 * Name of a distribution for the result names
+		 * \param dist Distribution
+		 * \returns Name string
+		 */
+		static string DistributionName(Distribution dist)
+		{
+			switch (dist)
+			{
+			case Distribution::Uniform:
+				return "uniform";
+			case Distribution::Clustered:
+				return "clustered";
+			default:
+				return "stacked";
+			}
+		}
+
+		/**
+		 * Populate an aquarium with a mix of every item type.
+		 * \param aquarium Aquarium to populate
+		 * \param count Number of items to add
+		 * \param dist Spatial distribution of the items
+		 */
+		static void Populate(CAquarium* aquarium, int count, Distribution dist)
+		{
+			mt19937 random(count);
+			uniform_real_distribution<double> x(0, aquarium->GetWidth());
+			uniform_real_distribution<double> y(0, aquarium->GetHeight());
+			normal_distribution<double> spread(0, 40);
+
+			// Cluster centers for the clustered distribution
+			vector<pair<double, double>> centers;
+			for (int c = 0; c < 8; c++)
+			{
+				centers.push_back(make_pair(x(random), y(random)));
+			}
+
+			for (int i = 0; i < count; i++)
+			{
+				shared_ptr<CItem> item;
+				switch (i % 4)
+				{
+				case 0:
+					item = make_shared<CFishBeta>(aquarium);
+					break;
+				case 1:
+					item = make_shared<CMagikarp>(aquarium);
+					break;
+				case 2:
+					item = make_shared<CBuddha>(aquarium);
+					break;
+				default:
+					item = make_shared<CDecorCastle>(aquarium);
+					break;
+				}
+
+				switch (dist)
+				{
+				case Distribution::Uniform:
+					item->SetLocation(x(random), y(random));
+					break;
+
+				case Distribution::Clustered:
+				{
+					auto& center = centers[i % centers.size()];
+					item->SetLocation(center.first + spread(random), center.second + spread(random));
+					break;
+				}
+
+				case Distribution::Stacked:
+					item->SetLocation(aquarium->GetWidth() / 2, aquarium->GetHeight() / 2);
+					break;
+				}
+
+				aquarium->Add(item);
+			}
+		}
+
+		/**
+		 * Time an operation over several repetitions.
+		 * \param name Result name
+		 * \param items Number of items each repetition processes
+		 * \param operation Operation to time
+		 * \returns Benchmark result
+		 */
+		template <typename Operation>
+		static BenchmarkResult Measure(const string& name, int items, Operation operation)
+		{
+			return Measure(name, items, []() {}, operation);
+		}
+
+		/**
+		 * Time an operation over several repetitions, each from the
+		 * same starting state.
+		 * \param name Result name
+		 * \param items Number of items each repetition processes
+		 * \param setup Untimed setup run before each repetition
+		 * \param operation Operation to time
+		 * \returns Benchmark result
+		 */
+		template <typename Setup, typename Operation>
+		static BenchmarkResult Measure(const string& name, int items, Setup setup, Operation operation)
+		{
+			vector<double> samples;
+			for (int r = 0; r < BenchmarkRepetitions; r++)
+			{
+				setup();
+
+				auto start = chrono::steady_clock::now();
+				operation();
+				auto end = chrono::steady_clock::now();
+
+				double ns = double(chrono::duration_cast<chrono::nanoseconds>(end - start).count());
+				samples.push_back(ns / items);
+			}
+
+			double mean = 0;
+			for (auto s : samples)
+			{
+				mean += s;
+			}
+			mean /= samples.size();
+
+			double variance = 0;
+			for (auto s : samples)
+			{
+				variance += (s - mean) * (s - mean);
+			}
+			variance /= samples.size();
+
+			BenchmarkResult result;
+			result.mName = name;
+			result.mItems = items;
+			result.mNsPerItem = mean;
+			result.mItemsPerSec = mean > 0 ? 1e9 / mean : 0;
+			result.mVariance = variance;
+			return result;
+		}
+
+		/**
+		 * Write results as JSON, one result object per line.
+		 * \param filename File to write
+		 * \param results Results to write
+		 */
+		static void SaveResults(const wstring& filename, const vector<BenchmarkResult>& results)
+		{
+			ofstream out(filename);
+			out << "[" << endl;
+			for (size_t i = 0; i < results.size(); i++)
+			{
+				auto& r = results[i];
+				out << "{\"name\": \"" << r.mName << "\", \"items\": " << r.mItems
+					<< ", \"unit\": \"" << r.mUnit << "\""
+					<< ", \"ns_per_item\": " << r.mNsPerItem
+					<< ", \"items_per_sec\": " << r.mItemsPerSec
+					<< ", \"variance\": " << r.mVariance << "}"
+					<< (i + 1 < results.size() ? "," : "") << endl;
+			}
+			out << "]" << endl;
+		}
+
+		/**
+		 * Load the ns/item values from a results file written by SaveResults.
+		 * \param filename File to read
+		 * \returns Map from result name to ns/item, empty if there is no file
+		 */
+		static map<string, double> LoadResults(const wstring& filename)
+		{
+			map<string, double> results;
+			ifstream in(filename);
+			regex line("\"name\": \"([^\"]*)\".*\"ns_per_item\": ([-+.eE0-9]+)");
+
+			string text;
+			while (getline(in, text))
+			{
+				smatch match;
+				if (regex_search(text, match, line))
+				{
+					results[match[1]] = stod(match[2]);
+				}
+			}
+
+			return results;
+		}
+
+		/**
+		 * Compare results against the baseline and fail on regressions.
+		 * \param results Results of this run
+		 */
+		void CompareToBaseline(const vector<BenchmarkResult>& results)
+		{
+			auto baseline = LoadResults(BaselineName);
+			if (baseline.empty())
+			{
+				Logger::WriteMessage(L"No benchmark baseline, skipping comparison");
+				return;
+			}
+
+			wstringstream regressions;
+			for (auto& r : results)
+			{
+				auto b = baseline.find(r.mName);
+				if (b != baseline.end() && b->second > 0 &&
+					r.mNsPerItem > b->second * (1 + RegressionThreshold))
+				{
+					regressions << wstring(r.mName.begin(), r.mName.end()) << L": "
+						<< b->second << L" -> " << r.mNsPerItem << L" ns/"
+						<< wstring(r.mUnit.begin(), r.mUnit.end()) << endl;
+				}
+			}
+
+			if (!regressions.str().empty())
+			{
+				Logger::WriteMessage(regressions.str().c_str());
+				Assert::Fail(L"Benchmark regressions against the baseline");
+			}
+		}
+
+		TEST_METHOD_INITIALIZE(methodName)
+		{
+			extern wchar_t g_dir[];
+			::SetCurrentDirectory(g_dir);
+		}
+
+		/**
+		 * Are benchmarks to be run?
+		 * \returns true if AQUARIUM_BENCHMARKS is set
+		 */
+		static bool Enabled()
+		{
+			extern bool g_benchmarks;
+			if (!g_benchmarks)
+			{
+				Logger::WriteMessage(L"Set AQUARIUM_BENCHMARKS to run the benchmarks");
+			}
+			return g_benchmarks;
+		}
+
+		BEGIN_TEST_METHOD_ATTRIBUTE(BenchmarkCAquariumHotPaths)
+			TEST_METHOD_ATTRIBUTE(L"Category", L"Benchmark")
+		END_TEST_METHOD_ATTRIBUTE()
+
+		TEST_METHOD(BenchmarkCAquariumHotPaths)
+		{
+			if (!Enabled())
+			{
+				return;
+			}
+
+			vector<BenchmarkResult> results;
+
+			for (auto dist : { Distribution::Uniform, Distribution::Clustered, Distribution::Stacked })
+			{
+				for (int count = 10; count <= MaxBenchmarkItems; count *= 10)
+				{
+					// Operations that change the tank start each
+					// repetition from a tank rebuilt from the seed
+					unique_ptr<CAquarium> aquarium;
+					auto rebuild = [&aquarium, count, dist]() {
+						aquarium = make_unique<CAquarium>();
+						Populate(aquarium.get(), count, dist);
+					};
+					rebuild();
+
+					string suffix = "/" + DistributionName(dist) + "/" + to_string(count);
+					int w = aquarium->GetWidth();
+					int h = aquarium->GetHeight();
+
+					mt19937 random(count);
+					uniform_int_distribution<int> px(0, w);
+					uniform_int_distribution<int> py(0, h);
+
+					results.push_back(Measure("Update" + suffix, count, rebuild, [&aquarium]() {
+						aquarium->Update(0.03);
+					}));
+
+					results.push_back(Measure("Nudge" + suffix, count, rebuild, [&aquarium, w, h]() {
+						aquarium->Nudge(w / 2.0, h / 2.0);
+					}));
+
+					// HitTest is a grid query, so it is timed per query
+					results.push_back(Measure("HitTest" + suffix, HitTestQueries, [&]() {
+						for (int q = 0; q < HitTestQueries; q++)
+						{
+							aquarium->HitTest(px(random), py(random));
+						}
+					}));
+					results.back().mItems = count;
+					results.back().mUnit = "query";
+
+					// Two items at the same spot so the test always walks the list
+					auto bottom = make_shared<CFishBeta>(aquarium.get());
+					auto top = make_shared<CFishBeta>(aquarium.get());
+					bottom->SetLocation(w / 2.0, h / 2.0);
+					top->SetLocation(w / 2.0, h / 2.0);
+					aquarium->Add(bottom);
+					aquarium->Add(top);
+
+					// Only the two items are tested, so it is timed per call
+					results.push_back(Measure("TopImageHitTest" + suffix, 1, [&]() {
+						aquarium->TopImageHitTest(bottom, top, w / 2, h / 2);
+					}));
+					results.back().mItems = count;
+					results.back().mUnit = "call";
+
+					results.push_back(Measure("MoveToFront" + suffix, count, [&]() {
+						aquarium->MoveToFront(bottom);
+						aquarium->MoveToFront(top);
+					}));
+
+					// UpdatePosition is timed on its own items outside the aquarium
+					CAquarium scratch;
+					vector<shared_ptr<CItem>> items;
+					for (int i = 0; i < count; i++)
+					{
+						auto item = make_shared<CFishBeta>(&scratch);
+						item->SetLocation(px(random), py(random));
+						items.push_back(item);
+					}
+
+					results.push_back(Measure("UpdatePosition" + suffix, count, [&]() {
+						for (auto& item : items)
+						{
+							item->UpdatePosition(w / 2.0, h / 2.0);
+						}
+					}));
+				}
+			}
+
+			wstring filename = TempPath() + L"aquarium-benchmark.json";
+			SaveResults(filename, results);
+			Logger::WriteMessage(filename.c_str());
+
+			CompareToBaseline(results);
+		}
+
+		BEGIN_TEST_METHOD_ATTRIBUTE(BenchmarkCAquariumParallelScaling)
+			TEST_METHOD_ATTRIBUTE(L"Category", L"Benchmark")
+		END_TEST_METHOD_ATTRIBUTE()
+
+		TEST_METHOD(BenchmarkCAquariumParallelScaling)
+		{
+			if (!Enabled())
+			{
+				return;
+			}
+
+			wstringstream str;
+			str << L"Parallel scaling, " << MaxBenchmarkItems << L" items, ms a frame:" << endl;
+
+			for (auto dist : { Distribution::Uniform, Distribution::Clustered, Distribution::Stacked })
+			{
+				uint64_t serialUpdateHash = 0, serialNudgeHash = 0;
+				double serialUpdate = 0, serialNudge = 0;
+				for (int threads : { 1, 2, 4, 8, 16, 32, 64 })
+				{
+					unique_ptr<CAquarium> aquarium;
+					auto rebuild = [&aquarium, threads, dist]() {
+						aquarium = make_unique<CAquarium>();
+						aquarium->SetThreads(threads);
+						Populate(aquarium.get(), MaxBenchmarkItems, dist);
+					};
+					rebuild();
+					int w = aquarium->GetWidth();
+					int h = aquarium->GetHeight();
+
+					auto update = Measure("Update", 1, rebuild, [&aquarium]() {
+						aquarium->Update(0.03);
+					});
+					uint64_t updateHash = aquarium->GetStateHash();
+
+					auto nudge = Measure("Nudge", 1, rebuild, [&aquarium, w, h]() {
+						aquarium->Nudge(w / 2.0, h / 2.0);
+					});
+
+					// Every thread count ends in exactly the same tank
+					uint64_t nudgeHash = aquarium->GetStateHash();
+					if (threads == 1)
+					{
+						serialUpdateHash = updateHash;
+						serialNudgeHash = nudgeHash;
+						serialUpdate = update.mNsPerItem;
+						serialNudge = nudge.mNsPerItem;
+					}
+					Assert::AreEqual(serialUpdateHash, updateHash);
+					Assert::AreEqual(serialNudgeHash, nudgeHash);
+
+					str << DistributionName(dist).c_str() << L" " << threads << L" threads: update "
+						<< update.mNsPerItem / 1e6 << L" (" << serialUpdate / update.mNsPerItem << L"x), nudge "
+						<< nudge.mNsPerItem / 1e6 << L" (" << serialNudge / nudge.mNsPerItem << L"x)" << endl;
+				}
+			}
+
+			Logger::WriteMessage(str.str().c_str());
+		}
+	};
+}
@@ -0,0 +1,320 @@
+#include "pch.h"
+#include <memory>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <Psapi.h>
+#include "CppUnitTest.h"
+#include "Aquarium.h"
+#include "SceneGenerator.h"
+#include "TiledTank.h"
+
+#pragma comment(lib, "Psapi.lib")
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace std;
+
+namespace Testing
+{
+	/// Number of warm repetitions of each measurement
+	const int PersistenceRepetitions = 3;
+
+	/// Sizes of the generated tanks. Loaded items of a type share
+	/// one decoded sprite, so the largest is bounded by time.
+	const int PersistenceCounts[] = { 1000, 10000, 100000, 1000000, 2000000 };
+
+	/// Tanks larger than this are timed warm only once
+	const int MaxRepeatedItems = 100000;
+
+	/// Number of heap allocations seen by the allocation hook
+	static long gAllocationCount = 0;
+
+#ifdef _DEBUG
+	/**
+	 * Debug CRT allocation hook that counts allocations
+	 * \returns TRUE to allow the allocation
+	 */
+	static int CountAllocations(int allocType, void*, size_t, int, long, const unsigned char*, int)
+	{
+		if (allocType == _HOOK_ALLOC || allocType == _HOOK_REALLOC)
+		{
+			gAllocationCount++;
+		}
+		return TRUE;
+	}
+#endif
+
+	/** The result of one persistence measurement */
+	struct PersistenceResult
+	{
+		string mName;            ///< Operation/fixture/cache state
+		int mItems = 0;          ///< Number of items saved or loaded
+		double mBytes = 0;       ///< File size in bytes
+		double mSeconds = 0;     ///< Mean wall clock time
+		double mPeakRss = 0;     ///< Peak working set in bytes after the run
+		long mAllocations = -1;  ///< Allocations per run, -1 in release builds
+	};
+
+	TEST_CLASS(CAquariumPersistenceBenchmark)
+	{
+	public:
+
+		/**
+		* Create a path to a place to put temporary files
+		*/
+		wstring TempPath()
+		{
+			wchar_t path_nts[MAX_PATH];
+			GetTempPath(MAX_PATH, path_nts);
+			return wstring(path_nts);
+		}
+
+		/**
+		 * Size of a file in bytes
+		 * \param filename File to test
+		 * \returns Size in bytes, 0 if it does not exist
+		 */
+		static double FileSize(const wstring& filename)
+		{
+			ifstream in(filename, ios::binary | ios::ate);
+			return in ? double(in.tellg()) : 0;
+		}
+
+		/**
+		 * Peak working set of this process
+		 * \returns Peak resident bytes
+		 */
+		static double PeakRss()
+		{
+			PROCESS_MEMORY_COUNTERS counters;
+			if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+			{
+				return double(counters.PeakWorkingSetSize);
+			}
+			return 0;
+		}
+
+		/**
+		 * Time one persistence operation.
+		 * \param name Result name
+		 * \param items Number of items the operation handles
+		 * \param filename File the operation reads or writes
+		 * \param repetitions Number of times to run the operation
+		 * \param operation Operation to time
+		 * \returns Persistence result
+		 */
+		template <typename Operation>
+		static PersistenceResult Measure(const string& name, int items, const wstring& filename,
+			int repetitions, Operation operation)
+		{
+			gAllocationCount = 0;
+#ifdef _DEBUG
+			auto oldHook = _CrtSetAllocHook(CountAllocations);
+#endif
+
+			auto start = chrono::steady_clock::now();
+			for (int r = 0; r < repetitions; r++)
+			{
+				operation();
+			}
+			auto end = chrono::steady_clock::now();
+
+			PersistenceResult result;
+#ifdef _DEBUG
+			_CrtSetAllocHook(oldHook);
+			result.mAllocations = gAllocationCount / repetitions;
+#endif
+
+			result.mName = name;
+			result.mItems = items;
+			result.mBytes = FileSize(filename);
+			result.mSeconds = chrono::duration<double>(end - start).count() / repetitions;
+			result.mPeakRss = PeakRss();
+			return result;
+		}
+
+		/**
+		 * Write results as JSON, one result object per line.
+		 * \param filename File to write
+		 * \param results Results to write
+		 */
+		static void SaveResults(const wstring& filename, const vector<PersistenceResult>& results)
+		{
+			ofstream out(filename);
+			out << "[" << endl;
+			for (size_t i = 0; i < results.size(); i++)
+			{
+				auto& r = results[i];
+				double seconds = r.mSeconds > 0 ? r.mSeconds : 1e-9;
+				out << "{\"name\": \"" << r.mName << "\", \"items\": " << r.mItems
+					<< ", \"bytes\": " << r.mBytes
+					<< ", \"mb_per_sec\": " << r.mBytes / seconds / (1024 * 1024)
+					<< ", \"items_per_sec\": " << r.mItems / seconds
+					<< ", \"peak_rss\": " << r.mPeakRss
+					<< ", \"allocations\": " << r.mAllocations << "}"
+					<< (i + 1 < results.size() ? "," : "") << endl;
+			}
+			out << "]" << endl;
+		}
+
+		/**
+		 * Check that a saved file loads back to the same aquarium
+		 * \param aquarium Aquarium that was saved
+		 * \param filename File it was saved to
+		 */
+		static void CheckRoundTrip(CAquarium& aquarium, const wstring& filename)
+		{
+			CAquarium loaded;
+			loaded.Load(filename);
+			Assert::AreEqual(aquarium.GetNumItems(), loaded.GetNumItems());
+			Assert::IsTrue(aquarium.GetStateHash() == loaded.GetStateHash());
+		}
+
+		/**
+		 * Measure loading and saving one file, cold first and then warm.
+		 *
+		 * The first load after the file is written is reported as cold.
+		 * Windows gives us no unprivileged way to drop the file cache, so
+		 * cold here means the first touch by the parser, not a disk read.
+		 * \param name Fixture name
+		 * \param filename File to load
+		 * \param results Results to append to
+		 */
+		void MeasureFile(const string& name, const wstring& filename, vector<PersistenceResult>& results)
+		{
+			CAquarium aquarium;
+			results.push_back(Measure("Load/" + name + "/cold", 0, filename, 1, [&]() {
+				aquarium.Load(filename);
+			}));
+			results.back().mItems = aquarium.GetNumItems();
+			Assert::IsTrue(aquarium.GetNumItems() > 0);
+			uint64_t hash = aquarium.GetStateHash();
+
+			results.push_back(Measure("Load/" + name + "/warm", aquarium.GetNumItems(), filename,
+				PersistenceRepetitions, [&]() {
+				aquarium.Load(filename);
+			}));
+			Assert::IsTrue(hash == aquarium.GetStateHash());
+
+			wstring copy = TempPath() + L"persistence-copy.aqua";
+			results.push_back(Measure("Save/" + name, aquarium.GetNumItems(), copy,
+				PersistenceRepetitions, [&]() {
+				aquarium.Save(copy);
+			}));
+			CheckRoundTrip(aquarium, copy);
+		}
+
+		/**
+		 * Measure writing and streaming in a tiled tank of the items of an aquarium.
+		 *
+		 * Loading opens the file and streams in every tile around a
+		 * view of the whole world. Closing writes every tile back.
+		 * \param aquarium Aquarium to write
+		 * \param suffix Result name suffix
+		 * \param results Results to append to
+		 */
+		void MeasureTiled(CAquarium& aquarium, const string& suffix, vector<PersistenceResult>& results)
+		{
+			wstring filename = TempPath() + L"persistence-tiled.aqtl";
+			int count = aquarium.GetNumItems();
+			results.push_back(Measure("Save" + suffix + "/aqtl", count, filename, 1, [&]() {
+				Assert::IsTrue(CTiledTank::Write(&aquarium, filename));
+			}));
+
+			CAquarium streamed;
+			CTiledTank tank;
+			for (auto state : { "/cold", "/warm" })
+			{
+				results.push_back(Measure("Load" + suffix + "/aqtl" + state, count, filename, 1, [&]() {
+					Assert::IsTrue(tank.Open(filename, &streamed));
+					tank.SetView(0, 0, aquarium.GetWidth(), aquarium.GetHeight());
+					tank.Wait();
+				}));
+				Assert::AreEqual(count, streamed.GetNumItems());
+
+				results.push_back(Measure("Close" + suffix + "/aqtl" + state, count, filename, 1, [&]() {
+					Assert::IsTrue(tank.Close());
+				}));
+			}
+		}
+
+		/**
+		 * Determine if the benchmarks should run. They take minutes, so
+		 * they only run when AQUARIUM_BENCHMARKS is set.
+		 * \returns True if the benchmarks are enabled
+		 */
+		static bool Enabled()
+		{
+			extern bool g_benchmarks;
+			if (!g_benchmarks)
+			{
+				Logger::WriteMessage(L"Set AQUARIUM_BENCHMARKS to run the benchmarks");
+			}
+			return g_benchmarks;
+		}
+
+		TEST_METHOD_INITIALIZE(methodName)
+		{
+			extern wchar_t g_dir[];
+			::SetCurrentDirectory(g_dir);
+		}
+
+		BEGIN_TEST_METHOD_ATTRIBUTE(BenchmarkCAquariumPersistence)
+			TEST_METHOD_ATTRIBUTE(L"Category", L"Benchmark")
+		END_TEST_METHOD_ATTRIBUTE()
+
+		TEST_METHOD(BenchmarkCAquariumPersistence)
+		{
+			if (!Enabled())
+			{
+				return;
+			}
+
+			vector<PersistenceResult> results;
+
+			// Small fixtures already in the repository
+			MeasureFile("GrantTest", L"GrantTest.aqua", results);
+			MeasureFile("Test", L"Test.aqua", results);
+			MeasureFile("y", L"y.aqua", results);
+
+			// Generated tanks
+			for (int count : PersistenceCounts)
+			{
+				wstring filename = TempPath() + L"persistence-" + to_wstring(count) + L".aqua";
+				string suffix = "/generated/" + to_string(count);
+				int repetitions = count > MaxRepeatedItems ? 1 : PersistenceRepetitions;
+
+				CAquarium aquarium;
+				CSceneGenerator generator(aquarium.GetWidth(), aquarium.GetHeight());
+				generator.SetCount(count);
+				generator.Generate(filename);
+
+				results.push_back(Measure("Load" + suffix + "/cold", count, filename, 1, [&]() {
+					aquarium.Load(filename);
+				}));
+				Assert::AreEqual(count, aquarium.GetNumItems());
+				uint64_t hash = aquarium.GetStateHash();
+
+				results.push_back(Measure("Load" + suffix + "/warm", count, filename, repetitions, [&]() {
+					aquarium.Load(filename);
+				}));
+				Assert::AreEqual(count, aquarium.GetNumItems());
+				Assert::IsTrue(hash == aquarium.GetStateHash());
+
+				// The saved file must load back to the same items
+				results.push_back(Measure("Save" + suffix, count, filename, repetitions, [&]() {
+					aquarium.Save(filename);
+				}));
+				CheckRoundTrip(aquarium, filename);
+
+				MeasureTiled(aquarium, suffix, results);
+			}
+
+			wstring filename = TempPath() + L"aquarium-persistence.json";
+			SaveResults(filename, results);
+			Logger::WriteMessage(filename.c_str());
+		}
+	};
+}
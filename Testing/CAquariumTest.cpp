@@ -58,7 +58,7 @@ namespace Testing
 			Logger::WriteMessage(xml.c_str());
 
 			Assert::IsTrue(regex_search(xml, wregex(L"<\\?xml.*\\?>")));
-			Assert::IsTrue(regex_search(xml, wregex(L"<aqua/>")));
+			Assert::IsTrue(regex_search(xml, wregex(L"<aqua( [^>]*)?/>")));
 		}
 
 		/**
@@ -87,7 +87,7 @@ namespace Testing
 			Logger::WriteMessage(xml.c_str());
 
 			// Ensure three items
-			Assert::IsTrue(regex_search(xml, wregex(L"<aqua><item.*<item.*<item.*</aqua>")));
+			Assert::IsTrue(regex_search(xml, wregex(L"<aqua( [^>]*)?><item.*<item.*<item.*</aqua>")));
 
 			// Ensure the positions are correct
 			Assert::IsTrue(regex_search(xml, wregex(L"<item x=\"100\" y=\"200\"")));
@@ -96,7 +96,7 @@ namespace Testing
 
 			// Ensure the types are correct
 			Assert::IsTrue(regex_search(xml,
-				wregex(L"<aqua><item.* type=\"beta\"/><item.* type=\"beta\"/><item.* type=\"beta\"/></aqua>")));
+				wregex(L"<aqua( [^>]*)?><item.* type=\"beta\"/><item.* type=\"beta\"/><item.* type=\"beta\"/></aqua>")));
 		}
 
 		void PopulateAllTypes(CAquarium *aquarium)
@@ -126,7 +126,7 @@ namespace Testing
 			Logger::WriteMessage(xml.c_str());
 
 			// Ensure four items
-			Assert::IsTrue(regex_search(xml, wregex(L"<aqua><item.*<item.*<item.*<item.*</aqua>")));
+			Assert::IsTrue(regex_search(xml, wregex(L"<aqua( [^>]*)?><item.*<item.*<item.*<item.*</aqua>")));
 
 			// Ensure the positions are correct
 			Assert::IsTrue(regex_search(xml, wregex(L"<item x=\"100\" y=\"200\"")));
@@ -136,7 +136,7 @@ namespace Testing
 
 			// Ensure the types are correct
 			Assert::IsTrue(regex_search(xml,
-				wregex(L"<aqua><item.* type=\"beta\"/><item.* type=\"buddha\"/><item.* type=\"magikarp\"/><item.* type=\"castle\"/></aqua>")));
+				wregex(L"<aqua( [^>]*)?><item.* type=\"beta\"/><item.* type=\"buddha\"/><item.* type=\"magikarp\"/><item.* type=\"castle\"/></aqua>")));
 		}
 
 		TEST_METHOD_INITIALIZE(methodName)
@@ -303,5 +303,145 @@ namespace Testing
 			aquarium2.Save(file3);
 			TestAllTypes(file3);
 		}
+
+		TEST_METHOD(TestCAquariumEventDriven)
+		{
+			CAquarium stepped, driven;
+			stepped.SetSeed(11);
+			driven.SetSeed(11);
+			driven.SetEventDriven(true);
+			Assert::IsTrue(driven.IsEventDriven());
+
+			vector<shared_ptr<CItem>> steppedFish, drivenFish;
+			for (int i = 0; i < 20; i++)
+			{
+				for (auto aquarium : { &stepped, &driven })
+				{
+					auto fish = aquarium->CreateItem(i % 2 ? L"magikarp" : L"buddha");
+					fish->SetLocation(100 + i * 30, 100 + i * 20);
+					aquarium->Add(fish);
+					(aquarium == &stepped ? steppedFish : drivenFish).push_back(fish);
+				}
+			}
+
+			// Event driven frames only touch fish at bounces, but end
+			// in the same place as jumping straight there
+			for (int i = 0; i < 3000; i++)
+			{
+				driven.Update(0.02);
+			}
+			stepped.FastForward(60);
+			driven.Synchronize();
+
+			Assert::AreEqual(stepped.GetTime(), driven.GetTime(), 0.000001);
+			for (size_t i = 0; i < steppedFish.size(); i++)
+			{
+				Assert::AreEqual(steppedFish[i]->GetX(), drivenFish[i]->GetX(), 0.001);
+				Assert::AreEqual(steppedFish[i]->GetY(), drivenFish[i]->GetY(), 0.001);
+			}
+		}
+
+		TEST_METHOD(TestCAquariumEventDrivenFastForward)
+		{
+			CAquarium stepped, driven;
+			stepped.SetSeed(11);
+			driven.SetSeed(11);
+			driven.SetEventDriven(true);
+
+			vector<shared_ptr<CItem>> steppedFish, drivenFish;
+			for (int i = 0; i < 20; i++)
+			{
+				for (auto aquarium : { &stepped, &driven })
+				{
+					auto fish = aquarium->CreateItem(i % 2 ? L"magikarp" : L"beta");
+					fish->SetLocation(100 + i * 30, 100 + i * 20);
+					aquarium->Add(fish);
+					(aquarium == &stepped ? steppedFish : drivenFish).push_back(fish);
+				}
+			}
+
+			// Jumps and long frames move each fish once
+			for (auto aquarium : { &stepped, &driven })
+			{
+				aquarium->FastForward(7.5);
+				aquarium->Update(1.0);
+				aquarium->Update(0.02);
+			}
+			driven.Synchronize();
+
+			Assert::AreEqual(stepped.GetTime(), driven.GetTime(), 0.000001);
+			for (size_t i = 0; i < steppedFish.size(); i++)
+			{
+				Assert::AreEqual(steppedFish[i]->GetX(), drivenFish[i]->GetX(), 0.001);
+				Assert::AreEqual(steppedFish[i]->GetY(), drivenFish[i]->GetY(), 0.001);
+			}
+		}
+
+		TEST_METHOD(TestCAquariumParallel)
+		{
+			// The same tank on any number of threads gives the same bits
+			vector<uint64_t> hashes;
+			for (int threads : { 1, 2, 3, 8, 64 })
+			{
+				CAquarium aquarium;
+				aquarium.SetSeed(5);
+				aquarium.SetWorldSize(4000, 3000);
+				aquarium.SetThreads(threads);
+				Assert::AreEqual(threads, aquarium.GetNumThreads());
+
+				for (int i = 0; i < 20000; i++)
+				{
+					auto item = aquarium.CreateItem(i % 500 == 0 ? L"stinky" : (i % 2 ? L"magikarp" : L"beta"));
+					item->SetLocation(20 + (i * 379) % 3960, 20 + (i * 211) % 2960);
+					aquarium.Add(item);
+				}
+
+				for (int frame = 0; frame < 60; frame++)
+				{
+					aquarium.Update(1.0 / 30);
+				}
+
+				hashes.push_back(aquarium.GetStateHash());
+				Assert::AreEqual(hashes[0], hashes.back());
+			}
+		}
+
+		TEST_METHOD(TestCAquariumCulledDraw)
+		{
+			CAquarium aquarium;
+			aquarium.SetWorldSize(20000, 20000);
+
+			// One castle in the middle of each 1000 pixel square
+			for (int x = 0; x < 20; x++)
+			{
+				for (int y = 0; y < 20; y++)
+				{
+					auto castle = make_shared<CDecorCastle>(&aquarium);
+					castle->SetLocation(x * 1000 + 500, y * 1000 + 500);
+					aquarium.Add(castle);
+				}
+			}
+
+			Gdiplus::Bitmap bitmap(1000, 1000);
+			Gdiplus::Graphics graphics(&bitmap);
+
+			// Only the castle the camera sees is drawn
+			CCamera camera;
+			camera.SetLocation(5000, 7000);
+			aquarium.OnDraw(&graphics, camera, 1000, 1000);
+			Assert::AreEqual(1, aquarium.GetNumDrawn());
+
+			// Zoomed out, a 2x2 block of squares is in view
+			camera.SetZoom(0.5);
+			aquarium.OnDraw(&graphics, camera, 1000, 1000);
+			Assert::AreEqual(4, aquarium.GetNumDrawn());
+
+			// Hit testing is in world coordinates
+			auto fish = make_shared<CFishBeta>(&aquarium);
+			fish->SetLocation(15000, 19000);
+			aquarium.Add(fish);
+			Assert::IsTrue(aquarium.HitTest(15000, 19000) == fish);
+			Assert::IsTrue(aquarium.HitTest(14850, 19000) == nullptr);
+		}
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,191 @@
+#include "pch.h"
+#include <memory>
+#include <vector>
+#include "CppUnitTest.h"
+#include "AssetLoader.h"
+#include "PixelCache.h"
+#include "SpriteAtlas.h"
+#include "SpriteBatch.h"
+#include "SpriteCache.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace Gdiplus;
+using namespace std;
+
+namespace Testing
+{
+	TEST_CLASS(CAssetLoaderTest)
+	{
+	public:
+
+		TEST_METHOD_INITIALIZE(methodName)
+		{
+			extern wchar_t g_dir[];
+			::SetCurrentDirectory(g_dir);
+		}
+
+		/** Get a pixel cache path in the temp directory */
+		static wstring CachePath(const wchar_t* name)
+		{
+			wchar_t temp[MAX_PATH];
+			GetTempPath(MAX_PATH, temp);
+			return wstring(temp) + name;
+		}
+
+		TEST_METHOD(TestCAssetLoaderReadSize)
+		{
+			int width, height;
+			Assert::IsTrue(CAssetLoader::ReadSize(L"images/beta.png", width, height));
+			Assert::AreEqual(125, width);
+			Assert::AreEqual(117, height);
+
+			Assert::IsTrue(CAssetLoader::ReadSize(L"images/background1.png", width, height));
+			Assert::AreEqual(1024, width);
+			Assert::AreEqual(800, height);
+
+			Assert::IsFalse(CAssetLoader::ReadSize(L"images/nothere.png", width, height));
+		}
+
+		TEST_METHOD(TestCAssetLoaderPixelCache)
+		{
+			wstring path = CachePath(L"aquarium-pixels-unit.cache");
+			DeleteFile(path.c_str());
+
+			{
+				CPixelCache cache;
+				Assert::IsFalse(cache.Open(path));
+
+				vector<uint32_t> pixels(3 * 5);
+				for (size_t i = 0; i < pixels.size(); i++)
+				{
+					pixels[i] = (uint32_t)(i * 7 + 1);
+				}
+				cache.Add(42, 3, 5, false, move(pixels));
+				cache.Add(7, 2, 2, true, vector<uint32_t>(4, 0xffffffff));
+				Assert::IsTrue(cache.IsDirty());
+				Assert::IsTrue(cache.Save(path));
+			}
+
+			{
+				CPixelCache cache;
+				Assert::IsTrue(cache.Open(path));
+				Assert::AreEqual(2, cache.GetNumMapped());
+
+				CPixelCache::Image image;
+				Assert::IsTrue(cache.Find(42, image));
+				Assert::AreEqual(3, image.mWidth);
+				Assert::AreEqual(5, image.mHeight);
+				Assert::IsFalse(image.mOpaque);
+				Assert::IsTrue(image.mPixels[14] == 99);
+
+				// Images not used this run are dropped by the next save
+				Assert::IsTrue(cache.IsDirty());
+				Assert::IsTrue(cache.Save(path));
+			}
+
+			CPixelCache cache;
+			Assert::IsTrue(cache.Open(path));
+			Assert::AreEqual(1, cache.GetNumMapped());
+			CPixelCache::Image image;
+			Assert::IsFalse(cache.Find(7, image));
+			Assert::IsFalse(cache.IsDirty());
+
+			Assert::IsTrue(CPixelCache::Hash("beta", 4) != CPixelCache::Hash("betb", 4));
+		}
+
+		TEST_METHOD(TestCAssetLoaderPlaceholder)
+		{
+			CSpriteAtlas atlas;
+			auto sprite = atlas.Reserve(L"images/beta.png", 125, 117);
+			Assert::IsFalse(sprite->mReady);
+			Assert::AreEqual(125, sprite->mWidth);
+			Assert::IsTrue(atlas.Find(L"images/beta.png") == sprite);
+			Assert::AreEqual(0, atlas.GetNumSprites());
+
+			// The placeholder is drawn until the pixels arrive
+			Bitmap target(400, 400, PixelFormat32bppPARGB);
+			Graphics graphics(&target);
+			CSpriteBatch batch(atlas);
+			batch.Add(sprite, false, 200, 200);
+			batch.Flush(&graphics);
+			Assert::AreEqual(1, batch.GetNumDraws());
+
+			Color color;
+			target.GetPixel(200 - 60, 200 - 55, &color);
+			Assert::IsTrue(color.GetAlpha() != 0);
+
+			// Pixels of the wrong size are refused
+			Bitmap small(10, 10, PixelFormat32bppPARGB);
+			Assert::IsFalse(atlas.Fill(L"images/beta.png", &small, false));
+
+			unique_ptr<Bitmap> beta(Bitmap::FromFile(L"images/beta.png"));
+			Assert::IsTrue(atlas.Fill(L"images/beta.png", beta.get(), false));
+			Assert::IsTrue(sprite->mReady);
+			Assert::AreEqual(1, atlas.GetNumSprites());
+			Assert::IsFalse(atlas.Fill(L"images/beta.png", beta.get(), false));
+		}
+
+		TEST_METHOD(TestCAssetLoaderLoad)
+		{
+			wstring path = CachePath(L"aquarium-pixels-test.cache");
+			DeleteFile(path.c_str());
+
+			// A cold start decodes everything in parallel
+			CSpriteAtlas cold;
+			{
+				CAssetLoader loader(cold, 4);
+				loader.Start(L"images/", path);
+
+				// Every sprite is sized before any is decoded
+				Assert::AreEqual(117, cold.Find(L"images/beta.png")->mHeight);
+
+				loader.Wait();
+				Assert::IsTrue(loader.IsDone());
+				Assert::AreEqual(29, loader.GetNumImages());
+				Assert::AreEqual(29, loader.GetNumDecoded());
+				Assert::AreEqual(0, loader.GetNumFromCache());
+				Assert::AreEqual(0, loader.GetNumFailed());
+				Assert::AreEqual(28, cold.GetNumSprites());
+
+				// The background went to the sprite cache already decoded
+				auto background = CSpriteCache::Get().Load(L"images/background1.png");
+				Assert::AreEqual(1024, (int)background->GetWidth());
+
+				Logger::WriteMessage((L"Cold load " + to_wstring(loader.GetSeconds()) + L" s\n").c_str());
+			}
+
+			// A warm start takes every image from the mapped cache
+			CSpriteAtlas warm;
+			CAssetLoader loader(warm, 4);
+			loader.Start(L"images/", path);
+			loader.Wait();
+			Assert::AreEqual(29, loader.GetNumFromCache());
+			Assert::AreEqual(0, loader.GetNumDecoded());
+			Assert::AreEqual(28, warm.GetNumSprites());
+			Logger::WriteMessage((L"Warm load " + to_wstring(loader.GetSeconds()) + L" s\n").c_str());
+
+			// Both starts produce the same pixels in the same places
+			for (auto name : { L"images/beta.png", L"images/magikarp.png", L"images/castle.png" })
+			{
+				auto a = cold.Find(name);
+				auto b = warm.Find(name);
+				Assert::AreEqual(a->mX, b->mX);
+				Assert::AreEqual(a->mY, b->mY);
+				Assert::AreEqual(a->mPage, b->mPage);
+				Assert::IsTrue(a->mOpaque == b->mOpaque);
+
+				for (int y = 0; y < a->mHeight; y += 11)
+				{
+					for (int x = 0; x < a->mWidth; x += 11)
+					{
+						Color ca, cb;
+						a->mImage->GetPixel(a->mMirrorX + x, a->mY + y, &ca);
+						b->mImage->GetPixel(b->mMirrorX + x, b->mY + y, &cb);
+						Assert::IsTrue(ca.GetValue() == cb.GetValue());
+					}
+				}
+			}
+		}
+
+	};
+}
@@ -0,0 +1,64 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "Camera.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Testing
+{
+	TEST_CLASS(CCameraTest)
+	{
+	public:
+
+		TEST_METHOD_INITIALIZE(methodName)
+		{
+			extern wchar_t g_dir[];
+			::SetCurrentDirectory(g_dir);
+		}
+
+		TEST_METHOD(TestCCameraMapping)
+		{
+			CCamera camera;
+			camera.SetLocation(1000, 2000);
+			camera.SetZoom(2);
+
+			double x, y;
+			camera.ScreenToWorld(100, 50, x, y);
+			Assert::AreEqual(1050.0, x, 0.0001);
+			Assert::AreEqual(2025.0, y, 0.0001);
+
+			double sx, sy;
+			camera.WorldToScreen(x, y, sx, sy);
+			Assert::AreEqual(100.0, sx, 0.0001);
+			Assert::AreEqual(50.0, sy, 0.0001);
+
+			double left, top, right, bottom;
+			camera.GetVisibleRect(800, 600, left, top, right, bottom);
+			Assert::AreEqual(1000.0, left, 0.0001);
+			Assert::AreEqual(1400.0, right, 0.0001);
+			Assert::AreEqual(2300.0, bottom, 0.0001);
+		}
+
+		TEST_METHOD(TestCCameraPanZoom)
+		{
+			CCamera camera;
+
+			// Dragging the world right moves the camera left
+			camera.Pan(100, 0);
+			Assert::AreEqual(-100.0, camera.GetX(), 0.0001);
+
+			// The point under the mouse stays put while zooming
+			double before[2], after[2];
+			camera.ScreenToWorld(300, 200, before[0], before[1]);
+			camera.ZoomAt(1.5, 300, 200);
+			camera.ScreenToWorld(300, 200, after[0], after[1]);
+			Assert::AreEqual(before[0], after[0], 0.0001);
+			Assert::AreEqual(before[1], after[1], 0.0001);
+			Assert::AreEqual(1.5, camera.GetZoom(), 0.0001);
+
+			// Zoom is limited
+			camera.SetZoom(1000);
+			Assert::IsTrue(camera.GetZoom() < 1000);
+		}
+	};
+}
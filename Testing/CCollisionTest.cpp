@@ -0,0 +1,204 @@
+#include "pch.h"
+#include <cmath>
+#include <memory>
+#include <vector>
+#include "CppUnitTest.h"
+#include "Collision.h"
+#include "Aquarium.h"
+#include "FishBeta.h"
+#include "DecorCastle.h"
+#include "Random.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace std;
+
+namespace Testing
+{
+	TEST_CLASS(CCollisionTest)
+	{
+	public:
+
+		TEST_METHOD_INITIALIZE(methodName)
+		{
+			extern wchar_t g_dir[];
+			::SetCurrentDirectory(g_dir);
+		}
+
+		TEST_METHOD(TestCCollisionDetect)
+		{
+			CAquarium aquarium;
+			auto a = make_shared<CFishBeta>(&aquarium);
+			auto b = make_shared<CFishBeta>(&aquarium);
+			auto castle = make_shared<CDecorCastle>(&aquarium);
+
+			a->SetLocation(300, 300);
+			b->SetLocation(700, 300);
+			castle->SetLocation(300, 300);
+
+			vector<shared_ptr<CItem>> items = { a, castle, b };
+			CCollision collision;
+			collision.Detect(items);
+
+			// Decor never collides
+			Assert::AreEqual(0, collision.GetNumPairs());
+			Assert::AreEqual(1, collision.GetNumRebuilds());
+
+			// Move b over a a few pixels at a time, like frames
+			for (double x = 700; x >= 350; x -= 5)
+			{
+				b->SetLocation(x, 300);
+				collision.Detect(items);
+			}
+
+			Assert::AreEqual(1, collision.GetNumPairs());
+			Assert::AreEqual(1, (int)collision.GetContacts().size());
+			Assert::IsTrue(collision.GetContacts()[0].first == a.get());
+			Assert::IsTrue(collision.GetContacts()[0].second == b.get());
+
+			// Found from the swaps alone, without rebuilding
+			Assert::AreEqual(1, collision.GetNumRebuilds());
+
+			// And moving apart again ends the overlap
+			b->SetLocation(300, 600);
+			collision.Detect(items);
+			Assert::AreEqual(0, collision.GetNumPairs());
+
+			// A new fish rebuilds the lists
+			auto c = make_shared<CFishBeta>(&aquarium);
+			c->SetLocation(310, 610);
+			items.push_back(c);
+			collision.Detect(items);
+			Assert::AreEqual(2, collision.GetNumRebuilds());
+			Assert::AreEqual(1, collision.GetNumPairs());
+		}
+
+		TEST_METHOD(TestCCollisionIncremental)
+		{
+			// The incremental pairs always match a brute force test
+			CAquarium aquarium;
+			aquarium.SetWorldSize(4000, 4000);
+			CRandom random = aquarium.CreateStream();
+
+			vector<shared_ptr<CItem>> items;
+			vector<double> speedX, speedY;
+			for (int i = 0; i < 200; i++)
+			{
+				auto fish = make_shared<CFishBeta>(&aquarium);
+				fish->SetLocation(random.Uniform(0, 2000), random.Uniform(0, 2000));
+				items.push_back(fish);
+				speedX.push_back(random.Uniform(-300, 300));
+				speedY.push_back(random.Uniform(-300, 300));
+			}
+
+			CCollision collision;
+			for (int frame = 0; frame < 100; frame++)
+			{
+				for (size_t i = 0; i < items.size(); i++)
+				{
+					items[i]->SetLocation(items[i]->GetX() + speedX[i] * 0.02, items[i]->GetY() + speedY[i] * 0.02);
+				}
+
+				collision.Detect(items);
+
+				// Compare the same float boxes the detection uses
+				auto overlaps = [](CItem* a, CItem* b) {
+					float halfWidth = (float)a->GetImageWidth() / 2;
+					float halfHeight = (float)a->GetImageHeight() / 2;
+					return (float)a->GetX() - halfWidth < (float)b->GetX() + halfWidth &&
+						(float)b->GetX() - halfWidth < (float)a->GetX() + halfWidth &&
+						(float)a->GetY() - halfHeight < (float)b->GetY() + halfHeight &&
+						(float)b->GetY() - halfHeight < (float)a->GetY() + halfHeight;
+				};
+
+				int expected = 0;
+				for (size_t i = 0; i < items.size(); i++)
+				{
+					for (size_t j = i + 1; j < items.size(); j++)
+					{
+						if (overlaps(items[i].get(), items[j].get()))
+						{
+							expected++;
+						}
+					}
+				}
+
+				Assert::AreEqual(expected, collision.GetNumPairs());
+			}
+
+			Assert::AreEqual(1, collision.GetNumRebuilds());
+		}
+
+		TEST_METHOD(TestCCollisionResolve)
+		{
+			CAquarium aquarium;
+			auto a = make_shared<CFishBeta>(&aquarium);
+			auto b = make_shared<CFishBeta>(&aquarium);
+
+			// Overlapping mostly along X, swimming into each other
+			a->SetLocation(300, 300);
+			b->SetLocation(400, 310);
+			a->SetVelocity(150, 20);
+			b->SetVelocity(-150, 20);
+
+			vector<shared_ptr<CItem>> items = { a, b };
+			CCollision collision;
+			collision.Resolve(items);
+
+			Assert::AreEqual(1, (int)collision.GetContacts().size());
+			Assert::IsTrue(b->GetX() - a->GetX() >= 125 - 0.001);
+			Assert::AreEqual(300, a->GetY(), 0.001);
+			Assert::IsTrue(a->GetSpeedX() < 0);
+			Assert::IsTrue(b->GetSpeedX() > 0);
+
+			// Now only touching, so nothing happens on the next frame
+			collision.Resolve(items);
+			Assert::AreEqual(0, (int)collision.GetContacts().size());
+		}
+
+		TEST_METHOD(TestCCollisionAlpha)
+		{
+			CAquarium aquarium;
+			auto a = make_shared<CFishBeta>(&aquarium);
+			auto b = make_shared<CFishBeta>(&aquarium);
+			auto c = make_shared<CFishBeta>(&aquarium);
+
+			// a and b on top of each other, c only over the corners
+			// of their boxes
+			a->SetLocation(300, 300);
+			b->SetLocation(300, 300);
+			c->SetLocation(300 + 122, 300 + 114);
+
+			vector<shared_ptr<CItem>> items = { a, b, c };
+			CCollision collision;
+			collision.SetAlphaTest(true);
+			Assert::IsTrue(collision.IsAlphaTest());
+			collision.Detect(items);
+
+			// The narrowphase can only drop box pairs, and fish drawn
+			// on top of each other always collide
+			Assert::AreEqual(3, collision.GetNumPairs());
+			Assert::IsTrue(collision.GetContacts().size() >= 1);
+			Assert::IsTrue(collision.GetContacts()[0].first == a.get());
+			Assert::IsTrue(collision.GetContacts()[0].second == b.get());
+		}
+
+		TEST_METHOD(TestCCollisionAquarium)
+		{
+			CAquarium aquarium;
+			Assert::IsFalse(aquarium.IsColliding());
+
+			auto a = make_shared<CFishBeta>(&aquarium);
+			auto b = make_shared<CFishBeta>(&aquarium);
+			a->SetLocation(300, 300);
+			b->SetLocation(320, 300);
+			aquarium.Add(a);
+			aquarium.Add(b);
+
+			aquarium.SetColliding(true);
+			Assert::IsTrue(aquarium.IsColliding());
+			aquarium.Update(0.001);
+
+			Assert::IsTrue(fabs(b->GetX() - a->GetX()) >= 124 || fabs(b->GetY() - a->GetY()) >= 116);
+		}
+	};
+}
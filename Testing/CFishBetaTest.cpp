@@ -1,4 +1,5 @@
 #include "pch.h"
+#include <cmath>
 #include "CppUnitTest.h"
 #include "Item.h"
 #include "FishBeta.h"
@@ -22,5 +23,51 @@ namespace Testing
 			extern wchar_t g_dir[];
 			::SetCurrentDirectory(g_dir);
 		}
+
+		TEST_METHOD(TestCFishBetaFastForward)
+		{
+			CAquarium aquarium;
+			CFishBeta stepped(&aquarium), jumped(&aquarium);
+			stepped.SetLocation(300, 300);
+			jumped.SetLocation(300, 300);
+
+			// Each fish draws its own random speed, so start them together
+			jumped.SetVelocity(stepped.GetSpeedX(), stepped.GetSpeedY());
+
+			// Small steps approach the closed form motion
+			CItem& item = stepped;
+			for (int i = 0; i < 100000; i++)
+			{
+				item.Update(0.0001);
+			}
+			jumped.FastForward(10);
+
+			Assert::AreEqual(stepped.GetX(), jumped.GetX(), 1.0);
+			Assert::AreEqual(stepped.GetY(), jumped.GetY(), 1.0);
+			Assert::AreEqual(stepped.GetSpeedX(), jumped.GetSpeedX());
+			Assert::AreEqual(stepped.GetSpeedY(), jumped.GetSpeedY());
+		}
+
+		TEST_METHOD(TestCFishBetaFastForwardBounds)
+		{
+			CAquarium aquarium;
+			CFishBeta fish(&aquarium);
+
+			// Dragged outside the tank, it swims back in and stays
+			fish.SetLocation(-500, 5000);
+			fish.FastForward(1e7);
+
+			double halfWidth = fish.GetImageWidth() / 2;
+			double halfHeight = fish.GetImageHeight() / 2;
+			Assert::IsTrue(fish.GetX() >= 10 + halfWidth - 0.001);
+			Assert::IsTrue(fish.GetX() <= aquarium.GetWidth() - 10 - halfWidth + 0.001);
+			Assert::IsTrue(fish.GetY() >= 10 + halfHeight - 0.001);
+			Assert::IsTrue(fish.GetY() <= aquarium.GetHeight() - 10 - halfHeight + 0.001);
+
+			// The next bounce is no further than one crossing of the tank
+			double next = fish.GetTimeToEvent();
+			Assert::IsTrue(next > 0);
+			Assert::IsTrue(next <= aquarium.GetWidth() / fabs(fish.GetSpeedX()));
+		}
 	};
 }
\ No newline at end of file
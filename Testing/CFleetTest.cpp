@@ -0,0 +1,90 @@
+#include "pch.h"
+#include <memory>
+#include <string>
+#include "CppUnitTest.h"
+#include "Fleet.h"
+#include "Aquarium.h"
+#include "FishBeta.h"
+#include "SpriteAtlas.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace std;
+
+namespace Testing
+{
+	TEST_CLASS(CFleetTest)
+	{
+	public:
+
+		TEST_METHOD_INITIALIZE(methodName)
+		{
+			extern wchar_t g_dir[];
+			::SetCurrentDirectory(g_dir);
+		}
+
+		TEST_METHOD(TestCFleetConstruct)
+		{
+			CFleet fleet(2);
+			Assert::AreEqual(0, fleet.GetNumTanks());
+			Assert::AreEqual(2, fleet.GetPool().GetNumThreads());
+			Assert::AreEqual(0.0, fleet.GetTanksPerCore(30));
+		}
+
+		TEST_METHOD(TestCFleetTickRates)
+		{
+			CFleet fleet(2);
+
+			auto fast = make_shared<CAquarium>();
+			auto slow = make_shared<CAquarium>();
+			fast->Add(make_shared<CFishBeta>(fast.get()));
+			slow->Add(make_shared<CFishBeta>(slow.get()));
+
+			int fastIndex = fleet.AddTank(fast, 30);
+			int slowIndex = fleet.AddTank(slow, 10);
+			Assert::AreEqual(2, fleet.GetNumTanks());
+			Assert::IsTrue(fleet.GetTank(fastIndex) == fast);
+
+			fleet.Run(1, false);
+
+			// Each tank ran at its own rate and reached the same time
+			Assert::AreEqual(30LL, fleet.GetStats(fastIndex).mTicks);
+			Assert::AreEqual(10LL, fleet.GetStats(slowIndex).mTicks);
+			Assert::AreEqual(1.0, fast->GetTime(), 0.0001);
+			Assert::AreEqual(1.0, slow->GetTime(), 0.0001);
+			Assert::AreEqual(0LL, fleet.GetStats(fastIndex).mLateTicks);
+
+			Assert::IsTrue(fleet.GetStats(fastIndex).mBusySeconds >= 0);
+			Assert::IsTrue(fleet.GetStats(fastIndex).mMaxTickSeconds <= fleet.GetStats(fastIndex).mBusySeconds);
+			Assert::IsFalse(fleet.Report(30).empty());
+		}
+
+		TEST_METHOD(TestCFleetSharedSprites)
+		{
+			CFleet fleet(4);
+
+			// Many tanks of the same fish share one sprite in the atlas
+			for (int i = 0; i < 20; i++)
+			{
+				auto tank = make_shared<CAquarium>();
+				for (int j = 0; j < 5; j++)
+				{
+					tank->Add(make_shared<CFishBeta>(tank.get()));
+				}
+				fleet.AddTank(tank, 20);
+			}
+
+			int sprites = CSpriteAtlas::Get().GetNumSprites();
+			auto first = make_shared<CFishBeta>(fleet.GetTank(0).get());
+			Assert::AreEqual(sprites, CSpriteAtlas::Get().GetNumSprites());
+
+			fleet.Run(0.5, false);
+			for (int i = 0; i < fleet.GetNumTanks(); i++)
+			{
+				Assert::AreEqual(10LL, fleet.GetStats(i).mTicks);
+				Assert::AreEqual(0.5, fleet.GetTank(i)->GetTime(), 0.0001);
+			}
+
+			Assert::IsTrue(fleet.GetTanksPerCore(30) > 0);
+		}
+	};
+}
@@ -0,0 +1,184 @@
+#include "pch.h"
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "CppUnitTest.h"
+#include "FrameCapture.h"
+#include "Aquarium.h"
+#include "FishBeta.h"
+#include "Magikarp.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace Gdiplus;
+using namespace std;
+
+namespace Testing
+{
+	TEST_CLASS(CFrameCaptureTest)
+	{
+	public:
+
+		TEST_METHOD_INITIALIZE(methodName)
+		{
+			extern wchar_t g_dir[];
+			::SetCurrentDirectory(g_dir);
+		}
+
+		/** Get the temporary directory */
+		static wstring TempPath()
+		{
+			wchar_t path[MAX_PATH];
+			GetTempPath(MAX_PATH, path);
+			return wstring(path);
+		}
+
+		/** Get the size of a file, -1 if it does not exist */
+		static long long FileSize(const wstring& filename)
+		{
+			WIN32_FILE_ATTRIBUTE_DATA data;
+			if (!GetFileAttributesEx(filename.c_str(), GetFileExInfoStandard, &data))
+			{
+				return -1;
+			}
+
+			return ((long long)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+		}
+
+		/** Fill an aquarium with fish that swim */
+		static void Populate(CAquarium& aquarium, int count)
+		{
+			for (int i = 0; i < count; i++)
+			{
+				shared_ptr<CItem> item;
+				if (i % 2 == 0)
+				{
+					item = make_shared<CFishBeta>(&aquarium);
+				}
+				else
+				{
+					item = make_shared<CMagikarp>(&aquarium);
+				}
+
+				item->SetLocation(100 + (i * 97) % 800, 100 + (i * 53) % 600);
+				aquarium.Add(item);
+			}
+		}
+
+		TEST_METHOD(TestCFrameCaptureYuv)
+		{
+			// Width 4 and height 2 make two chroma samples:
+			// a white block on the left and a black block on the right
+			uint32_t pixels[] = {
+				0xffffffff, 0xffffffff, 0xff000000, 0xff000000,
+				0xffffffff, 0xffffffff, 0xff000000, 0xff000000 };
+			uint8_t yuv[12];
+			CFrameCapture::ToYuv420(pixels, 4, 2, 4, yuv);
+
+			Assert::AreEqual(255, (int)yuv[0]);
+			Assert::AreEqual(255, (int)yuv[5]);
+			Assert::AreEqual(0, (int)yuv[2]);
+			Assert::AreEqual(0, (int)yuv[7]);
+
+			// Gray has no color in either block
+			Assert::AreEqual(128, (int)yuv[8]);
+			Assert::AreEqual(128, (int)yuv[9]);
+			Assert::AreEqual(128, (int)yuv[10]);
+			Assert::AreEqual(128, (int)yuv[11]);
+
+			// Pure red is all Cr
+			uint32_t red[] = { 0xffff0000, 0xffff0000, 0xffff0000, 0xffff0000 };
+			CFrameCapture::ToYuv420(red, 2, 2, 2, yuv);
+			Assert::AreEqual(77, (int)yuv[0]);
+			Assert::IsTrue(yuv[4] < 100);
+			Assert::AreEqual(255, (int)yuv[5]);
+		}
+
+		TEST_METHOD(TestCFrameCaptureFrameName)
+		{
+			Assert::AreEqual(wstring(L"clip00000.png"), CFrameCapture::GetFrameName(L"clip.png", 0));
+			Assert::AreEqual(wstring(L"out/clip00123.png"), CFrameCapture::GetFrameName(L"out/clip.png", 123));
+			Assert::AreEqual(wstring(L"frame00007.png"), CFrameCapture::GetFrameName(L"frame", 7));
+		}
+
+		TEST_METHOD(TestCFrameCaptureSize)
+		{
+			// Odd sizes round down for 4:2:0 color
+			CFrameCapture capture(321, 241, 30, 1);
+			Assert::AreEqual(320, capture.GetWidth());
+			Assert::AreEqual(240, capture.GetHeight());
+
+			// The whole world fits, centered
+			CAquarium aquarium;
+			auto camera = capture.FitCamera(&aquarium);
+			double left, top, right, bottom;
+			camera.GetVisibleRect(capture.GetWidth(), capture.GetHeight(), left, top, right, bottom);
+			Assert::IsTrue(left <= 0.001 && top <= 0.001);
+			Assert::IsTrue(right >= aquarium.GetWidth() - 0.001 && bottom >= aquarium.GetHeight() - 0.001);
+		}
+
+		TEST_METHOD(TestCFrameCaptureY4m)
+		{
+			CAquarium aquarium;
+			Populate(aquarium, 10);
+
+			CFrameCapture capture(320, 240, 30);
+			wstring path = TempPath() + L"capture-test.y4m";
+			const int Frames = 20;
+			Assert::IsTrue(capture.Capture(&aquarium, capture.FitCamera(&aquarium), Frames, CFrameCapture::Y4m, path));
+			Assert::AreEqual(Frames, capture.GetNumFrames());
+
+			// A header, then each frame marker and its planes
+			string header = "YUV4MPEG2 W320 H240 F30000:1000 Ip A1:1 C420jpeg\n";
+			long long frameBytes = 6 + 320 * 240 * 3 / 2;
+			Assert::AreEqual((long long)header.size() + Frames * frameBytes, FileSize(path));
+
+			DeleteFile(path.c_str());
+		}
+
+		TEST_METHOD(TestCFrameCapturePng)
+		{
+			CAquarium aquarium;
+			Populate(aquarium, 4);
+
+			CFrameCapture capture(160, 120, 10);
+			wstring path = TempPath() + L"capture-test.png";
+			const int Frames = 5;
+			Assert::IsTrue(capture.Capture(&aquarium, capture.FitCamera(&aquarium), Frames, CFrameCapture::Png, path));
+
+			for (int i = 0; i < Frames; i++)
+			{
+				auto name = CFrameCapture::GetFrameName(path, i);
+				{
+					Bitmap frame(name.c_str());
+					Assert::IsTrue(frame.GetLastStatus() == Ok);
+					Assert::AreEqual(160u, frame.GetWidth());
+					Assert::AreEqual(120u, frame.GetHeight());
+				}
+				DeleteFile(name.c_str());
+			}
+		}
+
+		TEST_METHOD(TestCFrameCaptureSpeed)
+		{
+			CAquarium aquarium;
+			Populate(aquarium, 50);
+
+			// Ten seconds of 30 fps video at 640x360
+			CFrameCapture capture(640, 360, 30);
+			wstring path = TempPath() + L"capture-speed.y4m";
+			Assert::IsTrue(capture.Capture(&aquarium, capture.FitCamera(&aquarium), 300, CFrameCapture::Y4m, path));
+
+			wstringstream str;
+			str << L"Captured " << capture.GetNumFrames() << L" frames in " << capture.GetSeconds()
+				<< L"s, " << capture.GetDrawSeconds() << L"s drawing, " << capture.GetSpeedup()
+				<< L"x real time" << endl;
+			Logger::WriteMessage(str.str().c_str());
+
+			// Drawing and encoding overlap, so the capture beats real time
+			Assert::IsTrue(capture.GetSpeedup() > 1);
+
+			DeleteFile(path.c_str());
+		}
+	};
+}
@@ -0,0 +1,70 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "FrameProfiler.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Testing
+{
+	TEST_CLASS(CFrameProfilerTest)
+	{
+	public:
+
+		TEST_METHOD(TestCFrameProfilerStats)
+		{
+			CFrameProfiler profiler;
+
+			// Nothing recorded yet
+			Assert::AreEqual(0, profiler.GetStats(CFrameProfiler::Update).mCount);
+
+			for (int i = 1; i <= 100; i++)
+			{
+				profiler.AddSample(CFrameProfiler::Update, i);
+			}
+
+			auto stats = profiler.GetStats(CFrameProfiler::Update);
+			Assert::AreEqual(100, stats.mCount);
+			Assert::AreEqual(1, stats.mMin, 0.0001);
+			Assert::AreEqual(50.5, stats.mAvg, 0.0001);
+			Assert::AreEqual(99, stats.mP99, 0.0001);
+
+			// Other phases are unaffected
+			Assert::AreEqual(0, profiler.GetStats(CFrameProfiler::Items).mCount);
+		}
+
+		TEST_METHOD(TestCFrameProfilerRingWraps)
+		{
+			CFrameProfiler profiler;
+
+			for (int i = 0; i < CFrameProfiler::RingSize; i++)
+			{
+				profiler.AddSample(CFrameProfiler::Input, 1000);
+			}
+
+			// A full ring of newer samples replaces the old ones
+			for (int i = 0; i < CFrameProfiler::RingSize; i++)
+			{
+				profiler.AddSample(CFrameProfiler::Input, 2);
+			}
+
+			auto stats = profiler.GetStats(CFrameProfiler::Input);
+			Assert::AreEqual(CFrameProfiler::RingSize, stats.mCount);
+			Assert::AreEqual(2, stats.mAvg, 0.0001);
+		}
+
+		TEST_METHOD(TestCFrameProfilerDisabledTimer)
+		{
+			CFrameProfiler profiler;
+			{
+				CProfileTimer timer(profiler, CFrameProfiler::Nudge);
+			}
+			Assert::AreEqual(0, profiler.GetStats(CFrameProfiler::Nudge).mCount);
+
+			profiler.SetEnabled(true);
+			{
+				CProfileTimer timer(profiler, CFrameProfiler::Nudge);
+			}
+			Assert::AreEqual(1, profiler.GetStats(CFrameProfiler::Nudge).mCount);
+		}
+	};
+}
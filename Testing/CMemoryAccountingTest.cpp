@@ -0,0 +1,102 @@
+#include "pch.h"
+#include <memory>
+#include <fstream>
+#include "CppUnitTest.h"
+#include "MemoryAccounting.h"
+#include "Aquarium.h"
+#include "FishBeta.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace std;
+
+namespace Testing
+{
+	TEST_CLASS(CMemoryAccountingTest)
+	{
+	public:
+
+		TEST_METHOD_INITIALIZE(methodName)
+		{
+			extern wchar_t g_dir[];
+			::SetCurrentDirectory(g_dir);
+		}
+
+		TEST_METHOD(TestCMemoryAccountingPeak)
+		{
+			auto& accounting = CMemoryAccounting::Get();
+			auto before = accounting.GetUsage(CMemoryAccounting::Journal);
+
+			accounting.Add(CMemoryAccounting::Journal, L"test", 100);
+			accounting.Add(CMemoryAccounting::Journal, L"test", 50);
+			accounting.Remove(CMemoryAccounting::Journal, L"test", 100);
+
+			auto usage = accounting.GetUsage(CMemoryAccounting::Journal, L"test");
+			Assert::AreEqual(1LL, usage.mCount);
+			Assert::AreEqual(50LL, usage.mBytes);
+			Assert::AreEqual(2LL, usage.mPeakCount);
+			Assert::AreEqual(150LL, usage.mPeakBytes);
+
+			auto total = accounting.GetUsage(CMemoryAccounting::Journal);
+			Assert::AreEqual(before.mBytes + 50, total.mBytes);
+
+			accounting.Remove(CMemoryAccounting::Journal, L"test", 50);
+			Assert::AreEqual(0LL, accounting.GetUsage(CMemoryAccounting::Journal, L"test").mBytes);
+		}
+
+		TEST_METHOD(TestCMemoryAccountingItems)
+		{
+			auto& accounting = CMemoryAccounting::Get();
+			CAquarium aquarium;
+
+			auto before = accounting.GetUsage(CMemoryAccounting::Items, L"beta");
+			auto total = accounting.GetUsage(CMemoryAccounting::Items);
+			{
+				auto fish = make_shared<CFishBeta>(&aquarium);
+				auto during = accounting.GetUsage(CMemoryAccounting::Items, L"beta");
+				Assert::AreEqual(before.mCount + 1, during.mCount);
+				Assert::AreEqual(before.mBytes + (long long)sizeof(CFishBeta), during.mBytes);
+				Assert::AreEqual(total.mBytes + (long long)sizeof(CFishBeta),
+					accounting.GetUsage(CMemoryAccounting::Items).mBytes);
+
+				// A 125x117 sprite decoded at 32 bits per pixel
+				auto sprite = accounting.GetUsage(CMemoryAccounting::Sprites, L"images/beta.png");
+				Assert::IsTrue(sprite.mBytes >= 125 * 117 * 4);
+			}
+
+			auto after = accounting.GetUsage(CMemoryAccounting::Items, L"beta");
+			Assert::AreEqual(before.mCount, after.mCount);
+		}
+
+		TEST_METHOD(TestCMemoryAccountingSave)
+		{
+			auto& accounting = CMemoryAccounting::Get();
+			CAquarium aquarium;
+			for (int i = 0; i < 1000; i++)
+			{
+				aquarium.Add(make_shared<CFishBeta>(&aquarium));
+			}
+
+			wchar_t path[MAX_PATH];
+			GetTempPath(MAX_PATH, path);
+			auto before = accounting.GetUsage(CMemoryAccounting::Xml, L"Save");
+			aquarium.Save(wstring(path) + L"accounting-test.aqua");
+
+			// Held while saving and released after. Each item adds at
+			// least its element name and its type attribute.
+			auto after = accounting.GetUsage(CMemoryAccounting::Xml, L"Save");
+			Assert::AreEqual(before.mBytes, after.mBytes);
+			long long itemText = (wcslen(L"item") + wcslen(L"type") + wcslen(L"beta")) * sizeof(wchar_t);
+			Assert::IsTrue(after.mPeakBytes >= 1000 * itemText);
+
+			// A loaded document is accounted at the size of the file parsed
+			ifstream file(wstring(path) + L"accounting-test.aqua", ios::binary | ios::ate);
+			long long fileSize = (long long)file.tellg();
+			file.close();
+
+			aquarium.Load(wstring(path) + L"accounting-test.aqua");
+			auto loaded = accounting.GetUsage(CMemoryAccounting::Xml, L"Load");
+			Assert::AreEqual(0LL, loaded.mBytes);
+			Assert::IsTrue(loaded.mPeakBytes >= fileSize);
+		}
+	};
+}
@@ -0,0 +1,179 @@
+#include "pch.h"
+#include <chrono>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <vector>
+#include "CppUnitTest.h"
+#include "MipCache.h"
+#include "SpriteAtlas.h"
+#include "SpriteBatch.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace Gdiplus;
+using namespace std;
+
+namespace Testing
+{
+	TEST_CLASS(CMipCacheTest)
+	{
+	public:
+
+		TEST_METHOD_INITIALIZE(methodName)
+		{
+			extern wchar_t g_dir[];
+			::SetCurrentDirectory(g_dir);
+		}
+
+		TEST_METHOD(TestCMipCacheDownsample)
+		{
+			// One 2x2 block averages to one pixel, rounding half up
+			uint32_t block[] = { 0xff000000, 0xff0000ff, 0x00000000, 0x01020304 };
+			uint32_t pixel = 0;
+			CMipCache::DownsampleScalar(block, 2, 2, 2, &pixel, 1);
+			Assert::IsTrue(pixel == 0x80010141);
+
+			// The vector downsampler matches the reference for every size,
+			// including odd ones that repeat the last row and column
+			mt19937 random(1);
+			for (int trial = 0; trial < 200; trial++)
+			{
+				int width = 1 + random() % 70;
+				int height = 1 + random() % 40;
+				int stride = width + random() % 5;
+				vector<uint32_t> source((size_t)stride * height);
+				for (auto& p : source)
+				{
+					p = random();
+				}
+
+				int targetWidth = (width + 1) / 2;
+				int targetHeight = (height + 1) / 2;
+				vector<uint32_t> vector1((size_t)targetWidth * targetHeight, 1);
+				vector<uint32_t> scalar((size_t)targetWidth * targetHeight, 2);
+				CMipCache::Downsample(source.data(), width, height, stride, vector1.data(), targetWidth);
+				CMipCache::DownsampleScalar(source.data(), width, height, stride, scalar.data(), targetWidth);
+				Assert::IsTrue(vector1 == scalar);
+			}
+		}
+
+		TEST_METHOD(TestCMipCacheChooseLevel)
+		{
+			CSpriteAtlas::Sprite sprite;
+			sprite.mWidth = 250;
+			sprite.mHeight = 304;
+
+			Assert::AreEqual(0, CMipCache::ChooseLevel(&sprite, 2));
+			Assert::AreEqual(0, CMipCache::ChooseLevel(&sprite, 1));
+			Assert::AreEqual(0, CMipCache::ChooseLevel(&sprite, 0.6));
+			Assert::AreEqual(1, CMipCache::ChooseLevel(&sprite, 0.5));
+			Assert::AreEqual(2, CMipCache::ChooseLevel(&sprite, 0.25));
+			Assert::AreEqual(2, CMipCache::ChooseLevel(&sprite, 0.2));
+
+			// Never smaller than one pixel
+			Assert::AreEqual(7, CMipCache::ChooseLevel(&sprite, 0.0001));
+		}
+
+		TEST_METHOD(TestCMipCacheLevels)
+		{
+			CSpriteAtlas atlas;
+			CMipCache mips;
+			auto sprite = atlas.Find(L"images/buddha.png");
+
+			Assert::IsTrue(mips.Find(sprite, 0) == nullptr);
+
+			auto level = mips.Find(sprite, 2);
+			Assert::AreEqual(63, level->mWidth);
+			Assert::AreEqual(76, level->mHeight);
+			Assert::AreEqual(2, mips.GetNumLevels());
+			Assert::AreEqual(1LL, mips.GetMisses());
+
+			// Level 1 was built on the way and is kept
+			mips.Find(sprite, 1);
+			mips.Find(sprite, 2);
+			Assert::AreEqual(2LL, mips.GetHits());
+			Assert::AreEqual(2.0 / 3, mips.GetHitRate(), 0.0001);
+			Assert::AreEqual((63LL * 2 * 76 + 125LL * 2 * 152) * 4, mips.GetResidentBytes());
+
+			// The mirror is the sprite flipped
+			level = mips.Find(sprite, 1);
+			for (int y = 0; y < level->mHeight; y += 9)
+			{
+				for (int x = 0; x < level->mWidth; x += 9)
+				{
+					Color normal, mirrored;
+					level->mImage->GetPixel(x, y, &normal);
+					level->mImage->GetPixel(level->mWidth * 2 - 1 - x, y, &mirrored);
+					Assert::IsTrue(normal.GetValue() == mirrored.GetValue());
+				}
+			}
+		}
+
+		TEST_METHOD(TestCMipCacheBudget)
+		{
+			CSpriteAtlas atlas;
+
+			// Room for only a few level 1 copies
+			CMipCache mips(200 * 1024);
+			vector<const CSpriteAtlas::Sprite*> sprites;
+			for (auto name : { L"images/beta.png", L"images/buddha.png", L"images/magikarp.png",
+				L"images/castle.png", L"images/stinky.png", L"images/nemo.png" })
+			{
+				sprites.push_back(atlas.Find(name));
+			}
+
+			for (int pass = 0; pass < 3; pass++)
+			{
+				for (auto sprite : sprites)
+				{
+					Assert::IsTrue(mips.Find(sprite, 1) != nullptr);
+					Assert::IsTrue(mips.GetResidentBytes() <= mips.GetBudget());
+				}
+			}
+			Assert::IsTrue(mips.GetEvictions() > 0);
+
+			// The most recently used level is always kept
+			Assert::IsTrue(mips.Find(sprites.back(), 1) != nullptr);
+			long long hits = mips.GetHits();
+			mips.Find(sprites.back(), 1);
+			Assert::AreEqual(hits + 1, mips.GetHits());
+
+			mips.SetBudget(0);
+			Assert::AreEqual(0, mips.GetNumLevels());
+			Assert::AreEqual(0LL, mips.GetResidentBytes());
+		}
+
+		TEST_METHOD(TestCMipCacheBenchmark)
+		{
+			CSpriteAtlas atlas;
+			CMipCache mips;
+			auto sprite = atlas.Find(L"images/buddha.png");
+
+			Bitmap target(512, 512, PixelFormat32bppPARGB);
+			Graphics graphics(&target);
+
+			// Drawing a zoomed out sprite from its level against the full page
+			auto measure = [&](bool mipmapping) {
+				CSpriteBatch batch(atlas, mips);
+				batch.SetMipmapping(mipmapping);
+				auto start = chrono::steady_clock::now();
+				for (int i = 0; i < 200; i++)
+				{
+					batch.Add(sprite, i % 2 == 0, 100 + i, 200);
+					batch.Flush(&graphics, 0.25);
+				}
+				return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			};
+
+			double full = measure(false);
+			double reduced = measure(true);
+			Assert::AreEqual(1LL, mips.GetMisses());
+
+			wstringstream out;
+			out << L"Quarter size draws: level 0 " << full * 1000 << L" ms, level 2 " << reduced * 1000
+				<< L" ms, hit rate " << mips.GetHitRate() << endl;
+			Logger::WriteMessage(out.str().c_str());
+		}
+
+	};
+}
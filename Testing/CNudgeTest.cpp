@@ -0,0 +1,237 @@
+#include "pch.h"
+#include <cmath>
+#include <memory>
+#include <vector>
+#include "CppUnitTest.h"
+#include "Nudge.h"
+#include "Aquarium.h"
+#include "FishBeta.h"
+#include "Stinky.h"
+#include "Random.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace std;
+
+namespace Testing
+{
+	TEST_CLASS(CNudgeTest)
+	{
+	public:
+
+		TEST_METHOD_INITIALIZE(methodName)
+		{
+			extern wchar_t g_dir[];
+			::SetCurrentDirectory(g_dir);
+		}
+
+		TEST_METHOD(TestCNudgeKernel)
+		{
+			// The single pass kernel gives exactly what applying each
+			// repeller to each item one at a time gives
+			CRandom random(12, 0);
+			for (int trial = 0; trial < 20; trial++)
+			{
+				size_t count = 1 + (size_t)random.Uniform(0, 1500);
+
+				vector<double> x(count), y(count), minX(count, 70), maxX(count, 1930), minY(count, 60), maxY(count, 1440);
+				for (size_t i = 0; i < count; i++)
+				{
+					x[i] = random.Uniform(0, 2000);
+					y[i] = random.Uniform(0, 1500);
+				}
+
+				vector<CNudge::Repeller> repellers;
+				for (int r = 0; r < 1 + trial % 5; r++)
+				{
+					repellers.push_back(CNudge::Repeller{ random.Uniform(0, 2000), random.Uniform(0, 1500), random.Uniform(50, 400) });
+				}
+
+				vector<double> scalarX = x, scalarY = y;
+				vector<unsigned char> moved(count, 0), scalarMoved(count, 0);
+
+				CNudge::Batch batch = { x.data(), y.data(), minX.data(), maxX.data(), minY.data(), maxY.data(), moved.data(), count };
+				CNudge::Kernel(batch, repellers);
+
+				CNudge::Batch scalar = { scalarX.data(), scalarY.data(), minX.data(), maxX.data(), minY.data(), maxY.data(), scalarMoved.data(), count };
+				for (auto& repeller : repellers)
+				{
+					CNudge::KernelScalar(scalar, 0, count, repeller);
+				}
+
+				for (size_t i = 0; i < count; i++)
+				{
+					Assert::AreEqual(scalarX[i], x[i]);
+					Assert::AreEqual(scalarY[i], y[i]);
+					Assert::AreEqual((int)scalarMoved[i], (int)moved[i]);
+				}
+			}
+		}
+
+		TEST_METHOD(TestCNudgeStinky)
+		{
+			CAquarium aquarium;
+			aquarium.SetWorldSize(2000, 2000);
+
+			auto stinky = make_shared<CStinky>(&aquarium);
+			auto fish = make_shared<CFishBeta>(&aquarium);
+			auto far = make_shared<CFishBeta>(&aquarium);
+
+			stinky->SetLocation(500, 400);
+			fish->SetLocation(550, 400);
+			far->SetLocation(150, 150);
+			aquarium.Add(stinky);
+			aquarium.Add(fish);
+			aquarium.Add(far);
+
+			Assert::AreEqual((double)CNudge::DefaultDistance, stinky->GetRepelDistance());
+
+			// Pushed straight away onto the circle around Stinky
+			aquarium.Nudge();
+			Assert::AreEqual(700, fish->GetX(), 0.000001);
+			Assert::AreEqual(400, fish->GetY(), 0.000001);
+			Assert::AreEqual(150, far->GetX(), 0.000001);
+
+			// Moving Stinky pushes right away
+			stinky->SetLocation(300, 150);
+			Assert::AreEqual(300, stinky->GetX(), 0.000001);
+			Assert::AreEqual(100, far->GetX(), 0.000001);
+			Assert::AreEqual(150, far->GetY(), 0.000001);
+			Assert::AreEqual(700, fish->GetX(), 0.000001);
+		}
+
+		TEST_METHOD(TestCNudgeLongFrame)
+		{
+			CAquarium aquarium;
+			aquarium.SetWorldSize(2000, 2000);
+
+			auto stinky = make_shared<CStinky>(&aquarium);
+			stinky->SetLocation(1000, 1000);
+			aquarium.Add(stinky);
+
+			vector<shared_ptr<CItem>> fish;
+			for (int i = 0; i < 200; i++)
+			{
+				auto item = make_shared<CFishBeta>(&aquarium);
+				item->SetLocation(700 + (i * 37) % 600, 700 + (i * 53) % 600);
+				aquarium.Add(item);
+				fish.push_back(item);
+			}
+
+			// A frame long enough to be fast forwarded still pushes
+			aquarium.Update(1.0);
+			for (auto& item : fish)
+			{
+				double dx = item->GetX() - 1000;
+				double dy = item->GetY() - 1000;
+				Assert::IsTrue(sqrt(dx * dx + dy * dy) >= CNudge::DefaultDistance - 0.000001);
+			}
+		}
+
+		TEST_METHOD(TestCNudgeRepellerList)
+		{
+			CAquarium aquarium;
+			aquarium.SetWorldSize(2000, 2000);
+
+			auto stinky = make_shared<CStinky>(&aquarium);
+			stinky->SetLocation(1000, 1010);
+			aquarium.Add(stinky);
+
+			// A Stinky taken out no longer pushes
+			aquarium.Remove(stinky);
+			auto fish = make_shared<CFishBeta>(&aquarium);
+			fish->SetLocation(1000, 1000);
+			aquarium.Add(fish);
+			aquarium.Nudge();
+			Assert::AreEqual(1000.0, fish->GetX(), 0.000001);
+			Assert::AreEqual(1000.0, fish->GetY(), 0.000001);
+
+			// A Stinky moved around in the drawing order still does
+			aquarium.Add(stinky);
+			aquarium.MoveToFront(fish);
+			aquarium.MoveBack(stinky, 1);
+			stinky->SetLocation(1000, 1010);
+			double dx = fish->GetX() - 1000;
+			double dy = fish->GetY() - 1010;
+			Assert::IsTrue(sqrt(dx * dx + dy * dy) >= CNudge::DefaultDistance - 0.000001);
+
+			// And none are left after the aquarium is cleared
+			aquarium.Clear();
+			aquarium.Add(fish);
+			fish->SetLocation(1000, 1010);
+			aquarium.Nudge();
+			Assert::AreEqual(1010.0, fish->GetY(), 0.000001);
+		}
+
+		TEST_METHOD(TestCNudgeTankBounds)
+		{
+			CAquarium aquarium;
+			aquarium.SetWorldSize(800, 600);
+
+			auto stinky = make_shared<CStinky>(&aquarium);
+			auto fish = make_shared<CFishBeta>(&aquarium);
+			stinky->SetLocation(650, 300);
+			fish->SetLocation(700, 300);
+			aquarium.Add(stinky);
+			aquarium.Add(fish);
+
+			// Kept inside the tank where the fish turns around
+			aquarium.Nudge();
+			double minX, maxX, minY, maxY;
+			fish->GetBounds(minX, maxX, minY, maxY);
+			Assert::AreEqual(800 - 10 - fish->GetImageWidth() / 2, maxX, 0.000001);
+			Assert::AreEqual(maxX, fish->GetX(), 0.000001);
+
+			// The same for the old single item routine
+			fish->SetLocation(700, 300);
+			fish->UpdatePosition(650, 300);
+			Assert::AreEqual(maxX, fish->GetX(), 0.000001);
+
+			// A larger tank lets the fish go further
+			aquarium.SetWorldSize(2000, 600);
+			fish->SetLocation(700, 300);
+			aquarium.Nudge();
+			Assert::AreEqual(850, fish->GetX(), 0.000001);
+		}
+
+		TEST_METHOD(TestCNudgeManyRepellers)
+		{
+			CAquarium aquarium;
+			aquarium.SetWorldSize(6000, 4000);
+
+			for (int i = 0; i < 10; i++)
+			{
+				auto stinky = make_shared<CStinky>(&aquarium);
+				stinky->SetLocation(1000 + i * 400, 2000);
+				aquarium.Add(stinky);
+			}
+
+			CRandom random(7, 0);
+			vector<shared_ptr<CFishBeta>> fish;
+			for (int i = 0; i < 500; i++)
+			{
+				fish.push_back(make_shared<CFishBeta>(&aquarium));
+				fish.back()->SetLocation(random.Uniform(500, 5100), random.Uniform(1500, 2500));
+				aquarium.Add(fish.back());
+			}
+
+			aquarium.Nudge();
+
+			// Stinky does not swim, so the last repeller in the list
+			// has always had the final say
+			for (auto& f : fish)
+			{
+				double dx = f->GetX() - (1000 + 9 * 400);
+				double dy = f->GetY() - 2000;
+				Assert::IsTrue(sqrt(dx * dx + dy * dy) >= CNudge::DefaultDistance - 0.000001);
+			}
+		}
+
+		TEST_METHOD(TestCNudgeCreate)
+		{
+			CAquarium aquarium;
+			auto item = aquarium.CreateItem(L"stinky");
+			Assert::IsTrue(dynamic_pointer_cast<CStinky>(item) != nullptr);
+			Assert::IsTrue(item->GetImageWidth() >= 0);
+		}
+	};
+}
@@ -0,0 +1,288 @@
+#include "pch.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <vector>
+#include "CppUnitTest.h"
+#include "ObserverStream.h"
+#include "ObserverClient.h"
+#include "Aquarium.h"
+#include "FishBeta.h"
+#include "Magikarp.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace std;
+
+namespace Testing
+{
+	TEST_CLASS(CObserverStreamTest)
+	{
+	public:
+
+		TEST_METHOD_INITIALIZE(methodName)
+		{
+			extern wchar_t g_dir[];
+			::SetCurrentDirectory(g_dir);
+		}
+
+		/** Get a socket file for a test stream */
+		static wstring SocketPath()
+		{
+			wchar_t path[MAX_PATH];
+			GetTempPath(MAX_PATH, path);
+			return wstring(path) + L"observer-test.sock";
+		}
+
+		/** Fill an aquarium with fish, every other one mirrored */
+		static void Populate(CAquarium& aquarium, int count)
+		{
+			for (int i = 0; i < count; i++)
+			{
+				shared_ptr<CItem> item;
+				if (i % 2 == 0)
+				{
+					item = make_shared<CFishBeta>(&aquarium);
+				}
+				else
+				{
+					item = make_shared<CMagikarp>(&aquarium);
+				}
+
+				item->SetLocation(100 + (i * 37) % 800, 100 + (i * 53) % 600);
+				item->SetMirror(i % 2 == 1);
+				aquarium.Add(item);
+			}
+		}
+
+		/** Poll a client until it has a number of ticks, for at most a second */
+		static bool PollFor(CObserverClient& client, long long ticks)
+		{
+			for (int wait = 0; wait < 1000 && client.GetNumTicks() < ticks; wait++)
+			{
+				client.Poll();
+				if (client.GetNumTicks() < ticks)
+				{
+					Sleep(1);
+				}
+			}
+
+			return client.GetNumTicks() >= ticks;
+		}
+
+		TEST_METHOD(TestCObserverStreamIds)
+		{
+			CAquarium aquarium;
+			Populate(aquarium, 3);
+
+			// Items are numbered as they are added
+			vector<CItem*> items;
+			aquarium.Query(0, 0, aquarium.GetWidth(), aquarium.GetHeight(), items);
+			Assert::AreEqual(3, (int)items.size());
+
+			vector<unsigned> ids;
+			for (auto item : items)
+			{
+				ids.push_back(item->GetId());
+			}
+			sort(ids.begin(), ids.end());
+			Assert::IsTrue(ids == vector<unsigned>({ 1, 2, 3 }));
+
+			// An item keeps an id it already has
+			auto fish = make_shared<CFishBeta>(&aquarium);
+			fish->SetId(100);
+			aquarium.Add(fish);
+			Assert::AreEqual(100u, fish->GetId());
+			Assert::AreEqual(wstring(L"beta"), wstring(fish->GetType()));
+		}
+
+		TEST_METHOD(TestCObserverStreamPublish)
+		{
+			CAquarium aquarium;
+			Populate(aquarium, 10);
+
+			CObserverStream stream;
+			Assert::IsTrue(stream.Open(SocketPath()));
+
+			CObserverClient client;
+			Assert::IsTrue(client.Connect(SocketPath()));
+			Assert::IsTrue(client.Subscribe(0));
+
+			stream.Publish(&aquarium);
+			Assert::AreEqual(1, stream.GetNumSubscribers());
+			Assert::IsTrue(PollFor(client, 1));
+
+			CObserverClient::Tick tick;
+			Assert::IsTrue(client.Next(tick));
+			Assert::AreEqual(10, (int)tick.mItems.size());
+
+			vector<CItem*> items;
+			aquarium.Query(0, 0, aquarium.GetWidth(), aquarium.GetHeight(), items);
+			for (size_t i = 0; i < items.size(); i++)
+			{
+				auto& published = tick.mItems[i];
+				Assert::AreEqual(items[i]->GetId(), published.mId);
+				Assert::AreEqual(wstring(items[i]->GetType()), client.GetTypeName(published.mType));
+				Assert::AreEqual(items[i]->IsMirror(), published.mMirror);
+				Assert::AreEqual((float)items[i]->GetX(), published.mX);
+				Assert::AreEqual((float)items[i]->GetY(), published.mY);
+			}
+
+			// A subscriber that connects later is told the types already seen
+			CObserverClient late;
+			Assert::IsTrue(late.Connect(SocketPath()));
+			stream.Publish(&aquarium);
+			Assert::IsTrue(PollFor(late, 1));
+			Assert::AreEqual(wstring(L"beta"), late.GetTypeName(tick.mItems[0].mType));
+
+			// Subscribers that leave are removed on the next tick
+			client.Close();
+			late.Close();
+			stream.Publish(&aquarium);
+			Assert::AreEqual(0, stream.GetNumSubscribers());
+			Assert::AreEqual(0ll, stream.GetNumDropped());
+		}
+
+		TEST_METHOD(TestCObserverStreamViewport)
+		{
+			CAquarium aquarium;
+			Populate(aquarium, 40);
+
+			CObserverStream stream;
+			Assert::IsTrue(stream.Open(SocketPath()));
+
+			CObserverClient client;
+			Assert::IsTrue(client.Connect(SocketPath()));
+			Assert::IsTrue(client.Subscribe(0, 0, 0, 400, 400));
+			stream.Publish(&aquarium);
+			Assert::IsTrue(PollFor(client, 1));
+
+			// Only items that overlap the region are published
+			vector<CItem*> expected;
+			aquarium.Query(0, 0, 400, 400, expected);
+			CObserverClient::Tick tick;
+			Assert::IsTrue(client.Next(tick));
+			Assert::AreEqual((int)expected.size(), (int)tick.mItems.size());
+			Assert::IsTrue(tick.mItems.size() < 40);
+		}
+
+		TEST_METHOD(TestCObserverStreamRate)
+		{
+			CAquarium aquarium;
+			Populate(aquarium, 10);
+
+			CObserverStream stream;
+			Assert::IsTrue(stream.Open(SocketPath()));
+
+			CObserverClient every, limited;
+			Assert::IsTrue(every.Connect(SocketPath()));
+			Assert::IsTrue(limited.Connect(SocketPath()));
+			Assert::IsTrue(every.Subscribe(0));
+			Assert::IsTrue(limited.Subscribe(1));
+
+			// Twenty quick ticks are far less than a second
+			for (int i = 0; i < 20; i++)
+			{
+				stream.Publish(&aquarium);
+			}
+
+			Assert::IsTrue(PollFor(every, 20));
+			PollFor(limited, 2);
+			Assert::AreEqual(1ll, limited.GetNumTicks());
+			Assert::AreEqual(19ll, stream.GetNumSkipped());
+		}
+
+		TEST_METHOD(TestCObserverStreamSlowReader)
+		{
+			CAquarium aquarium;
+			Populate(aquarium, 500);
+
+			CObserverStream stream;
+			stream.SetMaxBacklog(64 * 1024);
+			Assert::IsTrue(stream.Open(SocketPath()));
+
+			CObserverClient slow, reader;
+			Assert::IsTrue(slow.Connect(SocketPath()));
+			Assert::IsTrue(reader.Connect(SocketPath()));
+
+			// The slow subscriber never reads, and publishing never waits for it
+			auto start = chrono::steady_clock::now();
+			CObserverClient::Tick tick;
+			for (int i = 0; i < 2000; i++)
+			{
+				stream.Publish(&aquarium);
+				reader.Poll();
+				while (reader.Next(tick))
+				{
+				}
+			}
+			double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+			Assert::AreEqual(1ll, stream.GetNumDropped());
+			Assert::AreEqual(1, stream.GetNumSubscribers());
+			Assert::IsTrue(reader.Poll());
+			Assert::IsFalse(slow.Poll());
+
+			wstringstream str;
+			str << L"2000 ticks of 500 items with a stalled subscriber: " << seconds << L"s" << endl;
+			Logger::WriteMessage(str.str().c_str());
+		}
+
+		TEST_METHOD(TestCObserverStreamBenchmark)
+		{
+			const int Items = 1000;
+			const int Ticks = 200;
+
+			wstringstream str;
+			str << L"Observer stream, " << Items << L" items, " << Ticks << L" ticks" << endl;
+			str << L"subscribers, update ms/tick, publish ms/tick, overhead, MB sent" << endl;
+
+			for (int subscribers : { 0, 1, 4, 16, 64 })
+			{
+				CAquarium aquarium;
+				aquarium.SetSeed(1);
+				Populate(aquarium, Items);
+
+				CObserverStream stream;
+				Assert::IsTrue(stream.Open(SocketPath()));
+
+				vector<unique_ptr<CObserverClient>> clients;
+				for (int i = 0; i < subscribers; i++)
+				{
+					clients.push_back(make_unique<CObserverClient>());
+					Assert::IsTrue(clients.back()->Connect(SocketPath()));
+				}
+
+				// Only the simulation side is timed; the clients drain between ticks
+				double updateSeconds = 0;
+				CObserverClient::Tick tick;
+				for (int i = 0; i < Ticks; i++)
+				{
+					auto start = chrono::steady_clock::now();
+					aquarium.Update(1.0 / 30);
+					updateSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+					stream.Publish(&aquarium);
+					for (auto& client : clients)
+					{
+						client->Poll();
+						while (client->Next(tick))
+						{
+						}
+					}
+				}
+
+				Assert::AreEqual(0ll, stream.GetNumDropped());
+				Assert::AreEqual(subscribers, stream.GetNumSubscribers());
+
+				double update = updateSeconds * 1000 / Ticks;
+				double publish = stream.GetPublishSeconds() * 1000 / Ticks;
+				str << subscribers << L", " << update << L", " << publish << L", "
+					<< (update > 0 ? publish / update * 100 : 0) << L"%, "
+					<< stream.GetBytesSent() / 1048576.0 << endl;
+			}
+
+			Logger::WriteMessage(str.str().c_str());
+		}
+	};
+}
@@ -0,0 +1,151 @@
+#include "pch.h"
+#include <cmath>
+#include <memory>
+#include "CppUnitTest.h"
+#include "Random.h"
+#include "Aquarium.h"
+#include "FishBeta.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace std;
+
+namespace Testing
+{
+	TEST_CLASS(CRandomTest)
+	{
+	public:
+
+		TEST_METHOD_INITIALIZE(methodName)
+		{
+			extern wchar_t g_dir[];
+			::SetCurrentDirectory(g_dir);
+		}
+
+		TEST_METHOD(TestCRandomReproducible)
+		{
+			CRandom a(1234, 7), b(1234, 7), c(1234, 8);
+
+			bool differs = false;
+			for (int i = 0; i < 100; i++)
+			{
+				uint64_t value = a.Next();
+				Assert::IsTrue(value == b.Next());
+				differs = differs || value != c.Next();
+			}
+
+			Assert::IsTrue(differs);
+		}
+
+		TEST_METHOD(TestCRandomState)
+		{
+			CRandom a(99), b;
+			a.Next();
+
+			Assert::IsTrue(b.SetState(a.GetState()));
+			for (int i = 0; i < 10; i++)
+			{
+				Assert::IsTrue(a.Next() == b.Next());
+			}
+
+			Assert::IsFalse(b.SetState(L"not a state"));
+			Assert::IsFalse(b.SetState(L"0,0,0,0"));
+		}
+
+		TEST_METHOD(TestCRandomFillUniform)
+		{
+			double values[103];
+			CRandom a(5), b(5);
+			a.FillUniform(values, 103, 10, 20);
+
+			double sum = 0;
+			for (double value : values)
+			{
+				Assert::IsTrue(value >= 10 && value < 20);
+				sum += value;
+			}
+
+			// Loose check that the values are spread over the range
+			Assert::AreEqual(15.0, sum / 103, 1.0);
+
+			double again[103];
+			b.FillUniform(again, 103, 10, 20);
+			Assert::AreEqual(values[102], again[102]);
+		}
+
+		TEST_METHOD(TestCRandomDistributions)
+		{
+			CRandom random(9);
+			const int Count = 20000;
+
+			double sum = 0, squares = 0;
+			for (int i = 0; i < Count; i++)
+			{
+				double value = random.Normal(50, 4);
+				sum += value;
+				squares += value * value;
+			}
+
+			double mean = sum / Count;
+			Assert::AreEqual(50.0, mean, 0.2);
+			Assert::AreEqual(4.0, sqrt(squares / Count - mean * mean), 0.2);
+
+			// Zero weights are never picked
+			const double weights[] = { 1, 0, 3 };
+			int picks[3] = { 0 };
+			for (int i = 0; i < Count; i++)
+			{
+				picks[random.Pick(weights, 3)]++;
+			}
+			Assert::AreEqual(0, picks[1]);
+			Assert::AreEqual(0.25, (double)picks[0] / Count, 0.02);
+
+			for (int i = 0; i < 1000; i++)
+			{
+				int value = random.UniformInt(7);
+				Assert::IsTrue(value >= 0 && value < 7);
+			}
+
+			// Splits of equal generators are equal, and differ from each other
+			CRandom a(3), b(3);
+			auto first = a.Split();
+			auto second = a.Split();
+			Assert::IsTrue(first.Next() == b.Split().Next());
+			Assert::IsFalse(first.Next() == second.Next());
+		}
+
+		TEST_METHOD(TestCRandomAquariumStreams)
+		{
+			CAquarium aquarium1, aquarium2;
+			aquarium1.SetSeed(42);
+			aquarium2.SetSeed(42);
+
+			auto fish1 = make_shared<CFishBeta>(&aquarium1);
+			auto fish2 = make_shared<CFishBeta>(&aquarium2);
+			auto fish3 = make_shared<CFishBeta>(&aquarium1);
+
+			// Same seed and order gives the same fish
+			Assert::AreEqual(fish1->GetSpeedX(), fish2->GetSpeedX());
+			Assert::AreEqual(fish1->GetSpeedY(), fish2->GetSpeedY());
+
+			// Each fish gets its own stream
+			Assert::IsTrue(fish1->GetSpeedX() != fish3->GetSpeedX());
+		}
+
+		TEST_METHOD(TestCRandomAquariumReload)
+		{
+			wchar_t path[MAX_PATH];
+			::GetTempPath(MAX_PATH, path);
+			wstring file = wstring(path) + L"random.aqua";
+
+			CAquarium aquarium, reloaded;
+			aquarium.SetSeed(7);
+			aquarium.Add(make_shared<CFishBeta>(&aquarium));
+			aquarium.Save(file);
+			reloaded.Load(file);
+
+			// A reloaded tank continues the streams of the saved one
+			CFishBeta next(&aquarium), nextReloaded(&reloaded);
+			Assert::AreEqual(next.GetSpeedX(), nextReloaded.GetSpeedX());
+		}
+	};
+}
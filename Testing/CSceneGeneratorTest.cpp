@@ -0,0 +1,104 @@
+#include "pch.h"
+#include <string>
+#include <fstream>
+#include <streambuf>
+#include "CppUnitTest.h"
+#include "Aquarium.h"
+#include "SceneGenerator.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace std;
+
+namespace Testing
+{
+	TEST_CLASS(CSceneGeneratorTest)
+	{
+	public:
+
+		/**
+		* Create a path to a place to put temporary files
+		*/
+		wstring TempPath()
+		{
+			wchar_t path_nts[MAX_PATH];
+			GetTempPath(MAX_PATH, path_nts);
+			return wstring(path_nts);
+		}
+
+		/**
+		* Read a file into a string and return it.
+		* \param filename Name of the file to read
+		* \return File contents
+		*/
+		string ReadFile(const wstring& filename)
+		{
+			ifstream t(filename, ios::binary);
+			return string((istreambuf_iterator<char>(t)), istreambuf_iterator<char>());
+		}
+
+		TEST_METHOD_INITIALIZE(methodName)
+		{
+			extern wchar_t g_dir[];
+			::SetCurrentDirectory(g_dir);
+		}
+
+		TEST_METHOD(TestCSceneGeneratorLoad)
+		{
+			CAquarium aquarium;
+			wstring file = TempPath() + L"generated.aqua";
+
+			CSceneGenerator generator(aquarium.GetWidth(), aquarium.GetHeight());
+			generator.SetCount(100);
+			generator.SetDistribution(CSceneGenerator::Distribution::Clustered);
+			generator.Generate(file);
+
+			aquarium.Load(file);
+			Assert::AreEqual(100, aquarium.GetNumItems());
+
+			// An empty scene is still a valid aquarium
+			generator.SetCount(0);
+			generator.Generate(file);
+			aquarium.Load(file);
+			Assert::AreEqual(0, aquarium.GetNumItems());
+		}
+
+		TEST_METHOD(TestCSceneGeneratorDeterministic)
+		{
+			wstring file1 = TempPath() + L"generated1.aqua";
+			wstring file2 = TempPath() + L"generated2.aqua";
+
+			// Enough items for several chunks
+			CSceneGenerator generator(1024, 768);
+			generator.SetCount(200000);
+			generator.SetDistribution(CSceneGenerator::Distribution::Gaussian);
+			generator.SetSeed(42);
+
+			generator.SetThreads(1);
+			generator.Generate(file1);
+
+			generator.SetThreads(7);
+			generator.Generate(file2);
+
+			Assert::IsTrue(ReadFile(file1) == ReadFile(file2), L"Thread count changed the output");
+
+			generator.SetSeed(43);
+			generator.Generate(file2);
+			Assert::IsFalse(ReadFile(file1) == ReadFile(file2), L"Seed did not change the output");
+		}
+
+		TEST_METHOD(TestCSceneGeneratorMix)
+		{
+			wstring file = TempPath() + L"generated.aqua";
+
+			CSceneGenerator generator(1024, 768);
+			generator.SetCount(50);
+			generator.SetMix(0, 0, 0, 1);
+			generator.Generate(file);
+
+			string xml = ReadFile(file);
+			Assert::IsTrue(xml.find("type=\"castle\"") != string::npos);
+			Assert::IsTrue(xml.find("type=\"beta\"") == string::npos);
+			Assert::IsTrue(xml.find("speedx") == string::npos);
+		}
+	};
+}
@@ -0,0 +1,170 @@
+#include "pch.h"
+#include <cmath>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <vector>
+#include "CppUnitTest.h"
+#include "Schooling.h"
+#include "Aquarium.h"
+#include "FishBeta.h"
+#include "Magikarp.h"
+#include "DecorCastle.h"
+#include "Random.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace std;
+
+namespace Testing
+{
+	TEST_CLASS(CSchoolingTest)
+	{
+	public:
+
+		TEST_METHOD_INITIALIZE(methodName)
+		{
+			extern wchar_t g_dir[];
+			::SetCurrentDirectory(g_dir);
+		}
+
+		TEST_METHOD(TestCSchoolingWeights)
+		{
+			CSchooling schooling;
+			Assert::IsTrue(schooling.GetWeights(CSchooling::Beta).mRadius > 0);
+			Assert::AreEqual(0.0f, schooling.GetWeights(CSchooling::Other).mRadius);
+
+			CSchooling::Weights weights = { 100, 10, 2, 1, 0 };
+			schooling.SetWeights(CSchooling::Magikarp, weights);
+			Assert::AreEqual(100.0f, schooling.GetWeights(CSchooling::Magikarp).mRadius);
+			Assert::AreEqual(2.0f, schooling.GetWeights(CSchooling::Magikarp).mAlignment);
+		}
+
+		TEST_METHOD(TestCSchoolingAlignment)
+		{
+			CAquarium aquarium;
+			auto slow = make_shared<CFishBeta>(&aquarium);
+			auto fast = make_shared<CFishBeta>(&aquarium);
+			Assert::IsTrue(slow->GetSpecies() == CSchooling::Beta);
+
+			// Within sight of each other but too far apart to push
+			slow->SetLocation(500, 400);
+			fast->SetLocation(600, 400);
+			slow->SetVelocity(120, 20);
+			fast->SetVelocity(180, 20);
+
+			vector<shared_ptr<CItem>> items = { slow, fast };
+			CSchooling schooling;
+			schooling.Steer(items, 0.1);
+
+			// Each fish speeds toward the other's velocity and location
+			Assert::AreEqual(2, schooling.GetNumFish());
+			Assert::IsTrue(slow->GetSpeedX() > 120);
+			Assert::IsTrue(fast->GetSpeedX() < 180);
+			Assert::AreEqual(20, slow->GetSpeedY(), 0.001);
+		}
+
+		TEST_METHOD(TestCSchoolingSpecies)
+		{
+			CAquarium aquarium;
+			auto beta = make_shared<CFishBeta>(&aquarium);
+			auto magikarp = make_shared<CMagikarp>(&aquarium);
+			auto castle = make_shared<CDecorCastle>(&aquarium);
+
+			beta->SetLocation(500, 400);
+			magikarp->SetLocation(650, 400);
+			castle->SetLocation(550, 400);
+			beta->SetVelocity(120, 20);
+			magikarp->SetVelocity(180, 40);
+
+			vector<shared_ptr<CItem>> items = { beta, castle, magikarp };
+			CSchooling schooling;
+			schooling.Steer(items, 0.1);
+
+			// Decor is not steered and different species ignore each other
+			Assert::AreEqual(2, schooling.GetNumFish());
+			Assert::AreEqual(120, beta->GetSpeedX(), 0.001);
+			Assert::AreEqual(180, magikarp->GetSpeedX(), 0.001);
+		}
+
+		TEST_METHOD(TestCSchoolingSeparation)
+		{
+			CAquarium aquarium;
+			auto left = make_shared<CFishBeta>(&aquarium);
+			auto right = make_shared<CFishBeta>(&aquarium);
+
+			// Too close, so the push wins over the pull of the school
+			left->SetLocation(500, 400);
+			right->SetLocation(520, 400);
+			left->SetVelocity(150, 20);
+			right->SetVelocity(150, 20);
+
+			vector<shared_ptr<CItem>> items = { left, right };
+			CSchooling schooling;
+			schooling.Steer(items, 0.1);
+
+			Assert::IsTrue(left->GetSpeedX() < 150);
+			Assert::IsTrue(right->GetSpeedX() > 150);
+		}
+
+		TEST_METHOD(TestCSchoolingAquarium)
+		{
+			CAquarium aquarium;
+			Assert::IsFalse(aquarium.IsSchooling());
+
+			for (int i = 0; i < 20; i++)
+			{
+				aquarium.Add(make_shared<CFishBeta>(&aquarium));
+			}
+
+			aquarium.SetSchooling(true);
+			Assert::IsTrue(aquarium.IsSchooling());
+			aquarium.Update(0.02);
+			Assert::AreEqual(20, aquarium.GetSchooling().GetNumFish());
+
+			// Event driven tanks are brought up to date and steered too
+			aquarium.SetEventDriven(true);
+			aquarium.Update(0.02);
+			Assert::AreEqual(0.04, aquarium.GetTime(), 0.000001);
+		}
+
+		TEST_METHOD(BenchmarkCSchoolingDensity)
+		{
+			// Steering cost per fish for the same fish count spread
+			// over worlds of different size
+			wstringstream report;
+			report << fixed << setprecision(1);
+
+			for (int count = 1000; count <= 10000; count *= 10)
+			{
+				for (int size = 2000; size <= 32000; size *= 4)
+				{
+					CAquarium aquarium;
+					aquarium.SetWorldSize(size, size);
+					CRandom random = aquarium.CreateStream();
+
+					vector<shared_ptr<CItem>> items;
+					for (int i = 0; i < count; i++)
+					{
+						auto fish = make_shared<CFishBeta>(&aquarium);
+						fish->SetLocation(random.Uniform(0, size), random.Uniform(0, size));
+						items.push_back(fish);
+					}
+
+					CSchooling schooling;
+					double best = 1e30;
+					for (int r = 0; r < 5; r++)
+					{
+						schooling.Steer(items, 0.016);
+						best = min(best, schooling.GetNanosPerFish());
+					}
+
+					Assert::AreEqual(count, schooling.GetNumFish());
+					report << count << L" fish in " << size << L"x" << size << L": " << best
+						<< L" ns per fish, " << schooling.GetNumCandidates() / count << L" candidates per fish" << endl;
+				}
+			}
+
+			Logger::WriteMessage(report.str().c_str());
+		}
+	};
+}
@@ -0,0 +1,248 @@
+#include "pch.h"
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include "CppUnitTest.h"
+#include "SessionLog.h"
+#include "SessionPlayer.h"
+#include "Aquarium.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace std;
+
+namespace Testing
+{
+	TEST_CLASS(CSessionPlayerTest)
+	{
+	public:
+
+		/**
+		* Create a path to a place to put temporary files
+		*/
+		wstring TempPath()
+		{
+			// Create a path to temporary files
+			wchar_t path_nts[MAX_PATH];
+			GetTempPath(MAX_PATH, path_nts);
+
+			// Convert null terminated string to wstring
+			return wstring(path_nts);
+		}
+
+		TEST_METHOD_INITIALIZE(methodName)
+		{
+			extern wchar_t g_dir[];
+			::SetCurrentDirectory(g_dir);
+		}
+
+		/**
+		 * Record an event and apply it, like the view does
+		 */
+		void Play(CSessionLog& log, CSessionPlayer& player, CSessionEvent::Type type,
+			double x = 0, double y = 0, bool button = false, const wstring& text = L"")
+		{
+			CSessionEvent event;
+			event.mType = type;
+			event.mX = x;
+			event.mY = y;
+			event.mButton = button;
+			event.mValue = 0.03;
+			event.mText = text;
+
+			log.Record(event);
+			player.Apply(event);
+		}
+
+		TEST_METHOD(TestCSessionPlayerDrag)
+		{
+			CAquarium aquarium;
+			CSessionPlayer player(&aquarium);
+			CSessionLog log;
+
+			Play(log, player, CSessionEvent::Type::Add, 0, 0, false, L"castle");
+			Play(log, player, CSessionEvent::Type::MouseDown, 200, 200);
+			Play(log, player, CSessionEvent::Type::MouseMove, 300, 250, true);
+			Play(log, player, CSessionEvent::Type::MouseMove, 310, 260, false);
+			Play(log, player, CSessionEvent::Type::MouseMove, 400, 400, true);
+
+			// Not recording, so nothing was logged
+			Assert::AreEqual(0, (int)log.GetEvents().size());
+
+			// The castle was dropped at the first release
+			auto item = aquarium.HitTest(310, 260);
+			Assert::IsTrue(item != nullptr);
+			Assert::AreEqual(310.0, item->GetX(), 0.0001);
+			Assert::AreEqual(260.0, item->GetY(), 0.0001);
+		}
+
+		TEST_METHOD(TestCSessionPlayerReplay)
+		{
+			CAquarium aquarium;
+			aquarium.SetSeed(3);
+			aquarium.Add(aquarium.CreateItem(L"beta"));
+
+			CSessionPlayer player(&aquarium);
+			CSessionLog log;
+			log.Start(&aquarium);
+			Assert::IsTrue(log.IsRecording());
+
+			Play(log, player, CSessionEvent::Type::Add, 0, 0, false, L"magikarp");
+			Play(log, player, CSessionEvent::Type::Update);
+			Play(log, player, CSessionEvent::Type::MouseDown, 200, 200);
+			Play(log, player, CSessionEvent::Type::MouseMove, 500, 300, true);
+			Play(log, player, CSessionEvent::Type::MouseMove, 500, 300, false);
+			Play(log, player, CSessionEvent::Type::Add, 0, 0, false, L"buddha");
+			for (int i = 0; i < 50; i++)
+			{
+				Play(log, player, CSessionEvent::Type::Update);
+			}
+
+			log.Stop(&aquarium);
+			Assert::AreEqual(57, (int)log.GetEvents().size());
+
+			wstring filename = TempPath() + L"test.session";
+			Assert::IsTrue(log.Save(filename));
+
+			CSessionLog loaded;
+			Assert::IsTrue(loaded.Load(filename));
+			Assert::AreEqual(57, (int)loaded.GetEvents().size());
+
+			// Replay headless into a different aquarium
+			CAquarium replayed;
+			CSessionPlayer replayer(&replayed);
+			auto result = replayer.Replay(loaded, false);
+
+			Assert::AreEqual(57, (int)result.mEventNanos.size());
+			Assert::IsTrue(result.mHash == aquarium.GetStateHash());
+			Assert::IsTrue(result.mHasExpected);
+			Assert::IsTrue(result.Matches());
+			Assert::AreEqual(aquarium.GetNumItems(), replayed.GetNumItems());
+
+			// Replaying again gives the same state
+			Assert::IsTrue(replayer.Replay(loaded, false).mHash == result.mHash);
+			Assert::IsFalse(CSessionPlayer::Report(loaded, result).empty());
+
+			// An event the recording never had ends somewhere else
+			{
+				wofstream out(filename, ios::app);
+				out << L"100 update 1\n";
+			}
+			CSessionLog changed;
+			Assert::IsTrue(changed.Load(filename));
+			auto mismatch = replayer.Replay(changed, false);
+			Assert::IsFalse(mismatch.Matches());
+			Assert::IsTrue(CSessionPlayer::Report(changed, mismatch).find(L"MISMATCH") != wstring::npos);
+		}
+
+		TEST_METHOD(TestCSessionPlayerLoadPath)
+		{
+			// A tank to load, and a log in a directory beside it
+			wstring directory = TempPath() + L"aquarium-session-test\\";
+			CreateDirectory(directory.c_str(), nullptr);
+
+			CAquarium saved;
+			saved.SetSeed(5);
+			saved.Add(saved.CreateItem(L"beta"));
+			saved.Add(saved.CreateItem(L"castle"));
+			wstring tank = TempPath() + L"test-session-load.aqua";
+			saved.Save(tank);
+
+			CAquarium aquarium;
+			CSessionPlayer player(&aquarium);
+			CSessionLog log;
+			log.Start(&aquarium);
+			Play(log, player, CSessionEvent::Type::Load, 0, 0, false, tank);
+			Play(log, player, CSessionEvent::Type::Update);
+			log.Stop(&aquarium);
+			Assert::AreEqual(2, aquarium.GetNumItems());
+
+			wstring filename = directory + L"test-load.session";
+			Assert::IsTrue(log.Save(filename));
+
+			// The log names the tank relative to itself
+			wifstream in(filename);
+			wstring text((istreambuf_iterator<wchar_t>(in)), istreambuf_iterator<wchar_t>());
+			Assert::IsTrue(text.find(L"load ..\\test-session-load.aqua") != wstring::npos);
+
+			CSessionLog loaded;
+			Assert::IsTrue(loaded.Load(filename));
+			CAquarium replayed;
+			CSessionPlayer replayer(&replayed);
+			auto result = replayer.Replay(loaded, false);
+			Assert::AreEqual(2, replayed.GetNumItems());
+			Assert::IsTrue(result.Matches());
+		}
+
+		/**
+		 * Record and apply turning a mode on or off
+		 */
+		void PlayMode(CSessionLog& log, CSessionPlayer& player, const wchar_t* mode, bool enabled)
+		{
+			CSessionEvent event;
+			event.mType = CSessionEvent::Type::Mode;
+			event.mText = mode;
+			event.mValue = enabled ? 1 : 0;
+
+			log.Record(event);
+			Assert::IsTrue(player.Apply(event));
+		}
+
+		TEST_METHOD(TestCSessionPlayerModes)
+		{
+			CAquarium aquarium;
+			aquarium.SetSeed(7);
+			aquarium.SetWorldSize(4000, 3000);
+			for (int i = 0; i < 200; i++)
+			{
+				auto item = aquarium.CreateItem(i % 2 ? L"magikarp" : L"beta");
+				item->SetLocation(100 + (i * 379) % 3800, 100 + (i * 211) % 2800);
+				aquarium.Add(item);
+			}
+
+			// Modes on before recording are part of the snapshot
+			aquarium.SetSchooling(true);
+
+			CSessionPlayer player(&aquarium);
+			CSessionLog log;
+			log.Start(&aquarium);
+
+			CSessionEvent view;
+			view.mType = CSessionEvent::Type::View;
+			view.mRight = 800;
+			view.mBottom = 600;
+			log.Record(view);
+			Assert::IsFalse(player.Apply(view));
+
+			PlayMode(log, player, CSessionPlayer::ModeUpdateLod, true);
+			PlayMode(log, player, CSessionPlayer::ModeCollisions, true);
+			for (int i = 0; i < 30; i++)
+			{
+				Play(log, player, CSessionEvent::Type::Update);
+			}
+
+			PlayMode(log, player, CSessionPlayer::ModeUpdateLod, false);
+			PlayMode(log, player, CSessionPlayer::ModeSchooling, false);
+			PlayMode(log, player, CSessionPlayer::ModeEventDriven, true);
+			for (int i = 0; i < 30; i++)
+			{
+				Play(log, player, CSessionEvent::Type::Update);
+			}
+			log.Stop(&aquarium);
+
+			wstring filename = TempPath() + L"test-modes.session";
+			Assert::IsTrue(log.Save(filename));
+			CSessionLog loaded;
+			Assert::IsTrue(loaded.Load(filename));
+			Assert::AreEqual((int)log.GetEvents().size(), (int)loaded.GetEvents().size());
+
+			CAquarium replayed;
+			CSessionPlayer replayer(&replayed);
+			auto result = replayer.Replay(loaded, false);
+			Assert::IsTrue(result.mHash == aquarium.GetStateHash());
+			Assert::IsTrue(replayed.IsEventDriven());
+			Assert::IsTrue(replayed.IsColliding());
+			Assert::IsFalse(replayed.IsSchooling());
+			Assert::IsFalse(replayed.IsUpdateLod());
+		}
+	};
+}
@@ -0,0 +1,314 @@
+#include "pch.h"
+#include <cmath>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <vector>
+#include "CppUnitTest.h"
+#include "SnapshotCodec.h"
+#include "MemoryAccounting.h"
+#include "Aquarium.h"
+#include "FishBeta.h"
+#include "Magikarp.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace std;
+
+namespace Testing
+{
+	TEST_CLASS(CSnapshotCodecTest)
+	{
+	public:
+
+		TEST_METHOD_INITIALIZE(methodName)
+		{
+			extern wchar_t g_dir[];
+			::SetCurrentDirectory(g_dir);
+		}
+
+		/** Make a snapshot of items wandering around */
+		static CSnapshotCodec::Snapshot MakeSnapshot(int count, mt19937& random)
+		{
+			CSnapshotCodec::Snapshot snapshot;
+			for (int i = 0; i < count; i++)
+			{
+				CSnapshotCodec::Item item;
+				item.mId = i * 3 + 1;
+				item.mType = i % 3;
+				item.mMirror = random() % 2 == 0;
+				item.mX = (random() % 100000) / 97.0;
+				item.mY = (random() % 80000) / 97.0;
+				snapshot.mItems.push_back(item);
+			}
+
+			return snapshot;
+		}
+
+		/** Move every item a little, flipping some */
+		static void Wander(CSnapshotCodec::Snapshot& snapshot, mt19937& random)
+		{
+			snapshot.mTime += 1.0 / 30;
+			for (auto& item : snapshot.mItems)
+			{
+				item.mX += (int)(random() % 200 - 100) / 37.0;
+				item.mY += (int)(random() % 200 - 100) / 37.0;
+				if (random() % 50 == 0)
+				{
+					item.mMirror = !item.mMirror;
+				}
+			}
+		}
+
+		/** Check a decoded snapshot against the original */
+		static void AssertDecoded(const CSnapshotCodec::Snapshot& original, const CSnapshotCodec::Snapshot& decoded, double quantum)
+		{
+			Assert::AreEqual(original.mSequence, decoded.mSequence);
+			Assert::AreEqual(original.mTime, decoded.mTime);
+			Assert::AreEqual(original.mItems.size(), decoded.mItems.size());
+			for (size_t i = 0; i < original.mItems.size(); i++)
+			{
+				auto& a = original.mItems[i];
+				auto& b = decoded.mItems[i];
+				Assert::AreEqual(a.mId, b.mId);
+				Assert::AreEqual(a.mType, b.mType);
+				Assert::AreEqual(a.mMirror, b.mMirror);
+				Assert::IsTrue(fabs(a.mX - b.mX) <= quantum / 2 + 1e-9);
+				Assert::IsTrue(fabs(a.mY - b.mY) <= quantum / 2 + 1e-9);
+			}
+		}
+
+		TEST_METHOD(TestCSnapshotCodecVarint)
+		{
+			vector<int64_t> signedValues = { 0, 1, -1, 63, -64, 64, 1000000, -1000000, INT64_MAX, INT64_MIN };
+			for (auto value : signedValues)
+			{
+				Assert::AreEqual(value, CSnapshotCodec::UnZigZag(CSnapshotCodec::ZigZag(value)));
+			}
+
+			// Small magnitudes in either direction stay small
+			Assert::AreEqual((uint64_t)0, CSnapshotCodec::ZigZag(0));
+			Assert::AreEqual((uint64_t)1, CSnapshotCodec::ZigZag(-1));
+			Assert::AreEqual((uint64_t)2, CSnapshotCodec::ZigZag(1));
+
+			vector<uint8_t> frame;
+			vector<uint64_t> values = { 0, 127, 128, 16383, 16384, 0xffffffffull, UINT64_MAX };
+			for (auto value : values)
+			{
+				CSnapshotCodec::PutVarint(frame, value);
+			}
+			Assert::AreEqual((size_t)(1 + 1 + 2 + 2 + 3 + 5 + 10), frame.size());
+
+			const uint8_t* at = frame.data();
+			for (auto value : values)
+			{
+				uint64_t read;
+				Assert::IsTrue(CSnapshotCodec::GetVarint(at, frame.data() + frame.size(), read));
+				Assert::AreEqual(value, read);
+			}
+
+			// A number cut off by the end of the frame does not read
+			uint8_t cut[] = { 0x80, 0x80 };
+			at = cut;
+			uint64_t read;
+			Assert::IsFalse(CSnapshotCodec::GetVarint(at, cut + 2, read));
+		}
+
+		TEST_METHOD(TestCSnapshotCodecRoundTrip)
+		{
+			mt19937 random(1);
+			CSnapshotCodec encoder(4, 10);
+			CSnapshotCodec decoder(4, 10);
+
+			auto snapshot = MakeSnapshot(200, random);
+			vector<uint8_t> frame;
+			CSnapshotCodec::Snapshot decoded;
+			for (int i = 0; i < 45; i++)
+			{
+				encoder.Encode(snapshot, frame);
+				Assert::AreEqual(i % 10 == 0, CSnapshotCodec::IsKeyframe(frame.data(), frame.size()));
+				Assert::IsTrue(decoder.Decode(frame.data(), frame.size(), decoded));
+				AssertDecoded(snapshot, decoded, encoder.GetQuantum());
+				Wander(snapshot, random);
+			}
+
+			Assert::AreEqual(5ll, encoder.GetNumKeyframes());
+			Assert::AreEqual(40ll, encoder.GetNumDeltas());
+		}
+
+		TEST_METHOD(TestCSnapshotCodecAddRemove)
+		{
+			mt19937 random(2);
+			CSnapshotCodec encoder;
+			CSnapshotCodec decoder;
+
+			auto snapshot = MakeSnapshot(50, random);
+			vector<uint8_t> frame;
+			CSnapshotCodec::Snapshot decoded;
+			encoder.Encode(snapshot, frame);
+			Assert::IsTrue(decoder.Decode(frame.data(), frame.size(), decoded));
+
+			// Remove the first, last and some middle items, add new ones
+			// between and after the others, and change the type of one
+			auto& items = snapshot.mItems;
+			items.erase(items.begin() + 30);
+			items.erase(items.begin() + 10, items.begin() + 13);
+			items.erase(items.begin());
+			items.pop_back();
+			items.insert(items.begin() + 5, CSnapshotCodec::Item{ 17, 1, true, 5.5, 6.5 });
+			items.push_back(CSnapshotCodec::Item{ 1000, 2, false, 100.25, 200.75 });
+			items[20].mType = 2;
+			Wander(snapshot, random);
+
+			encoder.Encode(snapshot, frame);
+			Assert::IsFalse(CSnapshotCodec::IsKeyframe(frame.data(), frame.size()));
+			Assert::IsTrue(decoder.Decode(frame.data(), frame.size(), decoded));
+			AssertDecoded(snapshot, decoded, encoder.GetQuantum());
+
+			// Everything removed
+			items.clear();
+			encoder.Encode(snapshot, frame);
+			Assert::IsTrue(decoder.Decode(frame.data(), frame.size(), decoded));
+			Assert::AreEqual((size_t)0, decoded.mItems.size());
+		}
+
+		TEST_METHOD(TestCSnapshotCodecErrors)
+		{
+			mt19937 random(3);
+			CSnapshotCodec encoder;
+			auto snapshot = MakeSnapshot(20, random);
+
+			vector<uint8_t> keyframe, delta;
+			encoder.Encode(snapshot, keyframe);
+			Wander(snapshot, random);
+			encoder.Encode(snapshot, delta);
+
+			// A delta does not decode without its keyframe
+			CSnapshotCodec decoder;
+			CSnapshotCodec::Snapshot decoded;
+			Assert::IsFalse(decoder.Decode(delta.data(), delta.size(), decoded));
+
+			// Cut off frames do not decode
+			for (size_t size = 0; size < keyframe.size(); size++)
+			{
+				Assert::IsFalse(decoder.Decode(keyframe.data(), size, decoded));
+			}
+
+			Assert::IsTrue(decoder.Decode(keyframe.data(), keyframe.size(), decoded));
+			for (size_t size = 0; size < delta.size(); size++)
+			{
+				Assert::IsFalse(decoder.Decode(delta.data(), size, decoded));
+			}
+			Assert::IsTrue(decoder.Decode(delta.data(), delta.size(), decoded));
+
+			// Neither do frames with something after them, or an unknown kind
+			delta.push_back(0);
+			Assert::IsFalse(decoder.Decode(delta.data(), delta.size(), decoded));
+			keyframe[0] = 7;
+			Assert::IsFalse(decoder.Decode(keyframe.data(), keyframe.size(), decoded));
+
+			// Corrupt frames never crash
+			for (int trial = 0; trial < 1000; trial++)
+			{
+				auto corrupt = delta;
+				corrupt[random() % corrupt.size()] = (uint8_t)random();
+				decoder.Decode(corrupt.data(), corrupt.size(), decoded);
+			}
+		}
+
+		TEST_METHOD(TestCSnapshotCodecMemory)
+		{
+			auto& accounting = CMemoryAccounting::Get();
+			auto before = accounting.GetUsage(CMemoryAccounting::Snapshots).mBytes;
+			{
+				mt19937 random(4);
+				CSnapshotCodec codec;
+				auto snapshot = MakeSnapshot(100, random);
+				vector<uint8_t> frame;
+				codec.Encode(snapshot, frame);
+				Assert::IsTrue(accounting.GetUsage(CMemoryAccounting::Snapshots).mBytes > before);
+			}
+
+			Assert::AreEqual(before, accounting.GetUsage(CMemoryAccounting::Snapshots).mBytes);
+		}
+
+		TEST_METHOD(TestCSnapshotCodecTypeNames)
+		{
+			CAquarium aquarium;
+			auto beta = make_shared<CFishBeta>(&aquarium);
+			beta->SetLocation(100, 100);
+			aquarium.Add(beta);
+
+			CSnapshotCodec encoder;
+			CSnapshotCodec decoder;
+			CSnapshotCodec::Snapshot snapshot, decoded;
+			vector<uint8_t> frame;
+			encoder.Take(&aquarium, snapshot);
+			encoder.Encode(snapshot, frame);
+			Assert::IsTrue(decoder.Decode(frame.data(), frame.size(), decoded));
+			Assert::AreEqual(wstring(L"beta"), decoder.GetTypeName(decoded.mItems[0].mType));
+
+			// A type first seen after the keyframe is named by the delta
+			auto magikarp = make_shared<CMagikarp>(&aquarium);
+			magikarp->SetLocation(200, 200);
+			aquarium.Add(magikarp);
+			encoder.Take(&aquarium, snapshot);
+			encoder.Encode(snapshot, frame);
+			Assert::IsFalse(CSnapshotCodec::IsKeyframe(frame.data(), frame.size()));
+			Assert::IsTrue(decoder.Decode(frame.data(), frame.size(), decoded));
+			Assert::AreEqual(2, (int)decoded.mItems.size());
+			Assert::AreEqual(wstring(L"magikarp"), decoder.GetTypeName(decoded.mItems[1].mType));
+		}
+
+		TEST_METHOD(TestCSnapshotCodecAquarium)
+		{
+			CAquarium aquarium;
+			aquarium.SetSeed(5);
+			for (int i = 0; i < 1000; i++)
+			{
+				shared_ptr<CItem> item;
+				if (i % 2 == 0)
+				{
+					item = make_shared<CFishBeta>(&aquarium);
+				}
+				else
+				{
+					item = make_shared<CMagikarp>(&aquarium);
+				}
+
+				item->SetLocation(100 + (i * 37) % 800, 100 + (i * 53) % 600);
+				aquarium.Add(item);
+			}
+
+			CSnapshotCodec encoder;
+			CSnapshotCodec decoder;
+			CSnapshotCodec::Snapshot snapshot, decoded;
+			vector<uint8_t> frame;
+			const int Ticks = 300;
+			for (int i = 0; i < Ticks; i++)
+			{
+				aquarium.Update(1.0 / 30);
+				encoder.Take(&aquarium, snapshot);
+				encoder.Encode(snapshot, frame);
+				Assert::IsTrue(decoder.Decode(frame.data(), frame.size(), decoded));
+				AssertDecoded(snapshot, decoded, encoder.GetQuantum());
+			}
+
+			// The decoder learns the type names from the frames
+			Assert::AreEqual(wstring(L"beta"), decoder.GetTypeName(decoded.mItems[0].mType));
+			Assert::AreEqual(wstring(L"magikarp"), decoder.GetTypeName(decoded.mItems[1].mType));
+
+			double rawMB = encoder.GetRawBytes() / 1048576.0;
+			wstringstream str;
+			str << L"Snapshot codec, 1000 fish, " << Ticks << L" ticks" << endl;
+			str << L"Raw " << rawMB << L" MB, encoded " << encoder.GetEncodedBytes() / 1048576.0
+				<< L" MB, ratio " << encoder.GetCompressionRatio() << L":1, "
+				<< (double)encoder.GetEncodedBytes() / Ticks / 1000 << L" bytes per item" << endl;
+			str << L"Encode " << rawMB / encoder.GetEncodeSeconds() << L" MB/s, decode "
+				<< rawMB / decoder.GetDecodeSeconds() << L" MB/s of raw snapshots" << endl;
+			Logger::WriteMessage(str.str().c_str());
+
+			// Fish moving a few pixels a tick pack well below their raw size
+			Assert::IsTrue(encoder.GetCompressionRatio() > 3);
+		}
+	};
+}
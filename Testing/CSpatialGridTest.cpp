@@ -0,0 +1,76 @@
+#include "pch.h"
+#include <memory>
+#include <vector>
+#include "CppUnitTest.h"
+#include "SpatialGrid.h"
+#include "Aquarium.h"
+#include "DecorCastle.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace std;
+
+namespace Testing
+{
+	TEST_CLASS(CSpatialGridTest)
+	{
+	public:
+
+		TEST_METHOD_INITIALIZE(methodName)
+		{
+			extern wchar_t g_dir[];
+			::SetCurrentDirectory(g_dir);
+		}
+
+		TEST_METHOD(TestCSpatialGridQuery)
+		{
+			CAquarium aquarium;
+			CSpatialGrid grid(100);
+
+			// A row of castles far apart, not in the aquarium so
+			// moving them does not touch its own index
+			vector<shared_ptr<CDecorCastle>> castles;
+			for (int i = 0; i < 10; i++)
+			{
+				castles.push_back(make_shared<CDecorCastle>(&aquarium));
+				castles.back()->SetLocation(i * 1000.0, 500);
+				grid.Insert(castles.back().get());
+			}
+
+			Assert::AreEqual(10, grid.GetCount());
+
+			vector<CItem*> found;
+			grid.Query(2900, 400, 4100, 600, found);
+			Assert::AreEqual(2, (int)found.size());
+			Assert::IsTrue(found[0] == castles[3].get());
+			Assert::IsTrue(found[1] == castles[4].get());
+
+			// Moving an item changes which queries find it
+			castles[3]->SetLocation(9000, 500);
+			grid.Move(castles[3].get());
+			grid.Query(2900, 400, 4100, 600, found);
+			Assert::AreEqual(1, (int)found.size());
+
+			// Reinserting puts an item in front
+			grid.Query(8900, 400, 9100, 600, found);
+			Assert::AreEqual(2, (int)found.size());
+			Assert::IsTrue(found[1] == castles[9].get());
+			grid.Insert(castles[3].get());
+			grid.Query(8900, 400, 9100, 600, found);
+			Assert::IsTrue(found[1] == castles[3].get());
+
+			grid.Remove(castles[9].get());
+			grid.Query(8900, 400, 9100, 600, found);
+			Assert::AreEqual(1, (int)found.size());
+			Assert::AreEqual(9, grid.GetCount());
+		}
+
+		TEST_METHOD(TestCSpatialGridTimeToLeave)
+		{
+			CSpatialGrid grid(100);
+			Assert::AreEqual(0.5, grid.GetTimeToLeaveCell(50, 50, 100, 0), 0.000001);
+			Assert::AreEqual(0.25, grid.GetTimeToLeaveCell(50, 25, 0, -100), 0.000001);
+			Assert::AreEqual(0.1, grid.GetTimeToLeaveCell(-10, 50, -100, 10), 0.000001);
+			Assert::IsTrue(grid.GetTimeToLeaveCell(50, 50, 0, 0) > 1e300);
+		}
+	};
+}
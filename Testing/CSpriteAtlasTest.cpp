@@ -0,0 +1,169 @@
+#include "pch.h"
+#include <memory>
+#include <vector>
+#include "CppUnitTest.h"
+#include "SpriteAtlas.h"
+#include "SpriteBatch.h"
+#include "Aquarium.h"
+#include "FishBeta.h"
+#include "Magikarp.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace Gdiplus;
+using namespace std;
+
+namespace Testing
+{
+	TEST_CLASS(CSpriteAtlasTest)
+	{
+	public:
+
+		TEST_METHOD_INITIALIZE(methodName)
+		{
+			extern wchar_t g_dir[];
+			::SetCurrentDirectory(g_dir);
+		}
+
+		/** Determine if two sprites overlap in a page, counting both copies */
+		static bool Overlaps(const CSpriteAtlas::Sprite* a, const CSpriteAtlas::Sprite* b)
+		{
+			if (a->mPage != b->mPage)
+			{
+				return false;
+			}
+
+			int aRight = a->mMirrorX + a->mWidth;
+			int bRight = b->mMirrorX + b->mWidth;
+			return a->mX < bRight && b->mX < aRight &&
+				a->mY < b->mY + b->mHeight && b->mY < a->mY + a->mHeight;
+		}
+
+		TEST_METHOD(TestCSpriteAtlasFind)
+		{
+			CSpriteAtlas atlas;
+
+			auto beta = atlas.Find(L"images/beta.png");
+			Assert::IsTrue(beta->mImage != nullptr);
+			Assert::AreEqual(125, beta->mWidth);
+			Assert::AreEqual(117, beta->mHeight);
+
+			// The mirrored copy sits beside the sprite
+			Assert::IsTrue(beta->mMirrorX >= beta->mX + beta->mWidth);
+
+			// Finding a sprite again does not pack it twice
+			Assert::IsTrue(beta == atlas.Find(L"images/beta.png"));
+			Assert::AreEqual(1, atlas.GetNumSprites());
+			Assert::AreEqual(1, atlas.GetNumPages());
+
+			// A file that does not decode has no image
+			auto missing = atlas.Find(L"images/nothere.png");
+			Assert::IsTrue(missing->mImage == nullptr);
+			Assert::AreEqual(1, atlas.GetNumSprites());
+		}
+
+		TEST_METHOD(TestCSpriteAtlasMirror)
+		{
+			CSpriteAtlas atlas;
+			auto sprite = atlas.Find(L"images/beta.png");
+
+			// Every column of the mirror is the opposite column of the sprite
+			for (int y = 0; y < sprite->mHeight; y += 13)
+			{
+				for (int x = 0; x < sprite->mWidth; x += 7)
+				{
+					Color normal, mirrored;
+					sprite->mImage->GetPixel(sprite->mX + x, sprite->mY + y, &normal);
+					sprite->mImage->GetPixel(sprite->mMirrorX + sprite->mWidth - 1 - x, sprite->mY + y, &mirrored);
+					Assert::IsTrue(normal.GetValue() == mirrored.GetValue());
+				}
+			}
+
+			// The middle of the beta is drawn
+			Color center;
+			sprite->mImage->GetPixel(sprite->mX + sprite->mWidth / 2, sprite->mY + sprite->mHeight / 2, &center);
+			Assert::IsTrue(center.GetAlpha() != 0);
+		}
+
+		TEST_METHOD(TestCSpriteAtlasMask)
+		{
+			CSpriteAtlas atlas;
+			auto sprite = atlas.Find(L"images/beta.png");
+			auto mask = sprite->GetMask();
+			Assert::IsTrue(mask != nullptr);
+
+			// A bit is set exactly where the page pixel shows
+			int drawn = 0;
+			for (int y = 0; y < sprite->mHeight; y++)
+			{
+				for (int x = 0; x < sprite->mWidth; x++)
+				{
+					Color color;
+					sprite->mImage->GetPixel(sprite->mX + x, sprite->mY + y, &color);
+					Assert::AreEqual(color.GetAlpha() != 0, mask->Test(x, y));
+					drawn += mask->Test(x, y) ? 1 : 0;
+				}
+			}
+			Assert::IsTrue(drawn > 0 && drawn < sprite->mWidth * sprite->mHeight);
+
+			// Reserved sprites hit over their whole box until filled
+			auto reserved = atlas.Reserve(L"images/magikarp.png", 100, 80);
+			Assert::IsTrue(reserved->GetMask() == nullptr);
+		}
+
+		TEST_METHOD(TestCSpriteAtlasPack)
+		{
+			// Small pages so the sprites spread over several
+			CSpriteAtlas atlas(256);
+			vector<const CSpriteAtlas::Sprite*> sprites;
+			for (auto name : { L"images/beta.png", L"images/buddha.png", L"images/magikarp.png",
+				L"images/castle.png", L"images/stinky.png", L"images/nemo.png", L"images/dory.png" })
+			{
+				sprites.push_back(atlas.Find(name));
+			}
+			Assert::IsTrue(atlas.GetNumPages() > 1);
+			Assert::AreEqual((int)sprites.size(), atlas.GetNumSprites());
+
+			for (size_t i = 0; i < sprites.size(); i++)
+			{
+				// Sprites too large for a page get a page their own size
+				Assert::IsTrue(sprites[i]->mMirrorX + sprites[i]->mWidth <= (int)sprites[i]->mImage->GetWidth());
+				Assert::IsTrue(sprites[i]->mY + sprites[i]->mHeight <= (int)sprites[i]->mImage->GetHeight());
+				for (size_t j = i + 1; j < sprites.size(); j++)
+				{
+					Assert::IsFalse(Overlaps(sprites[i], sprites[j]));
+				}
+			}
+		}
+
+		TEST_METHOD(TestCSpriteAtlasBatch)
+		{
+			CAquarium aquarium;
+			for (int i = 0; i < 20; i++)
+			{
+				shared_ptr<CItem> item;
+				if (i % 2 == 0)
+				{
+					item = make_shared<CFishBeta>(&aquarium);
+				}
+				else
+				{
+					item = make_shared<CMagikarp>(&aquarium);
+				}
+
+				item->SetLocation(100 + i * 30, 300);
+				item->SetMirror(i % 4 < 2);
+				aquarium.Add(item);
+			}
+
+			Bitmap target(1024, 800, PixelFormat32bppPARGB);
+			Graphics graphics(&target);
+			aquarium.OnDraw(&graphics);
+
+			// Both species come from one page, so the whole frame is one run
+			auto& batch = aquarium.GetSpriteBatch();
+			Assert::AreEqual(20, batch.GetNumDraws());
+			Assert::AreEqual(1, batch.GetNumRuns());
+		}
+
+	};
+}
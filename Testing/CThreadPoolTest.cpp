@@ -0,0 +1,128 @@
+#include "pch.h"
+#include <atomic>
+#include <vector>
+#include "CppUnitTest.h"
+#include "ThreadPool.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace std;
+
+namespace Testing
+{
+	TEST_CLASS(CThreadPoolTest)
+	{
+	public:
+
+		TEST_METHOD_INITIALIZE(methodName)
+		{
+			extern wchar_t g_dir[];
+			::SetCurrentDirectory(g_dir);
+		}
+
+		TEST_METHOD(TestCThreadPoolConstruct)
+		{
+			CThreadPool pool(3);
+			Assert::AreEqual(3, pool.GetNumThreads());
+
+			CThreadPool automatic;
+			Assert::IsTrue(automatic.GetNumThreads() >= 1);
+		}
+
+		TEST_METHOD(TestCThreadPoolWait)
+		{
+			CThreadPool pool(4);
+
+			atomic<long long> sum{ 0 };
+			for (int i = 1; i <= 1000; i++)
+			{
+				pool.Submit([&sum, i]() { sum += i; });
+			}
+
+			pool.Wait();
+			Assert::AreEqual(500500LL, (long long)sum);
+
+			// Waiting with nothing queued returns at once
+			pool.Wait();
+		}
+
+		TEST_METHOD(TestCThreadPoolNested)
+		{
+			CThreadPool pool(4);
+
+			// Tasks that submit more tasks land on the submitting
+			// worker, the others have to steal them
+			atomic<int> count{ 0 };
+			for (int i = 0; i < 4; i++)
+			{
+				pool.Submit([&pool, &count]() {
+					for (int j = 0; j < 100; j++)
+					{
+						pool.Submit([&count]() { count++; });
+					}
+					count++;
+				});
+			}
+
+			pool.Wait();
+			Assert::AreEqual(404, (int)count);
+		}
+
+		TEST_METHOD(TestCThreadPoolParallelFor)
+		{
+			for (int threads : { 1, 2, 3, 8 })
+			{
+				CThreadPool pool(threads);
+				for (size_t count : { 0, 1, 7, 1000, 100003 })
+				{
+					// Every index is run exactly once
+					vector<int> hits(count, 0);
+					pool.ParallelFor(count, [&hits](size_t begin, size_t end) {
+						for (size_t i = begin; i < end; i++)
+						{
+							hits[i]++;
+						}
+					});
+
+					for (auto hit : hits)
+					{
+						Assert::AreEqual(1, hit);
+					}
+				}
+			}
+
+			// The grain grows with the loop but never drops below the minimum
+			CThreadPool pool(4);
+			Assert::AreEqual((size_t)1, pool.GetGrain(10));
+			Assert::AreEqual((size_t)100, pool.GetGrain(10, 100));
+			Assert::AreEqual((size_t)(1000000 / 32), pool.GetGrain(1000000));
+
+			// A loop run from a worker runs on that worker
+			atomic<long long> sum{ 0 };
+			pool.Submit([&pool, &sum]() {
+				pool.ParallelFor(1000, [&sum](size_t begin, size_t end) {
+					for (size_t i = begin; i < end; i++)
+					{
+						sum += i;
+					}
+				});
+			});
+			pool.Wait();
+			Assert::AreEqual(499500LL, (long long)sum);
+		}
+
+		TEST_METHOD(TestCThreadPoolDestroy)
+		{
+			// Destroying the pool finishes the queued tasks first
+			atomic<int> count{ 0 };
+			{
+				CThreadPool pool(2);
+				for (int i = 0; i < 50; i++)
+				{
+					pool.Submit([&count]() { count++; });
+				}
+			}
+
+			Assert::AreEqual(50, (int)count);
+		}
+	};
+}
@@ -0,0 +1,262 @@
+#include "pch.h"
+#include <map>
+#include <memory>
+#include <sstream>
+#include <tuple>
+#include "CppUnitTest.h"
+#include "TiledTank.h"
+#include "Aquarium.h"
+#include "FishBeta.h"
+#include "Magikarp.h"
+#include "Stinky.h"
+#include "SessionPlayer.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace std;
+
+namespace Testing
+{
+	TEST_CLASS(CTiledTankTest)
+	{
+	public:
+
+		TEST_METHOD_INITIALIZE(methodName)
+		{
+			extern wchar_t g_dir[];
+			::SetCurrentDirectory(g_dir);
+		}
+
+		/// Item id to type and location
+		typedef map<unsigned, tuple<wstring, double, double>> Items;
+
+		/** Get every item of an aquarium by id */
+		static Items GetItems(CAquarium& aquarium)
+		{
+			Items items;
+			for (auto& item : aquarium.GetItems())
+			{
+				Assert::IsTrue(items.count(item->GetId()) == 0);
+				items[item->GetId()] = make_tuple(wstring(item->GetType()), item->GetX(), item->GetY());
+			}
+			return items;
+		}
+
+		/** Fill a 20000 by 15000 world with fish spread over it and write it as 1000 pixel tiles */
+		static Items MakeTank(const wstring& filename, int count)
+		{
+			CAquarium aquarium;
+			aquarium.SetWorldSize(20000, 15000);
+			for (int i = 0; i < count; i++)
+			{
+				shared_ptr<CItem> item;
+				if (i % 3 == 0)
+				{
+					item = make_shared<CFishBeta>(&aquarium);
+				}
+				else if (i % 3 == 1)
+				{
+					item = make_shared<CMagikarp>(&aquarium);
+				}
+				else
+				{
+					auto stinky = make_shared<CStinky>(&aquarium);
+					stinky->SetRepelDistance(100 + i % 50);
+					item = stinky;
+				}
+
+				item->CItem::SetLocation((i * 7919) % 20000 + 0.5, (i * 104729) % 15000 + 0.5);
+				aquarium.Add(item);
+			}
+
+			Assert::IsTrue(CTiledTank::Write(&aquarium, filename, 1000));
+			return GetItems(aquarium);
+		}
+
+		/** Get a temporary file name */
+		static wstring TempFile(const wstring& name)
+		{
+			wchar_t path[MAX_PATH];
+			GetTempPath(MAX_PATH, path);
+			return wstring(path) + name;
+		}
+
+		TEST_METHOD(TestCTiledTankRegion)
+		{
+			wstring filename = TempFile(L"tiled-test.aqtl");
+			auto all = MakeTank(filename, 6000);
+
+			CAquarium aquarium;
+			CTiledTank tank;
+			Assert::IsFalse(tank.Open(TempFile(L"tiled-test-missing.aqtl"), &aquarium));
+			Assert::IsTrue(tank.Open(filename, &aquarium));
+			Assert::AreEqual(20000, aquarium.GetWidth());
+			Assert::AreEqual(20, tank.GetNumColumns());
+			Assert::AreEqual(15, tank.GetNumRows());
+			Assert::AreEqual(0, aquarium.GetNumItems());
+
+			// A view inside one tile loads it and the ring around it
+			tank.SetView(5100, 5100, 5900, 5900);
+			tank.Wait();
+			Assert::AreEqual(9, tank.GetNumResident());
+			Assert::IsTrue(tank.IsResident(tank.GetTile(4500, 6500)));
+			Assert::IsFalse(tank.IsResident(tank.GetTile(7500, 5500)));
+
+			int expected = 0;
+			for (auto& item : all)
+			{
+				double x = get<1>(item.second), y = get<2>(item.second);
+				if (x >= 4000 && x < 7000 && y >= 4000 && y < 7000)
+				{
+					expected++;
+				}
+			}
+			Assert::AreEqual(expected, aquarium.GetNumItems());
+			Assert::AreEqual(9LL, tank.GetNumLoads());
+
+			// Items read are exactly the items written
+			for (auto& item : GetItems(aquarium))
+			{
+				Assert::IsTrue(all[item.first] == item.second);
+			}
+
+			Logger::WriteMessage(tank.Report().c_str());
+			Assert::IsTrue(tank.Close());
+			Assert::AreEqual(0, aquarium.GetNumItems());
+		}
+
+		TEST_METHOD(TestCTiledTankClear)
+		{
+			wstring filename = TempFile(L"tiled-test-clear.aqtl");
+			auto all = MakeTank(filename, 3000);
+
+			CAquarium aquarium;
+			CTiledTank tank;
+			CSessionPlayer player(&aquarium);
+			player.SetTiledTank(&tank);
+			Assert::IsTrue(tank.Open(filename, &aquarium));
+			tank.SetView(5100, 5100, 5900, 5900);
+			tank.Wait();
+			Assert::IsTrue(aquarium.GetNumItems() > 0);
+
+			// Clearing writes the tiles back before their items go
+			CSessionEvent clear;
+			clear.mType = CSessionEvent::Type::Clear;
+			player.Apply(clear);
+			Assert::IsFalse(tank.IsOpen());
+			Assert::AreEqual(0, aquarium.GetNumItems());
+			Assert::IsTrue(tank.Close());
+
+			// Every item is still in the file
+			CAquarium whole;
+			Assert::IsTrue(tank.Open(filename, &whole));
+			tank.SetView(0, 0, 20000, 15000);
+			tank.Wait();
+			Assert::IsTrue(GetItems(whole) == all);
+			Assert::IsTrue(tank.Close());
+		}
+
+		TEST_METHOD(TestCTiledTankStreaming)
+		{
+			wstring filename = TempFile(L"tiled-stream-test.aqtl");
+			auto all = MakeTank(filename, 6000);
+
+			CAquarium aquarium;
+			CTiledTank tank;
+			tank.SetEvictSeconds(0);
+			Assert::IsTrue(tank.Open(filename, &aquarium));
+
+			// Pan across the world; tiles behind the view go back to disk
+			int most = 0;
+			for (int step = 0; step < 50; step++)
+			{
+				double x = 500 + step * 350;
+				tank.SetView(x, 7100, x + 800, 7700);
+				tank.Wait();
+				most = max(most, tank.GetNumResident());
+			}
+
+			Assert::IsTrue(most <= 5 * 5);
+			Assert::IsTrue(tank.GetNumEvicted() > 0);
+			Assert::IsTrue(tank.GetNumResident() < 20);
+
+			// A new item is kept with the rest
+			auto added = make_shared<CFishBeta>(&aquarium);
+			added->SetLocation(18000, 7500);
+			aquarium.Add(added);
+			Assert::AreEqual(6001u, added->GetId());
+
+			wstringstream str;
+			str << L"Streaming: " << tank.GetNumReads() << L" reads, " << tank.GetNumWrites() << L" writes, "
+				<< tank.GetAverageLatency() * 1000 << L" ms average load, " << tank.GetMaxLatency() * 1000
+				<< L" ms worst" << endl;
+			Logger::WriteMessage(str.str().c_str());
+			Assert::IsTrue(tank.Close());
+
+			// Every item is still there, once
+			CTiledTank whole;
+			Assert::IsTrue(whole.Open(filename, &aquarium));
+			whole.SetView(0, 0, 20000, 15000);
+			whole.Wait();
+			auto items = GetItems(aquarium);
+			Assert::AreEqual(all.size() + 1, items.size());
+			for (auto& item : all)
+			{
+				Assert::IsTrue(items[item.first] == item.second);
+			}
+
+			// Ids stay unique after reopening
+			auto next = make_shared<CFishBeta>(&aquarium);
+			aquarium.Add(next);
+			Assert::AreEqual(6002u, next->GetId());
+		}
+
+		TEST_METHOD(TestCTiledTankMigration)
+		{
+			wstring filename = TempFile(L"tiled-migrate-test.aqtl");
+			MakeTank(filename, 600);
+
+			CAquarium aquarium;
+			CTiledTank tank;
+			tank.SetEvictSeconds(0);
+			Assert::IsTrue(tank.Open(filename, &aquarium));
+			tank.SetView(1100, 1100, 1900, 1900);
+			tank.Wait();
+
+			// One fish swims to a tile far from anything loaded, another
+			// to a tile that is loaded
+			auto distant = aquarium.GetItems()[0];
+			auto neighbor = aquarium.GetItems()[1];
+			distant->CItem::SetLocation(15500, 12500);
+			neighbor->CItem::SetLocation(2500, 500);
+			unsigned distantId = distant->GetId();
+			unsigned neighborId = neighbor->GetId();
+
+			// Moving away writes both back to the tiles they are in now
+			tank.SetView(10100, 1100, 10900, 1900);
+			tank.Wait();
+			Assert::AreEqual(1LL, tank.GetNumMigrated());
+			Assert::IsTrue(tank.Close());
+
+			Assert::IsTrue(tank.Open(filename, &aquarium));
+			tank.SetView(15100, 12100, 15900, 12900);
+			tank.Wait();
+			auto items = GetItems(aquarium);
+			Assert::IsTrue(items.count(distantId) == 1);
+			Assert::AreEqual(15500.0, get<1>(items[distantId]));
+			Assert::IsTrue(items.count(neighborId) == 0);
+			Assert::IsTrue(tank.Close());
+
+			Assert::IsTrue(tank.Open(filename, &aquarium));
+			tank.SetView(2100, 100, 2900, 900);
+			tank.Wait();
+			items = GetItems(aquarium);
+			Assert::IsTrue(items.count(neighborId) == 1);
+			Assert::IsTrue(items.count(distantId) == 0);
+
+			// Nothing was lost or copied
+			tank.SetView(0, 0, 20000, 15000);
+			tank.Wait();
+			Assert::AreEqual(600, aquarium.GetNumItems());
+		}
+	};
+}
@@ -0,0 +1,114 @@
+#include "pch.h"
+#include <string>
+#include <fstream>
+#include <streambuf>
+#include <regex>
+#include <thread>
+#include "CppUnitTest.h"
+#include "TraceLog.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace std;
+
+namespace Testing
+{
+	TEST_CLASS(CTraceLogTest)
+	{
+	public:
+
+		/**
+		* Create a path to a place to put temporary files
+		*/
+		wstring TempPath()
+		{
+			wchar_t path_nts[MAX_PATH];
+			GetTempPath(MAX_PATH, path_nts);
+			return wstring(path_nts);
+		}
+
+		TEST_METHOD(TestCTraceLogSave)
+		{
+			auto& log = CTraceLog::Get();
+			log.Clear();
+			log.SetMainThread();
+
+			{
+				CTraceScope scope("TestMain");
+			}
+
+			thread worker([]() {
+				CTraceScope scope("TestWorker");
+			});
+			worker.join();
+
+			wstring file = TempPath() + L"trace.json";
+			Assert::IsTrue(log.Save(file));
+
+			ifstream t(file);
+			string json((istreambuf_iterator<char>(t)), istreambuf_iterator<char>());
+
+			Assert::IsTrue(regex_search(json, regex("^\\{\"traceEvents\":\\[")));
+			Assert::IsTrue(regex_search(json, regex("\"name\":\"TestMain\",\"ph\":\"B\"")));
+			Assert::IsTrue(regex_search(json, regex("\"name\":\"TestMain\",\"ph\":\"E\"")));
+
+			// The worker events are on a different thread row
+			smatch mainMatch, workerMatch;
+			Assert::IsTrue(regex_search(json, mainMatch, regex("\"TestMain\",\"ph\":\"B\",\"ts\":[0-9]+,\"pid\":1,\"tid\":([0-9]+)")));
+			Assert::IsTrue(regex_search(json, workerMatch, regex("\"TestWorker\",\"ph\":\"B\",\"ts\":[0-9]+,\"pid\":1,\"tid\":([0-9]+)")));
+			Assert::IsTrue(mainMatch[1] != workerMatch[1]);
+
+			// Only the thread that called SetMainThread is labelled main
+			Assert::IsTrue(json.find("\"name\":\"main " + mainMatch[1].str() + "\"") != string::npos);
+			Assert::IsTrue(json.find("\"name\":\"worker " + workerMatch[1].str() + "\"") != string::npos);
+		}
+
+		TEST_METHOD(TestCTraceLogRing)
+		{
+			auto& log = CTraceLog::Get();
+			log.Clear();
+
+			// Far more events than a ring holds
+			thread worker([]() {
+				for (size_t i = 0; i < CTraceLog::RingEvents; i++)
+				{
+					CTraceScope scope("TestRing");
+				}
+			});
+			worker.join();
+
+			wstring file = TempPath() + L"trace-ring.json";
+			Assert::IsTrue(log.Save(file));
+
+			ifstream t(file);
+			string json((istreambuf_iterator<char>(t)), istreambuf_iterator<char>());
+
+			// Only the most recent events are kept, starting with a begin
+			auto count = [&json](const string& text) {
+				long long found = 0;
+				for (auto at = json.find(text); at != string::npos; at = json.find(text, at + 1))
+				{
+					found++;
+				}
+				return found;
+			};
+			auto begins = count("\"TestRing\",\"ph\":\"B\"");
+			auto ends = count("\"TestRing\",\"ph\":\"E\"");
+			Assert::IsTrue(begins + ends <= (long long)CTraceLog::RingEvents);
+			Assert::IsTrue(begins + ends >= (long long)CTraceLog::RingEvents - 2);
+			Assert::IsTrue(begins >= ends);
+
+			// The ring is handed on to the next thread, which gets an id of its own
+			thread next([]() {
+				CTraceScope scope("TestRingNext");
+			});
+			next.join();
+			smatch ringMatch, nextMatch;
+			Assert::IsTrue(log.Save(file));
+			ifstream u(file);
+			json.assign(istreambuf_iterator<char>(u), istreambuf_iterator<char>());
+			Assert::IsTrue(regex_search(json, ringMatch, regex("\"TestRing\",\"ph\":\"B\",\"ts\":[0-9]+,\"pid\":1,\"tid\":([0-9]+)")));
+			Assert::IsTrue(regex_search(json, nextMatch, regex("\"TestRingNext\",\"ph\":\"B\",\"ts\":[0-9]+,\"pid\":1,\"tid\":([0-9]+)")));
+			Assert::IsTrue(ringMatch[1] != nextMatch[1]);
+		}
+	};
+}
@@ -0,0 +1,305 @@
+#include "pch.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <vector>
+#include "CppUnitTest.h"
+#include "TrajectoryRecorder.h"
+#include "TrajectoryPlayer.h"
+#include "Aquarium.h"
+#include "FishBeta.h"
+#include "Magikarp.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace std;
+
+namespace Testing
+{
+	TEST_CLASS(CTrajectoryRecorderTest)
+	{
+	public:
+
+		TEST_METHOD_INITIALIZE(methodName)
+		{
+			extern wchar_t g_dir[];
+			::SetCurrentDirectory(g_dir);
+		}
+
+		/** Where every item is at one time */
+		struct Truth
+		{
+			double mTime;                               ///< Aquarium time
+			map<unsigned, pair<double, double>> mItems; ///< Location of each item by id
+		};
+
+		/** Get a file for a test recording */
+		static wstring RecordingPath()
+		{
+			wchar_t path[MAX_PATH];
+			GetTempPath(MAX_PATH, path);
+			return wstring(path) + L"trajectory-test.traj";
+		}
+
+		/** Fill an aquarium with fish */
+		static void Populate(CAquarium& aquarium, int count)
+		{
+			for (int i = 0; i < count; i++)
+			{
+				shared_ptr<CItem> item;
+				if (i % 2 == 0)
+				{
+					item = make_shared<CFishBeta>(&aquarium);
+				}
+				else
+				{
+					item = make_shared<CMagikarp>(&aquarium);
+				}
+
+				item->SetLocation(100 + (i * 37) % 800, 100 + (i * 53) % 600);
+				aquarium.Add(item);
+			}
+		}
+
+		/** Remember where every item is now */
+		static Truth Take(CAquarium& aquarium)
+		{
+			Truth truth;
+			truth.mTime = aquarium.GetTime();
+
+			vector<CItem*> items;
+			aquarium.Query(0, 0, aquarium.GetWidth(), aquarium.GetHeight(), items);
+			for (auto item : items)
+			{
+				truth.mItems[item->GetId()] = make_pair(item->GetX(), item->GetY());
+			}
+
+			return truth;
+		}
+
+		/** Seek to each remembered time in a shuffled order and check every item */
+		static double Check(CTrajectoryPlayer& player, vector<Truth> truths, double tolerance)
+		{
+			shuffle(truths.begin(), truths.end(), mt19937(1));
+
+			double worst = 0;
+			vector<CTrajectoryPlayer::Item> items;
+			for (auto& truth : truths)
+			{
+				Assert::IsTrue(player.Seek(truth.mTime));
+				player.GetItems(items);
+				Assert::AreEqual(truth.mItems.size(), items.size());
+				for (auto& item : items)
+				{
+					auto& location = truth.mItems.at(item.mId);
+					worst = max(worst, max(fabs(item.mX - location.first), fabs(item.mY - location.second)));
+				}
+			}
+
+			Assert::IsTrue(worst <= tolerance);
+			return worst;
+		}
+
+		TEST_METHOD(TestCTrajectoryRecorderStepped)
+		{
+			CAquarium aquarium;
+			aquarium.SetSeed(1);
+			Populate(aquarium, 200);
+
+			CTrajectoryRecorder recorder(2, 0.5);
+			Assert::IsTrue(recorder.Open(RecordingPath()));
+
+			mt19937 random(2);
+			vector<CItem*> items;
+			vector<Truth> truths;
+			int drags = 0;
+			recorder.Sample(&aquarium);
+			for (int tick = 0; tick < 300; tick++)
+			{
+				aquarium.Update(1.0 / 30);
+				recorder.Sample(&aquarium);
+
+				// Now and then a fish is dragged somewhere else
+				if (tick % 20 == 5)
+				{
+					aquarium.Query(0, 0, aquarium.GetWidth(), aquarium.GetHeight(), items);
+					auto item = items[random() % items.size()];
+					item->SetLocation(200 + random() % 600, 200 + random() % 400);
+					recorder.Sample(&aquarium, CTrajectoryRecorder::Drag);
+					drags++;
+				}
+
+				if (tick % 7 == 3)
+				{
+					truths.push_back(Take(aquarium));
+				}
+			}
+
+			// Fish taken out end their paths
+			aquarium.Clear();
+			recorder.Sample(&aquarium);
+			Assert::IsTrue(recorder.Close());
+
+			Assert::AreEqual(200ll, recorder.GetNumEvents(CTrajectoryRecorder::Start));
+			Assert::AreEqual(200ll, recorder.GetNumEvents(CTrajectoryRecorder::End));
+			Assert::AreEqual((long long)drags, recorder.GetNumEvents(CTrajectoryRecorder::Drag));
+			Assert::IsTrue(recorder.GetNumChunks() >= 5);
+
+			CTrajectoryPlayer player;
+			Assert::IsTrue(player.Open(RecordingPath()));
+			Assert::AreEqual(recorder.GetNumChunks(), player.GetNumChunks());
+			Assert::AreEqual(0.0, player.GetStartTime());
+			Assert::AreEqual(aquarium.GetTime(), player.GetEndTime());
+
+			// Stepped bounces overshoot the walls, and are corrected
+			// once they are off by more than the tolerance
+			double worst = Check(player, truths, 0.5 + 1e-3);
+
+			Assert::IsTrue(player.Seek(player.GetEndTime()));
+			vector<CTrajectoryPlayer::Item> played;
+			player.GetItems(played);
+			Assert::AreEqual((size_t)0, played.size());
+			Assert::IsTrue(player.Seek(0));
+			player.GetItems(played);
+			Assert::AreEqual((size_t)200, played.size());
+			Assert::AreEqual(wstring(L"beta"), player.GetTypeName(played[0].mType));
+			Assert::AreEqual(1u, played[0].mId);
+
+			wstringstream str;
+			str << L"Stepped, 200 fish, 300 ticks: " << recorder.GetNumEvents() << L" events, "
+				<< recorder.GetNumEvents(CTrajectoryRecorder::Bounce) << L" bounces, "
+				<< recorder.GetBytesWritten() << L" bytes, worst error " << worst << endl;
+			Logger::WriteMessage(str.str().c_str());
+		}
+
+		TEST_METHOD(TestCTrajectoryRecorderEventDriven)
+		{
+			CAquarium aquarium;
+			aquarium.SetSeed(3);
+			aquarium.SetEventDriven(true);
+			Populate(aquarium, 200);
+
+			CTrajectoryRecorder recorder(10);
+			Assert::IsTrue(recorder.Open(RecordingPath()));
+
+			vector<Truth> truths;
+			recorder.Sample(&aquarium);
+			for (int tick = 0; tick < 600; tick++)
+			{
+				aquarium.Update(1.0 / 30);
+				recorder.Sample(&aquarium);
+				if (tick % 11 == 0)
+				{
+					truths.push_back(Take(aquarium));
+				}
+			}
+			Assert::IsTrue(recorder.Close());
+
+			// Continuous bounces are just what the model predicts, so
+			// only a fish first turning to face the way it swims is an event
+			Assert::AreEqual(0ll, recorder.GetNumEvents(CTrajectoryRecorder::Speed));
+			Assert::IsTrue(recorder.GetNumEvents() <= 200 * 2);
+
+			CTrajectoryPlayer player;
+			Assert::IsTrue(player.Open(RecordingPath()));
+			Check(player, truths, 0.01);
+
+			// Playing forward a frame at a time loads each chunk once
+			Assert::IsTrue(player.Seek(0));
+			auto loads = player.GetNumLoads();
+			for (double time = 0; time < player.GetEndTime() + 0.25; time += 0.25)
+			{
+				Assert::IsTrue(player.Seek(time));
+			}
+			Assert::AreEqual(loads + player.GetNumChunks() - 1, player.GetNumLoads());
+		}
+
+		TEST_METHOD(TestCTrajectoryRecorderErrors)
+		{
+			CTrajectoryPlayer player;
+			Assert::IsFalse(player.Open(RecordingPath() + L".missing"));
+			Assert::IsFalse(player.Seek(0));
+
+			CAquarium aquarium;
+			Populate(aquarium, 10);
+			{
+				CTrajectoryRecorder recorder(1);
+				Assert::IsTrue(recorder.Open(RecordingPath()));
+				for (int tick = 0; tick < 90; tick++)
+				{
+					aquarium.Update(1.0 / 30);
+					recorder.Sample(&aquarium);
+				}
+			}
+
+			// The destructor finishes the file
+			Assert::IsTrue(player.Open(RecordingPath()));
+			Assert::AreEqual(3, player.GetNumChunks());
+			player.Close();
+
+			// A recording cut off before its index does not open
+			ifstream in(RecordingPath(), ios::binary);
+			vector<char> bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+			in.close();
+			{
+				ofstream out(RecordingPath(), ios::binary | ios::trunc);
+				out.write(bytes.data(), bytes.size() - 10);
+			}
+			Assert::IsFalse(player.Open(RecordingPath()));
+		}
+
+		TEST_METHOD(TestCTrajectoryRecorderSize)
+		{
+			const int Fish = 10000;
+			const int Seconds = 1200;
+
+			CAquarium aquarium;
+			aquarium.SetSeed(4);
+			aquarium.SetEventDriven(true);
+			Populate(aquarium, Fish);
+
+			// Samples a second apart fast forward the tank each time
+			CTrajectoryRecorder recorder;
+			Assert::IsTrue(recorder.Open(RecordingPath()));
+			recorder.Sample(&aquarium);
+			for (int second = 0; second < Seconds; second++)
+			{
+				aquarium.Update(1);
+				recorder.Sample(&aquarium);
+			}
+			Assert::IsTrue(recorder.Close());
+
+			// A day is the same keyframes and events again and again
+			double day = 24.0 * 3600 / Seconds;
+			double dayMB = recorder.GetBytesWritten() * day / 1048576.0;
+
+			CTrajectoryPlayer player;
+			Assert::IsTrue(player.Open(RecordingPath()));
+			auto start = chrono::steady_clock::now();
+			vector<CTrajectoryPlayer::Item> items;
+			mt19937 random(5);
+			const int Seeks = 100;
+			for (int i = 0; i < Seeks; i++)
+			{
+				Assert::IsTrue(player.Seek(random() % (Seconds * 1000) / 1000.0));
+				player.GetItems(items);
+				Assert::AreEqual((size_t)Fish, items.size());
+			}
+			double seek = chrono::duration<double>(chrono::steady_clock::now() - start).count() / Seeks;
+
+			wstringstream str;
+			str << L"Trajectories, " << Fish << L" fish, " << Seconds << L" s: " << recorder.GetNumEvents()
+				<< L" events, " << recorder.GetNumChunks() << L" chunks, " << recorder.GetBytesWritten() / 1048576.0
+				<< L" MB, " << dayMB << L" MB a day" << endl;
+			str << L"Sample " << recorder.GetSampleSeconds() * 1000 / recorder.GetNumSamples() << L" ms, random seek "
+				<< seek * 1000 << L" ms" << endl;
+			Logger::WriteMessage(str.str().c_str());
+
+			Assert::IsTrue(dayMB < 100);
+		}
+	};
+}
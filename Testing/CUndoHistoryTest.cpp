@@ -0,0 +1,307 @@
+#include "pch.h"
+#include <cmath>
+#include <memory>
+#include <sstream>
+#include <vector>
+#include "CppUnitTest.h"
+#include "UndoHistory.h"
+#include "ItemSequence.h"
+#include "Aquarium.h"
+#include "FishBeta.h"
+#include "Magikarp.h"
+#include "DecorCastle.h"
+#include "MemoryAccounting.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace std;
+
+namespace Testing
+{
+	TEST_CLASS(CUndoHistoryTest)
+	{
+	public:
+
+		TEST_METHOD_INITIALIZE(methodName)
+		{
+			extern wchar_t g_dir[];
+			::SetCurrentDirectory(g_dir);
+		}
+
+		/** Make a fish at a spread out location */
+		static shared_ptr<CItem> MakeFish(CAquarium& aquarium, int i)
+		{
+			shared_ptr<CItem> item;
+			if (i % 2 == 0)
+			{
+				item = make_shared<CFishBeta>(&aquarium);
+			}
+			else
+			{
+				item = make_shared<CMagikarp>(&aquarium);
+			}
+
+			item->SetLocation(100 + (i * 37) % 800, 100 + (i * 53) % 600);
+			return item;
+		}
+
+		TEST_METHOD(TestCItemSequence)
+		{
+			vector<shared_ptr<CItem>> items;
+			CAquarium aquarium;
+			for (int i = 0; i < 100; i++)
+			{
+				items.push_back(MakeFish(aquarium, i));
+			}
+
+			CItemSequence built(items);
+			Assert::AreEqual((size_t)100, built.GetSize());
+
+			// Changes make new versions and leave the old one alone
+			auto inserted = built.Insert(10, items[99]).Erase(100).PushBack(items[0]).Erase(0);
+			Assert::AreEqual((size_t)100, built.GetSize());
+			Assert::AreEqual((size_t)100, inserted.GetSize());
+			Assert::IsTrue(built.Get(10) == items[10]);
+			Assert::IsTrue(inserted.Get(9) == items[99]);
+			Assert::IsTrue(inserted.Get(10) == items[10]);
+			Assert::IsTrue(inserted.Get(99) == items[0]);
+
+			vector<shared_ptr<CItem>> got;
+			built.ToVector(got);
+			Assert::IsTrue(got == items);
+			Assert::IsTrue(built.Get(100) == nullptr);
+			Assert::IsTrue(CItemSequence().Get(0) == nullptr);
+		}
+
+		TEST_METHOD(TestCUndoHistoryRoundTrip)
+		{
+			CAquarium aquarium;
+			CUndoHistory history(&aquarium);
+			Assert::IsFalse(history.CanUndo());
+			Assert::IsFalse(history.Undo());
+
+			// The hash covers the order and location of every item
+			vector<uint64_t> hashes;
+			hashes.push_back(aquarium.GetStateHash());
+
+			vector<shared_ptr<CItem>> items;
+			for (int i = 0; i < 5; i++)
+			{
+				items.push_back(MakeFish(aquarium, i));
+				history.Add(items.back());
+				hashes.push_back(aquarium.GetStateHash());
+			}
+
+			history.BeginDrag(items[1]);
+			aquarium.MoveToFront(items[1]);
+			history.DragTo(500, 400);
+			history.DragTo(520, 410);
+			history.EndDrag();
+			hashes.push_back(aquarium.GetStateHash());
+
+			// Already in front, so nothing to undo
+			history.MoveToFront(items[1]);
+			Assert::AreEqual(6, history.GetNumSteps());
+
+			history.MoveToFront(items[3]);
+			hashes.push_back(aquarium.GetStateHash());
+
+			// Clicked without moving is a move to the front
+			history.BeginDrag(items[0]);
+			aquarium.MoveToFront(items[0]);
+			history.EndDrag();
+			hashes.push_back(aquarium.GetStateHash());
+			Assert::AreEqual(wstring(L"Move to Front"), history.GetStepName(history.GetNumSteps() - 1));
+
+			history.Clear();
+			Assert::AreEqual(0, aquarium.GetNumItems());
+			hashes.push_back(aquarium.GetStateHash());
+			Assert::AreEqual((int)hashes.size() - 1, history.GetNumSteps());
+
+			for (int step = (int)hashes.size() - 2; step >= 0; step--)
+			{
+				Assert::IsTrue(history.Undo());
+				Assert::AreEqual(hashes[step], aquarium.GetStateHash());
+			}
+			Assert::IsFalse(history.CanUndo());
+
+			for (size_t step = 1; step < hashes.size(); step++)
+			{
+				Assert::IsTrue(history.Redo());
+				Assert::AreEqual(hashes[step], aquarium.GetStateHash());
+			}
+			Assert::IsFalse(history.CanRedo());
+
+			// An edit after undoing drops the steps that were undone
+			history.Undo();
+			history.Undo();
+			history.Add(MakeFish(aquarium, 5));
+			Assert::IsFalse(history.CanRedo());
+			Assert::AreEqual((int)hashes.size() - 2, history.GetNumSteps());
+
+			// Items changed behind our back leave nothing to undo
+			aquarium.Add(MakeFish(aquarium, 6));
+			Assert::IsFalse(history.Undo());
+			Assert::IsFalse(history.CanUndo());
+		}
+
+		TEST_METHOD(TestCUndoHistoryLoad)
+		{
+			wchar_t path[MAX_PATH];
+			GetTempPath(MAX_PATH, path);
+			wstring filename = wstring(path) + L"undo-test.aqua";
+
+			CAquarium aquarium;
+			aquarium.SetSeed(9);
+			aquarium.SetWorldSize(3000, 2000);
+			for (int i = 0; i < 20; i++)
+			{
+				aquarium.Add(MakeFish(aquarium, i));
+			}
+			aquarium.SetSchooling(true);
+			aquarium.SetEventDriven(true);
+			aquarium.Save(filename);
+
+			aquarium.Clear();
+			aquarium.SetEventDriven(false);
+			aquarium.SetSchooling(false);
+			aquarium.SetColliding(true);
+			aquarium.SetSeed(3);
+			aquarium.SetWorldSize(1024, 768);
+			CUndoHistory history(&aquarium);
+			history.Add(make_shared<CDecorCastle>(&aquarium));
+			auto before = aquarium.GetStateHash();
+			auto beforeSettings = aquarium.GetSettings();
+
+			history.Load(filename);
+			Assert::AreEqual(20, aquarium.GetNumItems());
+			Assert::AreEqual(3000, aquarium.GetWidth());
+			Assert::IsTrue(aquarium.IsSchooling());
+			Assert::IsTrue(aquarium.IsEventDriven());
+			auto after = aquarium.GetStateHash();
+			auto afterSettings = aquarium.GetSettings();
+
+			// Undoing the load puts back the modes and random streams too
+			Assert::IsTrue(history.Undo());
+			Assert::AreEqual(1, aquarium.GetNumItems());
+			Assert::AreEqual(1024, aquarium.GetWidth());
+			Assert::AreEqual(before, aquarium.GetStateHash());
+			Assert::IsFalse(aquarium.IsSchooling());
+			Assert::IsFalse(aquarium.IsEventDriven());
+			Assert::IsTrue(aquarium.IsColliding());
+			Assert::IsTrue(aquarium.GetSettings().mSeed == beforeSettings.mSeed);
+			Assert::IsTrue(aquarium.GetSettings().mNextStream == beforeSettings.mNextStream);
+
+			Assert::IsTrue(history.Redo());
+			Assert::AreEqual(3000, aquarium.GetWidth());
+			Assert::AreEqual(after, aquarium.GetStateHash());
+			Assert::IsTrue(aquarium.IsSchooling());
+			Assert::IsTrue(aquarium.IsEventDriven());
+			Assert::IsFalse(aquarium.IsColliding());
+			Assert::IsTrue(aquarium.GetSettings().mSeed == afterSettings.mSeed);
+		}
+
+		TEST_METHOD(TestCUndoHistoryEventDriven)
+		{
+			CAquarium aquarium;
+			aquarium.SetEventDriven(true);
+			CUndoHistory history(&aquarium);
+			for (int i = 0; i < 50; i++)
+			{
+				history.Add(MakeFish(aquarium, i));
+			}
+
+			// Items come back where they were when they were taken out
+			for (int tick = 0; tick < 30; tick++)
+			{
+				aquarium.Update(1.0 / 30);
+			}
+			auto hash = aquarium.GetStateHash();
+			history.Clear();
+			Assert::IsTrue(history.Undo());
+			Assert::AreEqual(hash, aquarium.GetStateHash());
+
+			// And carry on swimming
+			for (int tick = 0; tick < 30; tick++)
+			{
+				aquarium.Update(1.0 / 30);
+			}
+			Assert::IsTrue(hash != aquarium.GetStateHash());
+			Assert::IsTrue(history.Undo());
+			Assert::AreEqual(49, aquarium.GetNumItems());
+		}
+
+		TEST_METHOD(TestCUndoHistorySharing)
+		{
+			const int Items = 20000;
+
+			auto& accounting = CMemoryAccounting::Get();
+			auto journal = accounting.GetUsage(CMemoryAccounting::Journal).mBytes;
+			auto live = CItemSequence::GetNumLive();
+			{
+				CAquarium aquarium;
+				CUndoHistory history(&aquarium, 1LL << 40);
+				for (int i = 0; i < Items; i++)
+				{
+					history.Add(MakeFish(aquarium, i));
+				}
+
+				// Each add copies a path through the tree, not the tree
+				double perAdd = (double)(CItemSequence::GetNumLive() - live) / Items;
+				Assert::IsTrue(perAdd < 4 * log2(Items));
+
+				// Clearing shares the version that already exists
+				history.Clear();
+				long long clear = history.GetStepBytes(history.GetNumSteps() - 1);
+				Assert::IsTrue(clear < 1024);
+
+				// Moving one item to the front costs a couple of paths
+				history.Undo();
+				auto item = aquarium.GetItems()[Items / 2];
+				history.MoveToFront(item);
+				long long raise = history.GetStepBytes(history.GetNumSteps() - 1);
+				Assert::IsTrue(raise < 1024 + 16 * log2(Items) * CItemSequence::GetNodeBytes());
+
+				Assert::AreEqual(history.GetBytes(), accounting.GetUsage(CMemoryAccounting::Journal).mBytes - journal);
+
+				wstringstream str;
+				str << L"Undo history, " << Items << L" adds: " << perAdd << L" nodes per add, "
+					<< history.GetBytes() / 1048576.0 << L" MB, clear " << clear << L" bytes, move to front "
+					<< raise << L" bytes" << endl;
+				Logger::WriteMessage(str.str().c_str());
+			}
+
+			// Everything is given back
+			Assert::AreEqual(live, CItemSequence::GetNumLive());
+			Assert::AreEqual(journal, accounting.GetUsage(CMemoryAccounting::Journal).mBytes);
+		}
+
+		TEST_METHOD(TestCUndoHistoryCap)
+		{
+			CAquarium aquarium;
+			CUndoHistory history(&aquarium, 64 * 1024);
+			for (int i = 0; i < 2000; i++)
+			{
+				history.Add(MakeFish(aquarium, i));
+				Assert::IsTrue(history.GetBytes() <= history.GetMaxBytes());
+			}
+
+			Assert::IsTrue(history.GetNumDropped() > 0);
+			Assert::AreEqual(2000LL, history.GetNumDropped() + history.GetNumSteps());
+
+			// Undo reaches back as far as the kept steps
+			int undone = 0;
+			while (history.Undo())
+			{
+				undone++;
+			}
+			Assert::AreEqual(history.GetNumSteps(), undone);
+			Assert::AreEqual((int)history.GetNumDropped(), aquarium.GetNumItems());
+
+			Assert::IsTrue(history.Report().find(L"(undone) Add") != wstring::npos);
+
+			// A lower cap drops more
+			history.SetMaxBytes(1024);
+			Assert::IsTrue(history.GetBytes() <= 1024);
+		}
+	};
+}
@@ -0,0 +1,190 @@
+#include "pch.h"
+#include <cmath>
+#include <memory>
+#include <sstream>
+#include <vector>
+#include "CppUnitTest.h"
+#include "UpdateLod.h"
+#include "Aquarium.h"
+#include "FishBeta.h"
+#include "Magikarp.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace std;
+
+namespace Testing
+{
+	TEST_CLASS(CUpdateLodTest)
+	{
+	public:
+
+		TEST_METHOD_INITIALIZE(methodName)
+		{
+			extern wchar_t g_dir[];
+			::SetCurrentDirectory(g_dir);
+		}
+
+		/** Fill a 4000 by 3000 world with fish spread over it */
+		static void Fill(CAquarium& aquarium, int count)
+		{
+			aquarium.SetWorldSize(4000, 3000);
+			for (int i = 0; i < count; i++)
+			{
+				shared_ptr<CItem> item;
+				if (i % 2 == 0)
+				{
+					item = make_shared<CFishBeta>(&aquarium);
+				}
+				else
+				{
+					item = make_shared<CMagikarp>(&aquarium);
+				}
+
+				item->SetLocation(100 + (i * 379) % 3800, 100 + (i * 211) % 2800);
+				aquarium.Add(item);
+			}
+		}
+
+		TEST_METHOD(TestCUpdateLodClassify)
+		{
+			CAquarium aquarium;
+			CUpdateLod lod;
+			auto fish = make_shared<CFishBeta>(&aquarium);
+
+			// Without a view everything is visible
+			fish->SetLocation(3900, 2900);
+			Assert::IsTrue(lod.Classify(fish.get()) == CUpdateLod::Visible);
+
+			lod.SetView(0, 0, 800, 600);
+			fish->SetLocation(400, 300);
+			Assert::IsTrue(lod.Classify(fish.get()) == CUpdateLod::Visible);
+			fish->SetLocation(800 + CUpdateLod::DefaultGuard - 1, 300);
+			Assert::IsTrue(lod.Classify(fish.get()) == CUpdateLod::Visible);
+			fish->SetLocation(800 + CUpdateLod::DefaultGuard + 1, 300);
+			Assert::IsTrue(lod.Classify(fish.get()) == CUpdateLod::Near);
+			fish->SetLocation(400, 600 + CUpdateLod::DefaultGuard + CUpdateLod::DefaultNearMargin + 1);
+			Assert::IsTrue(lod.Classify(fish.get()) == CUpdateLod::Far);
+
+			lod.ClearView();
+			Assert::IsTrue(lod.Classify(fish.get()) == CUpdateLod::Visible);
+		}
+
+		TEST_METHOD(TestCUpdateLodTiers)
+		{
+			const int Items = 2000;
+			const int Frames = 64;
+
+			// Two tanks with the same fish, one updated at full rate
+			CAquarium full, lod;
+			Fill(full, Items);
+			Fill(lod, Items);
+			Assert::AreEqual(full.GetStateHash(), lod.GetStateHash());
+
+			lod.GetUpdateLod().SetView(1000, 1000, 1800, 1600);
+			lod.SetUpdateLod(true);
+
+			// Fish that stay in the view and its guard band the whole time
+			vector<bool> stayed(Items, true);
+			double guard = CUpdateLod::DefaultGuard;
+			for (int frame = 0; frame < Frames; frame++)
+			{
+				for (int i = 0; i < Items; i++)
+				{
+					auto item = full.GetItems()[i];
+					stayed[i] = stayed[i] && item->GetX() >= 1000 - guard && item->GetX() <= 1800 + guard &&
+						item->GetY() >= 1000 - guard && item->GetY() <= 1600 + guard;
+				}
+
+				full.Update(1.0 / 30);
+				lod.Update(1.0 / 30);
+			}
+
+			auto& counts = lod.GetUpdateLod();
+			int visible = counts.GetNumItems(CUpdateLod::Visible);
+			int nearby = counts.GetNumItems(CUpdateLod::Near);
+			int distant = counts.GetNumItems(CUpdateLod::Far);
+			Assert::AreEqual(Items, visible + nearby + distant);
+			Assert::IsTrue(visible > 0 && nearby > 0 && distant > 0);
+
+			// Near fish are updated every fourth frame, far fish every sixteenth
+			double nearRate = (double)counts.GetNumTicks(CUpdateLod::Near) / (nearby * Frames);
+			double farRate = (double)counts.GetNumTicks(CUpdateLod::Far) / (distant * Frames);
+			Assert::IsTrue(fabs(nearRate - 1.0 / CUpdateLod::DefaultNearInterval) < 0.05);
+			Assert::IsTrue(fabs(farRate - 1.0 / CUpdateLod::DefaultFarBatches) < 0.02);
+			Assert::AreEqual((long long)Items * Frames, counts.GetNumSkipped() + counts.GetNumTicks(CUpdateLod::Visible) +
+				counts.GetNumTicks(CUpdateLod::Near) + counts.GetNumTicks(CUpdateLod::Far));
+			Assert::IsTrue(counts.GetSavedFraction() > 0.5);
+
+			// Fish that stayed in view moved exactly as at full rate, the
+			// others only differ by where in a frame they bounced, and
+			// none left the tank by more than a frame of motion
+			lod.Synchronize();
+			const double Step = 200.0 / 30;
+			int stayedCount = 0;
+			for (int i = 0; i < Items; i++)
+			{
+				auto a = full.GetItems()[i];
+				auto b = lod.GetItems()[i];
+				if (stayed[i])
+				{
+					stayedCount++;
+					Assert::AreEqual(a->GetX(), b->GetX());
+					Assert::AreEqual(a->GetY(), b->GetY());
+				}
+				else
+				{
+					Assert::IsTrue(fabs(a->GetX() - b->GetX()) < 3 * Step);
+					Assert::IsTrue(fabs(a->GetY() - b->GetY()) < 3 * Step);
+				}
+
+				double minX, maxX, minY, maxY;
+				b->GetBounds(minX, maxX, minY, maxY);
+				Assert::IsTrue(b->GetX() >= minX - Step && b->GetX() <= maxX + Step);
+				Assert::IsTrue(b->GetY() >= minY - Step && b->GetY() <= maxY + Step);
+			}
+			Assert::IsTrue(stayedCount > 0);
+
+			wstringstream str;
+			str << L"Update LOD, " << Items << L" fish: " << visible << L" visible, " << nearby << L" near, "
+				<< distant << L" far, " << counts.GetSavedFraction() * 100 << L"% of updates skipped, "
+				<< counts.GetSavedSeconds() * 1000 << L" ms saved" << endl;
+			Logger::WriteMessage(str.str().c_str());
+		}
+
+		TEST_METHOD(TestCUpdateLodToggle)
+		{
+			CAquarium full, lod;
+			Fill(full, 500);
+			Fill(lod, 500);
+
+			// With the whole world in view nothing is skipped
+			lod.GetUpdateLod().SetView(0, 0, 4000, 3000);
+			lod.SetUpdateLod(true);
+			for (int frame = 0; frame < 30; frame++)
+			{
+				full.Update(1.0 / 30);
+				lod.Update(1.0 / 30);
+			}
+			Assert::AreEqual(0LL, lod.GetUpdateLod().GetNumSkipped());
+			Assert::AreEqual(full.GetStateHash(), lod.GetStateHash());
+
+			// Long frames jump ahead the same way
+			full.Update(2);
+			lod.Update(2);
+			Assert::AreEqual(full.GetStateHash(), lod.GetStateHash());
+
+			// Turning it off brings every fish up to date
+			lod.GetUpdateLod().SetView(0, 0, 10, 10);
+			for (int frame = 0; frame < 10; frame++)
+			{
+				lod.Update(1.0 / 30);
+			}
+			lod.SetUpdateLod(false);
+			Assert::IsFalse(lod.IsUpdateLod());
+			for (auto& item : lod.GetItems())
+			{
+				Assert::AreEqual(lod.GetTime(), item->GetSyncTime());
+			}
+		}
+	};
+}
@@ -1,5 +1,7 @@
 #include "pch.h"
 #include "CppUnitTest.h"
+#include "SpriteAtlas.h"
+#include "MipCache.h"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -14,6 +16,11 @@ using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 // a header every test will have to include.
 wchar_t g_dir[1000]; 
 
+// Benchmarks take minutes and their times vary from run to run, so
+// they only run when the AQUARIUM_BENCHMARKS environment variable is
+// set. Otherwise a normal test run stays quick and deterministic.
+bool g_benchmarks = false;
+
 namespace Testing
 {		
     ULONG_PTR           gdiplusToken;
@@ -26,10 +33,15 @@ namespace Testing
 
         ::SetCurrentDirectory(L"..");
         ::GetCurrentDirectory(sizeof(g_dir) / sizeof(wchar_t), g_dir);
+
+        g_benchmarks = ::GetEnvironmentVariable(L"AQUARIUM_BENCHMARKS", nullptr, 0) > 0;
     }
 
     TEST_MODULE_CLEANUP(Cleanup)
     {
+        // The mip levels and atlas pages must be freed while GDI+ is still running
+        CMipCache::Get().Clear();
+        CSpriteAtlas::Get().Clear();
         Gdiplus::GdiplusShutdown(gdiplusToken);
     }
 